@@ -28,8 +28,7 @@ public:
  
   void counter() {
     DataFrame* v = kv.waitAndGet(main);
-    size_t sum = 0;
-    for (size_t i = 0; i < 100*1000; ++i) sum += v->get_double(0,i);
+    size_t sum = v->sum(0);
     p("The sum is  ").pln(sum);
     DataFrame::fromScalar(&verify, &kv, sum);
   }
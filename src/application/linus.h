@@ -76,6 +76,16 @@ public:
     return total;
   }
 
+  /** Smallest and largest idx in the set, false if the set is empty. */
+  bool bounds(size_t& lo, size_t& hi) {
+    lo = 0;
+    while (lo < size_ && !vals_[lo]) lo++;
+    if (lo == size_) return false;
+    hi = size_ - 1;
+    while (!vals_[hi]) hi--;
+    return true;
+  }
+
   /** Performs set union in place. */
   void union_(Set& from) {
     for (size_t i = 0; i < from.size_; i++) 
@@ -89,7 +99,7 @@ public:
 //  * A SetUpdater is a reader that gets the first column of the data frame and
 //  * sets the corresponding value in the given set.
 //  ******************************************************************************/
-class SetUpdater : public Rower {
+class SetUpdater : public BatchRower {
 public:
   Set& set_; // set to update
   
@@ -100,6 +110,11 @@ public:
    * The return value is irrelevant here. */
   bool accept(Row & r) { set_.set(r.get_int(0));  return false; }
 
+  void accept(Batch & b) override {
+    const int* ids = b.ints(0);
+    for (size_t k = 0; k < b.count(); k++) set_.set(ids[b.row(k)]);
+  }
+
 };
 
 // /*****************************************************************************
@@ -135,7 +150,7 @@ public:
 //  * of Linus, then the project is added to the set. If the project was
 //  * already tagged then it is not added to the set of newProjects.
 //  *************************************************************************/
-class ProjectsTagger : public Rower {
+class ProjectsTagger : public BatchRower {
 public:
   Set& uSet; // set of collaborator 
   Set& pSet; // set of projects of collaborators
@@ -148,14 +163,25 @@ public:
    * set keeps track of projects that were newly tagged (they will have to
    * be communicated to other nodes). */
   bool accept(Row & row) override {
-    int pid = row.get_int(0);
-    int uid = row.get_int(1);
+    tag(row.get_int(0), row.get_int(1));
+    return false;
+  }
+
+  void accept(Batch & b) override {
+    const int* pids = b.ints(0);
+    const int* uids = b.ints(1);
+    for (size_t k = 0; k < b.count(); k++) {
+      size_t i = b.row(k);
+      tag(pids[i], uids[i]);
+    }
+  }
+
+  void tag(int pid, int uid) {
     if (uSet.test(uid)) 
       if (!pSet.test(pid)) {
     	  pSet.set(pid);
         newProjects.set(pid);
       }
-    return false;
   }
 };
 
@@ -167,7 +193,7 @@ public:
 //  * where the pid is the idefntifier of a project and the uids are the
 //  * identifiers of the author and committer. 
 //  *************************************************************************/
-class UsersTagger : public Rower {
+class UsersTagger : public BatchRower {
 public:
   Set& pSet;
   Set& uSet;
@@ -177,14 +203,25 @@ public:
     pSet(pSet), uSet(uSet), newUsers(users->nrows()) { }
 
   bool accept(Row & row) override {
-    int pid = row.get_int(0);
-    int uid = row.get_int(1);
+    tag(row.get_int(0), row.get_int(1));
+    return false;
+  }
+
+  void accept(Batch & b) override {
+    const int* pids = b.ints(0);
+    const int* uids = b.ints(1);
+    for (size_t k = 0; k < b.count(); k++) {
+      size_t i = b.row(k);
+      tag(pids[i], uids[i]);
+    }
+  }
+
+  void tag(int pid, int uid) {
     if (pSet.test(pid)) 
       if(!uSet.test(uid)) {
         uSet.set(uid);
         newUsers.set(uid);
       }
-    return false;
   }
 };
 
@@ -232,19 +269,19 @@ public:
       SorAdapter* sor_projects = new SorAdapter(0, UINT32_MAX, strdup(PROJ));
       projects = sor_projects->df_; //DataFrame::fromFile(PROJ, pK.clone(), &kv);
       unsigned char* blob = projects->serialize();
-      kv.put(*dynamic_cast<Key*>(pK.clone()), new Value(blob, strlen((char*)blob)));
+      kv.put(*dynamic_cast<Key*>(pK.clone()), new Value(blob, extract_size_t(blob, 0)));
       p("    ").p(projects->nrows()).pln(" projects");
 
       SorAdapter* sor_users = new SorAdapter(0, UINT32_MAX, strdup(USER));
       users = sor_users->df_; //DataFrame::fromFile(USER, uK.clone(), &kv);
       blob = users->serialize();
-      kv.put(*dynamic_cast<Key*>(uK.clone()), new Value(blob, strlen((char*)blob)));
+      kv.put(*dynamic_cast<Key*>(uK.clone()), new Value(blob, extract_size_t(blob, 0)));
       p("    ").p(users->nrows()).pln(" users");
 
       SorAdapter* sor_commits = new SorAdapter(0, UINT32_MAX, strdup(COMM));
       commits = sor_commits->df_; //DataFrame::fromFile(COMM, cK.clone(), &kv);
       blob = commits->serialize();
-      kv.put(*dynamic_cast<Key*>(cK.clone()), new Value(blob, strlen((char*) blob)));
+      kv.put(*dynamic_cast<Key*>(cK.clone()), new Value(blob, extract_size_t(blob, 0)));
       p("    ").p(commits->nrows()).pln(" commits");
        // This dataframe contains the id of Linus.
        //delete
@@ -272,11 +309,14 @@ public:
     newUsers->map(upd); // all of the new users are copied to delta.
     delete newUsers;
     ProjectsTagger ptagger(delta, *pSet, projects);
-    commits->map(ptagger); //local_map(ptagger); // marking all projects touched by delta
+    size_t lo, hi;
+    // marking all projects touched by delta, only commits with an author
+    // uid within delta's bounds can match so other chunks are skipped
+    if (delta.bounds(lo, hi)) Plan(commits).where(1, lo, hi).map(ptagger);
     merge(ptagger.newProjects, "projects-", stage);
     pSet->union_(ptagger.newProjects); // 
     UsersTagger utagger(ptagger.newProjects, *uSet, users);
-    commits->map(utagger);
+    if (ptagger.newProjects.bounds(lo, hi)) Plan(commits).where(0, lo, hi).map(utagger);
     merge(utagger.newUsers, "users-", stage + 1);
     uSet->union_(utagger.newUsers);
     p("    after stage ").p(stage).pln(":");
@@ -307,7 +347,7 @@ public:
       Key k(StrBuff(name).c(stage).c("-0").get());
       DataFrame* df = set.to_df();
       unsigned char* serial = df->serialize();
-      kv.put(*dynamic_cast<Key*>(k.clone()), new Value(serial, strlen((char*)serial)));
+      kv.put(*dynamic_cast<Key*>(k.clone()), new Value(serial, extract_size_t(serial, 0)));
       //delete DataFrame::fromVisitor(&k, &kv, "I", &writer);
     } else {
       p("    sending ").p(set.size()).pln(" elements to master node");
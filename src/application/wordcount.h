@@ -2,6 +2,7 @@
 #include "../dataframe/sor.h"
 #include "../dataframe/visitor.h"
 #include "../dataframe/rower.h"
+#include "../dataframe/plan.h"
 #include <map>
 #include "assert.h"
 #include <cstring>
@@ -20,22 +21,18 @@ class FileReader {
 public:
     DataFrame* all_words;
     int counter = 0;
-    String* temp;
     int upper_bound;
 
+    /** Stores the words in chunks parts, each serialized straight from a
+     *  view of its rows of all_words */
     void chunk(size_t chunks, KVStore* store) {
       for (int i = 0; i < chunks; i++) {
-        Schema* schema = new Schema("S");
-        DataFrame* df = new DataFrame(*schema);
         upper_bound = all_words->nrows() * (i + 1) / chunks;
-        for (int j = counter; j < upper_bound; j++) {
-          temp = all_words->get_string(0, counter);
-          assert(temp != nullptr);
-          df->set(0, df->nrows(), temp);
-          counter++;
-        }
-        unsigned char* serial = df->serialize();
-        DataFrame* test = new DataFrame(serial);
+        std::vector<size_t> rows;
+        for (int j = counter; j < upper_bound; j++) rows.push_back(j);
+        counter = upper_bound;
+        DataFrameView part(all_words, rows);
+        unsigned char* serial = part.serialize();
         Value* v = new Value(serial, extract_size_t(serial, 0));
         store->put(*get_key(i, true), v);
       }
@@ -58,7 +55,7 @@ public:
 
   bool accept(Row& r) override {
     String* word = r.get_string(0);
-    int add_amt = r.get_int(1);
+    int add_amt = r.get_long(1);
     assert(word != nullptr);
     map_[std::string(word->c_str())] += add_amt;
     //std::cout << "map_[" << std::string(word->c_str()) << "] = " << map_[std::string(word->c_str())] << std::endl;
@@ -79,52 +76,6 @@ public:
   }
 };
  
-/****************************************************************************/
-class Adder : public Rower {
-public:
-  std::map<std::string, int> map_; // String to Num map;  Num holds an int
-  DataFrame* df;
-
-  Adder(std::map<std::string, int>& map) {
-    map_ = map;
-  }
- 
-  bool accept(Row& r) override {
-    String* word = r.get_string(0);
-    int add_amt = 1;
-    if (r.width() > 1) add_amt = r.get_int(1);
-    assert(word != nullptr);
-    map_[std::string(word->c_str())] += add_amt;
-    //std::cout << "map_[" << std::string(word->c_str()) << "] = " << map_[std::string(word->c_str())] << std::endl;
-    return false;
-  }
-
-  void build() {
-    Schema* schema = new Schema("SI");
-    df = new DataFrame(*schema);
-
-    	// Create a map iterator and point to beginning of map
-	  std::map<std::string, int>::iterator it = map_.begin();
- 
-    // Iterate over the map using c++11 range based for loop
-    int row = 0;
-    for (std::pair<std::string, int> element : map_) {
-      std::string word = element.first;
-      int count = element.second;
-      df->set(0, row, new String(word.c_str()));
-      df->set(1, row, count);
-      row++;
-    } 
-  }
-
-  void store(size_t index, KVStore* store) {
-    unsigned char* serial = df->serialize();
-    DataFrame* test = new DataFrame(serial);
-    Value* v = new Value(serial, extract_size_t(serial, 0));
-    store->put(*get_key(index, false), v);
-  }
-};
- 
 /****************************************************************************
  * Calculate a word count for given file:
  *   1) read the data (single node)
@@ -156,11 +107,13 @@ public:
   void local_count() {
     DataFrame* words = (kv.waitAndGet(*get_key(idx_, true)));
     p("Node ").p(idx_).pln(": starting local count...");
-    map<std::string, int> map;
-    Adder add(map);
-    words->map(add);
-    add.build();
-    add.store(idx_, &kv);
+    //one row per distinct word with its count, counted in parallel
+    Plan plan(words);
+    DataFrame* counts = plan.aggregate(std::vector<size_t>(1, 0), std::vector<GroupAgg>(1, GroupAgg(AGG_COUNT, 0))).execute();
+    unsigned char* serial = counts->serialize();
+    Value* v = new Value(serial, extract_size_t(serial, 0));
+    kv.put(*get_key(idx_, false), v);
+    delete counts;
     delete words;
   }
  
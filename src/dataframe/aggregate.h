@@ -0,0 +1,444 @@
+//lang: CwC
+#pragma once
+
+#include <cmath>
+#include "column.h"
+#include "../threadpool.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+/** Chunks of a column aggregated by one task of a parallel aggregate */
+#define AGGREGATE_CHUNKS 16
+
+/*************************************************************************
+ * Span kernels::
+ * Aggregates over contiguous arrays of doubles, the chunks of a column.
+ * Each has an AVX2 loop, picked at run time when the processor has it, an
+ * SSE2 loop for other x86 processors and a scalar loop elsewhere. Loops
+ * keep several accumulators so additions do not wait on each other.
+ * Vector loops add in a different order than a scalar loop would, so sums
+ * of values that are not exactly representable may differ in the last
+ * bits. Kernels that take a minimum or maximum need n > 0.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+
+/** Does the processor running us have AVX2? Checked once. */
+inline bool has_avx2() {
+#ifdef SIMD_X86
+  static bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+#else
+  return false;
+#endif
+}
+
+#ifdef SIMD_X86
+TARGET_AVX2 inline double hsum_avx2(__m256d v) {
+  double lanes[4];
+  _mm256_storeu_pd(lanes, v);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+inline double hsum_sse2(__m128d v) {
+  double lanes[2];
+  _mm_storeu_pd(lanes, v);
+  return lanes[0] + lanes[1];
+}
+
+TARGET_AVX2 inline double span_sum_avx2(const double* x, size_t n) {
+  __m256d a = _mm256_setzero_pd();
+  __m256d b = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    a = _mm256_add_pd(a, _mm256_loadu_pd(x + i));
+    b = _mm256_add_pd(b, _mm256_loadu_pd(x + i + 4));
+  }
+  double s = hsum_avx2(_mm256_add_pd(a, b));
+  for (; i < n; i++) s += x[i];
+  return s;
+}
+
+inline double span_sum_sse2(const double* x, size_t n) {
+  __m128d a = _mm_setzero_pd();
+  __m128d b = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    a = _mm_add_pd(a, _mm_loadu_pd(x + i));
+    b = _mm_add_pd(b, _mm_loadu_pd(x + i + 2));
+  }
+  double s = hsum_sse2(_mm_add_pd(a, b));
+  for (; i < n; i++) s += x[i];
+  return s;
+}
+
+TARGET_AVX2 inline double span_dot_avx2(const double* x, const double* y, size_t n) {
+  __m256d a = _mm256_setzero_pd();
+  __m256d b = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    a = _mm256_add_pd(a, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    b = _mm256_add_pd(b, _mm256_mul_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4)));
+  }
+  double s = hsum_avx2(_mm256_add_pd(a, b));
+  for (; i < n; i++) s += x[i] * y[i];
+  return s;
+}
+
+inline double span_dot_sse2(const double* x, const double* y, size_t n) {
+  __m128d a = _mm_setzero_pd();
+  __m128d b = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    a = _mm_add_pd(a, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+    b = _mm_add_pd(b, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+  }
+  double s = hsum_sse2(_mm_add_pd(a, b));
+  for (; i < n; i++) s += x[i] * y[i];
+  return s;
+}
+
+/** Sum of (x[i] - mean)^2 */
+TARGET_AVX2 inline double span_sq_dev_avx2(const double* x, size_t n, double mean) {
+  __m256d m = _mm256_set1_pd(mean);
+  __m256d a = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d d = _mm256_sub_pd(_mm256_loadu_pd(x + i), m);
+    a = _mm256_add_pd(a, _mm256_mul_pd(d, d));
+  }
+  double s = hsum_avx2(a);
+  for (; i < n; i++) s += (x[i] - mean) * (x[i] - mean);
+  return s;
+}
+
+inline double span_sq_dev_sse2(const double* x, size_t n, double mean) {
+  __m128d m = _mm_set1_pd(mean);
+  __m128d a = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d d = _mm_sub_pd(_mm_loadu_pd(x + i), m);
+    a = _mm_add_pd(a, _mm_mul_pd(d, d));
+  }
+  double s = hsum_sse2(a);
+  for (; i < n; i++) s += (x[i] - mean) * (x[i] - mean);
+  return s;
+}
+
+/** Smallest and largest of x */
+TARGET_AVX2 inline void span_range_avx2(const double* x, size_t n, double& lo, double& hi) {
+  __m256d mn = _mm256_set1_pd(x[0]);
+  __m256d mx = mn;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d v = _mm256_loadu_pd(x + i);
+    mn = _mm256_min_pd(mn, v);
+    mx = _mm256_max_pd(mx, v);
+  }
+  double lows[4], highs[4];
+  _mm256_storeu_pd(lows, mn);
+  _mm256_storeu_pd(highs, mx);
+  lo = lows[0];
+  hi = highs[0];
+  for (size_t j = 1; j < 4; j++) {
+    if (lows[j] < lo) lo = lows[j];
+    if (highs[j] > hi) hi = highs[j];
+  }
+  for (; i < n; i++) {
+    if (x[i] < lo) lo = x[i];
+    if (x[i] > hi) hi = x[i];
+  }
+}
+
+inline void span_range_sse2(const double* x, size_t n, double& lo, double& hi) {
+  __m128d mn = _mm_set1_pd(x[0]);
+  __m128d mx = mn;
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d v = _mm_loadu_pd(x + i);
+    mn = _mm_min_pd(mn, v);
+    mx = _mm_max_pd(mx, v);
+  }
+  double lows[2], highs[2];
+  _mm_storeu_pd(lows, mn);
+  _mm_storeu_pd(highs, mx);
+  lo = lows[0] < lows[1] ? lows[0] : lows[1];
+  hi = highs[0] > highs[1] ? highs[0] : highs[1];
+  for (; i < n; i++) {
+    if (x[i] < lo) lo = x[i];
+    if (x[i] > hi) hi = x[i];
+  }
+}
+
+/** Converts n ints to doubles */
+TARGET_AVX2 inline void span_widen_avx2(const int* x, double* out, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(x + i));
+    _mm256_storeu_pd(out + i, _mm256_cvtepi32_pd(v));
+  }
+  for (; i < n; i++) out[i] = x[i];
+}
+
+inline void span_widen_sse2(const int* x, double* out, size_t n) {
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i v = _mm_loadl_epi64((const __m128i*)(x + i));
+    _mm_storeu_pd(out + i, _mm_cvtepi32_pd(v));
+  }
+  for (; i < n; i++) out[i] = x[i];
+}
+#endif
+
+inline double span_sum(const double* x, size_t n) {
+#ifdef SIMD_X86
+  return has_avx2() ? span_sum_avx2(x, n) : span_sum_sse2(x, n);
+#else
+  double s = 0;
+  for (size_t i = 0; i < n; i++) s += x[i];
+  return s;
+#endif
+}
+
+inline double span_dot(const double* x, const double* y, size_t n) {
+#ifdef SIMD_X86
+  return has_avx2() ? span_dot_avx2(x, y, n) : span_dot_sse2(x, y, n);
+#else
+  double s = 0;
+  for (size_t i = 0; i < n; i++) s += x[i] * y[i];
+  return s;
+#endif
+}
+
+inline double span_sq_dev(const double* x, size_t n, double mean) {
+#ifdef SIMD_X86
+  return has_avx2() ? span_sq_dev_avx2(x, n, mean) : span_sq_dev_sse2(x, n, mean);
+#else
+  double s = 0;
+  for (size_t i = 0; i < n; i++) s += (x[i] - mean) * (x[i] - mean);
+  return s;
+#endif
+}
+
+inline void span_range(const double* x, size_t n, double& lo, double& hi) {
+#ifdef SIMD_X86
+  if (has_avx2()) span_range_avx2(x, n, lo, hi);
+  else span_range_sse2(x, n, lo, hi);
+#else
+  lo = hi = x[0];
+  for (size_t i = 1; i < n; i++) {
+    if (x[i] < lo) lo = x[i];
+    if (x[i] > hi) hi = x[i];
+  }
+#endif
+}
+
+inline void span_widen(const int* x, double* out, size_t n) {
+#ifdef SIMD_X86
+  if (has_avx2()) span_widen_avx2(x, out, n);
+  else span_widen_sse2(x, out, n);
+#else
+  for (size_t i = 0; i < n; i++) out[i] = x[i];
+#endif
+}
+
+/*************************************************************************
+ * Moments::
+ * Aggregate of the present values of part of a column: how many there
+ * are, their sum, bounds and the sum of squared deviations from their
+ * mean. Partials of disjoint parts merge into the aggregate of the whole.
+ */
+class Moments {
+  public:
+    size_t n_;
+    double sum_;
+    double lo_;
+    double hi_;
+    double m2_;
+
+    Moments() {
+      n_ = 0;
+      sum_ = 0;
+      lo_ = 0;
+      hi_ = 0;
+      m2_ = 0;
+    }
+
+    double mean() {
+      return n_ == 0 ? 0 : sum_ / n_;
+    }
+
+    /** Adds the aggregate of other, using the pairwise update of m2 */
+    void merge(Moments& other) {
+      if (other.n_ == 0) return;
+      if (n_ == 0) {
+        *this = other;
+        return;
+      }
+      double delta = other.mean() - mean();
+      size_t n = n_ + other.n_;
+      m2_ += other.m2_ + delta * delta * ((double)n_ * other.n_ / n);
+      if (other.lo_ < lo_) lo_ = other.lo_;
+      if (other.hi_ > hi_) hi_ = other.hi_;
+      sum_ += other.sum_;
+      n_ = n;
+    }
+};
+
+/** What a pass over a column has to compute beyond count and sum */
+enum MomentKind { MOMENT_SUM, MOMENT_RANGE, MOMENT_SPREAD };
+
+/** The values of chunk c of a numeric column as doubles, read in place for
+ *  double columns and converted into scratch otherwise. Missing values
+ *  read as 0. */
+inline const double* chunk_doubles(Column* column, size_t c, double* scratch) {
+  size_t len = column->chunk_length(c);
+  switch (column->get_type()) {
+    case 'D':
+      return column->as_double()->chunk(c);
+    case 'I': {
+      int* ints = reinterpret_cast<int*>(scratch + CHUNK_SIZE);
+      span_widen(column->as_int()->read_chunk(c, ints), scratch, len);
+      return scratch;
+    }
+    case 'Y': {
+      int8_t* vals = column->as_byte()->chunk(c);
+      for (size_t i = 0; i < len; i++) scratch[i] = vals[i];
+      return scratch;
+    }
+    case 'H': {
+      int16_t* vals = column->as_short()->chunk(c);
+      for (size_t i = 0; i < len; i++) scratch[i] = vals[i];
+      return scratch;
+    }
+    case 'L': {
+      int64_t* vals = column->as_long()->chunk(c);
+      for (size_t i = 0; i < len; i++) scratch[i] = vals[i];
+      return scratch;
+    }
+    case 'F': {
+      float* vals = column->as_float()->chunk(c);
+      for (size_t i = 0; i < len; i++) scratch[i] = vals[i];
+      return scratch;
+    }
+    default:
+      assert("Column is not numeric." && false);
+  }
+  return nullptr;
+}
+
+/** Doubles of scratch chunk_doubles needs: a chunk of doubles followed by
+ *  a chunk of ints */
+#define CHUNK_SCRATCH (CHUNK_SIZE + CHUNK_SIZE / 2)
+
+/** Aggregate of the present values of chunk c of a numeric or bool column */
+inline Moments chunk_moments(Column* column, size_t c, MomentKind kind, double* scratch) {
+  Moments m;
+  size_t len = column->chunk_length(c);
+  size_t start = c << CHUNK_SHIFT;
+  m.n_ = len - column->chunk_null_count(c);
+  if (m.n_ == 0) return m;
+  BoolColumn* bools = column->as_bool();
+  if (bools != nullptr) {
+    //missing bools are stored false, so the true ones are the popcount
+    uint64_t* words = bools->chunk_words(c);
+    size_t trues = 0;
+    for (size_t w = 0; w < (len + 63) / 64; w++) {
+      uint64_t word = words[w];
+      if (w == len / 64) word &= ((uint64_t)1 << (len & 63)) - 1;
+      trues += __builtin_popcountll(word);
+    }
+    m.sum_ = trues;
+    m.lo_ = trues == m.n_ ? 1 : 0;
+    m.hi_ = trues > 0 ? 1 : 0;
+    m.m2_ = (double)trues * (m.n_ - trues) / m.n_;
+    return m;
+  }
+  const double* x = chunk_doubles(column, c, scratch);
+  if (m.n_ == len) {
+    m.sum_ = span_sum(x, len);
+    if (kind == MOMENT_RANGE) span_range(x, len, m.lo_, m.hi_);
+    if (kind == MOMENT_SPREAD) m.m2_ = span_sq_dev(x, len, m.mean());
+    return m;
+  }
+  //chunks with missing values only look at the present ones
+  bool first = true;
+  column->for_each_valid(start, start + len, [&](size_t i) {
+    double v = x[i - start];
+    m.sum_ += v;
+    if (first || v < m.lo_) m.lo_ = v;
+    if (first || v > m.hi_) m.hi_ = v;
+    first = false;
+  });
+  if (kind == MOMENT_SPREAD) {
+    double mean = m.mean();
+    column->for_each_valid(start, start + len, [&](size_t i) {
+      double d = x[i - start] - mean;
+      m.m2_ += d * d;
+    });
+  }
+  return m;
+}
+
+/** Calls f(c, scratch) for every chunk c below chunks, AGGREGATE_CHUNKS
+ *  chunks per task on the shared pool when there are more than that. Each
+ *  task has its own scratch, room for two columns' chunk_doubles. */
+template <typename Fn>
+void for_each_chunk(size_t chunks, Fn f) {
+  size_t tasks = (chunks + AGGREGATE_CHUNKS - 1) / AGGREGATE_CHUNKS;
+  auto run = [&](size_t t) {
+    double* scratch = new double[2 * CHUNK_SCRATCH];
+    size_t end = std::min((t + 1) * AGGREGATE_CHUNKS, chunks);
+    for (size_t c = t * AGGREGATE_CHUNKS; c < end; c++) f(c, scratch);
+    delete[] scratch;
+  };
+  if (tasks <= 1) {
+    for (size_t t = 0; t < tasks; t++) run(t);
+  } else {
+    ThreadPool::shared().parallel_for(tasks, run);
+  }
+}
+
+/** Aggregate of the present values of a numeric or bool column. Chunks
+ *  are aggregated in parallel and merged in order, so the result does not
+ *  depend on the number of threads. */
+inline Moments column_moments(Column* column, MomentKind kind) {
+  if (column->as_string() != nullptr) {
+    assert("Cannot aggregate a string column." && false);
+  }
+  size_t chunks = column->chunk_count();
+  std::vector<Moments> parts(chunks);
+  for_each_chunk(chunks, [&](size_t c, double* scratch) {
+    parts[c] = chunk_moments(column, c, kind, scratch);
+  });
+  Moments all;
+  for (size_t c = 0; c < chunks; c++) all.merge(parts[c]);
+  return all;
+}
+
+/** Sum over rows of a[i] * b[i], two numeric columns of the same length.
+ *  Missing values count as 0. */
+inline double column_dot(Column* a, Column* b) {
+  if (!is_numeric_type(a->get_type()) || !is_numeric_type(b->get_type())) {
+    assert("Dot product needs numeric columns." && false);
+  }
+  if (a->size() != b->size()) {
+    assert("Dot product needs columns of the same length." && false);
+  }
+  size_t chunks = a->chunk_count();
+  std::vector<double> parts(chunks);
+  for_each_chunk(chunks, [&](size_t c, double* scratch) {
+    const double* x = chunk_doubles(a, c, scratch);
+    const double* y = chunk_doubles(b, c, scratch + CHUNK_SCRATCH);
+    parts[c] = span_dot(x, y, a->chunk_length(c));
+  });
+  double total = 0;
+  for (size_t c = 0; c < chunks; c++) total += parts[c];
+  return total;
+}
@@ -0,0 +1,190 @@
+//lang: CwC
+#pragma once
+
+#include <mutex>
+#include "column.h"
+
+#define ARENA_SLAB_SHIFT 20
+#define ARENA_SLAB_SIZE ((size_t)1 << ARENA_SLAB_SHIFT)
+#define ARENA_SLAB_MASK (ARENA_SLAB_SIZE - 1)
+/** Offset recorded for a nullptr value */
+#define ARENA_NULL ((size_t)-1)
+
+/*************************************************************************
+ * StringArena::
+ * Append-only storage for string bytes in ARENA_SLAB_SIZE slabs. A string
+ * is addressed by its offset, (slab << ARENA_SLAB_SHIFT) | position, and
+ * never spans two slabs. Each string is stored with a trailing '\0'.
+ * Strings too long for a slab get a slab of their own at position 0.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+class StringArena {
+  public:
+    char** slabs_;   // owned; slab directory
+    size_t n_slabs_; // number of allocated slabs
+    size_t cap_;     // capacity of the slab directory
+    size_t used_;    // bytes used in the last slab
+
+    StringArena() {
+      n_slabs_ = 0;
+      cap_ = 4;
+      used_ = ARENA_SLAB_SIZE;
+      slabs_ = new char*[cap_];
+    }
+
+    ~StringArena() {
+      for (size_t i = 0; i < n_slabs_; i++) {
+        delete[] slabs_[i];
+      }
+      delete[] slabs_;
+    }
+
+    /** Copies len bytes of s into the arena and returns their offset */
+    size_t append(const char* s, size_t len) {
+      size_t offset = allocate(len + 1);
+      char* dest = const_cast<char*>(at(offset));
+      memcpy(dest, s, len);
+      dest[len] = '\0';
+      return offset;
+    }
+
+    /** Copies len bytes of strings already '\0' terminated into the arena
+     *  in one piece and returns the offset of the first. The strings are
+     *  at that offset plus their position in s. */
+    size_t append_terminated(const char* s, size_t len) {
+      size_t offset = allocate(len);
+      memcpy(const_cast<char*>(at(offset)), s, len);
+      return offset;
+    }
+
+    /** Offset of n free bytes within one slab */
+    size_t allocate(size_t n) {
+      bool oversized = n > ARENA_SLAB_SIZE;
+      if (oversized || n > ARENA_SLAB_SIZE - used_) {
+        addSlab(oversized ? n : ARENA_SLAB_SIZE);
+      }
+      size_t offset = ((n_slabs_ - 1) << ARENA_SLAB_SHIFT) | used_;
+      //an oversized slab is full as soon as its bytes are in
+      used_ = oversized ? ARENA_SLAB_SIZE : used_ + n;
+      return offset;
+    }
+
+    /** Bytes of the string stored at offset */
+    const char* at(size_t offset) {
+      return slabs_[offset >> ARENA_SLAB_SHIFT] + (offset & ARENA_SLAB_MASK);
+    }
+
+    /** Appends a slab of size bytes and starts filling it */
+    void addSlab(size_t size) {
+      if (n_slabs_ == cap_) {
+        char** slabs = new char*[cap_ * 2];
+        for (size_t i = 0; i < n_slabs_; i++) slabs[i] = slabs_[i];
+        delete[] slabs_;
+        slabs_ = slabs;
+        cap_ *= 2;
+      }
+      slabs_[n_slabs_++] = new char[size];
+      used_ = 0;
+    }
+};
+
+/*************************************************************************
+ * ArenaStringColumn::
+ * A string column whose bytes live in a StringArena, one offset and length
+ * per value. get_view reads the arena directly. get is kept for callers
+ * that need a String*: it builds the String on first use and caches it,
+ * the cached Strings are owned by the column.
+ */
+class ArenaStringColumn : public StringColumn {
+  public:
+    StringArena arena_;
+    ChunkedArray<size_t> offsets_;
+    ChunkedArray<size_t> lengths_;
+    ChunkedArray<String*> cache_; // owned strings, filled in by get
+    std::mutex cache_lock_;
+
+    ArenaStringColumn() { }
+
+    ~ArenaStringColumn() {
+      for (size_t i = 0; i < cache_.size(); i++) {
+        delete cache_.get(i);
+      }
+    }
+
+    StringView get_view(size_t idx) {
+      size_t offset = offsets_.get(idx);
+      if (offset == ARENA_NULL || is_missing(idx)) return StringView();
+      return StringView(arena_.at(offset), lengths_.get(idx));
+    }
+
+    String* get(size_t idx) {
+      std::lock_guard<std::mutex> guard(cache_lock_);
+      if (idx < cache_.size() && cache_.get(idx) != nullptr) return cache_.get(idx);
+      String* res = get_view(idx).to_string();
+      cache_.set(idx, res);
+      return res;
+    }
+
+    /** Set value at idx. The bytes of val are copied into the arena. */
+    void set(size_t idx, String* val) {
+      if (val == nullptr) {
+        note_set(idx);
+        store(idx, ARENA_NULL, 0);
+      } else {
+        set_chars(idx, val->c_str(), val->size());
+      }
+    }
+
+    void set_chars(size_t idx, const char* s, size_t len) {
+      note_set(idx);
+      store(idx, arena_.append(s, len), len);
+    }
+
+    /** Records the location of the value at idx and drops its cached String */
+    void store(size_t idx, size_t offset, size_t len) {
+      offsets_.set(idx, offset);
+      lengths_.set(idx, len);
+      if (idx < cache_.size() && cache_.get(idx) != nullptr) {
+        delete cache_.get(idx);
+        cache_.set(idx, nullptr);
+      }
+    }
+
+    /** Appends count strings stored back to back in blob, string k from
+     *  offsets[k] up to offsets[k + 1], the last byte being its '\0'. As
+     *  many strings as fit in a slab are copied at once. */
+    void append_table(const char* blob, const size_t* offsets, size_t count) {
+      size_t row = size();
+      size_t k = 0;
+      while (k < count) {
+        size_t end = k + 1;
+        while (end < count && offsets[end + 1] - offsets[k] <= ARENA_SLAB_SIZE) end++;
+        size_t first = offsets[k];
+        size_t base = arena_.append_terminated(blob + first, offsets[end] - first);
+        for (; k < end; k++) {
+          note_set(row);
+          store(row++, base + offsets[k] - first, offsets[k + 1] - offsets[k] - 1);
+        }
+      }
+    }
+
+    size_t size() {
+      return offsets_.size();
+    }
+
+    ArenaStringColumn* clone() {
+      ArenaStringColumn* newColumn = new ArenaStringColumn();
+      for (size_t i = 0; i < size(); i++) {
+        StringView val = get_view(i);
+        if (val.is_null()) {
+          newColumn->set(i, nullptr);
+        } else {
+          newColumn->set_chars(i, val.c_str(), val.size());
+        }
+      }
+      newColumn->copy_validity(this);
+      return newColumn;
+    }
+};
@@ -0,0 +1,234 @@
+//lang: CwC
+#pragma once
+
+#include "column.h"
+
+/*************************************************************************
+ * Batch::
+ * A run of consecutive rows of a dataframe that all lie in one chunk,
+ * handed to a BatchRower at once. Columns are read as typed spans indexed
+ * from the first row of the batch, so a rower loops over plain arrays
+ * instead of being shown a Row per row. Narrow or encoded columns are
+ * decoded into scratch buffers owned by the batch and reused as it moves,
+ * so a traversal only allocates when it starts. Spans stay valid until
+ * the batch moves. A batch may carry a selection, the positions of the
+ * only rows to visit; rowers loop over row(k) for k below count().
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+class Batch : public Object {
+  public:
+    Column** columns_;      // external
+    size_t width_;
+    size_t start_;          // row of the dataframe the batch starts at
+    size_t length_;         // number of rows
+    size_t chunk_;          // chunk holding the rows
+    int** int_scratch_;     // owned; per column, allocated on first use
+    double** dbl_scratch_;  // owned; per column, allocated on first use
+    const int** ints_;      // owned; spans read from the current rows
+    const double** doubles_;
+    bool* keep_;            // owned; rows a filter keeps
+    size_t* sel_;           // owned; positions of the selected rows
+    size_t n_sel_;
+    bool selecting_;        // are only the selected rows visited?
+
+    Batch(Column** columns, size_t width) {
+      columns_ = columns;
+      width_ = width;
+      start_ = 0;
+      length_ = 0;
+      chunk_ = 0;
+      int_scratch_ = new int*[width_]();
+      dbl_scratch_ = new double*[width_]();
+      ints_ = new const int*[width_]();
+      doubles_ = new const double*[width_]();
+      keep_ = new bool[CHUNK_SIZE]();
+      sel_ = new size_t[CHUNK_SIZE];
+      n_sel_ = 0;
+      selecting_ = false;
+    }
+
+    ~Batch() {
+      for (size_t i = 0; i < width_; i++) {
+        delete[] int_scratch_[i];
+        delete[] dbl_scratch_[i];
+      }
+      delete[] int_scratch_;
+      delete[] dbl_scratch_;
+      delete[] ints_;
+      delete[] doubles_;
+      delete[] keep_;
+      delete[] sel_;
+    }
+
+    /** Moves the batch to the length rows from start, which must not cross
+     *  a chunk boundary. Clears the kept rows and the selection. */
+    void move(size_t start, size_t length) {
+      start_ = start;
+      length_ = length;
+      chunk_ = start >> CHUNK_SHIFT;
+      for (size_t i = 0; i < width_; i++) {
+        ints_[i] = nullptr;
+        doubles_[i] = nullptr;
+      }
+      for (size_t i = 0; i < length; i++) keep_[i] = false;
+      selecting_ = false;
+    }
+
+    /** Number of rows to visit, the selected ones if there is a selection */
+    size_t count() {
+      return selecting_ ? n_sel_ : length_;
+    }
+
+    /** Position in the batch of the k-th row to visit */
+    size_t row(size_t k) {
+      return selecting_ ? sel_[k] : k;
+    }
+
+    /** Starts a selection holding no rows */
+    void select_none() {
+      selecting_ = true;
+      n_sel_ = 0;
+    }
+
+    /** Adds the row at position i to the selection, in increasing order */
+    void select(size_t i) {
+      sel_[n_sel_++] = i;
+    }
+
+    /** Keeps in the selection only the rows to visit at whose position i
+     *  keep(i) is true, in order */
+    template <typename Fn>
+    void retain(Fn keep) {
+      size_t kept = 0;
+      for (size_t k = 0; k < count(); k++) {
+        size_t i = row(k);
+        if (keep(i)) sel_[kept++] = i;
+      }
+      selecting_ = true;
+      n_sel_ = kept;
+    }
+
+    /** Row of the dataframe the batch starts at */
+    size_t start() {
+      return start_;
+    }
+
+    /** Number of rows in the batch */
+    size_t size() {
+      return length_;
+    }
+
+    size_t width() {
+      return width_;
+    }
+
+    char col_type(size_t col) {
+      return columns_[col]->get_type();
+    }
+
+    /** Position of the first row inside its chunk */
+    size_t offset() {
+      return start_ - (chunk_ << CHUNK_SHIFT);
+    }
+
+    /** Values of an integer column of at most 32 bits. Missing values
+     *  read as 0. */
+    const int* ints(size_t col) {
+      if (ints_[col] != nullptr) return ints_[col];
+      Column* column = columns_[col];
+      if (int_scratch_[col] == nullptr) int_scratch_[col] = new int[CHUNK_SIZE];
+      int* scratch = int_scratch_[col];
+      switch (column->get_type()) {
+        case 'I':
+          ints_[col] = column->as_int()->read_chunk(chunk_, scratch) + offset();
+          break;
+        case 'H':
+          widen(column->as_short()->chunk(chunk_) + offset(), scratch);
+          ints_[col] = scratch;
+          break;
+        case 'Y':
+          widen(column->as_byte()->chunk(chunk_) + offset(), scratch);
+          ints_[col] = scratch;
+          break;
+        default:
+          assert("Batch column is not an int column." && false);
+      }
+      return ints_[col];
+    }
+
+    /** Values of any numeric column, widened to doubles. Missing values
+     *  read as 0. */
+    const double* doubles(size_t col) {
+      if (doubles_[col] != nullptr) return doubles_[col];
+      Column* column = columns_[col];
+      if (column->get_type() == 'D') {
+        doubles_[col] = column->as_double()->chunk(chunk_) + offset();
+        return doubles_[col];
+      }
+      if (dbl_scratch_[col] == nullptr) dbl_scratch_[col] = new double[CHUNK_SIZE];
+      double* scratch = dbl_scratch_[col];
+      switch (column->get_type()) {
+        case 'F':
+          widen(column->as_float()->chunk(chunk_) + offset(), scratch);
+          break;
+        case 'L':
+          widen(column->as_long()->chunk(chunk_) + offset(), scratch);
+          break;
+        case 'Y':
+        case 'H':
+        case 'I':
+          widen(ints(col), scratch);
+          break;
+        default:
+          assert("Batch column is not a numeric column." && false);
+      }
+      doubles_[col] = scratch;
+      return scratch;
+    }
+
+    /** Values of an int64 column */
+    const int64_t* longs(size_t col) {
+      return columns_[col]->as_long()->chunk(chunk_) + offset();
+    }
+
+    /** Values of a float32 column */
+    const float* floats(size_t col) {
+      return columns_[col]->as_float()->chunk(chunk_) + offset();
+    }
+
+    /** Copies the batch's values from src into dst, converting each */
+    template <class From, class To>
+    void widen(const From* src, To* dst) {
+      for (size_t i = 0; i < length_; i++) dst[i] = src[i];
+    }
+
+    bool get_bool(size_t col, size_t i) {
+      return columns_[col]->as_bool()->get(start_ + i);
+    }
+
+    /** The i-th string of the batch in column col, read in place */
+    StringView get_view(size_t col, size_t i) {
+      return columns_[col]->as_string()->get_view(start_ + i);
+    }
+
+    bool is_missing(size_t col, size_t i) {
+      return columns_[col]->is_missing(start_ + i);
+    }
+
+    /** Does column col have a missing value anywhere in the batch's chunk?
+     *  When it does not, spans can be read without checking is_missing. */
+    bool has_missing(size_t col) {
+      return columns_[col]->chunk_null_count(chunk_) > 0;
+    }
+
+    /** Marks the i-th row as kept by a filter */
+    void keep(size_t i) {
+      keep_[i] = true;
+    }
+
+    bool kept(size_t i) {
+      return keep_[i];
+    }
+};
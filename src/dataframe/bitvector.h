@@ -0,0 +1,174 @@
+//lang: CwC
+#pragma once
+
+#include <cstdint>
+#include "../object.h"
+#include "../serial/serial.h"
+
+/*************************************************************************
+ * BitVector::
+ * A growable sequence of bits packed 64 to a 64-bit word. Bit idx lives in
+ * word (idx >> 6) at position (idx & 63). Bits past the length are always
+ * zero so whole words can be counted and combined without masking.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+class BitVector : public Object, public Serializable {
+  public:
+    uint64_t* words_; // owned
+    size_t n_words_;  // capacity in words
+    size_t len_;      // number of bits
+
+    BitVector() {
+      len_ = 0;
+      n_words_ = 1;
+      words_ = new uint64_t[n_words_]();
+    }
+
+    BitVector(BitVector& from) {
+      len_ = from.len_;
+      n_words_ = from.word_count() == 0 ? 1 : from.word_count();
+      words_ = new uint64_t[n_words_]();
+      memcpy(words_, from.words_, from.word_count() * sizeof(uint64_t));
+    }
+
+    ~BitVector() {
+      delete[] words_;
+    }
+
+    /** Number of bits */
+    size_t size() {
+      return len_;
+    }
+
+    /** Number of words holding at least one bit */
+    size_t word_count() {
+      return (len_ + 63) >> 6;
+    }
+
+    bool get(size_t idx) {
+      return (words_[idx >> 6] >> (idx & 63)) & 1;
+    }
+
+    /** Sets the bit at idx, growing if needed. Skipped bits are zero. */
+    void set(size_t idx, bool val) {
+      ensure(idx);
+      uint64_t mask = (uint64_t)1 << (idx & 63);
+      if (val) {
+        words_[idx >> 6] |= mask;
+      } else {
+        words_[idx >> 6] &= ~mask;
+      }
+      if (idx >= len_) len_ = idx + 1;
+    }
+
+    void push_back(bool val) {
+      set(len_, val);
+    }
+
+    /** Number of set bits, one popcount per word */
+    size_t count_true() {
+      size_t total = 0;
+      size_t n = word_count();
+      for (size_t i = 0; i < n; i++) {
+        total += __builtin_popcountll(words_[i]);
+      }
+      return total;
+    }
+
+    /** Ensures the word holding idx is allocated */
+    void ensure(size_t idx) {
+      size_t w = idx >> 6;
+      if (w < n_words_) return;
+      size_t cap = n_words_ * 2;
+      while (cap <= w) cap *= 2;
+      uint64_t* words = new uint64_t[cap]();
+      memcpy(words, words_, n_words_ * sizeof(uint64_t));
+      delete[] words_;
+      words_ = words;
+      n_words_ = cap;
+    }
+
+    /** Resizes to len bits. New bits are zero. */
+    void resize(size_t len) {
+      if (len > 0) ensure(len - 1);
+      if (len < len_) {
+        for (size_t w = (len + 63) >> 6; w < word_count(); w++) words_[w] = 0;
+      }
+      len_ = len;
+      clear_tail();
+    }
+
+    /** Resizes to len bits, all of them set to val */
+    void fill(size_t len, bool val) {
+      resize(0);
+      resize(len);
+      if (val) {
+        memset(words_, 0xff, word_count() * sizeof(uint64_t));
+        clear_tail();
+      }
+    }
+
+    /** Zeroes the unused bits of the last word */
+    void clear_tail() {
+      if ((len_ & 63) != 0) {
+        words_[len_ >> 6] &= ((uint64_t)1 << (len_ & 63)) - 1;
+      }
+    }
+
+    /** Word-wise AND with other, both must be of the same length */
+    void and_(BitVector& other) {
+      assert(len_ == other.len_);
+      for (size_t i = 0; i < word_count(); i++) words_[i] &= other.words_[i];
+    }
+
+    /** Word-wise OR with other, both must be of the same length */
+    void or_(BitVector& other) {
+      assert(len_ == other.len_);
+      for (size_t i = 0; i < word_count(); i++) words_[i] |= other.words_[i];
+    }
+
+    /** Flips every bit in place */
+    void not_() {
+      for (size_t i = 0; i < word_count(); i++) words_[i] = ~words_[i];
+      clear_tail();
+    }
+
+    bool equals(Object* other) {
+      if (other == this) return true;
+      BitVector* x = dynamic_cast<BitVector*>(other);
+      if (x == nullptr) return false;
+      if (len_ != x->len_) return false;
+      return memcmp(words_, x->words_, word_count() * sizeof(uint64_t)) == 0;
+    }
+
+    /** Serializes the bits as a raw bitmap. Structure is as following
+     *
+     * |--8 bytes-------------|--8 bytes--|--8 bytes each------|
+     * |--length in bytes-----|--len_-----|--word 1, word 2...--|
+     */
+    size_t serial_size() {
+      return 16 + 8 * word_count();
+    }
+
+    void write_to(BufferWriter& writer) {
+      writer.write_size_t(serial_size());
+      writer.write_size_t(len_);
+      writer.write_bytes(words_, 8 * word_count());
+    }
+
+    /** Reads the bits at the reader's cursor, mutating this BitVector */
+    void read_from(BufferReader& reader) {
+      size_t length = reader.read_size_t();
+      size_t len = reader.read_size_t();
+      //the words must be in the buffer before any is allocated
+      if (len / 64 > (reader.end_ - reader.pos_) / 8 || length != 16 + 8 * ((len + 63) >> 6)) {
+        assert("Malformed bit vector." && false);
+      }
+      resize(0);
+      resize(len);
+      reader.read_bytes(words_, 8 * word_count());
+      clear_tail();
+    }
+};
@@ -0,0 +1,188 @@
+//lang: CwC
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include "assert.h"
+
+#define CHUNK_SHIFT 12
+#define CHUNK_SIZE ((size_t)1 << CHUNK_SHIFT)
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+
+/*************************************************************************
+ * ChunkedArray::
+ * A growable array of T stored as fixed size chunks of CHUNK_SIZE
+ * elements. Element idx lives in chunk (idx >> CHUNK_SHIFT) at offset
+ * (idx & CHUNK_MASK), so addressing is a shift and a mask. Chunks never
+ * move once allocated and each one is a contiguous span that scans can
+ * iterate directly. The first chunk starts small and doubles up to
+ * CHUNK_SIZE so that tiny columns stay tiny. New slots read as zero.
+ * A chunk can also be borrowed, pointing into memory owned elsewhere such
+ * as a serialized blob; it is copied the first time it is written.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+template <typename T>
+class ChunkedArray {
+  public:
+    T** chunks_;      // owned; chunk directory
+    size_t n_chunks_; // number of allocated chunks
+    size_t dir_cap_;  // capacity of the chunk directory
+    size_t head_cap_; // capacity of chunk 0, CHUNK_SIZE once it is full size
+    size_t len_;      // number of elements
+    bool* lent_;      // owned; per chunk, is it borrowed, nullptr while none is
+
+    ChunkedArray() {
+      lent_ = nullptr;
+      len_ = 0;
+      n_chunks_ = 0;
+      head_cap_ = 0;
+      dir_cap_ = 4;
+      chunks_ = new T*[dir_cap_];
+    }
+
+    ~ChunkedArray() {
+      for (size_t i = 0; i < n_chunks_; i++) {
+        if (!is_borrowed(i)) delete[] chunks_[i];
+      }
+      delete[] chunks_;
+      delete[] lent_;
+    }
+
+    /** Number of elements */
+    size_t size() {
+      return len_;
+    }
+
+    /** Gets value at idx. An idx >= size() is undefined. */
+    T get(size_t idx) {
+      return chunks_[idx >> CHUNK_SHIFT][idx & CHUNK_MASK];
+    }
+
+    /** Sets value at idx, growing the array if needed. Slots skipped over
+     *  by a write past the end are zero. */
+    void set(size_t idx, T val) {
+      ensure(idx);
+      if (is_borrowed(idx >> CHUNK_SHIFT)) own(idx >> CHUNK_SHIFT);
+      chunks_[idx >> CHUNK_SHIFT][idx & CHUNK_MASK] = val;
+      if (idx >= len_) len_ = idx + 1;
+    }
+
+    void push_back(T val) {
+      set(len_, val);
+    }
+
+    /** Number of chunks holding at least one element */
+    size_t chunk_count() {
+      return (len_ + CHUNK_MASK) >> CHUNK_SHIFT;
+    }
+
+    /** Contiguous storage of chunk c, valid for chunk_length(c) elements */
+    T* chunk(size_t c) {
+      return chunks_[c];
+    }
+
+    /** Number of elements in chunk c */
+    size_t chunk_length(size_t c) {
+      size_t start = c << CHUNK_SHIFT;
+      if (start >= len_) return 0;
+      size_t rest = len_ - start;
+      return rest < CHUNK_SIZE ? rest : CHUNK_SIZE;
+    }
+
+    /** Frees the storage of chunk c. It must be restored before its slots
+     *  are read or written again. */
+    void release(size_t c) {
+      if (is_borrowed(c)) lent_[c] = false;
+      else delete[] chunks_[c];
+      chunks_[c] = nullptr;
+      //a restored head is always full size
+      if (c == 0) head_cap_ = CHUNK_SIZE;
+    }
+
+    /** Storage of chunk c, allocated zeroed if it was released */
+    T* restore(size_t c) {
+      if (chunks_[c] == nullptr) chunks_[c] = new T[CHUNK_SIZE]();
+      return chunks_[c];
+    }
+
+    /** Points released chunk c at span, chunk_length(c) elements owned
+     *  elsewhere that must outlive the array */
+    void borrow(size_t c, T* span) {
+      if (lent_ == nullptr) lent_ = new bool[dir_cap_]();
+      chunks_[c] = span;
+      lent_[c] = true;
+    }
+
+    /** Does chunk c point into memory owned elsewhere? */
+    bool is_borrowed(size_t c) {
+      return lent_ != nullptr && lent_[c];
+    }
+
+    /** Copies borrowed chunk c into storage of its own */
+    void own(size_t c) {
+      T* copy = new T[CHUNK_SIZE]();
+      for (size_t i = 0; i < chunk_length(c); i++) copy[i] = chunks_[c][i];
+      chunks_[c] = copy;
+      lent_[c] = false;
+    }
+
+    /** Gives an empty array len elements whose chunks all start out
+     *  released, for callers that keep the values elsewhere */
+    void set_length(size_t len) {
+      assert(len_ == 0 && n_chunks_ == 0);
+      if (len == 0) return;
+      len_ = len;
+      while (n_chunks_ < chunk_count()) {
+        if (n_chunks_ == dir_cap_) growDirectory();
+        chunks_[n_chunks_++] = nullptr;
+      }
+      head_cap_ = CHUNK_SIZE;
+    }
+
+    /** Ensures the slot at idx is allocated. */
+    void ensure(size_t idx) {
+      size_t c = idx >> CHUNK_SHIFT;
+      if (c == 0) {
+        if (idx >= head_cap_) growHead(idx + 1);
+        return;
+      }
+      if (head_cap_ < CHUNK_SIZE) growHead(CHUNK_SIZE);
+      while (n_chunks_ <= c) {
+        if (n_chunks_ == dir_cap_) growDirectory();
+        chunks_[n_chunks_++] = new T[CHUNK_SIZE]();
+      }
+    }
+
+    /** Grows chunk 0 to hold at least n elements, doubling up to CHUNK_SIZE */
+    void growHead(size_t n) {
+      size_t cap = head_cap_ == 0 ? 8 : head_cap_;
+      while (cap < n) cap *= 2;
+      if (cap > CHUNK_SIZE) cap = CHUNK_SIZE;
+      T* head = new T[cap]();
+      if (n_chunks_ == 0) {
+        n_chunks_ = 1;
+      } else {
+        for (size_t i = 0; i < head_cap_; i++) head[i] = chunks_[0][i];
+        delete[] chunks_[0];
+      }
+      chunks_[0] = head;
+      head_cap_ = cap;
+    }
+
+    /** Doubles the capacity of the chunk directory */
+    void growDirectory() {
+      T** dir = new T*[dir_cap_ * 2];
+      for (size_t i = 0; i < n_chunks_; i++) dir[i] = chunks_[i];
+      delete[] chunks_;
+      chunks_ = dir;
+      if (lent_ != nullptr) {
+        bool* lent = new bool[dir_cap_ * 2]();
+        for (size_t i = 0; i < n_chunks_; i++) lent[i] = lent_[i];
+        delete[] lent_;
+        lent_ = lent;
+      }
+      dir_cap_ *= 2;
+    }
+};
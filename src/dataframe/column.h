@@ -6,11 +6,35 @@
 #include <iostream>
 #include "../string.h"
 #include "../helper.h"
+#include "chunkedarray.h"
+#include "bitvector.h"
+#include "stringview.h"
+#include "zonemap.h"
+#include "intcodec.h"
+#include <vector>
 
 class IntColumn;
 class BoolColumn;
 class DoubleColumn;
 class StringColumn;
+class DictStringColumn;
+template <typename T, char TYPE> class NumericColumn;
+typedef NumericColumn<int8_t, 'Y'> ByteColumn;
+typedef NumericColumn<int16_t, 'H'> ShortColumn;
+typedef NumericColumn<int64_t, 'L'> LongColumn;
+typedef NumericColumn<float, 'F'> FloatColumn;
+
+/** Encodings of the payload of a serialized column. Raw payloads are the
+ *  values as they sit in memory, little endian at their own width, and
+ *  bools as their bitmap words. */
+#define ENCODING_RAW 0
+#define ENCODING_INTS 1    // int chunks as EncodedInts
+#define ENCODING_STRINGS 2 // every string in a StringArray, offsets then bytes
+#define ENCODING_DICT 3    // a dictionary and a code per row
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Raw column payloads are little endian"
+#endif
 
 using namespace std;
 /**************************************************************************
@@ -25,11 +49,15 @@ using namespace std;
  * */
 class Column : public Object {
  public:
-  size_t len_;
+  BitVector* valid_; // owned; one bit per value, nullptr while none is missing
 
-  Column() { }
+  Column() {
+    valid_ = nullptr;
+  }
 
-  virtual ~Column() { }
+  virtual ~Column() {
+    delete valid_;
+  }
  
   /** Type converters: Return same column under its actual type, or
    *  nullptr if of the wrong type.  */
@@ -45,6 +73,22 @@ class Column : public Object {
   virtual StringColumn* as_string() {
     return nullptr;
   }
+  ByteColumn* as_byte();
+  ShortColumn* as_short();
+  LongColumn* as_long();
+  FloatColumn* as_float();
+
+  /** Value at idx of a numeric column widened to a double. Calling it on
+   *  a non numeric column is undefined. */
+  virtual double get_numeric(size_t idx) {
+    assert("Invalid operation." && false);
+  }
+
+  /** Value at idx of an integer column widened to 64 bits. Calling it on
+   *  a non integer column is undefined. */
+  virtual int64_t get_integer(size_t idx) {
+    assert("Invalid operation." && false);
+  }
  
   /** Type appropriate push_back methods. Calling the wrong method is
     * undefined behavior. **/
@@ -61,17 +105,139 @@ class Column : public Object {
     assert("Invalid operation." && false);
   }
 
-  size_t getParentIndex(size_t idx) {
-    return (size_t)floor(log2(idx + 1));
+  /** Returns the number of elements in the column. */
+  virtual size_t size() {
+    assert("Invalid operation." && false);
+    return 0;
   }
 
-  size_t getChildIndex(size_t idx) {
-    return idx - (pow(2, getParentIndex(idx)) - 1);
+  /** Stores a missing value at idx. Calling it on the abstract class is
+   *  undefined. */
+  virtual void set_missing(size_t idx) {
+    assert("Invalid operation." && false);
+  }
+
+  /** Is the value at idx missing? */
+  bool is_missing(size_t idx) {
+    return valid_ != nullptr && !valid_->get(idx);
+  }
+
+  /** Number of missing values, counted a word at a time */
+  size_t null_count() {
+    if (valid_ == nullptr) return 0;
+    return size() - valid_->count_true();
+  }
+
+  /** Validity words, bit set when the value is present. nullptr means every
+   *  value is present. */
+  uint64_t* validity_words() {
+    return valid_ == nullptr ? nullptr : valid_->words_;
+  }
+
+  /** Calls f(idx) for every present index in [start, end). Whole all-valid
+   *  words are taken without testing bits and all-null words are skipped. */
+  template <typename Fn>
+  void for_each_valid(size_t start, size_t end, Fn f) {
+    if (valid_ == nullptr) {
+      for (size_t i = start; i < end; i++) f(i);
+      return;
+    }
+    size_t i = start;
+    while (i < end) {
+      size_t span = 64 - (i & 63);
+      if (span > end - i) span = end - i;
+      uint64_t mask = span == 64 ? ~(uint64_t)0 : ((uint64_t)1 << span) - 1;
+      uint64_t word = (valid_->words_[i >> 6] >> (i & 63)) & mask;
+      if (word == mask) {
+        for (size_t j = 0; j < span; j++) f(i + j);
+      } else {
+        while (word != 0) {
+          f(i + __builtin_ctzll(word));
+          word &= word - 1;
+        }
+      }
+      i += span;
+    }
+  }
+
+  /** Records a value written at idx. Called by subclasses before the value
+   *  is stored; slots skipped over by a write past the end become missing. */
+  void note_set(size_t idx) {
+    size_t len = size();
+    if (idx > len && valid_ == nullptr) {
+      valid_ = new BitVector();
+      valid_->fill(len, true);
+    }
+    if (valid_ != nullptr) valid_->set(idx, true);
+  }
+
+  /** Marks idx as missing. Called by subclasses after a zero is stored. */
+  void note_missing(size_t idx) {
+    if (valid_ == nullptr) {
+      valid_ = new BitVector();
+      valid_->fill(size(), true);
+    }
+    valid_->set(idx, false);
+  }
+
+  /** Copies the validity bitmap of other into this column */
+  void copy_validity(Column* other) {
+    delete valid_;
+    valid_ = other->valid_ == nullptr ? nullptr : new BitVector(*other->valid_);
+  }
+
+  /** Same missing values as other? */
+  bool same_validity(Column* other) {
+    if (null_count() != other->null_count()) return false;
+    if (valid_ == nullptr || other->valid_ == nullptr) return true;
+    return valid_->equals(other->valid_);
+  }
+
+  /** Number of CHUNK_SIZE chunks the column's values are stored in. */
+  size_t chunk_count() {
+    return (size() + CHUNK_MASK) >> CHUNK_SHIFT;
+  }
+
+  /** Number of values in chunk c, CHUNK_SIZE for every chunk but the last. */
+  size_t chunk_length(size_t c) {
+    size_t start = c << CHUNK_SHIFT;
+    if (start >= size()) return 0;
+    size_t rest = size() - start;
+    return rest < CHUNK_SIZE ? rest : CHUNK_SIZE;
+  }
+
+  /** Number of missing values in chunk c */
+  size_t chunk_null_count(size_t c) {
+    if (valid_ == nullptr) return 0;
+    size_t present = 0;
+    size_t first = c << (CHUNK_SHIFT - 6);
+    size_t words = (chunk_length(c) + 63) >> 6;
+    for (size_t w = first; w < first + words; w++) {
+      present += __builtin_popcountll(valid_->words_[w]);
+    }
+    return chunk_length(c) - present;
+  }
+
+  /** Can chunk c hold a present value in [lo, hi]? Columns without zone
+   *  maps cannot rule any chunk out. */
+  virtual bool chunk_overlaps(size_t c, double lo, double hi) {
+    return true;
+  }
+
+  /** Bounds of the present values, false if the column cannot tell or
+   *  holds no present value */
+  virtual bool value_range(double& lo, double& hi) {
+    return false;
   }
  
- /** Returns the number of elements in the column. */
-  virtual size_t size() {}
- 
+  /** Reads a serialized payload at the reader's cursor into this empty
+   *  column, leaving the values in the buffer where they can be read in
+   *  place. The buffer must be 8 byte aligned and outlive the column. Only
+   *  numeric columns can. */
+  virtual void borrow(BufferReader& reader) {
+    assert("Invalid operation." && false);
+  }
+
   /** Return the type of this column as a char: 'S', 'B', 'I' and 'D'.*/
   virtual char get_type() {
     assert("Should not be called on super type Column");
@@ -90,35 +256,23 @@ class Column : public Object {
 
 /*************************************************************************
  * IntColumn::
- * Holds int values.
+ * Holds int values. Sealing replaces each chunk's plain values with
+ * EncodedInts when that is smaller. A write into a sealed chunk decodes it
+ * back first. Serialization sends every chunk encoded.
  */
-class IntColumn : public Column {
+class IntColumn : public Column, public Serializable {
   public:
-    int** vals_;
+    ChunkedArray<int> vals_;
+    ZoneMap<int> zones_;
+    std::vector<EncodedInts*> sealed_; // owned; per chunk, nullptr while plain
 
-  IntColumn() {
-    len_ = 0;
-    vals_ = new int*[20];
-    for (int i = 0; i < 20; i++) {
-      vals_[i] = nullptr;
-    }
-  }
+  IntColumn() { }
 
   IntColumn(int n, ...) {
     va_list arguments;
-    len_ = n;
-    vals_ = new int*[20];
-    for (int i = 0; i < 20; i++) {
-      vals_[i] = nullptr;
-    }
-
     va_start(arguments, n);
     for (int i = 0; i < n; i++) {
-      ensureSubArray(i);
-      int val = va_arg(arguments, int);
-      size_t parentIndex = getParentIndex(i);
-      int subIndex = getChildIndex(i);
-      vals_[parentIndex][subIndex] = val;
+      push_back(va_arg(arguments, int));
     }
     va_end(arguments);
   }
@@ -127,19 +281,11 @@ class IntColumn : public Column {
     return 'I';
   }
 
-  /**Ensures the smaller subarray is large enough/instantiated. */
-  void ensureSubArray(size_t idx) {
-    size_t arrayIndex = getParentIndex(idx);
-    if (vals_[arrayIndex] == nullptr) {
-      int count = (int)pow(2, arrayIndex);
-      vals_[arrayIndex] = new int[count];
-    }
-  }
-
   /** Gets value at idx*/
   int get(size_t idx) {
-    ensureSubArray(idx);
-    return vals_[getParentIndex(idx)][getChildIndex(idx)];
+    size_t c = idx >> CHUNK_SHIFT;
+    if (c < sealed_.size() && sealed_[c] != nullptr) return sealed_[c]->get(idx & CHUNK_MASK);
+    return vals_.get(idx);
   }
 
   IntColumn* as_int() {
@@ -148,50 +294,193 @@ class IntColumn : public Column {
 
   /** Set value at idx. An out of bound idx is undefined.  */
   void set(size_t idx, int val) {
-    ensureSubArray(idx);
-    if (idx >= len_) {
-      for (size_t i = len_; i < idx; i++) {
-        ensureSubArray(i);
-        vals_[getParentIndex(i)][getChildIndex(i)] = NULL;
+    unseal(idx >> CHUNK_SHIFT);
+    note_set(idx);
+    vals_.set(idx, val);
+    zones_.record(idx, val);
+  }
+
+  void push_back(int val) {
+    set(size(), val);
+  }
+
+  void set_missing(size_t idx) {
+    unseal(idx >> CHUNK_SHIFT);
+    note_set(idx);
+    vals_.set(idx, 0);
+    note_missing(idx);
+  }
+
+  /** Encodes every chunk that shrinks by it and frees its plain values */
+  void seal() {
+    if (sealed_.size() < chunk_count()) sealed_.resize(chunk_count(), nullptr);
+    for (size_t c = 0; c < chunk_count(); c++) {
+      if (sealed_[c] != nullptr) continue;
+      EncodedInts* enc = EncodedInts::encode(vals_.chunk(c), chunk_length(c));
+      if (enc->encoding_ == INT_RAW) {
+        delete enc;
+        continue;
       }
-      len_ = idx + 1;
+      sealed_[c] = enc;
+      vals_.release(c);
     }
-    vals_[getParentIndex(idx)][getChildIndex(idx)] = val;
   }
 
-  void push_back(double val) {
-    ensureSubArray(len_);
-    vals_[getParentIndex(len_)][getChildIndex(len_)] = val;
-    len_++;
+  /** Decodes chunk c back into plain values if it is sealed */
+  void unseal(size_t c) {
+    if (c >= sealed_.size() || sealed_[c] == nullptr) return;
+    sealed_[c]->decode(vals_.restore(c));
+    delete sealed_[c];
+    sealed_[c] = nullptr;
+  }
+
+  /** Is chunk c encoded? */
+  bool is_sealed(size_t c) {
+    return c < sealed_.size() && sealed_[c] != nullptr;
+  }
+
+  /** Values of chunk c, valid for chunk_length(c) elements. A sealed chunk
+   *  is decoded into scratch, which must hold CHUNK_SIZE ints. */
+  int* read_chunk(size_t c, int* scratch) {
+    if (!is_sealed(c)) return vals_.chunk(c);
+    sealed_[c]->decode(scratch);
+    return scratch;
+  }
+
+  /** Bytes holding the values, plain chunks counted at full capacity */
+  size_t value_bytes() {
+    size_t total = 0;
+    for (size_t c = 0; c < chunk_count(); c++) {
+      total += is_sealed(c) ? sealed_[c]->bytes() : 4 * CHUNK_SIZE;
+    }
+    return total;
+  }
+
+  bool chunk_overlaps(size_t c, double lo, double hi) {
+    return zones_.overlaps(c, lo, hi);
+  }
+
+  bool value_range(double& lo, double& hi) {
+    return zones_.range(lo, hi);
+  }
+
+  double get_numeric(size_t idx) {
+    return get(idx);
+  }
+
+  int64_t get_integer(size_t idx) {
+    return get(idx);
+  }
+
+  /** Contiguous values of chunk c, valid for chunk_length(c) elements.
+   *  Unseals the chunk, use read_chunk to leave it encoded. */
+  int* chunk(size_t c) {
+    unseal(c);
+    return vals_.chunk(c);
   }
 
   size_t size() {
-    return len_;
+    return vals_.size();
   }
 
   IntColumn* clone() {
     IntColumn* newColumn = new IntColumn();
-    for (size_t i = 0; i < len_; i++) {
-      newColumn->push_back(vals_[getParentIndex(i)][getChildIndex(i)]);
+    int* scratch = new int[CHUNK_SIZE];
+    for (size_t c = 0; c < chunk_count(); c++) {
+      int* vals = read_chunk(c, scratch);
+      for (size_t i = 0; i < chunk_length(c); i++) {
+        newColumn->push_back(vals[i]);
+      }
     }
+    delete[] scratch;
+    newColumn->copy_validity(this);
     return newColumn;
   }
 
-  void print(size_t i) {
-    if (i < len_) {
-      int outVal = vals_[getParentIndex(i)][getChildIndex(i)];
-      if (outVal != NULL) {
-        std::cout << outVal;
+  /** Serializes the values with every chunk encoded. Structure is as
+   * following
+   *
+   * |--8 bytes-------------|--8 bytes--|--Unknown length each---------|
+   * |--length in bytes-----|--rows-----|--EncodedInts 1, 2...---------|
+   */
+  size_t serial_size() {
+    size_t length = 16;
+    for (size_t c = 0; c < chunk_count(); c++) {
+      //a plain chunk encodes to at most its raw size
+      if (is_sealed(c)) length += sealed_[c]->serial_size();
+      else length += EncodedInts::padded_size(4 * chunk_length(c));
+    }
+    return length;
+  }
+
+  void write_to(BufferWriter& writer) {
+    size_t start = writer.pos_;
+    writer.write_size_t(0);
+    writer.write_size_t(size());
+    for (size_t c = 0; c < chunk_count(); c++) {
+      if (is_sealed(c)) {
+        sealed_[c]->write_to(writer);
+      } else {
+        EncodedInts* enc = EncodedInts::encode(vals_.chunk(c), chunk_length(c));
+        enc->write_to(writer);
+        delete enc;
+      }
+    }
+    writer.patch_size_t(writer.pos_ - start, start);
+  }
+
+  void read_from(BufferReader& reader) {
+    read_from(reader, false);
+  }
+
+  /** Reads the column at the reader's cursor into this empty one. Encoded
+   *  chunks stay sealed, plainly sent ones are decoded. Borrowing reads
+   *  the packed words of encoded chunks in place and makes plain ones
+   *  spans of vals_. */
+  void read_from(BufferReader& reader, bool borrow) {
+    size_t start = reader.pos_;
+    size_t length = reader.read_size_t();
+    size_t rows = reader.read_size_t();
+    //every chunk takes at least the 56 bytes of its header
+    if (length < 16 || length > reader.end_ - start || rows / CHUNK_SIZE > (length - 16) / 56) {
+      assert("Malformed int column." && false);
+    }
+    BufferReader chunks(reader.buf_ + start, length);
+    chunks.skip(16);
+    vals_.set_length(rows);
+    sealed_.assign(chunk_count(), nullptr);
+    for (size_t c = 0; c < chunk_count(); c++) {
+      EncodedInts* enc = new EncodedInts();
+      enc->read_from(chunks, borrow);
+      if (enc->len_ != chunk_length(c)) assert("Malformed int column." && false);
+      if (enc->encoding_ != INT_RAW) {
+        sealed_[c] = enc;
+        continue;
       }
+      if (borrow) vals_.borrow(c, enc->aux_);
+      else enc->decode(vals_.restore(c));
+      delete enc;
+    }
+    if (chunks.pos_ != length) assert("Malformed int column." && false);
+    reader.skip(length - 16);
+  }
+
+  /** Reads the column like read_from, borrowing the buffer */
+  void borrow(BufferReader& reader) {
+    read_from(reader, true);
+  }
+
+  void print(size_t i) {
+    if (i < size() && !is_missing(i)) {
+      std::cout << get(i);
     }
   }
 
 
   void print() {
-    for (size_t i = 0; i < len_; i++) {
-      int outVal = vals_[getParentIndex(i)][getChildIndex(i)];
-      if (outVal != NULL) {
-        std::cout << outVal << std::endl;
+    for (size_t i = 0; i < size(); i++) {
+      if (!is_missing(i)) {
+        std::cout << get(i) << std::endl;
       } else {
         std::cout << "[NULL]" << std::endl;
       }
@@ -203,48 +492,41 @@ class IntColumn : public Column {
     IntColumn* otherCol = dynamic_cast<IntColumn*>(other);
     if (otherCol == nullptr) return false;
     if (size() != otherCol->size()) return false;
-    for (size_t i = 0; i < size(); i++) {
-      if (get(i) != otherCol->get(i)) return false;
+    if (!same_validity(otherCol)) return false;
+    int* scratch = new int[2 * CHUNK_SIZE];
+    bool same = true;
+    for (size_t c = 0; same && c < chunk_count(); c++) {
+      int* a = read_chunk(c, scratch);
+      int* b = otherCol->read_chunk(c, scratch + CHUNK_SIZE);
+      same = memcmp(a, b, chunk_length(c) * sizeof(int)) == 0;
     }
-    return true;
+    delete[] scratch;
+    return same;
   }
 
   ~IntColumn() {
-    delete[] vals_;
+    for (size_t c = 0; c < sealed_.size(); c++) {
+      delete sealed_[c];
+    }
   }
 };
 
 /*************************************************************************
  * BoolColumn::
- * Holds int values.
+ * Holds bool values, bit-packed 64 to a word. Chunks are word aligned so a
+ * chunk of CHUNK_SIZE values is CHUNK_SIZE / 64 consecutive words.
  */
 class BoolColumn : public Column {
   public:
-    bool** vals_;
+    BitVector vals_;
 
-  BoolColumn() {
-    len_ = 0;
-    vals_ = new bool*[20];
-    for (int i = 0; i < 20; i++) {
-      vals_[i] = nullptr;
-    }
-  }
+  BoolColumn() { }
 
   BoolColumn(int n, ...) {
     va_list arguments;
-    len_ = n;
-    vals_ = new bool*[20];
-    for (int i = 0; i < 20; i++) {
-      vals_[i] = nullptr;
-    }
-
     va_start(arguments, n);
     for (int i = 0; i < n; i++) {
-      ensureSubArray(i);
-      bool val = va_arg(arguments, int);
-      size_t parentIndex = getParentIndex(i);
-      int subIndex = getChildIndex(i);
-      vals_[parentIndex][subIndex] = val;
+      vals_.push_back(va_arg(arguments, int));
     }
     va_end(arguments);
   }
@@ -253,19 +535,9 @@ class BoolColumn : public Column {
     return 'B';
   }
 
-  /**Ensures the smaller subarray is large enough/instantiated. */
-  void ensureSubArray(size_t idx) {
-    size_t arrayIndex = getParentIndex(idx);
-    if (vals_[arrayIndex] == nullptr) {
-      int count = (int)pow(2, arrayIndex);
-      vals_[arrayIndex] = new bool[count];
-    }
-  }
-
   /** Gets value at idx*/
   bool get(size_t idx) {
-    ensureSubArray(idx);
-    return vals_[getParentIndex(idx)][getChildIndex(idx)];
+    return vals_.get(idx);
   }
 
   BoolColumn* as_bool() {
@@ -274,55 +546,74 @@ class BoolColumn : public Column {
 
   /** Set value at idx. An out of bound idx is undefined.  */
   void set(size_t idx, bool val) {
-    ensureSubArray(idx);
-    if (idx >= len_) {
-      for (size_t i = len_; i < idx; i++) {
-        ensureSubArray(i);
-        vals_[getParentIndex(i)][getChildIndex(i)] = NULL;
-      }
-      len_ = idx + 1;
-    }
-    vals_[getParentIndex(idx)][getChildIndex(idx)] = val;
+    note_set(idx);
+    vals_.set(idx, val);
   }
 
   void push_back(bool val) {
-    ensureSubArray(len_);
-    vals_[getParentIndex(len_)][getChildIndex(len_)] = val;
-    len_++;
+    set(size(), val);
+  }
+
+  void set_missing(size_t idx) {
+    set(idx, false);
+    note_missing(idx);
+  }
+
+  /** Packed words of chunk c, valid for (chunk_length(c) + 63) / 64 words */
+  uint64_t* chunk_words(size_t c) {
+    return vals_.words_ + (c << (CHUNK_SHIFT - 6));
   }
 
   size_t size() {
-    return len_;
+    return vals_.size();
+  }
+
+  /** Number of true values, counted a word at a time */
+  size_t count_true() {
+    return vals_.count_true();
+  }
+
+  /** New column holding this AND other, columns must be the same size */
+  BoolColumn* and_(BoolColumn* other) {
+    BoolColumn* res = clone();
+    res->vals_.and_(other->vals_);
+    return res;
+  }
+
+  /** New column holding this OR other, columns must be the same size */
+  BoolColumn* or_(BoolColumn* other) {
+    BoolColumn* res = clone();
+    res->vals_.or_(other->vals_);
+    return res;
+  }
+
+  /** New column holding the negation of this column */
+  BoolColumn* not_() {
+    BoolColumn* res = clone();
+    res->vals_.not_();
+    return res;
   }
 
   BoolColumn* clone() {
     BoolColumn* newColumn = new BoolColumn();
-    for (size_t i = 0; i < len_; i++) {
-      newColumn->push_back(vals_[getParentIndex(i)][getChildIndex(i)]);
-    }
+    newColumn->vals_.resize(size());
+    memcpy(newColumn->vals_.words_, vals_.words_, vals_.word_count() * sizeof(uint64_t));
+    newColumn->copy_validity(this);
     return newColumn;
   }
 
   void print(size_t i) {
-    if (i < len_) {
-      bool outVal = vals_[getParentIndex(i)][getChildIndex(i)];
-      if (outVal != NULL) {
-        std::cout << outVal;
-      } else {
-        std::cout << "0";
-      }
+    if (i < size() && !is_missing(i)) {
+      std::cout << get(i);
     }
   }
 
   void print() {
-    for (size_t i = 0; i < len_; i++) {
-      bool outVal = vals_[getParentIndex(i)][getChildIndex(i)];
-      if (outVal != NULL) {
-        if (outVal) {
-          std::cout << outVal << std::endl;
-        }
+    for (size_t i = 0; i < size(); i++) {
+      if (!is_missing(i)) {
+        std::cout << get(i) << std::endl;
       } else {
-        std::cout << "0" << std::endl;
+        std::cout << "[NULL]" << std::endl;
       }
     }
   }
@@ -331,49 +622,78 @@ class BoolColumn : public Column {
     if (this == other) return true;
     BoolColumn* otherCol = dynamic_cast<BoolColumn*>(other);
     if (otherCol == nullptr) return false;
-    if (size() != otherCol->size()) return false;
-    for (size_t i = 0; i < size(); i++) {
-      if (get(i) != otherCol->get(i)) return false;
-    }
-    return true;
+    if (!same_validity(otherCol)) return false;
+    return vals_.equals(&otherCol->vals_);
   }
 
-  ~BoolColumn() {
-    delete[] vals_;
-  }
+  ~BoolColumn() { }
 };
 
+/** Bytes write_values writes for vals and zones */
+template <typename T>
+size_t values_size(ChunkedArray<T>& vals, ZoneMap<T>& zones) {
+  return 16 + sizeof(T) * vals.size() + zones.serial_size();
+}
+
+/** Writes vals at their own width, a chunk at a time, followed by zones.
+ * Structure is as following
+ *
+ * |--8 bytes-------------|--8 bytes--|--sizeof(T) bytes each--|--Unknown length--|
+ * |--length in bytes-----|--rows-----|--val 1, val 2...-------|--ZoneMap---------|
+ */
+template <typename T>
+void write_values(BufferWriter& writer, ChunkedArray<T>& vals, ZoneMap<T>& zones) {
+  writer.write_size_t(values_size(vals, zones));
+  writer.write_size_t(vals.size());
+  for (size_t c = 0; c < vals.chunk_count(); c++) {
+    writer.write_bytes(vals.chunk(c), sizeof(T) * vals.chunk_length(c));
+  }
+  zones.write_to(writer);
+}
+
+/** Reads what write_values wrote at the reader's cursor into the empty
+ *  vals and zones, a memcpy per chunk, or none when the chunks borrow the
+ *  buffer */
+template <typename T>
+void read_values(BufferReader& reader, ChunkedArray<T>& vals, ZoneMap<T>& zones, bool borrow = false) {
+  size_t start = reader.pos_;
+  size_t length = reader.read_size_t();
+  size_t rows = reader.read_size_t();
+  //the values must be in the buffer before any chunk is allocated
+  if (length < 16 || length > reader.end_ - start || rows > (length - 16) / sizeof(T)) {
+    assert("Malformed column values." && false);
+  }
+  BufferReader values(reader.buf_ + start, length);
+  values.skip(16);
+  vals.set_length(rows);
+  for (size_t c = 0; c < vals.chunk_count(); c++) {
+    size_t bytes = sizeof(T) * vals.chunk_length(c);
+    values.need(bytes);
+    if (borrow) vals.borrow(c, (T*)values.cursor());
+    else memcpy(vals.restore(c), values.cursor(), bytes);
+    values.skip(bytes);
+  }
+  zones.read_from(values);
+  if (zones.size() > vals.chunk_count() || values.pos_ != length) assert("Malformed column values." && false);
+  reader.skip(length - 16);
+}
+
 /*************************************************************************
  * DoubleColumn::
  * Holds double values.
  */
-class DoubleColumn : public Column {
+class DoubleColumn : public Column, public Serializable {
  public:
-    double** vals_;
+    ChunkedArray<double> vals_;
+    ZoneMap<double> zones_;
 
-  DoubleColumn() {
-    len_ = 0;
-    vals_ = new double*[20];
-    for (int i = 0; i < 20; i++) {
-      vals_[i] = nullptr;
-    }
-  }
+  DoubleColumn() { }
 
   DoubleColumn(int n, ...) {
     va_list arguments;
-    len_ = n;
-    vals_ = new double*[20];
-    for (int i = 0; i < 20; i++) {
-      vals_[i] = nullptr;
-    }
-
     va_start(arguments, n);
     for (int i = 0; i < n; i++) {
-      ensureSubArray(i);
-      double val = va_arg(arguments, double);
-      size_t parentIndex = getParentIndex(i);
-      int subIndex = getChildIndex(i);
-      vals_[parentIndex][subIndex] = val;
+      push_back(va_arg(arguments, double));
     }
     va_end(arguments);
   }
@@ -382,19 +702,9 @@ class DoubleColumn : public Column {
     return 'D';
   }
 
-  /**Ensures the smaller subarray is large enough/instantiated. */
-  void ensureSubArray(size_t idx) {
-    size_t arrayIndex = getParentIndex(idx);
-    if (vals_[arrayIndex] == nullptr) {
-      int count = (int)pow(2, arrayIndex);
-      vals_[arrayIndex] = new double[count];
-    }
-  }
-
   /** Gets value at idx*/
   double get(size_t idx) {
-    ensureSubArray(idx);
-    return vals_[getParentIndex(idx)][getChildIndex(idx)];
+    return vals_.get(idx);
   }
 
   DoubleColumn* as_double() {
@@ -403,49 +713,64 @@ class DoubleColumn : public Column {
 
   /** Set value at idx. An out of bound idx is undefined.  */
   void set(size_t idx, double val) {
-    ensureSubArray(idx);
-    if (idx >= len_) {
-      for (size_t i = len_; i < idx; i++) {
-        ensureSubArray(i);
-        vals_[getParentIndex(i)][getChildIndex(i)] = NULL;
-      }
-      len_ = idx + 1;
-    }
-    vals_[getParentIndex(idx)][getChildIndex(idx)] = val;
+    note_set(idx);
+    vals_.set(idx, val);
+    zones_.record(idx, val);
   }
 
   void push_back(double val) {
-    ensureSubArray(len_);
-    vals_[getParentIndex(len_)][getChildIndex(len_)] = val;
-    len_++;
+    set(size(), val);
+  }
+
+  void set_missing(size_t idx) {
+    note_set(idx);
+    vals_.set(idx, 0.0);
+    note_missing(idx);
+  }
+
+  bool chunk_overlaps(size_t c, double lo, double hi) {
+    return zones_.overlaps(c, lo, hi);
+  }
+
+  bool value_range(double& lo, double& hi) {
+    return zones_.range(lo, hi);
+  }
+
+  double get_numeric(size_t idx) {
+    return get(idx);
+  }
+
+  /** Contiguous values of chunk c, valid for chunk_length(c) elements */
+  double* chunk(size_t c) {
+    return vals_.chunk(c);
   }
 
   size_t size() {
-    return len_;
+    return vals_.size();
   }
 
   DoubleColumn* clone() {
     DoubleColumn* newColumn = new DoubleColumn();
-    for (size_t i = 0; i < len_; i++) {
-      newColumn->push_back(vals_[getParentIndex(i)][getChildIndex(i)]);
+    for (size_t c = 0; c < chunk_count(); c++) {
+      double* vals = chunk(c);
+      for (size_t i = 0; i < chunk_length(c); i++) {
+        newColumn->push_back(vals[i]);
+      }
     }
+    newColumn->copy_validity(this);
     return newColumn;
   }
 
   void print(size_t i) {
-    if (i < len_) {
-      double outVal = vals_[getParentIndex(i)][getChildIndex(i)];
-      if (outVal != NULL) {
-        std::cout << outVal;
-      }
+    if (i < size() && !is_missing(i)) {
+      std::cout << get(i);
     }
   }
 
   void print() {
-    for (size_t i = 0; i < len_; i++) {
-      double outVal = vals_[getParentIndex(i)][getChildIndex(i)];
-      if (outVal != NULL) {
-        std::cout << outVal << std::endl;
+    for (size_t i = 0; i < size(); i++) {
+      if (!is_missing(i)) {
+        std::cout << get(i) << std::endl;
       } else {
         std::cout << "[NULL]" << std::endl;
       }
@@ -457,49 +782,55 @@ class DoubleColumn : public Column {
     DoubleColumn* otherCol = dynamic_cast<DoubleColumn*>(other);
     if (otherCol == nullptr) return false;
     if (size() != otherCol->size()) return false;
-    for (size_t i = 0; i < size(); i++) {
-      if (get(i) != otherCol->get(i)) return false;
+    if (!same_validity(otherCol)) return false;
+    for (size_t c = 0; c < chunk_count(); c++) {
+      double* a = chunk(c);
+      double* b = otherCol->chunk(c);
+      for (size_t i = 0; i < chunk_length(c); i++) {
+        if (a[i] != b[i]) return false;
+      }
     }
     return true;
   }
 
-  ~DoubleColumn() {
-    delete[] vals_;
+  /** Serializes the values followed by the zone map, see write_values */
+  size_t serial_size() {
+    return values_size(vals_, zones_);
+  }
+
+  void write_to(BufferWriter& writer) {
+    write_values(writer, vals_, zones_);
   }
+
+  /** Reads the values at the reader's cursor into this empty column */
+  void read_from(BufferReader& reader) {
+    read_values(reader, vals_, zones_);
+  }
+
+  void borrow(BufferReader& reader) {
+    read_values(reader, vals_, zones_, true);
+  }
+
+  ~DoubleColumn() { }
 };
 
 /*************************************************************************
  * StringColumn::
  * Holds string pointers. The strings are external.  Nullptr is a valid
- * value.
+ * value. Subclasses may store the strings in another encoding, so access
+ * goes through the virtual get and set.
  */
 class StringColumn : public Column {
   public:
-    String*** vals_;
+    ChunkedArray<String*> vals_;
 
-  StringColumn() {
-    len_ = 0;
-    vals_ = new String**[20];
-    for (int i = 0; i < 20; i++) {
-      vals_[i] = nullptr;
-    }
-  }
+  StringColumn() { }
 
   StringColumn(int n, ...) {
     va_list arguments;
-    len_ = n;
-    vals_ = new String**[20];
-    for (int i = 0; i < 20; i++) {
-      vals_[i] = nullptr;
-    }
-
     va_start(arguments, n);
     for (int i = 0; i < n; i++) {
-      ensureSubArray(i);
-      String* val = va_arg(arguments, String*);
-      size_t parentIndex = getParentIndex(i);
-      int subIndex = getChildIndex(i);
-      vals_[parentIndex][subIndex] = val;
+      vals_.push_back(va_arg(arguments, String*));
     }
     va_end(arguments);
   }
@@ -508,70 +839,84 @@ class StringColumn : public Column {
     return 'S';
   }
 
-  /**Ensures the smaller subarray is large enough/instantiated. */
-  void ensureSubArray(size_t idx) {
-    size_t arrayIndex = getParentIndex(idx);
-    if (vals_[arrayIndex] == nullptr) {
-      int count = (int)pow(2, arrayIndex);
-      vals_[arrayIndex] = new String*[count];
-    }
-  }
-
   /** Gets value at idx*/
-  String* get(size_t idx) {
-    ensureSubArray(idx);
-    return vals_[getParentIndex(idx)][getChildIndex(idx)];
+  virtual String* get(size_t idx) {
+    return vals_.get(idx);
   }
 
   StringColumn* as_string() {
     return this;
   }
 
+  /** View of the value at idx, a nullptr view for a nullptr or missing
+   *  value. Does not allocate. */
+  virtual StringView get_view(size_t idx) {
+    return is_missing(idx) ? StringView() : StringView(get(idx));
+  }
+
+  /** Returns this column as a dictionary encoded column, or nullptr if its
+   *  strings are stored plainly. */
+  virtual DictStringColumn* as_dict() {
+    return nullptr;
+  }
+
   /** Set value at idx. An out of bound idx is undefined.  */
-  void set(size_t idx, String* val) {
-    ensureSubArray(idx);
-    if (idx >= len_) {
-      for (size_t i = len_; i < idx; i++) {
-        ensureSubArray(i);
-        vals_[getParentIndex(i)][getChildIndex(i)] = nullptr;
-      }
-      len_ = idx + 1;
-    }
-    vals_[getParentIndex(idx)][getChildIndex(idx)] = val;
+  virtual void set(size_t idx, String* val) {
+    note_set(idx);
+    vals_.set(idx, val);
   }
 
   void push_back(String* val) {
-    ensureSubArray(len_);
-    vals_[getParentIndex(len_)][getChildIndex(len_)] = val;
-    len_++;
+    set(size(), val);
+  }
+
+  /** Set value at idx to the len bytes at s. A plain column stores them in
+   *  a new String, external like any other value. */
+  virtual void set_chars(size_t idx, const char* s, size_t len) {
+    set(idx, new String(s, len));
+  }
+
+  void set_missing(size_t idx) {
+    set(idx, nullptr);
+    note_missing(idx);
+  }
+
+  /** Contiguous values of chunk c, valid for chunk_length(c) elements.
+   *  Only plainly stored columns have String* chunks. */
+  String** chunk(size_t c) {
+    return vals_.chunk(c);
   }
 
   size_t size() {
-    return len_;
+    return vals_.size();
   }
 
   StringColumn* clone() {
     StringColumn* newColumn = new StringColumn();
-    for (size_t i = 0; i < len_; i++) {
-      newColumn->push_back(vals_[getParentIndex(i)][getChildIndex(i)]->clone());
+    for (size_t c = 0; c < chunk_count(); c++) {
+      String** vals = chunk(c);
+      for (size_t i = 0; i < chunk_length(c); i++) {
+        newColumn->push_back(vals[i] == nullptr ? nullptr : vals[i]->clone());
+      }
     }
+    newColumn->copy_validity(this);
     return newColumn;
   }
 
   void print(size_t i) {
-    if (i < len_) {
-      String* outVal = vals_[getParentIndex(i)][getChildIndex(i)];
-      if (outVal != nullptr) {
-        std::cout << outVal->c_str();
+    if (i < size()) {
+      StringView outVal = get_view(i);
+      if (!outVal.is_null()) {
+        std::cout.write(outVal.c_str(), outVal.size());
       }
     }
   }
 
   void print() {
-    for (size_t i = 0; i < len_; i++) {
-      String* outVal = vals_[getParentIndex(i)][getChildIndex(i)];
-      if (outVal != nullptr) {
-        std::cout << outVal->c_str() << std::endl;
+    for (size_t i = 0; i < size(); i++) {
+      StringView outVal = get_view(i);
+      if (!outVal.is_null()) {
+        std::cout.write(outVal.c_str(), outVal.size()) << std::endl;
       } else {
         std::cout << "[nullptr]" << std::endl;
       }
@@ -583,13 +928,225 @@ class StringColumn : public Column {
     StringColumn* otherCol = dynamic_cast<StringColumn*>(other);
     if (otherCol == nullptr) return false;
     if (size() != otherCol->size()) return false;
+    if (!same_validity(otherCol)) return false;
+    for (size_t i = 0; i < size(); i++) {
+      if (!get_view(i).equals(otherCol->get_view(i))) return false;
+    }
+    return true;
+  }
+
+  ~StringColumn() { }
+};
+
+/*************************************************************************
+ * NumericColumn::
+ * Holds values of a fixed width numeric type T, reported as type TYPE:
+ * ByteColumn 'Y' (int8), ShortColumn 'H' (int16), LongColumn 'L' (int64)
+ * and FloatColumn 'F' (float32). Values can be read widened through
+ * get_numeric and, for integers, get_integer.
+ */
+template <typename T, char TYPE>
+class NumericColumn : public Column, public Serializable {
+  public:
+    ChunkedArray<T> vals_;
+    ZoneMap<T> zones_;
+
+  NumericColumn() { }
+
+  char get_type() {
+    return TYPE;
+  }
+
+  /** Gets value at idx*/
+  T get(size_t idx) {
+    return vals_.get(idx);
+  }
+
+  /** Set value at idx. An out of bound idx is undefined.  */
+  void set(size_t idx, T val) {
+    note_set(idx);
+    vals_.set(idx, val);
+    zones_.record(idx, val);
+  }
+
+  void push_back(T val) {
+    set(size(), val);
+  }
+
+  void set_missing(size_t idx) {
+    note_set(idx);
+    vals_.set(idx, 0);
+    note_missing(idx);
+  }
+
+  double get_numeric(size_t idx) {
+    return get(idx);
+  }
+
+  int64_t get_integer(size_t idx) {
+    return (int64_t)get(idx);
+  }
+
+  bool chunk_overlaps(size_t c, double lo, double hi) {
+    return zones_.overlaps(c, lo, hi);
+  }
+
+  bool value_range(double& lo, double& hi) {
+    return zones_.range(lo, hi);
+  }
+
+  /** Contiguous values of chunk c, valid for chunk_length(c) elements */
+  T* chunk(size_t c) {
+    return vals_.chunk(c);
+  }
+
+  size_t size() {
+    return vals_.size();
+  }
+
+  NumericColumn* clone() {
+    NumericColumn* newColumn = new NumericColumn();
+    for (size_t c = 0; c < chunk_count(); c++) {
+      T* vals = chunk(c);
+      for (size_t i = 0; i < chunk_length(c); i++) {
+        newColumn->push_back(vals[i]);
+      }
+    }
+    newColumn->copy_validity(this);
+    return newColumn;
+  }
+
+  void print(size_t i) {
+    if (i < size() && !is_missing(i)) {
+      std::cout << +get(i);
+    }
+  }
+
+  void print() {
     for (size_t i = 0; i < size(); i++) {
-      if (!get(i)->equals(otherCol->get(i))) return false;
+      if (!is_missing(i)) {
+        std::cout << +get(i) << std::endl;
+      } else {
+        std::cout << "[NULL]" << std::endl;
+      }
+    }
+  }
+
+  bool equals(Object  * other) {
+    if (this == other) return true;
+    NumericColumn* otherCol = dynamic_cast<NumericColumn*>(other);
+    if (otherCol == nullptr) return false;
+    if (size() != otherCol->size()) return false;
+    if (!same_validity(otherCol)) return false;
+    for (size_t c = 0; c < chunk_count(); c++) {
+      if (memcmp(chunk(c), otherCol->chunk(c), chunk_length(c) * sizeof(T)) != 0) return false;
     }
     return true;
   }
 
-  ~StringColumn() {
-    delete[] vals_;
+  /** Serializes the values followed by the zone map, see write_values */
+  size_t serial_size() {
+    return values_size(vals_, zones_);
+  }
+
+  void write_to(BufferWriter& writer) {
+    write_values(writer, vals_, zones_);
+  }
+
+  /** Reads the values at the reader's cursor into this empty column */
+  void read_from(BufferReader& reader) {
+    read_values(reader, vals_, zones_);
+  }
+
+  void borrow(BufferReader& reader) {
+    read_values(reader, vals_, zones_, true);
   }
-};
\ No newline at end of file
+
+  ~NumericColumn() { }
+};
+
+inline ByteColumn* Column::as_byte() {
+  return dynamic_cast<ByteColumn*>(this);
+}
+inline ShortColumn* Column::as_short() {
+  return dynamic_cast<ShortColumn*>(this);
+}
+inline LongColumn* Column::as_long() {
+  return dynamic_cast<LongColumn*>(this);
+}
+inline FloatColumn* Column::as_float() {
+  return dynamic_cast<FloatColumn*>(this);
+}
+
+/** Is type one of the integer column types 'Y', 'H', 'I' or 'L'? */
+inline bool is_integer_type(char type) {
+  return type == 'Y' || type == 'H' || type == 'I' || type == 'L';
+}
+
+/** Is type one of the integer or floating point types? */
+inline bool is_numeric_type(char type) {
+  return is_integer_type(type) || type == 'F' || type == 'D';
+}
+
+/** Reads the n values of integer column col from start as int64s. Sealed
+ *  int chunks are decoded once each. */
+inline void read_integers(Column* col, size_t start, size_t n, int64_t* out) {
+  IntColumn* ints = col->as_int();
+  int* scratch = ints != nullptr ? new int[CHUNK_SIZE] : nullptr;
+  size_t i = start;
+  while (i < start + n) {
+    size_t c = i >> CHUNK_SHIFT;
+    size_t off = i & CHUNK_MASK;
+    size_t len = std::min(CHUNK_SIZE - off, start + n - i);
+    int64_t* dst = out + (i - start);
+    switch (col->get_type()) {
+      case 'I': {
+        int* vals = ints->read_chunk(c, scratch) + off;
+        for (size_t k = 0; k < len; k++) dst[k] = vals[k];
+        break;
+      }
+      case 'Y': {
+        int8_t* vals = col->as_byte()->chunk(c) + off;
+        for (size_t k = 0; k < len; k++) dst[k] = vals[k];
+        break;
+      }
+      case 'H': {
+        int16_t* vals = col->as_short()->chunk(c) + off;
+        for (size_t k = 0; k < len; k++) dst[k] = vals[k];
+        break;
+      }
+      case 'L':
+        memcpy(dst, col->as_long()->chunk(c) + off, len * sizeof(int64_t));
+        break;
+      default:
+        assert("Column is not an integer column." && false);
+    }
+    i += len;
+  }
+  delete[] scratch;
+}
+
+/** A new empty column of the given type */
+inline Column* make_column(char type) {
+  switch (type) {
+  case 'B':
+    return new BoolColumn();
+  case 'Y':
+    return new ByteColumn();
+  case 'H':
+    return new ShortColumn();
+  case 'I':
+    return new IntColumn();
+  case 'L':
+    return new LongColumn();
+  case 'F':
+    return new FloatColumn();
+  case 'D':
+    return new DoubleColumn();
+  case 'S':
+    return new StringColumn();
+  default:
+    assert("Type other than B, Y, H, I, L, F, D or S found." && false);
+  }
+  return nullptr;
+}
@@ -2,8 +2,13 @@
 #pragma once
 
 #include "column.h"
+#include "dictionary.h"
+#include "arena.h"
 #include "row.h"
 #include "rower.h"
+#include "batch.h"
+#include "aggregate.h"
+#include "sort.h"
 #include "schema.h"
 #include "../serial/serial.h"
 #include "../serial/array.h"
@@ -15,6 +20,7 @@
 #include <functional>
 #include <string>
 #include "visitor.h"
+#include "../threadpool.h"
 
 //KVStore
 #include "../map.h"
@@ -33,9 +39,12 @@
 #include <sys/time.h>
 #include <sys/ioctl.h>
 #include <vector>
+#include <deque>
+#include <map>
 
-#define MAX_THREADS 8
-#define MIN_LINES 1000
+/** Rows per task of parallel traversals, a whole chunk so batches of a
+ *  task never share a chunk with another task */
+#define MORSEL_ROWS CHUNK_SIZE
 #define DEBUG false
 
 #define BUFF_SIZE 1024
@@ -43,6 +52,8 @@
 
 //Forward declaration for KVStore
 class DataFrame;
+class DataFrameView;
+template <typename D> class Expr;
 
 //Forward declaration so `put` can be used in DataFrame
 class KVStore : public Object {
@@ -52,6 +63,17 @@ public:
     NetworkConfig nconfig_;
     DataFrame* waitAndGetValue;
     vector<Get*>* getRequests;  
+    std::mutex storeLock; // guards kv_map_ and getRequests, messages are handled on the thread pool
+    std::mutex sendLock;  // keeps messages sent from different threads whole
+    BufferWriter sendBuffer_; // reused by every message sent to a neighbor, guarded by sendLock
+    /** Messages read from one connection and not yet handled. They are
+     *  handled on the thread pool one at a time, in the order they came. */
+    struct Inbox {
+        std::deque<std::pair<unsigned char*, size_t>> msgs_; // each with its length
+        bool draining_ = false; // a pool task is handling them
+    };
+    std::mutex inboxLock_;
+    std::map<int, Inbox> inboxes_; // by connection, guarded by inboxLock_
     KVStore();
     ~KVStore();
     bool containsKey(Key *k);
@@ -66,22 +88,26 @@ public:
     void registerWithServer();
     void initializePeerToPeer();
     void listenToNeighbors();
-    unsigned char* readIncomingNodeMsg(int fd);
+    unsigned char* readIncomingNodeMsg(int fd, size_t& length);
     void handleDisconnect(int fd);
-    void handleNodeMsg(int fd, unsigned char* msg);
+    void handleNodeMsg(int fd, unsigned char* msg, size_t length);
+    void queueNodeMsg(int fd, unsigned char* msg, size_t length);
+    void drainInbox(int fd);
     void sendToNeighbor(int fd, unsigned char* msg);
     void sendToNeighbor(int fd, unsigned char* msg, const char* debug);
-    void handleStatus(int fd, unsigned char* msg);
-    void handlePut(int fd, unsigned char* msg);
-    void handleGet(int fd, unsigned char* msg);
+    void sendToNeighbor(int fd, Message* msg);
+    void sendToNeighbor(int fd, Message* msg, const char* debug);
+    void handleStatus(int fd, unsigned char* msg, size_t length);
+    void handlePut(int fd, unsigned char* msg, size_t length);
+    void handleGet(int fd, unsigned char* msg, size_t length);
     void updateRequests();
-    void handleResult(int fd, unsigned char* msg);
+    void handleResult(int fd, unsigned char* msg, size_t length);
     void listenToServer();
-    void handleIncoming(unsigned char* data);
+    void handleIncoming(unsigned char* data, size_t length);
     void shutdown();
     void closeNodeConnections();
     void closeServerConnection();
-    void updateConnections(unsigned char* data);
+    void updateConnections(unsigned char* data, size_t length);
     void createNeighborConnections();
     void greetAllNeighbors();
     void handleAck(Ack* ack);
@@ -104,6 +130,7 @@ public:
     Schema *schema;
     size_t col_cap;
     Column **columns;
+    Value *value_ = nullptr; // retained; blob the columns of a frame read from the store live in
 
     DataFrame() {
 
@@ -116,22 +143,7 @@ public:
         col_cap = df.col_cap;
         columns = new Column *[col_cap];
         for (int i = 0; i < schema->width(); i++) {
-            switch (schema->type(i)) {
-            case 'B':
-                columns[i] = new BoolColumn();
-                break;
-            case 'I':
-                columns[i] = new IntColumn();
-                break;
-            case 'S':
-                columns[i] = new StringColumn();
-                break;
-            case 'D':
-                columns[i] = new DoubleColumn();
-                break;
-            default:
-                assert("Type other than B, I, F, or S found." && false);
-            }
+            columns[i] = make_column(schema->type(i));
         }
     }
 
@@ -143,23 +155,7 @@ public:
         columns = new Column *[col_cap];
         for (int i = 0; i < schema->width(); i++)
         {
-            switch (schema->type(i))
-            {
-            case 'B':
-                columns[i] = new BoolColumn();
-                break;
-            case 'I':
-                columns[i] = new IntColumn();
-                break;
-            case 'S':
-                columns[i] = new StringColumn();
-                break;
-            case 'D':
-                columns[i] = new DoubleColumn();
-                break;
-            default:
-                assert("Type other than B, I, F, or S found." && false);
-            }
+            columns[i] = make_column(schema->type(i));
         }
     }
 
@@ -167,6 +163,29 @@ public:
         deserialize(serial);
     }
 
+    /** Creates a read-only frame over the blob of value. The columns are
+    * decoded by the first frame over value, with their numeric values left
+    * in the blob, and shared by every later one, so reading a value again
+    * costs a column directory. The blob stays alive until the last frame
+    * over it is deleted. Writing to the frame is undefined. */
+    DataFrame(Value *value) {
+        DataFrame *shared;
+        {
+            std::lock_guard<std::mutex> guard(value->frameLock_);
+            if (value->frame_ == nullptr) {
+                shared = new DataFrame();
+                shared->deserialize(value->blob_, value->blob_length_, true);
+                value->frame_ = shared;
+            }
+            shared = dynamic_cast<DataFrame *>(value->frame_);
+        }
+        schema = shared->schema;
+        col_cap = shared->col_cap;
+        columns = new Column *[col_cap];
+        for (size_t i = 0; i < schema->width(); i++) columns[i] = shared->columns[i];
+        value_ = value->retain();
+    }
+
     /** Returns the dataframe's schema. Modifying the schema after a dataframe
     * has been created in undefined. */
     Schema &get_schema() {
@@ -196,6 +215,7 @@ public:
             addCol = col->as_string()->clone();
             break;
         default:
+            addCol = dynamic_cast<Column *>(col->clone());
             break;
         }
         ensureColumnCapacity();
@@ -232,16 +252,28 @@ public:
     /** Return the value at the given column and row. Accessing rows or
    *  columns out of bounds, or request the wrong type is undefined.*/
     virtual int get_int(size_t col, size_t row) {
-        checkIndices(col, row, 'I');
-        return columns[col]->as_int()->get(row);
+        checkIndices(col, row, "YHI");
+        if (schema->type(col) == 'I') return columns[col]->as_int()->get(row);
+        return columns[col]->get_integer(row);
+    }
+    /** Any integer column, widened to 64 bits */
+    virtual int64_t get_long(size_t col, size_t row) {
+        checkIndices(col, row, "YHIL");
+        return columns[col]->get_integer(row);
+    }
+    virtual float get_float(size_t col, size_t row) {
+        checkIndices(col, row, 'F');
+        return columns[col]->as_float()->get(row);
     }
     virtual bool get_bool(size_t col, size_t row) {
         checkIndices(col, row, 'B');
         return columns[col]->as_bool()->get(row);
     }
+    /** A double or float column, widened to a double */
     virtual double get_double(size_t col, size_t row) {
-        checkIndices(col, row, 'D');
-        return columns[col]->as_double()->get(row);
+        checkIndices(col, row, "FD");
+        if (schema->type(col) == 'D') return columns[col]->as_double()->get(row);
+        return columns[col]->get_numeric(row);
     }
     virtual String *get_string(size_t col, size_t row) {
         checkIndices(col, row, 'S');
@@ -252,6 +284,10 @@ public:
     * If the column is not  of the right type or the indices are out of
     * bound, the result is undefined. */
     virtual void set(size_t col, size_t row, int val) {
+        if (schema->type(col) != 'I') {
+            set(col, row, (int64_t)val);
+            return;
+        }
         checkIndices(col, row, 'I');
         schema->new_length(row);
         IntColumn *column = columns[col]->as_int();
@@ -261,6 +297,32 @@ public:
             column->set(row, val);
         }
     }
+    /** Sets a value in any integer column. The value must fit the column. */
+    virtual void set(size_t col, size_t row, int64_t val) {
+        checkIndices(col, row, "YHIL");
+        schema->new_length(row);
+        switch (schema->type(col)) {
+        case 'Y':
+            if (val != (int8_t)val) assert("Value does not fit an int8 column." && false);
+            columns[col]->as_byte()->set(row, (int8_t)val);
+            break;
+        case 'H':
+            if (val != (int16_t)val) assert("Value does not fit an int16 column." && false);
+            columns[col]->as_short()->set(row, (int16_t)val);
+            break;
+        case 'I':
+            if (val != (int)val) assert("Value does not fit an int column." && false);
+            columns[col]->as_int()->set(row, (int)val);
+            break;
+        default:
+            columns[col]->as_long()->set(row, val);
+        }
+    }
+    virtual void set(size_t col, size_t row, float val) {
+        checkIndices(col, row, 'F');
+        schema->new_length(row);
+        columns[col]->as_float()->set(row, val);
+    }
     virtual void set(size_t col, size_t row, bool val) {
         if (DEBUG) printf("in set for bool\n");
         checkIndices(col, row, 'B');
@@ -279,6 +341,10 @@ public:
         fflush(stdout);
     }
     virtual void set(size_t col, size_t row, double val) {
+        if (schema->type(col) == 'F') {
+            set(col, row, (float)val);
+            return;
+        }
         checkIndices(col, row, 'D');
         schema->new_length(row);
         DoubleColumn *column = columns[col]->as_double();
@@ -299,6 +365,92 @@ public:
         }
     }
 
+    /** Sets a string value from len bytes at s, letting the column store
+     *  them without an intermediate String */
+    virtual void set_chars(size_t col, size_t row, const char *s, size_t len) {
+        checkIndices(col, row, 'S');
+        schema->new_length(row);
+        columns[col]->as_string()->set_chars(row, s, len);
+    }
+
+    /** Converts column col to the wider numeric type, keeping its values
+     *  and missing slots. Used when a value outgrows the inferred type. */
+    void widen_column(size_t col, char type) {
+        Column *old = columns[col];
+        columns[col] = make_column(type);
+        schema->types[col] = type;
+        for (size_t i = 0; i < old->size(); i++) {
+            if (old->is_missing(i)) {
+                columns[col]->set_missing(i);
+            } else if (is_integer_type(type)) {
+                set(col, i, old->get_integer(i));
+            } else {
+                set(col, i, old->get_numeric(i));
+            }
+        }
+        delete old;
+    }
+
+    /** Stores a missing value at the given column and row. */
+    virtual void set_missing(size_t col, size_t row) {
+        if (col >= schema->n_col) {
+            assert("Index out of bounds." && false);
+        }
+        schema->new_length(row);
+        columns[col]->set_missing(row);
+    }
+
+    /** Is the value at the given column and row missing? */
+    virtual bool is_missing(size_t col, size_t row) {
+        if (col >= schema->n_col) {
+            assert("Index out of bounds." && false);
+        }
+        return columns[col]->is_missing(row);
+    }
+
+    /** Number of missing values in the given column */
+    virtual size_t null_count(size_t col) {
+        return columns[col]->null_count();
+    }
+
+    /** Aggregates of the present values of a numeric or bool column, bools
+    * counting as 0 and 1. Chunks are reduced with vector kernels, in
+    * parallel on the shared thread pool for long columns. */
+    virtual double sum(size_t col) {
+        return column_moments(columns[col], MOMENT_SUM).sum_;
+    }
+
+    /** Number of present values in the given column */
+    virtual size_t count(size_t col) {
+        return columns[col]->size() - columns[col]->null_count();
+    }
+
+    virtual double mean(size_t col) {
+        return column_moments(columns[col], MOMENT_SUM).mean();
+    }
+
+    /** Smallest present value, 0 when there is none */
+    virtual double minimum(size_t col) {
+        return column_moments(columns[col], MOMENT_RANGE).lo_;
+    }
+
+    /** Largest present value, 0 when there is none */
+    virtual double maximum(size_t col) {
+        return column_moments(columns[col], MOMENT_RANGE).hi_;
+    }
+
+    /** Population variance of the present values, 0 when there is none */
+    virtual double variance(size_t col) {
+        Moments m = column_moments(columns[col], MOMENT_SPREAD);
+        return m.n_ == 0 ? 0 : m.m2_ / m.n_;
+    }
+
+    /** Sum over rows of the products of two numeric columns, missing
+    * values counting as 0 */
+    virtual double dot(size_t a, size_t b) {
+        return column_dot(columns[a], columns[b]);
+    }
+
     /** Ensures the value requested matches the schema and is in the DF's bounds */
     void checkIndices(size_t col, size_t row, char type) {
         if (col >= schema->n_col) {
@@ -308,14 +460,27 @@ public:
         }
     }
 
+    /** Like checkIndices, for a value that may be of any of the given types */
+    void checkIndices(size_t col, size_t row, const char *types) {
+        if (col >= schema->n_col) {
+            assert("Index out of bounds." && false);
+        } else if (strchr(types, schema->type(col)) == nullptr) {
+            assert("Type mismatch." && false);
+        }
+    }
+
     /** Set the fields of the given row object with values from the columns at
     * the given offset.  If the row is not form the same schema as the
     * dataframe, results are undefined.
     */
-    void fill_row(size_t idx, Row &row) {
+    virtual void fill_row(size_t idx, Row &row) {
         if (matchingSchema(row)) {
             row.set_idx(idx);
             for (size_t i = 0; i < ncols(); i++) {
+                if (columns[i]->is_missing(idx)) {
+                    row.set_missing(i);
+                    continue;
+                }
                 char type = columns[i]->get_type();
                 switch (type) {
                 case 'I':
@@ -342,6 +507,16 @@ public:
                     row.set(i, sCol->get(idx));
                     break;
                 }
+                case 'Y':
+                case 'H':
+                    row.set(i, (int)columns[i]->get_integer(idx));
+                    break;
+                case 'L':
+                    row.set(i, columns[i]->get_integer(idx));
+                    break;
+                case 'F':
+                    row.set(i, columns[i]->as_float()->get(idx));
+                    break;
                 default:
                     assert("Invalid operation." && false);
                 }
@@ -349,6 +524,136 @@ public:
         }
     }
 
+    /** Appends the n rows of this dataframe listed in rows to dest, a
+    * dataframe with the same schema. Copies a whole column at a time, the
+    * columns in parallel on the thread pool when there are many rows. */
+    void append_selected(DataFrame *dest, const size_t *rows, size_t n) {
+        if (n == 0) return;
+        size_t base = dest->nrows();
+        auto copy = [&](size_t i) { append_column(columns[i], dest->columns[i], rows, n, base); };
+        if (n < MORSEL_ROWS) {
+            for (size_t i = 0; i < ncols(); i++) copy(i);
+        } else {
+            ThreadPool::shared().parallel_for(ncols(), copy);
+        }
+        dest->schema->new_length(base + n - 1);
+    }
+
+    /** The order of the rows sorted by the columns in cols, the first one
+    * deciding, then the next for ties and so on. ascending says the
+    * direction of each column; when it is shorter every other column is
+    * ascending. Ties keep their order and missing values come last. */
+    virtual std::vector<size_t> sort_order(const std::vector<size_t> &cols, const std::vector<bool> &ascending) {
+        std::vector<size_t> perm(nrows());
+        for (size_t i = 0; i < perm.size(); i++) perm[i] = i;
+        for (size_t k = cols.size(); k-- > 0;) {
+            sort_by_column(perm, columns[cols[k]], k >= ascending.size() || ascending[k]);
+        }
+        return perm;
+    }
+
+    /** A new dataframe holding the rows sorted by sort_order */
+    virtual DataFrame *sort_by(const std::vector<size_t> &cols, const std::vector<bool> &ascending) {
+        std::vector<size_t> perm = sort_order(cols, ascending);
+        return permuted(perm);
+    }
+
+    /** A new dataframe holding the rows listed in perm, in that order.
+    * Copies a column at a time, in parallel for many rows. */
+    DataFrame *permuted(std::vector<size_t> &perm) {
+        DataFrame *out = new DataFrame(*this);
+        size_t n = perm.size();
+        if (n == 0) return out;
+        auto copy = [&](size_t i) {
+            Column *from = columns[i];
+            if (from->as_int() == nullptr) {
+                append_column(from, out->columns[i], perm.data(), n, 0);
+                return;
+            }
+            //sealed chunks would be decoded again for every row out of order
+            std::vector<int64_t> vals(from->size());
+            read_integers(from, 0, vals.size(), vals.data());
+            IntColumn *to = out->columns[i]->as_int();
+            for (size_t k = 0; k < n; k++) {
+                if (from->is_missing(perm[k])) to->set_missing(k);
+                else to->set(k, (int)vals[perm[k]]);
+            }
+        };
+        if (n < MORSEL_ROWS) {
+            for (size_t i = 0; i < ncols(); i++) copy(i);
+        } else {
+            ThreadPool::shared().parallel_for(ncols(), copy);
+        }
+        out->schema->new_length(n - 1);
+        return out;
+    }
+
+    /** Sets to[base + k] to from[rows[k]] for k below n, columns of one type */
+    static void append_column(Column *from, Column *to, const size_t *rows, size_t n, size_t base) {
+        switch (from->get_type()) {
+        case 'B':
+            append_values(from->as_bool(), to->as_bool(), rows, n, base);
+            break;
+        case 'Y':
+            append_values(from->as_byte(), to->as_byte(), rows, n, base);
+            break;
+        case 'H':
+            append_values(from->as_short(), to->as_short(), rows, n, base);
+            break;
+        case 'L':
+            append_values(from->as_long(), to->as_long(), rows, n, base);
+            break;
+        case 'F':
+            append_values(from->as_float(), to->as_float(), rows, n, base);
+            break;
+        case 'D':
+            append_values(from->as_double(), to->as_double(), rows, n, base);
+            break;
+        case 'I': {
+            //each sealed chunk is decoded once, by the first row read from
+            //it, so rows in any order, as a join's are, cost one pass
+            IntColumn *src = from->as_int();
+            IntColumn *dst = to->as_int();
+            std::vector<int *> vals(src->chunk_count(), nullptr);
+            std::vector<int *> scratch;
+            for (size_t k = 0; k < n; k++) {
+                size_t c = rows[k] >> CHUNK_SHIFT;
+                if (vals[c] == nullptr) {
+                    if (src->is_sealed(c)) scratch.push_back(new int[CHUNK_SIZE]);
+                    vals[c] = src->read_chunk(c, src->is_sealed(c) ? scratch.back() : nullptr);
+                }
+                dst->set(base + k, vals[c][rows[k] & CHUNK_MASK]);
+            }
+            for (size_t s = 0; s < scratch.size(); s++) delete[] scratch[s];
+            break;
+        }
+        case 'S': {
+            StringColumn *src = from->as_string();
+            StringColumn *dst = to->as_string();
+            for (size_t k = 0; k < n; k++) {
+                StringView val = src->get_view(rows[k]);
+                if (val.is_null()) {
+                    dst->set(base + k, nullptr);
+                } else {
+                    dst->set_chars(base + k, val.c_str(), val.size());
+                }
+            }
+            break;
+        }
+        default:
+            assert("Invalid operation." && false);
+        }
+        if (from->validity_words() == nullptr) return;
+        for (size_t k = 0; k < n; k++) {
+            if (from->is_missing(rows[k])) to->set_missing(base + k);
+        }
+    }
+
+    template <class C>
+    static void append_values(C *from, C *to, const size_t *rows, size_t n, size_t base) {
+        for (size_t k = 0; k < n; k++) to->set(base + k, from->get(rows[k]));
+    }
+
     /** Add a row at the end of this dataframe. The row is expected to have
    *  the right schema and be filled with values, otherwise undedined.  */
     void add_row(Row &row)
@@ -369,6 +674,10 @@ public:
             schema->new_length(idx);
             //Load data into columns
             for (size_t i = 0; i < row.width(); i++) {
+                if (row.is_missing(i)) {
+                    columns[i]->set_missing(idx);
+                    continue;
+                }
                 char type = schema->type(i);
                 switch (type)
                 {
@@ -389,9 +698,27 @@ public:
                 }
                 case 'S':
                 {
-                    columns[i]->as_string()->set(idx, row.get_string(i));
+                    //the row's string is external, the column stores a copy
+                    String *val = row.get_string(i);
+                    if (val == nullptr) {
+                        columns[i]->as_string()->set(idx, nullptr);
+                    } else {
+                        columns[i]->as_string()->set_chars(idx, val->c_str(), val->size());
+                    }
                     break;
                 }
+                case 'Y':
+                    columns[i]->as_byte()->set(idx, (int8_t)row.get_int(i));
+                    break;
+                case 'H':
+                    columns[i]->as_short()->set(idx, (int16_t)row.get_int(i));
+                    break;
+                case 'L':
+                    columns[i]->as_long()->set(idx, row.get_long(i));
+                    break;
+                case 'F':
+                    columns[i]->as_float()->set(idx, row.get_float(i));
+                    break;
                 default:
                     assert("Invalid type. Program terminated." && false);
                 }
@@ -415,10 +742,16 @@ public:
         return schema->width();
     }
 
-    /** Visit rows in order */
-    void map(Rower &r) {
+    /** Visit rows in order. Batch rowers are shown the rows a chunk at
+    * a time. */
+    virtual void map(Rower &r) {
+        BatchRower *b = r.as_batch();
+        if (b != nullptr) {
+            map_batches(0, nrows(), *b);
+            return;
+        }
+        Row newRow(get_schema());
         for (size_t i = 0; i < nrows(); i++) {
-            Row newRow(get_schema());
             fill_row(i, newRow);
             r.accept(newRow);
         }
@@ -426,71 +759,211 @@ public:
 
     //this method kept throwing errors when attempting to use for the first and last halves.
     void pmapRange(size_t start, size_t end, Rower *r) {
+        BatchRower *b = r->as_batch();
+        if (b != nullptr) {
+            map_batches(start, end, *b);
+            return;
+        }
+        Row newRow(get_schema());
         for (size_t i = start; i < end; i++) {
-            Row newRow(get_schema());
             fill_row(i, newRow);
             r->accept(newRow);
         }
     }
 
-    void pmap(Rower &r) {
-        size_t threadCount = nrows() / MIN_LINES;
-        if (threadCount <= 1) {
+    /** Visit rows in parallel on the shared thread pool, a morsel of
+    * MORSEL_ROWS rows at a time. Every task works on its own clone of r;
+    * the clones are joined into r at the end. */
+    virtual void pmap(Rower &r) {
+        size_t morsels = (nrows() + MORSEL_ROWS - 1) / MORSEL_ROWS;
+        if (morsels <= 1) {
             map(r);
-        } else {
-            threadCount = (threadCount > MAX_THREADS) ? MAX_THREADS : threadCount;
-            size_t rowsPerThread = nrows() / threadCount;
-
-            Rower **rowers = new Rower *[threadCount];
-            rowers[0] = &r;
-            for (int i = 1; i < threadCount; i++) {
-                rowers[i] = static_cast<Rower *>(r.clone());
-            }
-
-            std::thread *threads[threadCount];
-            int startingValue = 0;
-            int endValue = 0;
-            for (int i = 0; i < threadCount; i++) {
-                if (threadCount - i == 1) {
-                    endValue = nrows();
-                } else {
-                    endValue = startingValue + rowsPerThread;
-                }
-                threads[i] = new std::thread(&DataFrame::pmapRange, this, startingValue, endValue, rowers[i]);
-                startingValue = endValue;
-            }
+            return;
+        }
+        run_morsels(r, morsels, [&](Rower &mine, size_t m) {
+            size_t start = m * MORSEL_ROWS;
+            pmapRange(start, std::min(start + MORSEL_ROWS, nrows()), &mine);
+        });
+    }
 
-            for (int i = 0; i < threadCount; ++i) {
-                threads[i]->join();
+    /** Calls f(rower, m) for every morsel m below morsels on the shared
+    * thread pool. One task per worker, and one for the caller, takes a
+    * contiguous range of morsels and runs them in order, passing its own
+    * clone of r. The clones belong to tasks rather than threads: a thread
+    * may run tasks of other calls, or of this one, while it waits in a
+    * parallel_for, and no two tasks share a clone. The clones are joined
+    * into r at the end in the order of their ranges, so a rower sees its
+    * rows in order as long as its join appends. */
+    static void run_morsels(Rower &r, size_t morsels, std::function<void(Rower &, size_t)> f) {
+        ThreadPool &pool = ThreadPool::shared();
+        size_t tasks = std::min(morsels, pool.size() + 1);
+        Rower **rowers = new Rower *[tasks]();
+        pool.parallel_for(tasks, [&](size_t t) {
+            size_t end = morsels * (t + 1) / tasks;
+            for (size_t m = morsels * t / tasks; m < end; m++) {
+                if (rowers[t] == nullptr) rowers[t] = static_cast<Rower *>(r.clone());
+                f(*rowers[t], m);
             }
+        });
+        for (size_t t = 0; t < tasks; t++) {
+            if (rowers[t] != nullptr) r.join_delete(rowers[t]);
+        }
+        delete[] rowers;
+    }
 
-            for (int i = 1; i < threadCount; i++) {
-                rowers[0]->join_delete(rowers[i]);
-            }
+    /** Shows b the rows in [start, end), one batch per chunk they touch */
+    void map_batches(size_t start, size_t end, BatchRower &b) {
+        Batch batch(columns, ncols());
+        for_each_batch(start, end, batch, [&]() { b.accept(batch); });
+    }
 
-            for (int i = 0; i < threadCount; i++) {
-                delete threads[i];
-            }
+    /** Moves batch over [start, end) a chunk at a time, calling f() at
+    * each stop */
+    template <typename Fn>
+    void for_each_batch(size_t start, size_t end, Batch &batch, Fn f) {
+        size_t i = start;
+        while (i < end) {
+            size_t stop = ((i >> CHUNK_SHIFT) + 1) << CHUNK_SHIFT;
+            if (stop > end) stop = end;
+            batch.move(i, stop - i);
+            f();
+            i = stop;
+        }
+    }
 
-            delete[] rowers;
+    /** Moves batch over the n rows listed in rows, in increasing order, a
+    * chunk at a time. At each stop the batch selects the listed rows of its
+    * chunk and f() is called. */
+    template <typename Fn>
+    void for_each_listed(const size_t *rows, size_t n, Batch &batch, Fn f) {
+        size_t k = 0;
+        while (k < n) {
+            size_t start = rows[k] & ~(size_t)CHUNK_MASK;
+            batch.move(start, std::min(nrows() - start, (size_t)CHUNK_SIZE));
+            batch.select_none();
+            for (; k < n && rows[k] < start + CHUNK_SIZE; k++) batch.select(rows[k] - start);
+            f();
         }
     }
 
     /** Create a new dataframe, constructed from rows for which the given Rower
-    * returned true from its accept method. */
-    DataFrame *filter(Rower &r) {
+    * returned true from its accept method. A batch rower keeps rows by
+    * marking them on the batch. */
+    virtual DataFrame *filter(Rower &r) {
         DataFrame *newDataFrame = new DataFrame(*this);
-        int nr = nrows();
-        for (size_t i = 0; i < nr; i++) {
-            Row *newRow = new Row(*newDataFrame->schema);
-            fill_row(i, *newRow);
-            if (r.accept(*newRow)) {
-                newDataFrame->add_row(*newRow);
-            }
+        std::vector<size_t> sel;
+        select_rows(r, 0, nrows(), sel);
+        append_selected(newDataFrame, sel.data(), sel.size());
+        return newDataFrame;
+    }
+
+    /** Like filter, with the rows tested in parallel on the shared thread
+    * pool. Every morsel gets its own selection vector, tested by the clone
+    * of r of the thread running it; the selections are then concatenated
+    * and the kept rows copied a column at a time. The rower must not
+    * depend on the order it sees rows in. */
+    virtual DataFrame *pfilter(Rower &r) {
+        size_t morsels = (nrows() + MORSEL_ROWS - 1) / MORSEL_ROWS;
+        if (morsels <= 1) return filter(r);
+        std::vector<std::vector<size_t>> sels(morsels);
+        run_morsels(r, morsels, [&](Rower &mine, size_t m) {
+            size_t start = m * MORSEL_ROWS;
+            select_rows(mine, start, std::min(start + MORSEL_ROWS, nrows()), sels[m]);
+        });
+        std::vector<size_t> sel;
+        for (size_t m = 0; m < morsels; m++) sel.insert(sel.end(), sels[m].begin(), sels[m].end());
+        DataFrame *newDataFrame = new DataFrame(*this);
+        append_selected(newDataFrame, sel.data(), sel.size());
+        return newDataFrame;
+    }
+
+    /** Appends to sel, in order, the rows in [start, end) that r accepts */
+    void select_rows(Rower &r, size_t start, size_t end, std::vector<size_t> &sel) {
+        BatchRower *b = r.as_batch();
+        if (b != nullptr) {
+            Batch batch(columns, ncols());
+            for_each_batch(start, end, batch, [&]() {
+                b->accept(batch);
+                for (size_t i = 0; i < batch.size(); i++) {
+                    if (batch.kept(i)) sel.push_back(batch.start() + i);
+                }
+            });
+            return;
+        }
+        Row row(get_schema());
+        for (size_t i = start; i < end; i++) {
+            fill_row(i, row);
+            if (r.accept(row)) sel.push_back(i);
         }
+    }
+
+    /** Visit, in order, the rows whose value in the numeric column col
+    * lies in [lo, hi]. Chunks whose zone map rules the range out are
+    * skipped without being read. Missing values never match. */
+    virtual void map_where(size_t col, double lo, double hi, Rower &r) {
+        BatchRower *b = r.as_batch();
+        if (b != nullptr) {
+            //each chunk with matches becomes a batch selecting them
+            Batch batch(columns, ncols());
+            scan_where(col, lo, hi, [&](size_t i) {
+                if (batch.size() == 0 || (i >> CHUNK_SHIFT) != batch.chunk_) {
+                    if (batch.count() > 0) b->accept(batch);
+                    size_t start = i & ~(size_t)CHUNK_MASK;
+                    batch.move(start, std::min(nrows() - start, (size_t)CHUNK_SIZE));
+                    batch.select_none();
+                }
+                batch.select(i - batch.start());
+            });
+            if (batch.count() > 0) b->accept(batch);
+            return;
+        }
+        Row row(get_schema());
+        scan_where(col, lo, hi, [&](size_t i) {
+            fill_row(i, row);
+            r.accept(row);
+        });
+    }
+
+    /** Create a new dataframe of the rows whose value in the numeric column
+    * col lies in [lo, hi], skipping chunks using zone maps. */
+    virtual DataFrame *filter_where(size_t col, double lo, double hi) {
+        DataFrame *newDataFrame = new DataFrame(*this);
+        std::vector<size_t> sel;
+        scan_where(col, lo, hi, [&](size_t i) { sel.push_back(i); });
+        append_selected(newDataFrame, sel.data(), sel.size());
         return newDataFrame;
     }
 
+    /** Calls f(idx) for every row whose value in column col lies in
+    * [lo, hi], in order, skipping chunks whose zone map rules them out */
+    template <typename Fn>
+    void scan_where(size_t col, double lo, double hi, Fn f) {
+        Column *column = columns[col];
+        IntColumn *ints = column->as_int();
+        DoubleColumn *dbls = column->as_double();
+        int *scratch = ints != nullptr ? new int[CHUNK_SIZE] : nullptr;
+        for (size_t c = 0; c < column->chunk_count(); c++) {
+            if (!column->chunk_overlaps(c, lo, hi)) continue;
+            size_t start = c << CHUNK_SHIFT;
+            //sealed int chunks are decoded once for the whole chunk
+            int *ivals = ints != nullptr ? ints->read_chunk(c, scratch) : nullptr;
+            double *dvals = dbls != nullptr ? dbls->chunk(c) : nullptr;
+            column->for_each_valid(start, start + column->chunk_length(c), [&](size_t i) {
+                double val = ivals != nullptr ? ivals[i - start] :
+                             dvals != nullptr ? dvals[i - start] : column->get_numeric(i);
+                if (val >= lo && val <= hi) f(i);
+            });
+        }
+        delete[] scratch;
+    }
+
+    /** Encodes the chunks of every int column that shrink by it */
+    void seal() {
+        for (size_t i = 0; i < ncols(); i++) {
+            if (columns[i]->as_int() != nullptr) columns[i]->as_int()->seal();
+        }
+    }
+
     static DataFrame *fromArray(Key *key, KVStore *kv, size_t size, double *array) {
         String *schemaStr = new String("D");
         Schema *newSchema = new Schema(schemaStr->c_str());
@@ -507,6 +980,14 @@ public:
 
     static DataFrame *fromFile(const char* file, Key *key, KVStore kv); //implemented in sor file
 
+    /** A view of the rows for which the predicate holds */
+    template <typename P>
+    DataFrameView *where(const Expr<P> &pred); //implemented in expr file
+
+    /** A new dataframe with a column per expression */
+    template <typename... Es>
+    DataFrame *select(const Expr<Es> &... exprs); //implemented in expr file
+
     static DataFrame *fromScalar(Key *key, KVStore *kv, int value) {
         String *schemaStr = new String("I");
         Schema *newSchema = new Schema(schemaStr->c_str());
@@ -520,17 +1001,17 @@ public:
 
     static DataFrame *fromVisitor(Key *key, KVStore *kv, const char* type, Visitor* v) {
         Schema* newSchema = new Schema(type);
-        Row* r = new Row(*newSchema);
-        v->visit(*r);
+        Row r(*newSchema);
+        v->visit(r);
         DataFrame* newDf = new DataFrame(*newSchema);
-        newDf->add_row(*r);
+        newDf->add_row(r);
         unsigned char* serial = newDf->serialize();
         kv->put(*dynamic_cast<Key*>(key->clone()), serial, extract_size_t(serial, 0));
         return newDf;
     }
 
     /** Print the dataframe in SoR format to standard output. */
-    void print() {
+    virtual void print() {
         for (int i = 0; i < schema->length(); i++) {
             for (int j = 0; j < schema->width(); j++) {
                 cout << "<";
@@ -549,6 +1030,9 @@ public:
         DataFrame *x = dynamic_cast<DataFrame *>(other);
         if (x == nullptr)
             return false;
+        //views compare through their own rows
+        if (x->as_view() != nullptr)
+            return x->equals(this);
         if (!schema->equals(x->schema))
             return false;
         for (int i = 0; i < ncols(); i++) {
@@ -558,6 +1042,11 @@ public:
         return true;
     }
 
+    /** The view this dataframe is, nullptr when it holds its own columns */
+    virtual DataFrameView *as_view() {
+        return nullptr;
+    }
+
     /** Convenience printing method for debugging. */
     void debug_print() {
         cout << endl
@@ -572,112 +1061,229 @@ public:
              << "---------END SoR---------" << endl;
     }
 
-    unsigned char *serialize() {
-        size_t buffer_length = 100;
-        unsigned char *serial = new unsigned char[buffer_length];
-        unsigned char *schm = schema->serialize();
-        size_t index = 8 + 16 + schema->width() + 1;
-        copy_unsigned(serial + 8, schm, index - 8);
+    /** Serializes the dataframe, structure is as follows:
+    *
+    * |--8 bytes---------|--Unknown length--|--Unknown length each--|
+    * |--length in bytes-|--Schema----------|--column blocks--------|
+    */
+    size_t serial_size() {
+        size_t length = 8 + schema->serial_size();
         for (size_t i = 0; i < schema->width(); i++) {
-            if (schema->type(i) == 'S') {
-                StringArray *stra = new StringArray(columns[i]);
-                unsigned char *temp = stra->serialize();
-                size_t length = extract_size_t(temp, 0);
-
-                while (index + length >= buffer_length - 1) {
-                    unsigned char *temp = new unsigned char[buffer_length * 2];
-                    copy_unsigned(temp, serial, buffer_length);
-                    buffer_length *= 2;
-                    delete[] serial;
-                    serial = temp;
-                }
+            length += columnSize(columns[i]);
+        }
+        return length;
+    }
 
-                copy_unsigned(serial + index, temp, length);
-                delete[] temp;
-                index += length;
-            } else {
-                DoubleArray *dbl = new DoubleArray(columns[i]);
-                unsigned char *temp = dbl->serialize();
-                size_t length = extract_size_t(temp, 0);
-
-                while (index + length >= buffer_length - 1) {
-                    unsigned char *temp = new unsigned char[buffer_length * 2];
-                    copy_unsigned(temp, serial, buffer_length);
-                    buffer_length *= 2;
-                    delete[] serial;
-                    serial = temp;
-                }
+    void write_to(BufferWriter &writer) {
+        size_t start = writer.pos_;
+        writer.write_size_t(0);
+        schema->write_to(writer);
+        for (size_t i = 0; i < schema->width(); i++) {
+            serializeColumn(writer, start, columns[i]);
+        }
+        writer.patch_size_t(writer.pos_ - start, start);
+    }
+
+    /** Writes the block of column. A block is a header, the validity bitmap
+    * and the payload:
+    *
+    * |--8 bytes---------|--8 bytes--|--8 bytes--|--8 bytes--|--Unknown length--|--Unknown length--|
+    * |--length in bytes-|--type-----|--encoding-|--rows-----|--validity--------|--payload---------|
+    *
+    * An empty validity bitmap means no value is missing. Numeric columns
+    * are raw values followed by their zone map, except ints, which are
+    * encoded chunks followed by theirs. Bools are their bitmap and strings
+    * a dictionary or every string. Blocks start 8 byte aligned from the
+    * start of the frame, zero padding before them, so numeric values can
+    * be read in place. */
+    void serializeColumn(BufferWriter &writer, size_t frame_start, Column *column) {
+        while ((writer.pos_ - frame_start) % 8 != 0) writer.write_byte(0);
+        size_t start = writer.pos_;
+        char type = column->get_type();
+        size_t encoding = columnEncoding(column);
+        writer.write_size_t(0);
+        writer.write_size_t(type);
+        writer.write_size_t(encoding);
+        writer.write_size_t(column->size());
+        BitVector noneMissing;
+        (column->valid_ == nullptr ? &noneMissing : column->valid_)->write_to(writer);
+        if (encoding == ENCODING_DICT) {
+            column->as_string()->as_dict()->write_to(writer);
+        } else if (encoding == ENCODING_STRINGS) {
+            writeStrings(writer, column->as_string());
+        } else if (type == 'B') {
+            column->as_bool()->vals_.write_to(writer);
+        } else if (type == 'I') {
+            column->as_int()->write_to(writer);
+            column->as_int()->zones_.write_to(writer);
+        } else {
+            dynamic_cast<Serializable *>(column)->write_to(writer);
+        }
+        writer.patch_size_t(writer.pos_ - start, start);
+    }
 
-                copy_unsigned(serial + index, temp, length);
-                delete[] temp;
-                index += length;
+    /** Bytes of the block of column, its padding included, at most */
+    size_t columnSize(Column *column) {
+        size_t length = 7 + 32;
+        length += column->valid_ == nullptr ? 16 : column->valid_->serial_size();
+        char type = column->get_type();
+        switch (columnEncoding(column)) {
+        case ENCODING_DICT:
+            return length + column->as_string()->as_dict()->serial_size();
+        case ENCODING_STRINGS: {
+            StringColumn *strings = column->as_string();
+            size_t bytes = 0;
+            for (size_t j = 0; j < strings->size(); j++) {
+                StringView s = strings->get_view(j);
+                bytes += (s.is_null() ? 0 : s.len_) + 1;
             }
+            return length + StringArray::table_size(strings->size(), bytes);
+        }
+        case ENCODING_INTS:
+            return length + column->as_int()->serial_size() + column->as_int()->zones_.serial_size();
+        default:
+            if (type == 'B') return length + column->as_bool()->vals_.serial_size();
+            return length + dynamic_cast<Serializable *>(column)->serial_size();
+        }
+    }
+
+    size_t columnEncoding(Column *column) {
+        switch (column->get_type()) {
+        case 'S':
+            return column->as_string()->as_dict() != nullptr ? ENCODING_DICT : ENCODING_STRINGS;
+        case 'I':
+            return ENCODING_INTS;
+        default:
+            return ENCODING_RAW;
+        }
+    }
+
+    /** Writes the strings of column as a StringArray, missing ones empty,
+    * the validity bitmap restores them. The offsets are written first, one
+    * pass over the views, then the bytes. */
+    void writeStrings(BufferWriter &writer, StringColumn *column) {
+        size_t start = writer.pos_;
+        writer.write_size_t(0);
+        writer.write_size_t(column->size());
+        size_t offset = 0;
+        writer.write_size_t(offset);
+        for (size_t j = 0; j < column->size(); j++) {
+            StringView s = column->get_view(j);
+            offset += (s.is_null() ? 0 : s.len_) + 1;
+            writer.write_size_t(offset);
         }
-        insert_size_t(index, serial, 0);
-        return serial;
+        for (size_t j = 0; j < column->size(); j++) {
+            StringView s = column->get_view(j);
+            if (s.is_null()) writer.write_string("", 0);
+            else writer.write_string(s.data_, s.len_);
+        }
+        writer.patch_size_t(writer.pos_ - start, start);
     }
 
     size_t deserialize(unsigned char *serialized) {
-        size_t index = 8;
-        schema = new Schema(serialized + index);
+        return deserialize(serialized, extract_size_t(serialized, 0), false);
+    }
+
+    size_t deserialize(unsigned char *serialized, size_t length) {
+        return deserialize(serialized, length, false);
+    }
+
+    /** Reads the length bytes at serialized into this frame. Borrowing
+    * leaves the numeric values in serialized, which must be 8 byte aligned
+    * and outlive the columns. */
+    size_t deserialize(unsigned char *serialized, size_t length, bool borrow) {
+        BufferReader reader(serialized, length);
+        reader.skip(8);
+        schema = new Schema();
+        schema->read_from(reader);
         col_cap = schema->col_cap;
         columns = new Column *[col_cap];
-        index += 16 + schema->width() + 1;
-
-        DoubleArray *dbl;
-        StringArray *str;
+        for (size_t i = 0; i < schema->width(); i++) {
+            reader.align(8);
+            reader.need(32);
+            reader.skip(deserializeColumn(reader.cursor(), reader.end_ - reader.pos_, i, borrow));
+        }
+        return reader.pos_;
+    };
 
-        for (int i = 0; i < schema->width(); i++) {
-            switch (schema->type(i)) {
-            case 'B':
-                columns[i] = new BoolColumn();
-                dbl = new DoubleArray();
-                index += dbl->deserialize(serialized + index);
-                for (size_t j = 0; j < dbl->len_; j++) {
-                    if (dbl->vals_[j] == 0) {
-                        set(i, j, false);
-                    } else {
-                        set(i, j, true);
-                    }
-                }
-                delete dbl;
-                break;
-            case 'I':
-                columns[i] = new IntColumn();
-                dbl = new DoubleArray();
-                index += dbl->deserialize(serialized + index);
-                for (size_t j = 0; j < dbl->len_; j++) {
-                    set(i, j, int(dbl->vals_[j]));
-                }
-                delete dbl;
-                break;
-            case 'S':
-                columns[i] = new StringColumn();
-                str = new StringArray();
-                index += str->deserialize(serialized + index);
-                for (size_t j = 0; j < str->len_; j++) {
-                    set(i, j, str->vals_[j]->clone());
-                }
-                delete str;
-                break;
-            case 'D':
-                columns[i] = new DoubleColumn();
-                dbl = new DoubleArray();
-                index += dbl->deserialize(serialized + index);
-                for (size_t j = 0; j < dbl->len_; j++) {
-                    set(i, j, dbl->vals_[j]);
-                }
-                delete dbl;
-                break;
-            default:
-                assert("Type other than B, I, F, or S found." && false);
+    /** Reads the block of column i written by serializeColumn from the
+    * available bytes at block. Every part of the block is read through a
+    * reader bounded by the block and must hold the block's rows. Raw values
+    * are copied a chunk at a time and encoded int chunks stay encoded. */
+    size_t deserializeColumn(unsigned char *block, size_t available, size_t i, bool borrow) {
+        size_t length = extract_size_t(block, 0);
+        if (length < 32 || length > available) {
+            assert("Column block overruns the frame." && false);
+        }
+        BufferReader reader(block, length);
+        reader.skip(8);
+        char type = (char)reader.read_size_t();
+        size_t encoding = reader.read_size_t();
+        size_t rows = reader.read_size_t();
+        if (type != schema->type(i)) {
+            assert("Column block does not match the schema." && false);
+        }
+        BitVector *valid = new BitVector();
+        valid->read_from(reader);
+        if (valid->size() != 0 && valid->size() != rows) {
+            assert("Column block does not match its rows." && false);
+        }
+        //every payload starts with its length and its rows, checked before it is read
+        reader.need(16);
+        if (extract_size_t(reader.cursor(), 8) != rows) {
+            assert("Column block does not match its rows." && false);
+        }
+        Column *column;
+        switch (encoding) {
+        case ENCODING_RAW:
+            column = make_column(type);
+            if (type == 'B') column->as_bool()->vals_.read_from(reader);
+            else if (borrow) column->borrow(reader);
+            else dynamic_cast<Serializable *>(column)->read_from(reader);
+            break;
+        case ENCODING_INTS:
+            column = new IntColumn();
+            column->as_int()->read_from(reader, borrow);
+            column->as_int()->zones_.read_from(reader);
+            if (column->as_int()->zones_.size() > column->chunk_count()) {
+                assert("Column block does not match its rows." && false);
             }
+            break;
+        case ENCODING_DICT:
+            column = new DictStringColumn();
+            column->as_string()->as_dict()->read_from(reader);
+            break;
+        case ENCODING_STRINGS: {
+            //the table is 8 byte aligned in the block, its offsets are read in place
+            ArenaStringColumn *strings = new ArenaStringColumn();
+            size_t start = reader.pos_;
+            size_t end = start + reader.read_size_t();
+            size_t count = StringArray::read_table(reader, end);
+            const size_t *offsets = reinterpret_cast<const size_t *>(reader.cursor());
+            strings->append_table(reinterpret_cast<const char *>(offsets + count + 1), offsets, count);
+            reader.skip(end - reader.pos_);
+            column = strings;
+            break;
         }
-        return index;
-    };
+        default:
+            assert("Unknown column encoding found." && false);
+        }
+        if (column->size() != rows) {
+            assert("Column block does not match its rows." && false);
+        }
+        if (valid->size() > 0) {
+            delete column->valid_;
+            column->valid_ = valid;
+        } else {
+            delete valid;
+        }
+        columns[i] = column;
+        return length;
+    }
 
     ~DataFrame() {
         delete[] columns;
+        if (value_ != nullptr) value_->release();
     }
 };
 
@@ -691,15 +1297,17 @@ inline KVStore::~KVStore() {
     delete getRequests;
 }
 inline bool KVStore::containsKey(Key *k) {
+    std::lock_guard<std::mutex> guard(storeLock);
     return kv_map_.containsKey(k);
 }
 inline Value *KVStore::put(Key &k, Value *v) {
     // data is stored in local kvstore
     if (idx_ == k.node_) {
+        std::lock_guard<std::mutex> guard(storeLock);
         return kv_map_.put(&k, v);
     } else {
         Put* p = new Put(idx_, k.node_, 1234, &k, v);
-        sendToNeighbor(nconfig_.neighborSockets[k.node_], p->serialize());
+        sendToNeighbor(nconfig_.neighborSockets[k.node_], p);
         return nullptr;
     }
 }
@@ -709,24 +1317,29 @@ inline Value *KVStore::put(Key &k, unsigned char *data, size_t length) {
 inline DataFrame *KVStore::get(Key &k) {
     // data is stored in local kvstore
     if (idx_ == k.node_) {
+        std::lock_guard<std::mutex> guard(storeLock);
         Value *received = kv_map_.get(&k);
-        return (received == nullptr) ? nullptr : new DataFrame(received->blob_);
+        return (received == nullptr) ? nullptr : new DataFrame(received);
     } else {
         // ask the network for data
         Get* g = new Get(idx_, k.node_, 1234, &k);
-        sendToNeighbor(nconfig_.neighborSockets[k.node_], g->serialize());
+        sendToNeighbor(nconfig_.neighborSockets[k.node_], g);
         return nullptr;
     }
 }
 inline DataFrame *KVStore::waitAndGet(Key &k) {
     // Data should be stored in local kvstore
     if (idx_ == k.node_) {
-        Value *received = nullptr;
-        while (received == nullptr) {
+        DataFrame *result = nullptr;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> guard(storeLock);
+                Value *received = kv_map_.get(&k);
+                if (received != nullptr) result = new DataFrame(received);
+            }
+            if (result != nullptr) return result;
             usleep(250000);
-            received = kv_map_.get(&k);
         }
-        return (received == nullptr) ? nullptr : new DataFrame(received->blob_);
     } else {
         Get* g = new Get(idx_, k.node_, 1234, &k);
         while (nconfig_.neighborSockets[k.node_] == NULL) {
@@ -734,7 +1347,7 @@ inline DataFrame *KVStore::waitAndGet(Key &k) {
             if (DEBUG) pln("waiting for socket to not be null");
         }
         if (DEBUG) pln("not null anymore");
-        sendToNeighbor(nconfig_.neighborSockets[k.node_], g->serialize(), "in waitandget");
+        sendToNeighbor(nconfig_.neighborSockets[k.node_], g, "in waitandget");
         nconfig_.waiting = true;
         //wait for result from neighbors
         while (nconfig_.waiting);
@@ -850,26 +1463,24 @@ inline void KVStore::listenToNeighbors() {
                     }
                     FD_SET(new_socket, &nconfig_.neighborCurrentFds);
                 } else {
-                    handleNodeMsg(i, readIncomingNodeMsg(i));
+                    //reading stays on this thread, handling goes to the pool
+                    size_t length;
+                    unsigned char* msg = readIncomingNodeMsg(i, length);
+                    if (msg == nullptr) {
+                        handleDisconnect(i);
+                    } else {
+                        queueNodeMsg(i, msg, length);
+                    }
                 }
             }
         }
     }
 }
 
-//reads the incoming msg from the given file descriptor
-inline unsigned char* KVStore::readIncomingNodeMsg(int fd) {
-    //clear buffer
-    memset(nconfig_.neighborBuffer, 0, BUFF_SIZE);
-    int bytesRead = read(fd, nconfig_.neighborBuffer, BUFF_SIZE);
-    if (bytesRead < 0) {
-        assert("Error reading incoming data." && false);
-    }
-    unsigned char* newBuff = new unsigned char[BUFF_SIZE];
-    memcpy(newBuff, nconfig_.neighborBuffer, BUFF_SIZE);
-    //clear buffer
-    memset(nconfig_.neighborBuffer, 0, BUFF_SIZE);
-    return newBuff;
+//reads the incoming msg from the given file descriptor, whole however long,
+//setting length to the bytes read; nullptr once the neighbor disconnected
+inline unsigned char* KVStore::readIncomingNodeMsg(int fd, size_t& length) {
+    return read_message(fd, length);
 }
 
 inline void KVStore::handleDisconnect(int fd) {
@@ -877,37 +1488,66 @@ inline void KVStore::handleDisconnect(int fd) {
     FD_CLR(fd, &nconfig_.neighborCurrentFds);
 }
 
-//handles messages from other Nodes
-inline void KVStore::handleNodeMsg(int fd, unsigned char* msg) {
-    if (*msg != 0) {
-        MsgKind kind = message_kind(msg);
-        switch (kind) {
-            case MsgKind::Status: {
-                handleStatus(fd, msg);
-                break;
-            }
-            case MsgKind::Get: {
-                handleGet(fd, msg);
-                break;
-            }
-            case MsgKind::Put: {
-                handlePut(fd, msg);
-                break;
-            }
-            case MsgKind::Result: {
-                handleResult(fd, msg);
-                break;
-            }
-            default: {  
-                assert("Unrecognized message" && false);
+//queues msg behind the messages of its connection, starting a pool task
+//to handle them if none is running
+inline void KVStore::queueNodeMsg(int fd, unsigned char* msg, size_t length) {
+    {
+        std::lock_guard<std::mutex> guard(inboxLock_);
+        Inbox& inbox = inboxes_[fd];
+        inbox.msgs_.push_back(std::make_pair(msg, length));
+        if (inbox.draining_) return;
+        inbox.draining_ = true;
+    }
+    ThreadPool::shared().submit([this, fd]() { drainInbox(fd); });
+}
+
+//handles the queued messages of a connection in order until none is left
+inline void KVStore::drainInbox(int fd) {
+    while (true) {
+        std::pair<unsigned char*, size_t> msg;
+        {
+            std::lock_guard<std::mutex> guard(inboxLock_);
+            Inbox& inbox = inboxes_[fd];
+            if (inbox.msgs_.empty()) {
+                inbox.draining_ = false;
+                return;
             }
+            msg = inbox.msgs_.front();
+            inbox.msgs_.pop_front();
+        }
+        handleNodeMsg(fd, msg.first, msg.second);
+        delete[] msg.first;
+    }
+}
+
+//handles messages from other Nodes
+inline void KVStore::handleNodeMsg(int fd, unsigned char* msg, size_t length) {
+    MsgKind kind = message_kind(msg);
+    switch (kind) {
+        case MsgKind::Status: {
+            handleStatus(fd, msg, length);
+            break;
+        }
+        case MsgKind::Get: {
+            handleGet(fd, msg, length);
+            break;
+        }
+        case MsgKind::Put: {
+            handlePut(fd, msg, length);
+            break;
+        }
+        case MsgKind::Result: {
+            handleResult(fd, msg, length);
+            break;
+        }
+        default: {  
+            assert("Unrecognized message" && false);
         }
-    } else {
-        handleDisconnect(fd);
     }
 }
 
 inline void KVStore::sendToNeighbor(int fd, unsigned char* msg) {
+    std::lock_guard<std::mutex> guard(sendLock);
     if (send(fd, msg, message_length(msg), 0) < 0) {
         assert("Error sending data to neighbor node." && false);
     }
@@ -918,48 +1558,67 @@ inline void KVStore::sendToNeighbor(int fd, unsigned char* msg, const char* debu
     sendToNeighbor(fd, msg);
 }
 
+//writes msg into the send buffer instead of a new blob per message
+inline void KVStore::sendToNeighbor(int fd, Message* msg) {
+    std::lock_guard<std::mutex> guard(sendLock);
+    sendBuffer_.clear();
+    msg->write_to(sendBuffer_);
+    if (send(fd, sendBuffer_.buf_, sendBuffer_.pos_, 0) < 0) {
+        assert("Error sending data to neighbor node." && false);
+    }
+}
+
+inline void KVStore::sendToNeighbor(int fd, Message* msg, const char* debug) {
+    printf("FROM SENDTONEIGHBOR: %S\n", debug);
+    sendToNeighbor(fd, msg);
+}
+
 //handler for status messages
-inline void KVStore::handleStatus(int fd, unsigned char* msg) {
-    Status* incomingStatus = new Status(msg);
+inline void KVStore::handleStatus(int fd, unsigned char* msg, size_t length) {
+    Status* incomingStatus = new Status(msg, length);
     p("Received on ").p(nconfig_.ip_->c_str()).p(":").p(nconfig_.port_).p(": ").pln(incomingStatus->msg_->c_str());
     delete incomingStatus;
 }
 
 //handler for status messages
-inline void KVStore::handlePut(int fd, unsigned char* msg) {
-    Put* incomingPut = new Put(msg);
+inline void KVStore::handlePut(int fd, unsigned char* msg, size_t length) {
+    Put* incomingPut = new Put(msg, length);
     //printf("New put message on %zu\n", idx_);
     //printf("put|%s|%d|%s\n",incomingPut->key_->name_->c_str(), incomingPut->key_->node_, incomingPut->value_->blob_);
     if (incomingPut->key_->node_ == idx_) {
-        kv_map_.put(incomingPut->key_, incomingPut->value_);
+        std::lock_guard<std::mutex> guard(storeLock);
+        kv_map_.put(incomingPut->key_, incomingPut->value_->retain());
+        incomingPut->key_ = nullptr; // held by the store now
         //pln("put in local store");
         //maybe send back ACK later to notify of successful put, get everything working first
     }
     delete incomingPut;
 }
 
-inline void KVStore::handleResult(int fd, unsigned char* msg) {
+inline void KVStore::handleResult(int fd, unsigned char* msg, size_t length) {
     if (DEBUG)  std::cout << "in handle result for node " << idx_ << std::endl;
-    Result* r = new Result(msg); 
+    Result* r = new Result(msg, length);
     if (r->value_ != nullptr) {
         if (DEBUG) std::cout << "Size of " << strlen((char*)r->value_->blob_) << std::endl;
-        DataFrame* result = new DataFrame(r->value_->blob_);
+        DataFrame* result = new DataFrame(r->value_);
         waitAndGetValue = result;
         nconfig_.waiting = false;
     } else {
         assert("Error with returned value." && false);
     }
+    delete r; // the frame keeps the value
 }
 
-inline void KVStore::handleGet(int fd, unsigned char* msg) {
-    Get* incomingGet = new Get(msg);
+inline void KVStore::handleGet(int fd, unsigned char* msg, size_t length) {
+    Get* incomingGet = new Get(msg, length);
     if (DEBUG)  std::cout << "in handle get for node " << idx_ << std::endl;
     if (incomingGet->key_->node_ == idx_) {
+        std::lock_guard<std::mutex> guard(storeLock);
         Value* v = kv_map_.get(incomingGet->key_);
         if (v != nullptr) {
-            Result* r = new Result(v);
+            Result* r = new Result(v->retain());
             if (DEBUG) std::cout << "Size of " << strlen((char*)r->value_->blob_) << std::endl;
-            sendToNeighbor(nconfig_.neighborSockets[incomingGet->sender_], r->serialize());
+            sendToNeighbor(nconfig_.neighborSockets[incomingGet->sender_], r);
             delete r;
         } else {
             if (DEBUG) pln("get being added to vector");
@@ -974,6 +1633,7 @@ inline void KVStore::handleGet(int fd, unsigned char* msg) {
 inline void KVStore::updateRequests() {
     while (nconfig_.running) {
         usleep(1000000);
+        std::lock_guard<std::mutex> guard(storeLock);
         Get* i;
         for (int count = 0; count < getRequests->size(); ++count) {
             i = getRequests->at(count);
@@ -983,11 +1643,11 @@ inline void KVStore::updateRequests() {
             if (DEBUG) cout << "Got i key" << endl << std::flush;
             if (v != nullptr) {
                 if (DEBUG) cout << "V no longer nullptr" << std::flush;
-                Result* r = new Result(v);
+                Result* r = new Result(v->retain());
                 while (nconfig_.neighborSockets[i->sender_] == NULL) {
                     if (DEBUG) pln("null socket, waiting");
                 }
-                sendToNeighbor(nconfig_.neighborSockets[i->sender_], r->serialize(), "in update requests");
+                sendToNeighbor(nconfig_.neighborSockets[i->sender_], r, "in update requests");
                 delete r;
                 getRequests->erase(getRequests->begin() + count);
             }
@@ -998,28 +1658,30 @@ inline void KVStore::updateRequests() {
 //listens to the server for directory updates
 inline void KVStore::listenToServer() {
     while (nconfig_.running) {
-        memset(nconfig_.serverBuffer, 0, BUFF_SIZE);
-        read(nconfig_.serverSocket_, nconfig_.serverBuffer, BUFF_SIZE);
-        handleIncoming(nconfig_.serverBuffer);
+        size_t length;
+        unsigned char* data = read_message(nconfig_.serverSocket_, length);
+        if (data == nullptr) return;
+        handleIncoming(data, length);
+        delete[] data;
     }
 }
 
 //handles incoming messages from the server
-inline void KVStore::handleIncoming(unsigned char* data) {
+inline void KVStore::handleIncoming(unsigned char* data, size_t length) {
     MsgKind kind = message_kind(data);
     switch (kind) {
         case MsgKind::Ack: {
-            Ack* a = new Ack(data);
+            Ack* a = new Ack(data, length);
             handleAck(a);
             break;
         }    
         case MsgKind::Nack: {
-            Nack* n = new Nack(data);
+            Nack* n = new Nack(data, length);
             handleNack(n);
             break;
         }
         case MsgKind::Directory: {
-            updateConnections(data);
+            updateConnections(data, length);
             break;
         }
         case MsgKind::Kill: {
@@ -1053,8 +1715,8 @@ inline void KVStore::closeServerConnection() {
 }
 
 //updated the node directory and opens connections with all other nodes
-inline void KVStore::updateConnections(unsigned char* data) {
-    nconfig_.nodeDir = new Directory(data);
+inline void KVStore::updateConnections(unsigned char* data, size_t length) {
+    nconfig_.nodeDir = new Directory(data, length);
     createNeighborConnections();
     //the following method was for demo/debugging purposes
     //greetAllNeighbors();
@@ -1101,7 +1763,7 @@ inline void KVStore::greetAllNeighbors() {
             sb->c("directed to: ");
             sb->c(nconfig_.nodeDir->ports[i]);
             Status* greetStatus = new Status(sb->get());
-            sendToNeighbor(nconfig_.neighborSockets[i], greetStatus->serialize());
+            sendToNeighbor(nconfig_.neighborSockets[i], greetStatus);
             delete sb;
             delete greetStatus;
         }
@@ -0,0 +1,302 @@
+//lang: CwC
+#pragma once
+
+#include "../string.h"
+#include "../serial/array.h"
+
+/** Hashes len bytes of s the same way String::hash_me does, so raw bytes
+ *  and String objects with the same content land in the same slot. */
+inline size_t hash_chars(const char* s, size_t len) {
+  size_t hash = 0;
+  for (size_t i = 0; i < len; ++i)
+    hash = s[i] + (hash << 6) + (hash << 16) - hash;
+  return hash;
+}
+
+/*************************************************************************
+ * StringDictionary::
+ * The unique strings of a dictionary encoded column. Each distinct string
+ * is stored once and identified by its code, its position in insertion
+ * order. Lookups go through an open addressing table of codes with linear
+ * probing, kept at most half full.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+class StringDictionary : public Object {
+  public:
+    StringArray* strings_; // owned; strings owned, indexed by code
+    int* slots_;           // owned; codes, -1 marks an empty slot
+    size_t n_slots_;       // power of two
+
+    StringDictionary() {
+      strings_ = new StringArray(16);
+      n_slots_ = 32;
+      slots_ = new int[n_slots_];
+      for (size_t i = 0; i < n_slots_; i++) slots_[i] = -1;
+    }
+
+    ~StringDictionary() {
+      delete strings_;
+      delete[] slots_;
+    }
+
+    /** Number of distinct strings */
+    size_t size() {
+      return strings_->len_;
+    }
+
+    /** The string for code. The string is owned by the dictionary. */
+    String* get(int code) {
+      return strings_->vals_[code];
+    }
+
+    /** Code of the string with the given bytes, or -1 if absent */
+    int find(const char* s, size_t len) {
+      size_t slot = hash_chars(s, len) & (n_slots_ - 1);
+      while (slots_[slot] != -1) {
+        String* cand = strings_->vals_[slots_[slot]];
+        if (cand->size() == len && memcmp(cand->c_str(), s, len) == 0) return slots_[slot];
+        slot = (slot + 1) & (n_slots_ - 1);
+      }
+      return -1;
+    }
+
+    int find(String* s) {
+      return find(s->c_str(), s->size());
+    }
+
+    /** Code of the string with the given bytes, adding a copy if absent */
+    int intern(const char* s, size_t len) {
+      int code = find(s, len);
+      if (code != -1) return code;
+      code = strings_->len_;
+      strings_->push(new String(s, len));
+      if (2 * strings_->len_ > n_slots_) {
+        rehash(n_slots_ * 2);
+      } else {
+        place(code);
+      }
+      return code;
+    }
+
+    int intern(String* s) {
+      return intern(s->c_str(), s->size());
+    }
+
+    /** Puts code in the first free slot of its probe sequence */
+    void place(int code) {
+      String* s = strings_->vals_[code];
+      size_t slot = hash_chars(s->c_str(), s->size()) & (n_slots_ - 1);
+      while (slots_[slot] != -1) slot = (slot + 1) & (n_slots_ - 1);
+      slots_[slot] = code;
+    }
+
+    /** Rebuilds the slot table with n_slots slots */
+    void rehash(size_t n_slots) {
+      delete[] slots_;
+      n_slots_ = n_slots;
+      slots_ = new int[n_slots_];
+      for (size_t i = 0; i < n_slots_; i++) slots_[i] = -1;
+      for (size_t i = 0; i < strings_->len_; i++) place(i);
+    }
+
+    StringDictionary* clone() {
+      StringDictionary* res = new StringDictionary();
+      for (size_t i = 0; i < size(); i++) res->intern(get(i));
+      return res;
+    }
+};
+
+/*************************************************************************
+ * DictStringColumn::
+ * A string column stored as one int code per value into a dictionary of
+ * its distinct strings. A code of -1 is a nullptr value. Strings returned
+ * by get are owned by the dictionary, strings passed to set stay owned by
+ * the caller. Equality tests and grouping can compare codes instead of
+ * string bytes.
+ */
+class DictStringColumn : public StringColumn, public Serializable {
+  public:
+    StringDictionary* dict_; // owned
+    ChunkedArray<int> codes_;
+
+    DictStringColumn() {
+      dict_ = new StringDictionary();
+    }
+
+    ~DictStringColumn() {
+      delete dict_;
+    }
+
+    /** Encodes the strings of col. Returns nullptr without finishing if col
+     *  has more than max_distinct distinct strings. */
+    static DictStringColumn* encode(StringColumn* col, size_t max_distinct) {
+      DictStringColumn* res = new DictStringColumn();
+      for (size_t i = 0; i < col->size(); i++) {
+        StringView val = col->get_view(i);
+        res->codes_.push_back(val.is_null() ? -1 : res->dict_->intern(val.c_str(), val.size()));
+        if (res->dict_->size() > max_distinct) {
+          delete res;
+          return nullptr;
+        }
+      }
+      res->copy_validity(col);
+      return res;
+    }
+
+    DictStringColumn* as_dict() {
+      return this;
+    }
+
+    String* get(size_t idx) {
+      int code = codes_.get(idx);
+      return code == -1 ? nullptr : dict_->get(code);
+    }
+
+    StringView get_view(size_t idx) {
+      int code = codes_.get(idx);
+      return code == -1 ? StringView() : StringView(dict_->get(code));
+    }
+
+    /** Set value at idx. The dictionary keeps its own copy of val. */
+    void set(size_t idx, String* val) {
+      note_set(idx);
+      fill_gap(idx);
+      codes_.set(idx, code_for(val));
+    }
+
+    void set_chars(size_t idx, const char* s, size_t len) {
+      note_set(idx);
+      fill_gap(idx);
+      codes_.set(idx, dict_->intern(s, len));
+    }
+
+    /** Gives the missing slots before idx the nullptr code */
+    void fill_gap(size_t idx) {
+      while (codes_.size() < idx) codes_.push_back(-1);
+    }
+
+    size_t size() {
+      return codes_.size();
+    }
+
+    /** Code of the value at idx */
+    int code(size_t idx) {
+      return codes_.get(idx);
+    }
+
+    /** Contiguous codes of chunk c, valid for chunk_length(c) elements */
+    int* codes(size_t c) {
+      return codes_.chunk(c);
+    }
+
+    /** Number of distinct strings, codes range over [0, dict_size()) */
+    size_t dict_size() {
+      return dict_->size();
+    }
+
+    /** Code of s in this column's dictionary, -1 if s never occurs */
+    int find(String* s) {
+      return s == nullptr ? -1 : dict_->find(s);
+    }
+
+    /** Code for val, interning it if new */
+    int code_for(String* val) {
+      return val == nullptr ? -1 : dict_->intern(val);
+    }
+
+    /** New column with true where the value equals s. s is looked up once
+     *  and the scan compares codes. Missing values compare false. */
+    BoolColumn* equal_to(String* s) {
+      BoolColumn* res = new BoolColumn();
+      res->vals_.resize(size());
+      int target = find(s);
+      if (target == -1) return res;
+      for (size_t c = 0; c < chunk_count(); c++) {
+        int* vals = codes(c);
+        size_t base = c << CHUNK_SHIFT;
+        for (size_t i = 0; i < chunk_length(c); i++) {
+          if (vals[i] == target) res->vals_.set(base + i, true);
+        }
+      }
+      if (valid_ != nullptr) res->vals_.and_(*valid_);
+      return res;
+    }
+
+    /** Number of present values per code, missing values having no code.
+     *  An array of dict_size() counts
+     *  owned by the caller */
+    size_t* group_counts() {
+      size_t* counts = new size_t[dict_size()]();
+      for (size_t c = 0; c < chunk_count(); c++) {
+        int* vals = codes(c);
+        for (size_t i = 0; i < chunk_length(c); i++) {
+          if (vals[i] != -1) counts[vals[i]]++;
+        }
+      }
+      return counts;
+    }
+
+    DictStringColumn* clone() {
+      DictStringColumn* newColumn = new DictStringColumn();
+      delete newColumn->dict_;
+      newColumn->dict_ = dict_->clone();
+      for (size_t c = 0; c < chunk_count(); c++) {
+        int* vals = codes(c);
+        for (size_t i = 0; i < chunk_length(c); i++) {
+          newColumn->codes_.push_back(vals[i]);
+        }
+      }
+      newColumn->copy_validity(this);
+      return newColumn;
+    }
+
+    /** Serializes the dictionary once followed by the codes. Structure is
+     * as following
+     *
+     * |--8 bytes-------------|--8 bytes--|--Unknown length--|--4 bytes each--|
+     * |--length in bytes-----|--rows-----|--StringArray-----|--code 1...------|
+     */
+    size_t serial_size() {
+      return 16 + dict_->strings_->serial_size() + 4 * size();
+    }
+
+    void write_to(BufferWriter& writer) {
+      size_t start = writer.pos_;
+      writer.write_size_t(0);
+      writer.write_size_t(size());
+      dict_->strings_->write_to(writer);
+      for (size_t c = 0; c < chunk_count(); c++) {
+        writer.write_bytes(codes(c), 4 * chunk_length(c));
+      }
+      writer.patch_size_t(writer.pos_ - start, start);
+    }
+
+    /** Reads the column at the reader's cursor, mutating this column.
+     *  Every code must be -1 or one of the dictionary's. */
+    void read_from(BufferReader& reader) {
+      size_t start = reader.pos_;
+      size_t length = reader.read_size_t();
+      size_t rows = reader.read_size_t();
+      if (length < 16 || length > reader.end_ - start || rows > (length - 16) / 4) {
+        assert("Malformed dictionary column." && false);
+      }
+      BufferReader column(reader.buf_ + start, length);
+      column.skip(16);
+      StringArray* strings = new StringArray();
+      strings->read_from(column);
+      for (size_t i = 0; i < strings->len_; i++) dict_->intern(strings->vals_[i]);
+      delete strings;
+      if (rows != (length - column.pos_) / 4 || (length - column.pos_) % 4 != 0) {
+        assert("Malformed dictionary column." && false);
+      }
+      for (size_t i = 0; i < rows; i++) {
+        int code;
+        column.read_bytes(&code, 4);
+        if (code < -1 || code >= (int)dict_->size()) assert("Malformed dictionary column." && false);
+        codes_.push_back(code);
+      }
+      reader.skip(length - 16);
+    }
+};
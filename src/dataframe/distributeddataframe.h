@@ -11,6 +11,9 @@ class DistributedDataFrame : public DataFrame {
         KVStore* kv_;
         String* uid_;
         vector<int> sub_ids;
+        //Zone of each sub dataframe, parallel to sub_ids, ncols() bounds each
+        vector<vector<double>> sub_lo_;
+        vector<vector<double>> sub_hi_;
 
         DistributedDataFrame(Schema &schema_) {
             this->schema = &schema_;
@@ -34,6 +37,18 @@ class DistributedDataFrame : public DataFrame {
             setDFwithRow(row, df);
         }
 
+        void set(size_t col, size_t row, int64_t val) {
+            DataFrame* df = getDFwithRow(row);
+            df->set(col, getInternalRow(row), val);
+            setDFwithRow(row, df);
+        }
+
+        void set(size_t col, size_t row, float val) {
+            DataFrame* df = getDFwithRow(row);
+            df->set(col, getInternalRow(row), val);
+            setDFwithRow(row, df);
+        }
+
         void set(size_t col, size_t row, double val) {
             DataFrame* df = getDFwithRow(row);
             df->set(col, getInternalRow(row), val);
@@ -54,11 +69,38 @@ class DistributedDataFrame : public DataFrame {
             setDFwithRow(row, df);
         }
 
+        void set_chars(size_t col, size_t row, const char* s, size_t len) {
+            DataFrame* df = getDFwithRow(row);
+            df->set_chars(col, getInternalRow(row), s, len);
+            setDFwithRow(row, df);
+        }
+
+        void set_missing(size_t col, size_t row) {
+            DataFrame* df = getDFwithRow(row);
+            df->set_missing(col, getInternalRow(row));
+            setDFwithRow(row, df);
+        }
+
+        bool is_missing(size_t col, size_t row) {
+            DataFrame* df = getDFwithRow(row);
+            return df->is_missing(col, getInternalRow(row));
+        }
+
         int get_int(size_t col, size_t row) {
             DataFrame* df = getDFwithRow(row);
             return df->get_int(col, getInternalRow(row));
         }
 
+        int64_t get_long(size_t col, size_t row) {
+            DataFrame* df = getDFwithRow(row);
+            return df->get_long(col, getInternalRow(row));
+        }
+
+        float get_float(size_t col, size_t row) {
+            DataFrame* df = getDFwithRow(row);
+            return df->get_float(col, getInternalRow(row));
+        }
+
         double get_double(size_t col, size_t row) {
             DataFrame* df = getDFwithRow(row);
             return df->get_double(col, getInternalRow(row));
@@ -87,12 +129,49 @@ class DistributedDataFrame : public DataFrame {
         DataFrame* setDFwithRow(size_t row, DataFrame* df) {
             if (std::find(sub_ids.begin(), sub_ids.end(), getDFid(row)) == sub_ids.end())
                 sub_ids.push_back(getDFid(row));
+            recordZone(std::find(sub_ids.begin(), sub_ids.end(), getDFid(row)) - sub_ids.begin(), df);
             Key* k = createKeyFromRow(row);
             unsigned char* serial = df->serialize();
             kv_->put(*k, serial, extract_size_t(serial, 0));
             delete k;
         }
 
+        /** Keeps the bounds of df's columns for the sub dataframe at pos so
+         *  scans can skip it without fetching it. A column with no present
+         *  value gets an empty range. */
+        void recordZone(size_t pos, DataFrame* df) {
+            if (sub_lo_.size() <= pos) {
+                sub_lo_.resize(pos + 1);
+                sub_hi_.resize(pos + 1);
+            }
+            sub_lo_[pos].assign(df->ncols(), 1);
+            sub_hi_[pos].assign(df->ncols(), 0);
+            for (size_t i = 0; i < df->ncols(); i++) {
+                df->columns[i]->value_range(sub_lo_[pos][i], sub_hi_[pos][i]);
+            }
+        }
+
+        /** Can the sub dataframe at pos hold a value of column col in [lo, hi]? */
+        bool subOverlaps(size_t pos, size_t col, double lo, double hi) {
+            if (pos >= sub_lo_.size()) return true;
+            double zlo = sub_lo_[pos][col];
+            double zhi = sub_hi_[pos][col];
+            return zlo <= zhi && !(zhi < lo || zlo > hi);
+        }
+
+        /** Visits the matching rows of every sub dataframe whose zone can
+         *  hold the range, fetching only those from the store */
+        void map_where(size_t col, double lo, double hi, Rower &r) {
+            for (size_t pos = 0; pos < sub_ids.size(); pos++) {
+                if (!subOverlaps(pos, col, lo, hi)) continue;
+                Key* k = createKeyFromRow(sub_ids[pos] * ROWS_PER_DF);
+                DataFrame* df = kv_->waitAndGet(*k);
+                delete k;
+                df->map_where(col, lo, hi, r);
+                delete df;
+            }
+        }
+
         size_t getDFid(size_t row) {
             return row / ROWS_PER_DF;
         }
@@ -0,0 +1,574 @@
+//lang: CwC
+#pragma once
+
+#include <limits>
+#include <type_traits>
+#include "view.h"
+
+/*************************************************************************
+ * Expressions::
+ * Predicates and projections over the columns of a dataframe, built with
+ * ordinary operators and evaluated without a Rower:
+ *
+ *   df->where(col<int>(0) > 30 && col<String>(2).len() == 3)
+ *     ->select(col<String>(2), col<double>(1) * 2);
+ *
+ * Every expression is a small value whose type records its whole tree, so
+ * evaluating it is a loop the compiler sees through: no virtual calls, no
+ * Row and no type switches per row. Expressions are evaluated a batch at a
+ * time. bind(batch) fetches the typed spans of the columns a node reads,
+ * then at(i) is its value on the i-th row of the batch and null(i) says
+ * whether that value is missing. Work is split into morsels of MORSEL_ROWS
+ * rows run on the shared thread pool, each task evaluating its own copy of
+ * the expression.
+ * col<T>(i) reads column i as values of type T: int for byte, short and
+ * int columns, int64_t for long columns, float for float columns, double
+ * for any numeric column, bool and String, whose values are StringViews.
+ * A comparison or arithmetic with a missing value is missing, as is an
+ * integer divided by zero; && and ||
+ * treat missing as false, and !p holds wherever p does not.
+ * remap(cols) makes an expression read column cols[i] wherever it read
+ * column i and columns(out) lists the columns it reads, so a plan can move
+ * it below a projection.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+
+/** Tag shared by every expression node */
+class ExprBase { };
+
+/** Base of the expression node D */
+template <typename D>
+class Expr : public ExprBase {
+  public:
+    const D& self() const {
+      return static_cast<const D&>(*this);
+    }
+};
+
+template <typename T>
+struct IsExpr : std::is_base_of<ExprBase, T> { };
+
+/** Does expression e hold, that is have a value that is true, at row i? */
+template <typename E>
+bool expr_holds(E& e, size_t i) {
+  return !e.null(i) && e.at(i);
+}
+
+/** How col<T> reads its column from a batch */
+template <typename T> struct ColumnSpan;
+
+template <> struct ColumnSpan<int> {
+  typedef int value_type;
+  static bool fits(char type) { return type == 'Y' || type == 'H' || type == 'I'; }
+  static const int* read(Batch& b, size_t col) { return b.ints(col); }
+  static int get(Batch& b, const int* vals, size_t col, size_t i) { return vals[i]; }
+};
+
+template <> struct ColumnSpan<int64_t> {
+  typedef int64_t value_type;
+  static bool fits(char type) { return type == 'L'; }
+  static const int64_t* read(Batch& b, size_t col) { return b.longs(col); }
+  static int64_t get(Batch& b, const int64_t* vals, size_t col, size_t i) { return vals[i]; }
+};
+
+template <> struct ColumnSpan<float> {
+  typedef float value_type;
+  static bool fits(char type) { return type == 'F'; }
+  static const float* read(Batch& b, size_t col) { return b.floats(col); }
+  static float get(Batch& b, const float* vals, size_t col, size_t i) { return vals[i]; }
+};
+
+template <> struct ColumnSpan<double> {
+  typedef double value_type;
+  static bool fits(char type) { return is_numeric_type(type); }
+  static const double* read(Batch& b, size_t col) { return b.doubles(col); }
+  static double get(Batch& b, const double* vals, size_t col, size_t i) { return vals[i]; }
+};
+
+template <> struct ColumnSpan<bool> {
+  typedef bool value_type;
+  static bool fits(char type) { return type == 'B'; }
+  static const bool* read(Batch& b, size_t col) { return nullptr; }
+  static bool get(Batch& b, const bool* vals, size_t col, size_t i) { return b.get_bool(col, i); }
+};
+
+template <> struct ColumnSpan<String> {
+  typedef StringView value_type;
+  static bool fits(char type) { return type == 'S'; }
+  static const StringView* read(Batch& b, size_t col) { return nullptr; }
+  static StringView get(Batch& b, const StringView* vals, size_t col, size_t i) { return b.get_view(col, i); }
+};
+
+template <typename E> class LenExpr;
+
+/** The values of one column */
+template <typename T>
+class ColExpr : public Expr<ColExpr<T>> {
+  public:
+    typedef typename ColumnSpan<T>::value_type value_type;
+    size_t col_;
+    Batch* batch_;            // external
+    const value_type* vals_;  // external; span of the bound batch
+    bool nullable_;           // may the bound batch have missing values?
+
+    ColExpr(size_t col) {
+      col_ = col;
+      batch_ = nullptr;
+      vals_ = nullptr;
+      nullable_ = false;
+    }
+
+    void bind(Batch& b) {
+      if (!ColumnSpan<T>::fits(b.col_type(col_))) {
+        assert("Expression column is of another type." && false);
+      }
+      batch_ = &b;
+      vals_ = ColumnSpan<T>::read(b, col_);
+      nullable_ = b.has_missing(col_);
+    }
+
+    value_type at(size_t i) {
+      return ColumnSpan<T>::get(*batch_, vals_, col_, i);
+    }
+
+    bool null(size_t i) {
+      return nullable_ && batch_->is_missing(col_, i);
+    }
+
+    void remap(const std::vector<size_t>& cols) {
+      col_ = cols[col_];
+    }
+
+    void columns(std::vector<size_t>& out) const {
+      out.push_back(col_);
+    }
+
+    /** Length of each string, for String columns */
+    LenExpr<ColExpr> len() const {
+      return LenExpr<ColExpr>(*this);
+    }
+};
+
+/** Column i read as values of type T */
+template <typename T>
+ColExpr<T> col(size_t i) {
+  return ColExpr<T>(i);
+}
+
+/** A constant */
+template <typename V>
+class ConstExpr : public Expr<ConstExpr<V>> {
+  public:
+    typedef V value_type;
+    V val_;
+
+    ConstExpr(V val) {
+      val_ = val;
+    }
+
+    void bind(Batch& b) { }
+
+    V at(size_t i) {
+      return val_;
+    }
+
+    bool null(size_t i) {
+      return false;
+    }
+
+    void remap(const std::vector<size_t>& cols) { }
+
+    void columns(std::vector<size_t>& out) const { }
+};
+
+/** Length of each value of a string expression */
+template <typename E>
+class LenExpr : public Expr<LenExpr<E>> {
+  public:
+    typedef int value_type;
+    E e_;
+
+    LenExpr(const E& e) : e_(e) { }
+
+    void bind(Batch& b) {
+      e_.bind(b);
+    }
+
+    int at(size_t i) {
+      return (int)e_.at(i).size();
+    }
+
+    bool null(size_t i) {
+      return e_.null(i);
+    }
+
+    void remap(const std::vector<size_t>& cols) {
+      e_.remap(cols);
+    }
+
+    void columns(std::vector<size_t>& out) const {
+      e_.columns(out);
+    }
+};
+
+/** Ordering of values, strings by their bytes */
+template <typename A, typename B>
+bool expr_less(A a, B b) {
+  return a < b;
+}
+
+inline bool expr_less(StringView a, StringView b) {
+  int cmp = memcmp(a.c_str(), b.c_str(), std::min(a.size(), b.size()));
+  return cmp != 0 ? cmp < 0 : a.size() < b.size();
+}
+
+template <typename A, typename B>
+bool expr_equal(A a, B b) {
+  return a == b;
+}
+
+inline bool expr_equal(StringView a, StringView b) {
+  return a.equals(b);
+}
+
+/** Ops defined on every pair of values; undefined(l, r, i) says whether the
+ *  op has no value at row i */
+struct TotalOp {
+  template <typename L, typename R> static bool undefined(L& l, R& r, size_t i) { return false; }
+};
+
+struct AddOp : TotalOp { template <typename A, typename B> static auto apply(A a, B b) -> decltype(a + b) { return a + b; } };
+struct SubOp : TotalOp { template <typename A, typename B> static auto apply(A a, B b) -> decltype(a - b) { return a - b; } };
+struct MulOp : TotalOp { template <typename A, typename B> static auto apply(A a, B b) -> decltype(a * b) { return a * b; } };
+/** Integer division by zero, or of the least value of the result type by
+ *  -1, is missing rather than a trap */
+struct DivOp {
+  template <typename A, typename B> static auto apply(A a, B b) -> decltype(a / b) { return a / b; }
+  template <typename L, typename R> static bool undefined(L& l, R& r, size_t i) {
+    typedef decltype(apply(l.at(i), r.at(i))) T;
+    if (!std::is_integral<T>::value) return false;
+    T divisor = r.at(i);
+    if (divisor == 0) return true;
+    return std::is_signed<T>::value && divisor == T(-1) && T(l.at(i)) == std::numeric_limits<T>::min();
+  }
+};
+struct LtOp : TotalOp { template <typename A, typename B> static bool apply(A a, B b) { return expr_less(a, b); } };
+struct LeOp : TotalOp { template <typename A, typename B> static bool apply(A a, B b) { return !expr_less(b, a); } };
+struct GtOp : TotalOp { template <typename A, typename B> static bool apply(A a, B b) { return expr_less(b, a); } };
+struct GeOp : TotalOp { template <typename A, typename B> static bool apply(A a, B b) { return !expr_less(a, b); } };
+struct EqOp : TotalOp { template <typename A, typename B> static bool apply(A a, B b) { return expr_equal(a, b); } };
+struct NeOp : TotalOp { template <typename A, typename B> static bool apply(A a, B b) { return !expr_equal(a, b); } };
+
+/** Op applied to the values of two expressions, missing where either is or
+ *  where the op is undefined */
+template <typename Op, typename L, typename R>
+class BinaryExpr : public Expr<BinaryExpr<Op, L, R>> {
+  public:
+    typedef decltype(Op::apply(std::declval<typename L::value_type>(),
+                               std::declval<typename R::value_type>())) value_type;
+    L l_;
+    R r_;
+
+    BinaryExpr(const L& l, const R& r) : l_(l), r_(r) { }
+
+    void bind(Batch& b) {
+      l_.bind(b);
+      r_.bind(b);
+    }
+
+    value_type at(size_t i) {
+      return Op::apply(l_.at(i), r_.at(i));
+    }
+
+    bool null(size_t i) {
+      return l_.null(i) || r_.null(i) || Op::undefined(l_, r_, i);
+    }
+
+    void remap(const std::vector<size_t>& cols) {
+      l_.remap(cols);
+      r_.remap(cols);
+    }
+
+    void columns(std::vector<size_t>& out) const {
+      l_.columns(out);
+      r_.columns(out);
+    }
+};
+
+/** Holds where both sides hold; never missing */
+template <typename L, typename R>
+class AndExpr : public Expr<AndExpr<L, R>> {
+  public:
+    typedef bool value_type;
+    L l_;
+    R r_;
+
+    AndExpr(const L& l, const R& r) : l_(l), r_(r) { }
+
+    void bind(Batch& b) {
+      l_.bind(b);
+      r_.bind(b);
+    }
+
+    bool at(size_t i) {
+      return expr_holds(l_, i) && expr_holds(r_, i);
+    }
+
+    bool null(size_t i) {
+      return false;
+    }
+
+    void remap(const std::vector<size_t>& cols) {
+      l_.remap(cols);
+      r_.remap(cols);
+    }
+
+    void columns(std::vector<size_t>& out) const {
+      l_.columns(out);
+      r_.columns(out);
+    }
+};
+
+/** Holds where either side holds; never missing */
+template <typename L, typename R>
+class OrExpr : public Expr<OrExpr<L, R>> {
+  public:
+    typedef bool value_type;
+    L l_;
+    R r_;
+
+    OrExpr(const L& l, const R& r) : l_(l), r_(r) { }
+
+    void bind(Batch& b) {
+      l_.bind(b);
+      r_.bind(b);
+    }
+
+    bool at(size_t i) {
+      return expr_holds(l_, i) || expr_holds(r_, i);
+    }
+
+    bool null(size_t i) {
+      return false;
+    }
+
+    void remap(const std::vector<size_t>& cols) {
+      l_.remap(cols);
+      r_.remap(cols);
+    }
+
+    void columns(std::vector<size_t>& out) const {
+      l_.columns(out);
+      r_.columns(out);
+    }
+};
+
+/** Holds where e does not; never missing */
+template <typename E>
+class NotExpr : public Expr<NotExpr<E>> {
+  public:
+    typedef bool value_type;
+    E e_;
+
+    NotExpr(const E& e) : e_(e) { }
+
+    void bind(Batch& b) {
+      e_.bind(b);
+    }
+
+    bool at(size_t i) {
+      return !expr_holds(e_, i);
+    }
+
+    bool null(size_t i) {
+      return false;
+    }
+
+    void remap(const std::vector<size_t>& cols) {
+      e_.remap(cols);
+    }
+
+    void columns(std::vector<size_t>& out) const {
+      e_.columns(out);
+    }
+};
+
+/** The expression node for an operand: expressions are themselves, values
+ *  become constants and string literals constant StringViews */
+template <typename T, bool = IsExpr<T>::value>
+struct Lift {
+  typedef T type;
+  static const T& make(const T& e) { return e; }
+};
+
+template <typename T>
+struct Lift<T, false> {
+  typedef ConstExpr<T> type;
+  static type make(const T& v) { return type(v); }
+};
+
+template <size_t N>
+struct Lift<char[N], false> {
+  typedef ConstExpr<StringView> type;
+  static type make(const char* s) { return type(StringView(s, strlen(s))); }
+};
+
+template <>
+struct Lift<const char*, false> {
+  typedef ConstExpr<StringView> type;
+  static type make(const char* s) { return type(StringView(s, strlen(s))); }
+};
+
+/** The node Node<lifted L, lifted R>, when one operand is an expression */
+template <template <typename, typename> class Node, typename L, typename R>
+struct ExprResult
+    : std::enable_if<IsExpr<L>::value || IsExpr<R>::value,
+                     Node<typename Lift<L>::type, typename Lift<R>::type>> { };
+
+template <typename Op>
+struct BinaryOf {
+  template <typename L, typename R> using Node = BinaryExpr<Op, L, R>;
+};
+
+#define EXPR_OPERATOR(OP, NAME)                                                              \
+  template <typename L, typename R>                                                          \
+  typename ExprResult<BinaryOf<NAME>::template Node, L, R>::type operator OP(const L& l,    \
+                                                                              const R& r) { \
+    return BinaryExpr<NAME, typename Lift<L>::type, typename Lift<R>::type>(                 \
+        Lift<L>::make(l), Lift<R>::make(r));                                                 \
+  }
+
+EXPR_OPERATOR(+, AddOp)
+EXPR_OPERATOR(-, SubOp)
+EXPR_OPERATOR(*, MulOp)
+EXPR_OPERATOR(/, DivOp)
+EXPR_OPERATOR(<, LtOp)
+EXPR_OPERATOR(<=, LeOp)
+EXPR_OPERATOR(>, GtOp)
+EXPR_OPERATOR(>=, GeOp)
+EXPR_OPERATOR(==, EqOp)
+EXPR_OPERATOR(!=, NeOp)
+
+#undef EXPR_OPERATOR
+
+template <typename L, typename R>
+typename ExprResult<AndExpr, L, R>::type operator&&(const L& l, const R& r) {
+  return AndExpr<typename Lift<L>::type, typename Lift<R>::type>(Lift<L>::make(l), Lift<R>::make(r));
+}
+
+template <typename L, typename R>
+typename ExprResult<OrExpr, L, R>::type operator||(const L& l, const R& r) {
+  return OrExpr<typename Lift<L>::type, typename Lift<R>::type>(Lift<L>::make(l), Lift<R>::make(r));
+}
+
+template <typename E>
+typename std::enable_if<IsExpr<E>::value, NotExpr<E>>::type operator!(const E& e) {
+  return NotExpr<E>(e);
+}
+
+/** Schema type of the column a projection with values of type V fills */
+template <typename V> struct ExprType;
+template <> struct ExprType<int> { static const char code = 'I'; };
+template <> struct ExprType<int64_t> { static const char code = 'L'; };
+template <> struct ExprType<float> { static const char code = 'F'; };
+template <> struct ExprType<double> { static const char code = 'D'; };
+template <> struct ExprType<bool> { static const char code = 'B'; };
+template <> struct ExprType<StringView> { static const char code = 'S'; };
+
+inline void expr_put(Column* to, size_t row, int v) { to->as_int()->set(row, v); }
+inline void expr_put(Column* to, size_t row, int64_t v) { to->as_long()->set(row, v); }
+inline void expr_put(Column* to, size_t row, float v) { to->as_float()->set(row, v); }
+inline void expr_put(Column* to, size_t row, double v) { to->as_double()->set(row, v); }
+inline void expr_put(Column* to, size_t row, bool v) { to->as_bool()->set(row, v); }
+inline void expr_put(Column* to, size_t row, StringView v) { to->as_string()->set_chars(row, v.c_str(), v.size()); }
+
+/** The dataframe holding the columns of df, its parent for a view */
+inline DataFrame* expr_base(DataFrame* df) {
+  DataFrameView* view = df->as_view();
+  return view == nullptr ? df : view->parent_;
+}
+
+/** Moves batch over the rows of morsel m of df, a chunk at a time, calling
+ *  f() at each stop. The rows of df in the morsel are batch.row(k) for k
+ *  below batch.count(). */
+template <typename Fn>
+void scan_morsel(DataFrame* df, size_t m, Batch& batch, Fn f) {
+  size_t start = m * MORSEL_ROWS;
+  size_t end = std::min(start + MORSEL_ROWS, df->nrows());
+  DataFrameView* view = df->as_view();
+  if (view == nullptr) df->for_each_batch(start, end, batch, f);
+  else view->parent_->for_each_listed(view->rows_.data() + start, end - start, batch, f);
+}
+
+/** Fills the empty column to with the value of e on every row of df */
+template <typename E>
+void expr_project(DataFrame* df, E e, Column* to) {
+  typedef typename E::value_type V;
+  DataFrame* base = expr_base(df);
+  size_t morsels = (df->nrows() + MORSEL_ROWS - 1) / MORSEL_ROWS;
+  std::vector<std::vector<V>> vals(morsels);
+  std::vector<std::vector<size_t>> nulls(morsels);
+  for_each_morsel(morsels, [&](size_t m) {
+    E mine = e;
+    Batch batch(base->columns, base->ncols());
+    scan_morsel(df, m, batch, [&]() {
+      mine.bind(batch);
+      for (size_t k = 0; k < batch.count(); k++) {
+        size_t i = batch.row(k);
+        if (mine.null(i)) nulls[m].push_back(vals[m].size());
+        vals[m].push_back(mine.null(i) ? V() : mine.at(i));
+      }
+    });
+  });
+  //morsels are copied in order, missing values skipped then marked
+  size_t row = 0;
+  for (size_t m = 0; m < morsels; m++) {
+    size_t next = 0;
+    for (size_t j = 0; j < vals[m].size(); j++) {
+      if (next < nulls[m].size() && nulls[m][next] == j) {
+        to->set_missing(row + j);
+        next++;
+      } else {
+        expr_put(to, row + j, (V)vals[m][j]);
+      }
+    }
+    row += vals[m].size();
+  }
+}
+
+/** A view of the rows of this dataframe for which pred holds */
+template <typename P>
+DataFrameView* DataFrame::where(const Expr<P>& pred) {
+  DataFrame* base = expr_base(this);
+  size_t morsels = (nrows() + MORSEL_ROWS - 1) / MORSEL_ROWS;
+  std::vector<std::vector<size_t>> sels(morsels);
+  for_each_morsel(morsels, [&](size_t m) {
+    P mine = pred.self();
+    Batch batch(base->columns, base->ncols());
+    scan_morsel(this, m, batch, [&]() {
+      mine.bind(batch);
+      for (size_t k = 0; k < batch.count(); k++) {
+        size_t i = batch.row(k);
+        if (expr_holds(mine, i)) sels[m].push_back(batch.start() + i);
+      }
+    });
+  });
+  std::vector<size_t> rows;
+  for (size_t m = 0; m < morsels; m++) rows.insert(rows.end(), sels[m].begin(), sels[m].end());
+  return new DataFrameView(base, rows);
+}
+
+/** A new dataframe with a column per expression, holding its value on
+ *  every row of this dataframe */
+template <typename... Es>
+DataFrame* DataFrame::select(const Expr<Es>&... exprs) {
+  static const char types[] = { ExprType<typename Es::value_type>::code..., '\0' };
+  DataFrame* out = new DataFrame(*new Schema(types));
+  size_t i = 0;
+  int done[] = { 0, (expr_project(this, exprs.self(), out->columns[i++]), 0)... };
+  (void)done;
+  if (nrows() > 0) out->schema->new_length(nrows() - 1);
+  return out;
+}
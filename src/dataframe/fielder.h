@@ -1,6 +1,7 @@
 //lang: CwC
 #pragma once
 
+#include <cstdint>
 #include "../object.h"
 
 /*****************************************************************************
@@ -17,7 +18,15 @@ public:
   virtual void accept(bool b) { }
   virtual void accept(double d) { }
   virtual void accept(int i) { }
+  virtual void accept(int64_t l) { }
   virtual void accept(String* s) { }
+
+  /** Called for the narrow numeric types. By default the value is widened
+    and handed to the int or double accept. Longs have their own accept,
+    a double cannot hold every one of them. */
+  virtual void accept(int8_t b) { accept((int)b); }
+  virtual void accept(int16_t h) { accept((int)h); }
+  virtual void accept(float f) { accept((double)f); }
  
   /** Called when all fields have been seen. */
   virtual void done() { }
@@ -46,6 +55,9 @@ class PrintFielder: public Fielder {
     void accept(int i) {
       std::cout << "<" << i << ">";
     }
+    void accept(int64_t l) {
+      std::cout << "<" << l << ">";
+    }
     void accept(String* s) {
       std::cout << "<" << s->c_str() << ">";
     }
@@ -68,6 +80,9 @@ class SorPrintFielder: public Fielder {
     void accept(int i) {
       std::cout << "<" << i << ">";
     }
+    void accept(int64_t l) {
+      std::cout << "<" << l << ">";
+    }
     void accept(String* s) {
       std::cout << "<" << s->c_str() << ">";
     }
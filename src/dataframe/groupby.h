@@ -0,0 +1,407 @@
+//lang: CwC
+#pragma once
+
+#include "view.h"
+
+/** Kinds of group_by aggregates */
+enum AggKind { AGG_COUNT, AGG_SUM, AGG_MIN, AGG_MAX };
+
+/*************************************************************************
+ * GroupAgg::
+ * One aggregate of a group_by: its kind and the column it reads. Count
+ * counts the present values of the column; sum, min and max skip missing
+ * values. Results of integer and bool columns are int64 ('L') and those of
+ * float and double columns are doubles ('D'); counts are int64.
+ */
+class GroupAgg : public Object {
+  public:
+    AggKind kind_;
+    size_t col_;
+
+    GroupAgg(AggKind kind, size_t col) {
+      kind_ = kind;
+      col_ = col;
+    }
+
+    /** Type of the result column for a source column of type t */
+    char result_type(char t) {
+      if (kind_ == AGG_COUNT) return 'L';
+      if (t == 'S') assert("Cannot aggregate a string column." && false);
+      return t == 'F' || t == 'D' ? 'D' : 'L';
+    }
+};
+
+/** Accumulated value of one aggregate of one group */
+union AggValue {
+  int64_t i;
+  double d;
+};
+
+/** Reads the values of a Row for GroupTable::add */
+class RowSource {
+  public:
+    Row& row_;
+
+    RowSource(Row& row) : row_(row) { }
+
+    bool missing(size_t c) { return row_.is_missing(c); }
+    int64_t integer(size_t c) { return row_.get_long(c); }
+    double real(size_t c) { return row_.get_double(c); }
+    bool boolean(size_t c) { return row_.get_bool(c); }
+    StringView view(size_t c) { return StringView(row_.get_string(c)); }
+};
+
+/** Reads the values of the i-th row of a batch for GroupTable::add */
+class BatchSource {
+  public:
+    Batch& batch_;
+    size_t i_;
+
+    BatchSource(Batch& batch) : batch_(batch) {
+      i_ = 0;
+    }
+
+    bool missing(size_t c) { return batch_.is_missing(c, i_); }
+    int64_t integer(size_t c) {
+      if (batch_.col_type(c) == 'L') return batch_.longs(c)[i_];
+      return batch_.ints(c)[i_];
+    }
+    double real(size_t c) { return batch_.doubles(c)[i_]; }
+    bool boolean(size_t c) { return batch_.get_bool(c, i_); }
+    StringView view(size_t c) { return batch_.get_view(c, i_); }
+};
+
+/*************************************************************************
+ * GroupTable::
+ * The groups found so far by a group_by and their running aggregates.
+ * Groups are stored in arrays indexed by group number, in the order they
+ * were first seen: a word per key column (the value of an integer or bool,
+ * the bits of a double or the index of an owned copy of a string), a
+ * missing flag per key column and a value and present count per
+ * aggregate. An open addressing table with linear probing maps a key to
+ * its group; it doubles when half full. Missing key values form groups of
+ * their own.
+ */
+class GroupTable : public Object {
+  public:
+    std::vector<char> key_types_;
+    std::vector<size_t> key_cols_;
+    std::vector<GroupAgg> aggs_;
+    std::vector<char> agg_types_;     // type of the source column of each aggregate
+    size_t n_groups_;
+    std::vector<uint64_t> keys_;      // key words, key_cols_.size() per group
+    std::vector<char> nulls_;         // missing key flags, like keys_
+    std::vector<uint64_t> hashes_;    // per group
+    std::vector<AggValue> values_;    // aggs_.size() per group
+    std::vector<int64_t> seen_;       // present values, like values_
+    std::vector<String*> strings_;    // owned; copies of string keys
+    std::vector<int> slots_;          // group in each slot, -1 when empty
+    std::vector<uint64_t> probe_;     // key words of the row being added
+    std::vector<char> probe_nulls_;
+    std::vector<StringView> probe_views_;
+
+    GroupTable(Schema& schema, const std::vector<size_t>& keys, const std::vector<GroupAgg>& aggs) {
+      key_cols_ = keys;
+      aggs_ = aggs;
+      for (size_t k = 0; k < keys.size(); k++) key_types_.push_back(schema.type(keys[k]));
+      for (size_t a = 0; a < aggs.size(); a++) {
+        agg_types_.push_back(schema.type(aggs[a].col_));
+        aggs_[a].result_type(agg_types_[a]);
+      }
+      n_groups_ = 0;
+      slots_.assign(64, -1);
+      probe_.resize(keys.size());
+      probe_nulls_.resize(keys.size());
+      probe_views_.resize(keys.size());
+    }
+
+    ~GroupTable() {
+      for (size_t i = 0; i < strings_.size(); i++) delete strings_[i];
+    }
+
+    /** Adds the row src reads to its group */
+    template <class Src>
+    void add(Src& src) {
+      uint64_t h = 0;
+      for (size_t k = 0; k < key_cols_.size(); k++) {
+        size_t c = key_cols_[k];
+        probe_nulls_[k] = src.missing(c);
+        uint64_t word = 0;
+        if (!probe_nulls_[k]) {
+          switch (key_types_[k]) {
+            case 'B':
+              word = src.boolean(c);
+              break;
+            case 'F':
+            case 'D': {
+              double d = src.real(c);
+              if (d == 0) d = 0; //-0.0 and 0.0 are one group
+              memcpy(&word, &d, sizeof(word));
+              break;
+            }
+            case 'S': {
+              probe_views_[k] = src.view(c);
+              word = string_hash(probe_views_[k]);
+              break;
+            }
+            default:
+              word = (uint64_t)src.integer(c);
+          }
+        }
+        probe_[k] = word;
+        h = mix_group(h ^ word ^ probe_nulls_[k]);
+      }
+      size_t g = find_or_add(h);
+      for (size_t a = 0; a < aggs_.size(); a++) {
+        size_t c = aggs_[a].col_;
+        if (src.missing(c)) continue;
+        if (aggs_[a].kind_ == AGG_COUNT) {
+          seen_[g * aggs_.size() + a]++;
+          continue;
+        }
+        AggValue v;
+        switch (agg_types_[a]) {
+          case 'B':
+            v.i = src.boolean(c);
+            break;
+          case 'F':
+          case 'D':
+            v.d = src.real(c);
+            break;
+          default:
+            v.i = src.integer(c);
+        }
+        update(g * aggs_.size() + a, a, v, 1);
+      }
+    }
+
+    /** Folds value v, standing for n present values, into aggregate a at
+     *  index at of values_ */
+    void update(size_t at, size_t a, AggValue v, int64_t n) {
+      bool real = agg_types_[a] == 'F' || agg_types_[a] == 'D';
+      AggValue& acc = values_[at];
+      bool first = seen_[at] == 0;
+      seen_[at] += n;
+      switch (aggs_[a].kind_) {
+        case AGG_SUM:
+          if (real) acc.d += v.d;
+          else acc.i += v.i;
+          break;
+        case AGG_MIN:
+          if (real && (first || v.d < acc.d)) acc.d = v.d;
+          if (!real && (first || v.i < acc.i)) acc.i = v.i;
+          break;
+        case AGG_MAX:
+          if (real && (first || v.d > acc.d)) acc.d = v.d;
+          if (!real && (first || v.i > acc.i)) acc.i = v.i;
+          break;
+        default:
+          break;
+      }
+    }
+
+    static uint64_t mix_group(uint64_t x) {
+      x ^= x >> 31;
+      x *= 0x7fb5d329728ea185ULL;
+      x ^= x >> 27;
+      x *= 0x81dadef4bc2dd44dULL;
+      x ^= x >> 33;
+      return x;
+    }
+
+    static uint64_t string_hash(StringView s) {
+      uint64_t h = 14695981039346656037ULL;
+      for (size_t i = 0; i < s.size(); i++) h = (h ^ (unsigned char)s.c_str()[i]) * 1099511628211ULL;
+      return h;
+    }
+
+    /** Group of the key in probe_, added with empty aggregates if new */
+    size_t find_or_add(uint64_t h) {
+      size_t mask = slots_.size() - 1;
+      size_t s = h & mask;
+      while (slots_[s] != -1) {
+        size_t g = slots_[s];
+        if (hashes_[g] == h && same_key(g)) return g;
+        s = (s + 1) & mask;
+      }
+      size_t g = n_groups_++;
+      for (size_t k = 0; k < key_cols_.size(); k++) {
+        uint64_t word = probe_[k];
+        if (key_types_[k] == 'S' && !probe_nulls_[k]) {
+          word = strings_.size();
+          strings_.push_back(probe_views_[k].to_string());
+        }
+        keys_.push_back(word);
+        nulls_.push_back(probe_nulls_[k]);
+      }
+      hashes_.push_back(h);
+      AggValue zero;
+      zero.i = 0;
+      for (size_t a = 0; a < aggs_.size(); a++) {
+        values_.push_back(zero);
+        seen_.push_back(0);
+      }
+      slots_[s] = g;
+      if (2 * n_groups_ > slots_.size()) grow();
+      return g;
+    }
+
+    /** Is the key of group g the one in probe_? */
+    bool same_key(size_t g) {
+      for (size_t k = 0; k < key_cols_.size(); k++) {
+        size_t at = g * key_cols_.size() + k;
+        if (nulls_[at] != probe_nulls_[k]) return false;
+        if (nulls_[at]) continue;
+        if (key_types_[k] == 'S') {
+          if (!probe_views_[k].equals(strings_[keys_[at]])) return false;
+        } else if (keys_[at] != probe_[k]) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /** Doubles the slots and puts every group back */
+    void grow() {
+      slots_.assign(slots_.size() * 2, -1);
+      size_t mask = slots_.size() - 1;
+      for (size_t g = 0; g < n_groups_; g++) {
+        size_t s = hashes_[g] & mask;
+        while (slots_[s] != -1) s = (s + 1) & mask;
+        slots_[s] = g;
+      }
+    }
+
+    /** Adds the groups and aggregates of other, a table of the same keys
+     *  and aggregates */
+    void merge(GroupTable& other) {
+      size_t width = key_cols_.size();
+      for (size_t g = 0; g < other.n_groups_; g++) {
+        for (size_t k = 0; k < width; k++) {
+          size_t at = g * width + k;
+          probe_[k] = other.keys_[at];
+          probe_nulls_[k] = other.nulls_[at];
+          if (key_types_[k] == 'S' && !probe_nulls_[k]) {
+            probe_views_[k] = StringView(other.strings_[other.keys_[at]]);
+            probe_[k] = string_hash(probe_views_[k]);
+          }
+        }
+        size_t mine = find_or_add(other.hashes_[g]);
+        for (size_t a = 0; a < aggs_.size(); a++) {
+          size_t theirs = g * aggs_.size() + a;
+          if (other.seen_[theirs] == 0) continue;
+          if (aggs_[a].kind_ == AGG_COUNT) {
+            seen_[mine * aggs_.size() + a] += other.seen_[theirs];
+          } else {
+            update(mine * aggs_.size() + a, a, other.values_[theirs], other.seen_[theirs]);
+          }
+        }
+      }
+    }
+
+    /** A new dataframe with a row per group, in the order the groups were
+     *  first seen: the key columns, then one column per aggregate */
+    DataFrame* result() {
+      std::string types;
+      for (size_t k = 0; k < key_types_.size(); k++) types += key_types_[k];
+      for (size_t a = 0; a < aggs_.size(); a++) types += aggs_[a].result_type(agg_types_[a]);
+      DataFrame* df = new DataFrame(*new Schema(types.c_str()));
+      size_t width = key_cols_.size();
+      for (size_t g = 0; g < n_groups_; g++) {
+        for (size_t k = 0; k < width; k++) {
+          size_t at = g * width + k;
+          if (nulls_[at]) {
+            df->set_missing(k, g);
+            continue;
+          }
+          uint64_t word = keys_[at];
+          switch (key_types_[k]) {
+            case 'B':
+              df->set(k, g, word != 0);
+              break;
+            case 'F':
+            case 'D': {
+              double d;
+              memcpy(&d, &word, sizeof(d));
+              if (key_types_[k] == 'F') df->set(k, g, (float)d);
+              else df->set(k, g, d);
+              break;
+            }
+            case 'S':
+              df->set_chars(k, g, strings_[word]->c_str(), strings_[word]->size());
+              break;
+            default:
+              df->set(k, g, (int64_t)word);
+          }
+        }
+        for (size_t a = 0; a < aggs_.size(); a++) {
+          size_t at = g * aggs_.size() + a;
+          size_t c = width + a;
+          if (aggs_[a].kind_ == AGG_COUNT) {
+            df->set(c, g, seen_[at]);
+          } else if (seen_[at] == 0) {
+            df->set_missing(c, g);
+          } else if (df->get_schema().type(c) == 'D') {
+            df->set(c, g, values_[at].d);
+          } else {
+            df->set(c, g, values_[at].i);
+          }
+        }
+      }
+      return df;
+    }
+};
+
+/*************************************************************************
+ * GroupByRower::
+ * Adds the rows it is shown to a GroupTable. pmap gives every thread its
+ * own clone, so each pre-aggregates its rows without locking; the clones'
+ * tables are merged into the original's when they are joined.
+ */
+class GroupByRower : public BatchRower {
+  public:
+    Schema* schema_; // external
+    GroupTable table_;
+
+    GroupByRower(Schema& schema, const std::vector<size_t>& keys, const std::vector<GroupAgg>& aggs)
+        : table_(schema, keys, aggs) {
+      schema_ = &schema;
+    }
+
+    bool accept(Row& r) {
+      RowSource src(r);
+      table_.add(src);
+      return false;
+    }
+
+    void accept(Batch& b) {
+      BatchSource src(b);
+      for (size_t k = 0; k < b.count(); k++) {
+        src.i_ = b.row(k);
+        table_.add(src);
+      }
+    }
+
+    Object* clone() {
+      return new GroupByRower(*schema_, table_.key_cols_, table_.aggs_);
+    }
+
+    void join_delete(Rower* other) {
+      GroupByRower* o = dynamic_cast<GroupByRower*>(other);
+      table_.merge(o->table_);
+      delete o;
+    }
+};
+
+/** Groups the rows of df by their values in the key columns and computes
+ *  aggs over each group. Rows are pre-aggregated in parallel by pmap, one
+ *  table per thread, then merged. Returns a new dataframe with the key
+ *  columns followed by a column per aggregate, one row per group. Groups
+ *  appear in the order the merged tables first saw them, which only
+ *  matches the order of the rows when df is small enough to be visited by
+ *  a single thread. */
+inline DataFrame* group_by(DataFrame* df, const std::vector<size_t>& keys, const std::vector<GroupAgg>& aggs) {
+  GroupByRower rower(df->get_schema(), keys, aggs);
+  df->pmap(rower);
+  return rower.table_.result();
+}
@@ -0,0 +1,324 @@
+//lang: CwC
+#pragma once
+
+#include <cstdint>
+#include "../object.h"
+#include "../serial/serial.h"
+
+/** Encodings of a chunk of ints */
+#define INT_RAW 0   // plain 4 byte values
+#define INT_FOR 1   // frame of reference, value - min bit-packed
+#define INT_DELTA 2 // zigzagged differences bit-packed, with checkpoints
+#define INT_RLE 3   // runs of equal values
+
+/** A DELTA chunk keeps the absolute value of every DELTA_CHECKPOINT-th
+ *  value so random access sums at most DELTA_CHECKPOINT - 1 deltas */
+#define DELTA_CHECKPOINT 32
+
+/*************************************************************************
+ * EncodedInts::
+ * An immutable, compressed run of ints, usually one column chunk. encode
+ * measures every encoding and keeps the smallest. Bit-packed values of
+ * width_ bits are stored back to back in words_, value i starting at bit
+ * i * width_. Whole runs decode in one pass with decode, single values
+ * with get. Borrowed ones read their arrays in place from a serialized
+ * buffer instead of owning them.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+class EncodedInts : public Object, public Serializable {
+  public:
+    size_t encoding_;
+    size_t len_;      // number of values
+    int ref_;         // FOR: the minimum value
+    size_t width_;    // FOR and DELTA: bits per packed value
+    uint64_t* words_; // owned; packed values, one spare word
+    size_t n_words_;
+    int* aux_;        // owned; RAW values, DELTA checkpoints or RLE run values
+    size_t n_aux_;
+    uint32_t* ends_;  // owned; RLE: index one past the end of each run
+    bool lent_;       // do the arrays point into a buffer owned elsewhere?
+
+    EncodedInts() {
+      lent_ = false;
+      encoding_ = INT_RAW;
+      len_ = 0;
+      ref_ = 0;
+      width_ = 0;
+      words_ = nullptr;
+      n_words_ = 0;
+      aux_ = nullptr;
+      n_aux_ = 0;
+      ends_ = nullptr;
+    }
+
+    ~EncodedInts() {
+      if (lent_) return;
+      delete[] words_;
+      delete[] aux_;
+      delete[] ends_;
+    }
+
+    /** Encodes the n values at vals in whichever encoding is smallest */
+    static EncodedInts* encode(int* vals, size_t n) {
+      EncodedInts* res = new EncodedInts();
+      res->len_ = n;
+      if (n == 0) return res;
+      int64_t lo = vals[0], hi = vals[0];
+      uint64_t max_zigzag = 0;
+      size_t runs = 1;
+      for (size_t i = 1; i < n; i++) {
+        if (vals[i] < lo) lo = vals[i];
+        if (vals[i] > hi) hi = vals[i];
+        uint64_t zz = zigzag((int64_t)vals[i] - vals[i - 1]);
+        if (zz > max_zigzag) max_zigzag = zz;
+        if (vals[i] != vals[i - 1]) runs++;
+      }
+      size_t for_width = bit_width(hi - lo);
+      size_t delta_width = bit_width(max_zigzag);
+      size_t raw_bytes = 4 * n;
+      size_t for_bytes = 8 * packed_words(n, for_width);
+      size_t delta_bytes = delta_width > 32 ? SIZE_MAX :
+        8 * packed_words(n, delta_width) + 4 * checkpoints(n);
+      size_t rle_bytes = 8 * runs;
+      if (for_bytes <= rle_bytes && for_bytes <= delta_bytes && for_bytes < raw_bytes) {
+        res->encoding_ = INT_FOR;
+        res->ref_ = lo;
+        res->width_ = for_width;
+        res->allocate_words();
+        for (size_t i = 0; i < n; i++) res->pack(i, (uint64_t)((int64_t)vals[i] - lo));
+      } else if (rle_bytes <= delta_bytes && rle_bytes < raw_bytes) {
+        res->encoding_ = INT_RLE;
+        res->n_aux_ = runs;
+        res->aux_ = new int[runs];
+        res->ends_ = new uint32_t[runs];
+        size_t r = 0;
+        for (size_t i = 1; i <= n; i++) {
+          if (i == n || vals[i] != vals[i - 1]) {
+            res->aux_[r] = vals[i - 1];
+            res->ends_[r++] = i;
+          }
+        }
+      } else if (delta_bytes < raw_bytes) {
+        res->encoding_ = INT_DELTA;
+        res->width_ = delta_width;
+        res->allocate_words();
+        res->n_aux_ = checkpoints(n);
+        res->aux_ = new int[res->n_aux_];
+        for (size_t i = 0; i < n; i++) {
+          if (i % DELTA_CHECKPOINT == 0) res->aux_[i / DELTA_CHECKPOINT] = vals[i];
+          else res->pack(i, zigzag((int64_t)vals[i] - vals[i - 1]));
+        }
+      } else {
+        res->n_aux_ = n;
+        res->aux_ = new int[n];
+        memcpy(res->aux_, vals, 4 * n);
+      }
+      return res;
+    }
+
+    /** Number of values */
+    size_t size() {
+      return len_;
+    }
+
+    /** Bytes taken by the encoded values */
+    size_t bytes() {
+      return 8 * n_words_ + 4 * n_aux_ + (ends_ == nullptr ? 0 : 4 * n_aux_);
+    }
+
+    /** Value at idx */
+    int get(size_t idx) {
+      switch (encoding_) {
+        case INT_FOR:
+          return (int)((int64_t)ref_ + (int64_t)unpack(idx));
+        case INT_DELTA: {
+          size_t cp = idx / DELTA_CHECKPOINT;
+          int64_t val = aux_[cp];
+          for (size_t i = cp * DELTA_CHECKPOINT + 1; i <= idx; i++) val += unzigzag(unpack(i));
+          return (int)val;
+        }
+        case INT_RLE: {
+          size_t lo = 0, hi = n_aux_ - 1;
+          while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (ends_[mid] <= idx) lo = mid + 1;
+            else hi = mid;
+          }
+          return aux_[lo];
+        }
+        default:
+          return aux_[idx];
+      }
+    }
+
+    /** Decodes every value into out, which holds at least size() ints */
+    void decode(int* out) {
+      switch (encoding_) {
+        case INT_FOR:
+          for (size_t i = 0; i < len_; i++) out[i] = (int)((int64_t)ref_ + (int64_t)unpack(i));
+          break;
+        case INT_DELTA: {
+          int64_t val = 0;
+          for (size_t i = 0; i < len_; i++) {
+            val = i % DELTA_CHECKPOINT == 0 ? aux_[i / DELTA_CHECKPOINT] : val + unzigzag(unpack(i));
+            out[i] = (int)val;
+          }
+          break;
+        }
+        case INT_RLE: {
+          size_t i = 0;
+          for (size_t r = 0; r < n_aux_; r++) {
+            while (i < ends_[r]) out[i++] = aux_[r];
+          }
+          break;
+        }
+        default:
+          memcpy(out, aux_, 4 * len_);
+      }
+    }
+
+    /** Writes the low width_ bits of val as packed value i */
+    void pack(size_t i, uint64_t val) {
+      if (width_ == 0) return;
+      size_t bit = i * width_;
+      size_t off = bit & 63;
+      words_[bit >> 6] |= val << off;
+      if (off + width_ > 64) words_[(bit >> 6) + 1] |= val >> (64 - off);
+    }
+
+    /** Packed value i */
+    uint64_t unpack(size_t i) {
+      if (width_ == 0) return 0;
+      size_t bit = i * width_;
+      size_t off = bit & 63;
+      uint64_t val = words_[bit >> 6] >> off;
+      if (off + width_ > 64) val |= words_[(bit >> 6) + 1] << (64 - off);
+      return val & (((uint64_t)1 << width_) - 1);
+    }
+
+    void allocate_words() {
+      n_words_ = packed_words(len_, width_);
+      words_ = new uint64_t[n_words_]();
+    }
+
+    /** Words needed to pack n values of width bits, plus a spare word */
+    static size_t packed_words(size_t n, size_t width) {
+      return ((n * width + 63) >> 6) + 1;
+    }
+
+    static size_t checkpoints(size_t n) {
+      return (n + DELTA_CHECKPOINT - 1) / DELTA_CHECKPOINT;
+    }
+
+    /** Number of bits needed to hold val */
+    static size_t bit_width(uint64_t val) {
+      return val == 0 ? 0 : 64 - __builtin_clzll(val);
+    }
+
+    /** Maps small negative and positive differences to small unsigned ones */
+    static uint64_t zigzag(int64_t val) {
+      return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+    }
+
+    static int64_t unzigzag(uint64_t val) {
+      return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+    }
+
+    /** Serializes the encoded values. Structure is as following
+     *
+     * |--8 bytes--|--8 bytes--|--8 bytes--|--8 bytes--|--8 bytes--|--8 bytes--|
+     * |--length---|--encoding-|--len_-----|--ref_-----|--width_---|--n_words_-|
+     *
+     * |--8 bytes--|--8 bytes each--|--4 bytes each--|--4 bytes each, RLE only--|
+     * |--n_aux_---|--words_--------|--aux_----------|--ends_-------------------|
+     *
+     * zero padded to a multiple of 8 bytes, so the words of the next
+     * encoding in a buffer stay aligned.
+     */
+    size_t serial_size() {
+      return padded_size(bytes());
+    }
+
+    /** Serialized size of encoded values taking bytes, padding included */
+    static size_t padded_size(size_t bytes) {
+      return (56 + bytes + 7) & ~(size_t)7;
+    }
+
+    void write_to(BufferWriter& writer) {
+      size_t end = writer.pos_ + serial_size();
+      writer.write_size_t(serial_size());
+      writer.write_size_t(encoding_);
+      writer.write_size_t(len_);
+      writer.write_size_t((size_t)(int64_t)ref_);
+      writer.write_size_t(width_);
+      writer.write_size_t(n_words_);
+      writer.write_size_t(n_aux_);
+      writer.write_bytes(words_, 8 * n_words_);
+      writer.write_bytes(aux_, 4 * n_aux_);
+      if (ends_ != nullptr) writer.write_bytes(ends_, 4 * n_aux_);
+      while (writer.pos_ < end) writer.write_byte(0);
+    }
+
+    void read_from(BufferReader& reader) {
+      read_from(reader, false);
+    }
+
+    /** Reads the encoded values at the reader's cursor, mutating these
+     *  EncodedInts, and checks their arrays hold every value get and
+     *  decode read. Borrowing points the arrays into the buffer, which
+     *  must be 8 byte aligned and outlive these EncodedInts. */
+    void read_from(BufferReader& reader, bool borrow) {
+      size_t start = reader.pos_;
+      size_t length = reader.read_size_t();
+      encoding_ = reader.read_size_t();
+      len_ = reader.read_size_t();
+      ref_ = (int)(int64_t)reader.read_size_t();
+      width_ = reader.read_size_t();
+      n_words_ = reader.read_size_t();
+      n_aux_ = reader.read_size_t();
+      //the counts are checked against the bytes left before any is multiplied
+      size_t room = reader.end_ - reader.pos_;
+      if (encoding_ > INT_RLE || len_ > UINT32_MAX || width_ > 32 || n_words_ > room / 8 ||
+          n_aux_ > (room - 8 * n_words_) / (encoding_ == INT_RLE ? 8 : 4)) {
+        assert("Malformed encoded ints." && false);
+      }
+      bool packed = encoding_ == INT_FOR || encoding_ == INT_DELTA;
+      if ((packed && n_words_ < packed_words(len_, width_)) ||
+          (encoding_ == INT_DELTA && n_aux_ < checkpoints(len_)) ||
+          (encoding_ == INT_RAW && n_aux_ < len_) ||
+          (encoding_ == INT_RLE && (n_aux_ == 0) != (len_ == 0))) {
+        assert("Malformed encoded ints." && false);
+      }
+      if (borrow) {
+        lent_ = true;
+        words_ = n_words_ == 0 ? nullptr : (uint64_t*)reader.cursor();
+        reader.skip(8 * n_words_);
+        aux_ = n_aux_ == 0 ? nullptr : (int*)reader.cursor();
+        reader.skip(4 * n_aux_);
+        if (encoding_ == INT_RLE) {
+          ends_ = (uint32_t*)reader.cursor();
+          reader.skip(4 * n_aux_);
+        }
+      } else {
+        words_ = n_words_ == 0 ? nullptr : new uint64_t[n_words_];
+        reader.read_bytes(words_, 8 * n_words_);
+        aux_ = n_aux_ == 0 ? nullptr : new int[n_aux_];
+        reader.read_bytes(aux_, 4 * n_aux_);
+        if (encoding_ == INT_RLE) {
+          ends_ = new uint32_t[n_aux_];
+          reader.read_bytes(ends_, 4 * n_aux_);
+        }
+      }
+      if (encoding_ == INT_RLE) {
+        //runs end in increasing order, the last at the last value
+        for (size_t r = 0; r < n_aux_; r++) {
+          if (ends_[r] <= (r == 0 ? 0 : ends_[r - 1]) || ends_[r] > len_) assert("Malformed encoded ints." && false);
+        }
+        if (n_aux_ > 0 && ends_[n_aux_ - 1] != len_) assert("Malformed encoded ints." && false);
+      }
+      if (length != serial_size()) assert("Malformed encoded ints." && false);
+      reader.skip(start + length - reader.pos_);
+    }
+};
@@ -0,0 +1,372 @@
+//lang: CwC
+#pragma once
+
+#include "view.h"
+
+/** Kinds of hash_join. Inner keeps the pairs of matching rows, left also
+ *  keeps unmatched left rows with missing right values and semi keeps the
+ *  left rows that have a match, once each, as a view. */
+enum JoinKind { JOIN_INNER, JOIN_LEFT, JOIN_SEMI };
+
+/** No matching row */
+#define NO_ROW ((size_t)-1)
+
+/** Spreads the bits of x over the whole word, so that the low bits of
+ *  nearby keys differ */
+inline uint64_t mix_hash(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+/*************************************************************************
+ * JoinKeys::
+ * The key columns of one side of a join. A row's key is the tuple of its
+ * values in those columns; rows with a missing key value match nothing.
+ * Numeric values compare and hash as doubles so that keys of different
+ * numeric types can match. When the key is a single integer column the
+ * keys are read in bulk as int64s instead.
+ */
+class JoinKeys : public Object {
+  public:
+    DataFrame* df_;            // external
+    std::vector<size_t> cols_;
+    std::vector<bool> exact_;  // per key column, compared as int64s rather than doubles
+
+    JoinKeys(DataFrame* df, const std::vector<size_t>& cols) {
+      df_ = df;
+      cols_ = cols;
+      for (size_t k = 0; k < cols_.size(); k++) exact_.push_back(is_integer_type(column(k)->get_type()));
+    }
+
+    Column* column(size_t k) {
+      return df_->columns[cols_[k]];
+    }
+
+    /** Is the key a single integer column? */
+    bool integer() {
+      return cols_.size() == 1 && is_integer_type(column(0)->get_type());
+    }
+
+    bool missing(size_t row) {
+      for (size_t k = 0; k < cols_.size(); k++) {
+        if (column(k)->is_missing(row)) return true;
+      }
+      return false;
+    }
+
+    uint64_t hash(size_t row) {
+      uint64_t h = 0;
+      for (size_t k = 0; k < cols_.size(); k++) {
+        h = mix_hash(h ^ value_hash(k, row));
+      }
+      return h;
+    }
+
+    /** Hash of the value of key column k at row. Integers are hashed as
+     *  int64s, so keys past 2^53 stay distinct, unless the other side
+     *  of the join has a floating point column there. */
+    uint64_t value_hash(size_t k, size_t row) {
+      Column* col = column(k);
+      if (exact_[k]) return (uint64_t)col->get_integer(row);
+      switch (col->get_type()) {
+        case 'B':
+          return col->as_bool()->get(row);
+        case 'S': {
+          StringView s = col->as_string()->get_view(row);
+          uint64_t h = 14695981039346656037ULL;
+          for (size_t i = 0; i < s.size(); i++) h = (h ^ (unsigned char)s.c_str()[i]) * 1099511628211ULL;
+          return h;
+        }
+        default: {
+          double d = col->get_numeric(row);
+          if (d == 0) d = 0; //-0.0 and 0.0 are the same key
+          uint64_t bits;
+          memcpy(&bits, &d, sizeof(bits));
+          return bits;
+        }
+      }
+    }
+
+    /** Does row of this side have the same key as row other_row of other? */
+    bool equal(size_t row, JoinKeys& other, size_t other_row) {
+      for (size_t k = 0; k < cols_.size(); k++) {
+        Column* a = column(k);
+        Column* b = other.column(k);
+        switch (a->get_type()) {
+          case 'B':
+            if (a->as_bool()->get(row) != b->as_bool()->get(other_row)) return false;
+            break;
+          case 'S':
+            if (!a->as_string()->get_view(row).equals(b->as_string()->get_view(other_row))) return false;
+            break;
+          default:
+            if (exact_[k]) {
+              if (a->get_integer(row) != b->get_integer(other_row)) return false;
+            } else if (a->get_numeric(row) != b->get_numeric(other_row)) {
+              return false;
+            }
+        }
+      }
+      return true;
+    }
+
+    /** Can keys of this side be compared with keys of other? Also settles
+     *  for both sides which key columns compare as integers. */
+    bool compatible(JoinKeys& other) {
+      if (cols_.size() != other.cols_.size()) return false;
+      for (size_t k = 0; k < cols_.size(); k++) {
+        char a = column(k)->get_type();
+        char b = other.column(k)->get_type();
+        if (a != b && !(is_numeric_type(a) && is_numeric_type(b))) return false;
+        //integers meet floating point values as doubles, on both sides
+        bool exact = exact_[k] && other.exact_[k];
+        exact_[k] = exact;
+        other.exact_[k] = exact;
+      }
+      return true;
+    }
+};
+
+/*************************************************************************
+ * JoinTable::
+ * Hash table over the rows of the build side of a join. Open addressing
+ * with linear probing over a power of two number of slots, at most half
+ * full. A slot holds the first row with its key and a tag: the key itself
+ * for a single integer key, so probes compare int64s and never touch the
+ * columns, or the full hash otherwise. Rows with equal keys are chained
+ * through next_ in increasing order.
+ */
+class JoinTable : public Object {
+  public:
+    JoinKeys keys_;
+    bool integer_;
+    size_t mask_;
+    uint64_t* tags_;  // owned; per slot
+    size_t* first_;   // owned; per slot, first row with the key + 1, 0 if empty
+    size_t* next_;    // owned; per row, next row with the same key + 1
+
+    /** A table over the rows of keys' dataframe. integer says whether both
+     *  sides of the join have a single integer key. */
+    JoinTable(JoinKeys& keys, bool integer) : keys_(keys) {
+      integer_ = integer;
+      size_t n = keys_.df_->nrows();
+      size_t slots = 16;
+      while (slots < 2 * n) slots <<= 1;
+      mask_ = slots - 1;
+      tags_ = new uint64_t[slots];
+      first_ = new size_t[slots]();
+      next_ = new size_t[n + 1]();
+      int64_t* ints = integer_ ? new int64_t[n + 1] : nullptr;
+      if (integer_) read_integers(keys_.column(0), 0, n, ints);
+      //rows go in from the last so each chain ends up in increasing order
+      for (size_t row = n; row-- > 0;) {
+        if (keys_.missing(row)) continue;
+        uint64_t tag = integer_ ? (uint64_t)ints[row] : keys_.hash(row);
+        size_t s = (integer_ ? mix_hash(tag) : tag) & mask_;
+        while (first_[s] != 0 && !same(s, tag, row)) s = (s + 1) & mask_;
+        if (first_[s] != 0) next_[row] = first_[s];
+        tags_[s] = tag;
+        first_[s] = row + 1;
+      }
+      delete[] ints;
+    }
+
+    ~JoinTable() {
+      delete[] tags_;
+      delete[] first_;
+      delete[] next_;
+    }
+
+    /** Does slot s hold the key with the given tag of row of the build side? */
+    bool same(size_t s, uint64_t tag, size_t row) {
+      if (tags_[s] != tag) return false;
+      return integer_ || keys_.equal(first_[s] - 1, keys_, row);
+    }
+
+    /** First build row whose key is the integer key, + 1; 0 when none */
+    size_t find(int64_t key) {
+      size_t s = mix_hash((uint64_t)key) & mask_;
+      while (first_[s] != 0) {
+        if (tags_[s] == (uint64_t)key) return first_[s];
+        s = (s + 1) & mask_;
+      }
+      return 0;
+    }
+
+    /** First build row whose key equals the key of row of probe, + 1; 0
+     *  when none */
+    size_t find(JoinKeys& probe, size_t row) {
+      uint64_t h = probe.hash(row);
+      size_t s = h & mask_;
+      while (first_[s] != 0) {
+        if (tags_[s] == h && probe.equal(row, keys_, first_[s] - 1)) return first_[s];
+        s = (s + 1) & mask_;
+      }
+      return 0;
+    }
+
+    /** Build row after row with the same key, + 1; 0 at the end */
+    size_t next(size_t row) {
+      return next_[row];
+    }
+};
+
+/** Appends to left and right the matching pairs of rows for the probe rows
+ *  in [start, end). Unmatched rows are paired with NO_ROW for left joins
+ *  and semi joins add each matched row once, with no right row. */
+inline void probe_rows(JoinTable& table, JoinKeys& probe, JoinKind kind, size_t start, size_t end,
+                       std::vector<size_t>& left, std::vector<size_t>& right) {
+  int64_t* ints = nullptr;
+  if (table.integer_) {
+    ints = new int64_t[end - start];
+    read_integers(probe.column(0), start, end - start, ints);
+  }
+  for (size_t row = start; row < end; row++) {
+    size_t match = 0;
+    if (!probe.missing(row)) {
+      match = ints != nullptr ? table.find(ints[row - start]) : table.find(probe, row);
+    }
+    if (kind == JOIN_SEMI) {
+      if (match != 0) left.push_back(row);
+      continue;
+    }
+    if (match == 0 && kind == JOIN_LEFT) {
+      left.push_back(row);
+      right.push_back(NO_ROW);
+    }
+    for (; match != 0; match = table.next(match - 1)) {
+      left.push_back(row);
+      right.push_back(match - 1);
+    }
+  }
+  delete[] ints;
+}
+
+/** Copies the listed rows of column from into the empty column to, rows
+ *  equal to NO_ROW becoming missing values */
+inline void gather_rows(Column* from, Column* to, std::vector<size_t>& rows) {
+  std::vector<size_t> holes;
+  for (size_t k = 0; k < rows.size(); k++) {
+    if (rows[k] == NO_ROW) holes.push_back(k);
+  }
+  if (holes.empty()) {
+    DataFrame::append_column(from, to, rows.data(), rows.size(), 0);
+    return;
+  }
+  //holes are filled from row 0 in one pass, then marked missing
+  if (from->size() > 0) {
+    std::vector<size_t> filled(rows);
+    for (size_t k = 0; k < holes.size(); k++) filled[holes[k]] = 0;
+    DataFrame::append_column(from, to, filled.data(), filled.size(), 0);
+  }
+  for (size_t k = 0; k < holes.size(); k++) to->set_missing(holes[k]);
+}
+
+/** The columns cols of view gathered into a frame of their own, column
+ *  cols[k] in column k. Strings are shared with the view's parent. */
+inline DataFrame* gather_columns(DataFrameView* view, const std::vector<size_t>& cols) {
+  std::string types;
+  for (size_t k = 0; k < cols.size(); k++) types += view->get_schema().type(cols[k]);
+  DataFrame* keys = new DataFrame(*new Schema(types.c_str()));
+  for (size_t k = 0; k < cols.size(); k++) {
+    delete keys->columns[k];
+    keys->columns[k] = view->gather(cols[k]);
+  }
+  if (view->nrows() > 0) keys->schema->new_length(view->nrows() - 1);
+  return keys;
+}
+
+/** The indices of every column of df */
+inline std::vector<size_t> all_columns(DataFrame* df) {
+  std::vector<size_t> cols(df->ncols());
+  for (size_t i = 0; i < cols.size(); i++) cols[i] = i;
+  return cols;
+}
+
+/** Deletes a frame gathered out of a view together with its columns and
+ *  schema, which ~DataFrame leaves to their owner */
+inline void delete_copy(DataFrame* df) {
+  for (size_t i = 0; i < df->ncols(); i++) delete df->columns[i];
+  delete df->schema;
+  delete df;
+}
+
+/** Joins left and right on the keys in left_keys and right_keys, column k
+ *  of one matching column k of the other. A hash table is built over the
+ *  right rows and probed with the left rows a morsel at a time on the
+ *  shared thread pool; the matches keep the order of the left rows, and
+ *  of the right rows for each left row.
+ *  Inner and left joins return a new dataframe holding the left columns
+ *  followed by the right ones. Semi joins return a view of left. Views
+ *  given as inputs have their columns gathered first, only the key columns
+ *  for the left side of a semi join. */
+inline DataFrame* hash_join(DataFrame* left, DataFrame* right, const std::vector<size_t>& left_keys,
+                            const std::vector<size_t>& right_keys, JoinKind kind) {
+  DataFrameView* lview = left->as_view();
+  DataFrameView* rview = right->as_view();
+  DataFrame* probe_df = left;
+  std::vector<size_t> probe_keys(left_keys);
+  if (lview != nullptr && kind == JOIN_SEMI) {
+    probe_df = gather_columns(lview, left_keys);
+    for (size_t k = 0; k < probe_keys.size(); k++) probe_keys[k] = k;
+  } else if (lview != nullptr) {
+    probe_df = gather_columns(lview, all_columns(left));
+  }
+  DataFrame* build_df = rview == nullptr ? right : gather_columns(rview, all_columns(right));
+  JoinKeys probe(probe_df, probe_keys);
+  JoinKeys build(build_df, right_keys);
+  if (!probe.compatible(build)) {
+    assert("Join keys are of different types." && false);
+  }
+  JoinTable table(build, probe.integer() && build.integer());
+  size_t n = probe_df->nrows();
+  size_t morsels = (n + MORSEL_ROWS - 1) / MORSEL_ROWS;
+  std::vector<std::vector<size_t>> lefts(morsels);
+  std::vector<std::vector<size_t>> rights(morsels);
+  auto run = [&](size_t m) {
+    size_t start = m * MORSEL_ROWS;
+    probe_rows(table, probe, kind, start, std::min(start + MORSEL_ROWS, n), lefts[m], rights[m]);
+  };
+  if (morsels <= 1) {
+    for (size_t m = 0; m < morsels; m++) run(m);
+  } else {
+    ThreadPool::shared().parallel_for(morsels, run);
+  }
+  std::vector<size_t> lrows;
+  std::vector<size_t> rrows;
+  for (size_t m = 0; m < morsels; m++) {
+    lrows.insert(lrows.end(), lefts[m].begin(), lefts[m].end());
+    rrows.insert(rrows.end(), rights[m].begin(), rights[m].end());
+  }
+  DataFrame* result;
+  if (kind == JOIN_SEMI) {
+    if (lview != nullptr) {
+      for (size_t k = 0; k < lrows.size(); k++) lrows[k] = lview->rows_[lrows[k]];
+      result = new DataFrameView(lview->parent_, lrows);
+    } else {
+      result = new DataFrameView(left, lrows);
+    }
+  } else {
+    std::string types = std::string(probe_df->get_schema().types) + build_df->get_schema().types;
+    DataFrame* out = new DataFrame(*new Schema(types.c_str()));
+    size_t width = probe_df->ncols();
+    auto copy = [&](size_t i) {
+      if (i < width) DataFrame::append_column(probe_df->columns[i], out->columns[i], lrows.data(), lrows.size(), 0);
+      else gather_rows(build_df->columns[i - width], out->columns[i], rrows);
+    };
+    if (lrows.size() < MORSEL_ROWS) {
+      for (size_t i = 0; i < out->ncols(); i++) copy(i);
+    } else {
+      ThreadPool::shared().parallel_for(out->ncols(), copy);
+    }
+    if (!lrows.empty()) out->schema->new_length(lrows.size() - 1);
+    result = out;
+  }
+  if (probe_df != left) delete_copy(probe_df);
+  if (build_df != right) delete_copy(build_df);
+  return result;
+}
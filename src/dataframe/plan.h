@@ -0,0 +1,710 @@
+//lang: CwC
+#pragma once
+
+#include "expr.h"
+#include "groupby.h"
+#include "join.h"
+#include "distributeddataframe.h"
+
+/** Kinds of plan nodes */
+enum PlanKind { PLAN_SCAN, PLAN_FILTER, PLAN_PROJECT, PLAN_AGGREGATE, PLAN_JOIN, PLAN_LIMIT };
+
+/** A pipeline with no limit on its rows */
+#define NO_LIMIT ((size_t)-1)
+
+/*************************************************************************
+ * PlanPredicate::
+ * The condition of a filter in a plan, tested a batch at a time: narrow
+ * drops from the selection of a batch the rows where it does not hold.
+ * Predicates name columns by position and can be remapped, so a plan can
+ * move them below projections and joins.
+ */
+class PlanPredicate : public Object {
+  public:
+    virtual void narrow(Batch& b) {}
+
+    /** Reads column cols[i] wherever it read column i */
+    virtual void remap(const std::vector<size_t>& cols) {}
+
+    /** Appends the columns it reads to out */
+    virtual void columns(std::vector<size_t>& out) {}
+
+    /** Is it a test that column col lies in [lo, hi]? Scans skip the chunks
+     *  whose zone maps rule such ranges out. */
+    virtual bool range(size_t& col, double& lo, double& hi) {
+      return false;
+    }
+};
+
+/** A predicate given as an expression, see expr.h */
+template <typename P>
+class ExprPredicate : public PlanPredicate {
+  public:
+    P pred_;
+
+    ExprPredicate(const P& pred) : pred_(pred) { }
+
+    void narrow(Batch& b) {
+      pred_.bind(b);
+      b.retain([&](size_t i) { return expr_holds(pred_, i); });
+    }
+
+    void remap(const std::vector<size_t>& cols) {
+      pred_.remap(cols);
+    }
+
+    void columns(std::vector<size_t>& out) {
+      pred_.columns(out);
+    }
+
+    Object* clone() {
+      return new ExprPredicate(pred_);
+    }
+};
+
+/** Values of a numeric column in [lo, hi]; missing values never match */
+class RangePredicate : public PlanPredicate {
+  public:
+    size_t col_;
+    double lo_;
+    double hi_;
+
+    RangePredicate(size_t col, double lo, double hi) {
+      col_ = col;
+      lo_ = lo;
+      hi_ = hi;
+    }
+
+    void narrow(Batch& b) {
+      const double* vals = b.doubles(col_);
+      bool nullable = b.has_missing(col_);
+      b.retain([&](size_t i) {
+        return !(nullable && b.is_missing(col_, i)) && vals[i] >= lo_ && vals[i] <= hi_;
+      });
+    }
+
+    void remap(const std::vector<size_t>& cols) {
+      col_ = cols[col_];
+    }
+
+    void columns(std::vector<size_t>& out) {
+      out.push_back(col_);
+    }
+
+    bool range(size_t& col, double& lo, double& hi) {
+      col = col_;
+      lo = lo_;
+      hi = hi_;
+      return true;
+    }
+
+    Object* clone() {
+      return new RangePredicate(col_, lo_, hi_);
+    }
+};
+
+/*************************************************************************
+ * PlanNode::
+ * One operator of a logical plan. Scans read a dataframe, filters keep
+ * the rows where all their predicates hold, projections keep the columns
+ * in cols_, aggregates group by the keys in cols_ as group_by does, joins
+ * join their input with right_ as hash_join does on cols_ and right_cols_
+ * and limits keep the first limit_ rows. A scan may hold predicates moved
+ * into it by the optimizer.
+ */
+class PlanNode : public Object {
+  public:
+    PlanKind kind_;
+    PlanNode* input_;                    // owned; nullptr for scans
+    PlanNode* right_;                    // owned; right side of a join
+    DataFrame* source_;                  // external; scans
+    std::vector<PlanPredicate*> preds_;  // owned; filters and scans
+    std::vector<size_t> cols_;           // projected columns, group keys or left join keys
+    std::vector<size_t> right_cols_;     // right join keys
+    std::vector<GroupAgg> aggs_;
+    JoinKind join_;
+    size_t limit_;
+
+    PlanNode(PlanKind kind, PlanNode* input) {
+      kind_ = kind;
+      input_ = input;
+      right_ = nullptr;
+      source_ = nullptr;
+      join_ = JOIN_INNER;
+      limit_ = NO_LIMIT;
+    }
+
+    ~PlanNode() {
+      delete input_;
+      delete right_;
+      for (size_t i = 0; i < preds_.size(); i++) delete preds_[i];
+    }
+
+    /** Number of columns of the rows it produces */
+    size_t width() {
+      switch (kind_) {
+        case PLAN_SCAN:
+          return source_->ncols();
+        case PLAN_PROJECT:
+          return cols_.size();
+        case PLAN_AGGREGATE:
+          return cols_.size() + aggs_.size();
+        case PLAN_JOIN:
+          return input_->width() + (join_ == JOIN_SEMI ? 0 : right_->width());
+        default:
+          return input_->width();
+      }
+    }
+};
+
+/*************************************************************************
+ * Pipeline::
+ * A fused pass over one source dataframe: the rows that pass every
+ * predicate, up to a limit, read through a projection. Nothing is copied
+ * until a sink asks for it: materialize gathers the passing rows once, or
+ * returns a view when the columns are not projected, and map shows them
+ * to a rower. Morsels of MORSEL_ROWS rows run on the shared thread pool,
+ * in order when there is a limit. A distributed source is read one sub
+ * dataframe at a time, skipping the ones whose zones rule out a range
+ * predicate. Frames made by earlier pipeline breakers are owned.
+ */
+class Pipeline : public Object {
+  public:
+    DataFrame* source_;                  // external, or the last of owned_
+    std::vector<DataFrame*> owned_;      // owned; deleted last to first
+    std::vector<PlanPredicate*> preds_;  // owned; read source columns
+    std::vector<size_t> cols_;           // output column i is source column cols_[i]
+    std::string types_;                  // schema types of the output
+    size_t limit_;
+    size_t remaining_;                   // rows a limited sink may still take
+
+    Pipeline(DataFrame* source) {
+      source_ = source;
+      for (size_t i = 0; i < source->ncols(); i++) cols_.push_back(i);
+      types_ = source->get_schema().types;
+      limit_ = NO_LIMIT;
+      remaining_ = NO_LIMIT;
+    }
+
+    ~Pipeline() {
+      for (size_t i = 0; i < preds_.size(); i++) delete preds_[i];
+      for (size_t i = owned_.size(); i-- > 0;) delete owned_[i];
+    }
+
+    /** Adds a predicate over the output columns */
+    void add(PlanPredicate* pred) {
+      pred->remap(cols_);
+      preds_.push_back(pred);
+    }
+
+    /** Keeps the output columns in cols, in that order */
+    void project(const std::vector<size_t>& cols) {
+      std::vector<size_t> composed;
+      std::string types;
+      for (size_t i = 0; i < cols.size(); i++) {
+        composed.push_back(cols_[cols[i]]);
+        types += types_[cols[i]];
+      }
+      cols_.swap(composed);
+      types_ = types;
+    }
+
+    /** Are the output columns those of the source? */
+    bool identity() {
+      if (cols_.size() != source_->ncols()) return false;
+      for (size_t i = 0; i < cols_.size(); i++) {
+        if (cols_[i] != i) return false;
+      }
+      return true;
+    }
+
+    /** The predicates again, for a task to bind on its own */
+    std::vector<PlanPredicate*> copy_preds() {
+      std::vector<PlanPredicate*> preds;
+      for (size_t i = 0; i < preds_.size(); i++) preds.push_back(static_cast<PlanPredicate*>(preds_[i]->clone()));
+      return preds;
+    }
+
+    static void delete_preds(std::vector<PlanPredicate*>& preds) {
+      for (size_t i = 0; i < preds.size(); i++) delete preds[i];
+    }
+
+    /** Calls f(frame) with the source or, for a distributed source, with
+     *  each sub dataframe a range predicate does not rule out */
+    template <typename Fn>
+    void for_each_frame(Fn f) {
+      DistributedDataFrame* dist = dynamic_cast<DistributedDataFrame*>(source_);
+      if (dist == nullptr) {
+        f(source_);
+        return;
+      }
+      for (size_t pos = 0; pos < dist->sub_ids.size(); pos++) {
+        bool skip = false;
+        size_t col;
+        double lo, hi;
+        for (size_t p = 0; p < preds_.size(); p++) {
+          if (preds_[p]->range(col, lo, hi) && !dist->subOverlaps(pos, col, lo, hi)) skip = true;
+        }
+        if (skip) continue;
+        Key* k = dist->createKeyFromRow(dist->sub_ids[pos] * ROWS_PER_DF);
+        DataFrame* df = dist->kv_->waitAndGet(*k);
+        delete k;
+        f(df);
+        delete df;
+      }
+    }
+
+    /** Can chunk c of frame hold rows passing the range predicates? A
+     *  morsel of a dataframe is one chunk. */
+    bool overlaps(DataFrame* frame, size_t c) {
+      size_t col;
+      double lo, hi;
+      for (size_t p = 0; p < preds_.size(); p++) {
+        if (preds_[p]->range(col, lo, hi) && !frame->columns[col]->chunk_overlaps(c, lo, hi)) return false;
+      }
+      return true;
+    }
+
+    /** Calls f(batch) for the batches over morsel m of frame, each selecting
+     *  the rows that pass preds and fit in the limit. Batches read the
+     *  source columns; selections are never empty. */
+    template <typename Fn>
+    void scan(DataFrame* frame, size_t m, std::vector<PlanPredicate*>& preds, bool limited, Fn f) {
+      if (limited && remaining_ == 0) return;
+      if (frame->as_view() == nullptr && !overlaps(frame, m)) return;
+      DataFrame* base = expr_base(frame);
+      Batch batch(base->columns, base->ncols());
+      scan_morsel(frame, m, batch, [&]() {
+        for (size_t p = 0; p < preds.size(); p++) preds[p]->narrow(batch);
+        if (limited) {
+          size_t seen = 0;
+          batch.retain([&](size_t i) { return seen++ < remaining_; });
+          remaining_ -= batch.count();
+        }
+        if (batch.count() > 0) f(batch);
+      });
+    }
+
+    /** Number of morsels of frame */
+    static size_t morsels(DataFrame* frame) {
+      return (frame->nrows() + MORSEL_ROWS - 1) / MORSEL_ROWS;
+    }
+
+    /** Rows of the base of frame that pass, in order */
+    std::vector<size_t> selected(DataFrame* frame) {
+      size_t n = morsels(frame);
+      std::vector<std::vector<size_t>> sels(n);
+      auto collect = [&](size_t m, std::vector<PlanPredicate*>& preds, bool limited) {
+        scan(frame, m, preds, limited, [&](Batch& b) {
+          for (size_t k = 0; k < b.count(); k++) sels[m].push_back(b.start() + b.row(k));
+        });
+      };
+      if (limit_ != NO_LIMIT) {
+        for (size_t m = 0; m < n; m++) collect(m, preds_, true);
+      } else {
+        for_each_morsel(n, [&](size_t m) {
+          std::vector<PlanPredicate*> preds = copy_preds();
+          collect(m, preds, false);
+          delete_preds(preds);
+        });
+      }
+      std::vector<size_t> rows;
+      for (size_t m = 0; m < n; m++) rows.insert(rows.end(), sels[m].begin(), sels[m].end());
+      return rows;
+    }
+
+    /** The output rows. A view when the source is a local dataframe whose
+     *  columns are kept; otherwise the passing rows are copied once. */
+    DataFrame* materialize() {
+      remaining_ = limit_;
+      if (identity() && dynamic_cast<DistributedDataFrame*>(source_) == nullptr) {
+        std::vector<size_t> rows = selected(source_);
+        return new DataFrameView(expr_base(source_), rows);
+      }
+      DataFrame* out = new DataFrame(*new Schema(types_.c_str()));
+      size_t length = 0;
+      for_each_frame([&](DataFrame* frame) {
+        std::vector<size_t> rows = selected(frame);
+        if (rows.empty()) return;
+        DataFrame* base = expr_base(frame);
+        for (size_t i = 0; i < cols_.size(); i++) {
+          DataFrame::append_column(base->columns[cols_[i]], out->columns[i], rows.data(), rows.size(), length);
+        }
+        length += rows.size();
+      });
+      if (length > 0) out->schema->new_length(length - 1);
+      return out;
+    }
+
+    /** Shows the output rows to r, in order unless parallel, in which case
+     *  every thread works on its own clone of r as pmap does. Rowers that
+     *  only take rows are shown the materialized rows. */
+    void map(Rower& r, bool parallel) {
+      BatchRower* b = r.as_batch();
+      if (b == nullptr) {
+        DataFrame* df = materialize();
+        if (parallel) df->pmap(r);
+        else df->map(r);
+        delete df;
+        return;
+      }
+      remaining_ = limit_;
+      bool limited = limit_ != NO_LIMIT;
+      for_each_frame([&](DataFrame* frame) {
+        //a projection is read through a batch over the projected columns
+        DataFrame* base = expr_base(frame);
+        std::vector<Column*> outs;
+        for (size_t i = 0; i < cols_.size(); i++) outs.push_back(base->columns[cols_[i]]);
+        bool same = identity();
+        auto visit = [&](BatchRower& mine, size_t m, std::vector<PlanPredicate*>& preds) {
+          Batch out(outs.data(), outs.size());
+          scan(frame, m, preds, limited, [&](Batch& batch) {
+            if (same) {
+              mine.accept(batch);
+              return;
+            }
+            out.move(batch.start(), batch.size());
+            out.select_none();
+            for (size_t k = 0; k < batch.count(); k++) out.select(batch.row(k));
+            mine.accept(out);
+          });
+        };
+        size_t n = morsels(frame);
+        if (!parallel || limited || n <= 1) {
+          for (size_t m = 0; m < n; m++) visit(*b, m, preds_);
+          return;
+        }
+        DataFrame::run_morsels(r, n, [&](Rower& mine, size_t m) {
+          std::vector<PlanPredicate*> preds = copy_preds();
+          visit(*mine.as_batch(), m, preds);
+          delete_preds(preds);
+        });
+      });
+    }
+
+    /** The output rows grouped as group_by does */
+    DataFrame* aggregate(const std::vector<size_t>& keys, const std::vector<GroupAgg>& aggs) {
+      Schema schema(types_.c_str());
+      GroupByRower rower(schema, keys, aggs);
+      map(rower, true);
+      return rower.table_.result();
+    }
+
+    /** The output as a dataframe that does not depend on the frames this
+     *  pipeline owns. A source made by a breaker and read as it is is
+     *  handed over instead of copied. */
+    DataFrame* release() {
+      if (preds_.empty() && identity() && limit_ == NO_LIMIT && !owned_.empty() && owned_.back() == source_ &&
+          source_->as_view() == nullptr) {
+        owned_.pop_back();
+        return source_;
+      }
+      DataFrame* df = materialize();
+      DataFrameView* view = df->as_view();
+      if (view == nullptr) return df;
+      for (size_t i = 0; i < owned_.size(); i++) {
+        if (owned_[i] == view->parent_) {
+          df = view->materialize();
+          delete view;
+          break;
+        }
+      }
+      return df;
+    }
+};
+
+/*************************************************************************
+ * Plan::
+ * A lazy query over a dataframe, a local or a distributed one. Operators
+ * only add nodes to a logical plan; nothing is read until the plan is
+ * executed or mapped. Before running, the plan is optimized: adjacent
+ * filters and adjacent projections are merged, filters are moved below
+ * projections, into the sides of joins they only read and below
+ * aggregates when they only read keys, and end up in the scans, where
+ * range predicates skip whole chunks using zone maps. Chains of scans,
+ * filters, projections and limits then run as one fused pass over the
+ * source; only aggregates and joins, the pipeline breakers, materialize
+ * their inputs.
+ *
+ *   Plan(df).filter(col<int>(0) > 30).project(cols).aggregate(keys, aggs).execute();
+ *
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+class Plan : public Object {
+  public:
+    PlanNode* root_; // owned
+
+    /** A plan scanning df, which must outlive it */
+    Plan(DataFrame* df) {
+      root_ = new PlanNode(PLAN_SCAN, nullptr);
+      root_->source_ = df;
+    }
+
+    ~Plan() {
+      delete root_;
+    }
+
+    /** Keeps the rows where pred holds */
+    template <typename P>
+    Plan& filter(const Expr<P>& pred) {
+      return filter(new ExprPredicate<P>(pred.self()));
+    }
+
+    /** Keeps the rows whose value in the numeric column col is in [lo, hi] */
+    Plan& where(size_t col, double lo, double hi) {
+      return filter(new RangePredicate(col, lo, hi));
+    }
+
+    Plan& filter(PlanPredicate* pred) {
+      root_ = new PlanNode(PLAN_FILTER, root_);
+      root_->preds_.push_back(pred);
+      return *this;
+    }
+
+    /** Keeps the columns in cols, in that order */
+    Plan& project(const std::vector<size_t>& cols) {
+      root_ = new PlanNode(PLAN_PROJECT, root_);
+      root_->cols_ = cols;
+      return *this;
+    }
+
+    /** Groups the rows by the key columns, as group_by does */
+    Plan& aggregate(const std::vector<size_t>& keys, const std::vector<GroupAgg>& aggs) {
+      root_ = new PlanNode(PLAN_AGGREGATE, root_);
+      root_->cols_ = keys;
+      root_->aggs_ = aggs;
+      return *this;
+    }
+
+    /** Joins the rows with those of right, as hash_join does. The nodes of
+     *  right move into this plan, leaving it empty. */
+    Plan& join(Plan& right, const std::vector<size_t>& left_keys, const std::vector<size_t>& right_keys, JoinKind kind) {
+      root_ = new PlanNode(PLAN_JOIN, root_);
+      root_->right_ = right.root_;
+      right.root_ = nullptr;
+      root_->cols_ = left_keys;
+      root_->right_cols_ = right_keys;
+      root_->join_ = kind;
+      return *this;
+    }
+
+    /** Keeps the first n rows */
+    Plan& limit(size_t n) {
+      root_ = new PlanNode(PLAN_LIMIT, root_);
+      root_->limit_ = n;
+      return *this;
+    }
+
+    /** Rewrites the plan as described above */
+    void optimize() {
+      root_ = optimize(root_);
+    }
+
+    /** Runs the plan, returning a new dataframe of its rows. A plan that
+     *  only filters may return a view of its source. */
+    DataFrame* execute() {
+      optimize();
+      Pipeline* pipe = compile(root_);
+      DataFrame* df = pipe->release();
+      delete pipe;
+      return df;
+    }
+
+    /** Shows the rows of the plan to r, in order */
+    void map(Rower& r) {
+      optimize();
+      Pipeline* pipe = compile(root_);
+      pipe->map(r, false);
+      delete pipe;
+    }
+
+    /** Shows the rows of the plan to clones of r in parallel, as pmap does */
+    void pmap(Rower& r) {
+      optimize();
+      Pipeline* pipe = compile(root_);
+      pipe->map(r, true);
+      delete pipe;
+    }
+
+    static PlanNode* optimize(PlanNode* node) {
+      if (node->input_ != nullptr) node->input_ = optimize(node->input_);
+      if (node->right_ != nullptr) node->right_ = optimize(node->right_);
+      switch (node->kind_) {
+        case PLAN_FILTER:
+          return push_filter(node);
+        case PLAN_PROJECT:
+          if (node->input_->kind_ == PLAN_PROJECT) {
+            PlanNode* below = detach(node);
+            for (size_t i = 0; i < node->cols_.size(); i++) node->cols_[i] = below->cols_[node->cols_[i]];
+            delete below;
+          }
+          return node;
+        case PLAN_LIMIT:
+          if (node->input_->kind_ == PLAN_LIMIT) {
+            PlanNode* below = detach(node);
+            node->limit_ = std::min(node->limit_, below->limit_);
+            delete below;
+          }
+          return node;
+        default:
+          return node;
+      }
+    }
+
+    /** Removes the input of node from the plan, node taking its input */
+    static PlanNode* detach(PlanNode* node) {
+      PlanNode* below = node->input_;
+      node->input_ = below->input_;
+      below->input_ = nullptr;
+      return below;
+    }
+
+    /** Moves the predicates of the filter node as far down as they go,
+     *  returning what replaces the node */
+    static PlanNode* push_filter(PlanNode* node) {
+      PlanNode* below = node->input_;
+      std::vector<PlanPredicate*> kept;
+      switch (below->kind_) {
+        case PLAN_SCAN:
+          below->preds_.insert(below->preds_.end(), node->preds_.begin(), node->preds_.end());
+          node->preds_.clear();
+          break;
+        case PLAN_FILTER:
+          //one filter, whose predicates may now go further
+          below->preds_.insert(below->preds_.end(), node->preds_.begin(), node->preds_.end());
+          node->preds_.clear();
+          node->input_ = nullptr;
+          delete node;
+          return push_filter(below);
+        case PLAN_PROJECT:
+          for (size_t p = 0; p < node->preds_.size(); p++) node->preds_[p]->remap(below->cols_);
+          below->input_ = push_filter(wrap(below->input_, node->preds_));
+          node->preds_.clear();
+          break;
+        case PLAN_AGGREGATE:
+          //only predicates on the keys hold before grouping
+          for (size_t p = 0; p < node->preds_.size(); p++) {
+            if (reads_below(node->preds_[p], 0, below->cols_.size())) {
+              node->preds_[p]->remap(below->cols_);
+              below->input_ = push_filter(wrap(below->input_, std::vector<PlanPredicate*>(1, node->preds_[p])));
+            } else {
+              kept.push_back(node->preds_[p]);
+            }
+          }
+          node->preds_.swap(kept);
+          break;
+        case PLAN_JOIN: {
+          size_t width = below->input_->width();
+          std::vector<size_t> right_cols;
+          if (below->join_ == JOIN_INNER) {
+            for (size_t i = 0; i < below->right_->width(); i++) right_cols.push_back(i);
+            right_cols.insert(right_cols.begin(), width, 0);
+          }
+          for (size_t p = 0; p < node->preds_.size(); p++) {
+            PlanPredicate* pred = node->preds_[p];
+            if (reads_below(pred, 0, width)) {
+              below->input_ = push_filter(wrap(below->input_, std::vector<PlanPredicate*>(1, pred)));
+            } else if (!right_cols.empty() && reads_below(pred, width, width + below->right_->width())) {
+              //an unmatched left row has no right values, so only inner joins
+              pred->remap(right_cols);
+              below->right_ = push_filter(wrap(below->right_, std::vector<PlanPredicate*>(1, pred)));
+            } else {
+              kept.push_back(pred);
+            }
+          }
+          node->preds_.swap(kept);
+          break;
+        }
+        default:
+          break;
+      }
+      if (!node->preds_.empty()) return node;
+      node->input_ = nullptr;
+      delete node;
+      return below;
+    }
+
+    /** A filter node over input holding preds */
+    static PlanNode* wrap(PlanNode* input, const std::vector<PlanPredicate*>& preds) {
+      PlanNode* node = new PlanNode(PLAN_FILTER, input);
+      node->preds_ = preds;
+      return node;
+    }
+
+    /** Does pred only read columns in [lo, hi)? */
+    static bool reads_below(PlanPredicate* pred, size_t lo, size_t hi) {
+      std::vector<size_t> cols;
+      pred->columns(cols);
+      for (size_t i = 0; i < cols.size(); i++) {
+        if (cols[i] < lo || cols[i] >= hi) return false;
+      }
+      return true;
+    }
+
+    /** The pipeline producing the rows of node; breakers below it have
+     *  already run */
+    static Pipeline* compile(PlanNode* node) {
+      Pipeline* pipe;
+      switch (node->kind_) {
+        case PLAN_SCAN:
+          pipe = new Pipeline(node->source_);
+          break;
+        case PLAN_FILTER:
+          pipe = compile(node->input_);
+          //rows past a limit are cut before filtering
+          if (pipe->limit_ != NO_LIMIT) pipe = rebase(pipe, pipe->materialize());
+          break;
+        case PLAN_PROJECT:
+          pipe = compile(node->input_);
+          pipe->project(node->cols_);
+          return pipe;
+        case PLAN_LIMIT:
+          pipe = compile(node->input_);
+          pipe->limit_ = std::min(pipe->limit_, node->limit_);
+          return pipe;
+        case PLAN_AGGREGATE: {
+          pipe = compile(node->input_);
+          DataFrame* groups = pipe->aggregate(node->cols_, node->aggs_);
+          delete pipe;
+          pipe = new Pipeline(groups);
+          pipe->owned_.push_back(groups);
+          return pipe;
+        }
+        case PLAN_JOIN: {
+          Pipeline* left = compile(node->input_);
+          Pipeline* right = compile(node->right_);
+          DataFrame* ldf = left->materialize();
+          DataFrame* rdf = right->materialize();
+          DataFrame* joined = hash_join(ldf, rdf, node->cols_, node->right_cols_, node->join_);
+          pipe = new Pipeline(joined);
+          if (node->join_ == JOIN_SEMI) {
+            //a semi join is a view of the left rows
+            pipe->owned_.swap(left->owned_);
+            pipe->owned_.push_back(ldf);
+          } else {
+            delete ldf;
+          }
+          pipe->owned_.push_back(joined);
+          delete rdf;
+          delete right;
+          delete left;
+          return pipe;
+        }
+      }
+      for (size_t p = 0; p < node->preds_.size(); p++) {
+        pipe->add(static_cast<PlanPredicate*>(node->preds_[p]->clone()));
+      }
+      return pipe;
+    }
+
+    /** A pipeline over df, the output of pipe, taking what pipe owns */
+    static Pipeline* rebase(Pipeline* pipe, DataFrame* df) {
+      Pipeline* next = new Pipeline(df);
+      next->owned_.swap(pipe->owned_);
+      next->owned_.push_back(df);
+      delete pipe;
+      return next;
+    }
+};
@@ -4,12 +4,27 @@
 #include "schema.h"
 #include "fielder.h"
 
+/** The value of one field of a Row, held in the member for its type */
+union RowValue {
+    bool b;
+    int8_t y;
+    int16_t h;
+    int i;
+    int64_t l;
+    float f;
+    double d;
+    String *s;
+};
+
 /*************************************************************************
  * Row::
  *
  * This class represents a single row of data constructed according to a
  * dataframe's schema. The purpose of this class is to make it easier to add
  * read/write complete rows. Internally a dataframe hold data in columns.
+ * Values are kept in one inline slot per column, allocated with the row, so
+ * filling and reading a row never touches the heap. Reuse a row across
+ * calls instead of building one per row.
  * Rows have pointer equality, note: it was not overriden from object on purpose
  * Authors:
  * Canon Sawrey sawrey.c@husky.neu.edu
@@ -19,71 +34,106 @@ class Row : public Object
 {
 public:
     Schema *schema_;
-    Column **columns_;
+    RowValue *vals_; // owned; one slot per column
+    bool *missing_;  // owned; one flag per column
     int idx_;
     int width_;
 
-    /** Build a row following a schema. */
+    /** Build a row following a schema. All fields start out missing. */
     Row(Schema &scm) {
         schema_ = &scm;
         width_ = schema_->width();
-        columns_ = new Column *[width_];
+        vals_ = new RowValue[width_];
+        missing_ = new bool[width_];
         for (int i = 0; i < width_; i++) {
-            columns_[i] = nullptr;
+            vals_[i].l = 0;
+            missing_[i] = true;
         }
     }
 
     /** Setters: set the given column with the given value. Setting a column with
-    * a value of the wrong type is undefined. */
+    * a value of the wrong type is undefined. Ints may be set in any integer
+    * column they fit, doubles in float columns. */
     void set(size_t col, int val) {
-        if (schema_->col_type(col) == 'I') {
-            if (columns_[col] != nullptr) {
-                delete columns_[col];
-            }
-            columns_[col] = new IntColumn();
-            columns_[col]->as_int()->set(0, val);
+        if (col_type(col) == 'I') {
+            vals_[col].i = val;
+            missing_[col] = false;
+        } else {
+            set(col, (int64_t)val);
+        }
+    }
+
+    void set(size_t col, int64_t val) {
+        switch (col_type(col)) {
+        case 'Y':
+            vals_[col].y = (int8_t)val;
+            break;
+        case 'H':
+            vals_[col].h = (int16_t)val;
+            break;
+        case 'I':
+            vals_[col].i = (int)val;
+            break;
+        case 'L':
+            vals_[col].l = val;
+            break;
+        default:
+            assert("Wrong column type for given value." && false);
+        }
+        missing_[col] = false;
+    }
+
+    void set(size_t col, float val) {
+        if (col_type(col) == 'F') {
+            vals_[col].f = val;
+            missing_[col] = false;
         } else {
             assert("Wrong column type for given value." && false);
         }
     }
 
     void set(size_t col, double val) {
-        if (schema_->col_type(col) == 'D') {
-            if (columns_[col] != nullptr) {
-                delete columns_[col];
-            }
-            columns_[col] = new DoubleColumn();
-            columns_[col]->as_double()->set(0, val);
+        if (col_type(col) == 'F') {
+            set(col, (float)val);
+        } else if (col_type(col) == 'D') {
+            vals_[col].d = val;
+            missing_[col] = false;
         } else {
             assert("Wrong column type for given value." && false);
         }
     }
 
     void set(size_t col, bool val) {
-        if (schema_->col_type(col) == 'B') {
-            if (columns_[col] != nullptr) {
-                delete columns_[col];
-            }
-            columns_[col] = new BoolColumn();
-            columns_[col]->as_bool()->set(0, val);
+        if (col_type(col) == 'B') {
+            vals_[col].b = val;
+            missing_[col] = false;
         } else {
             assert("Wrong column type for given value." && false);
         }
     }
 
-    /** The string is external. */
+    /** The string is external, the row keeps the pointer until the field
+    * is set again. */
     void set(size_t col, String *val) {
-        if (schema_->col_type(col) == 'S') {
-            if (columns_[col] != nullptr) {
-                delete columns_[col];
-            }
-            columns_[col] = new StringColumn();
-            columns_[col]->as_string()->set(0, (val == nullptr) ? nullptr : val->clone());
+        if (col_type(col) == 'S') {
+            vals_[col].s = val;
+            missing_[col] = false;
         } else {
             assert("Wrong column type for given value." && false);
         }
     }
 
+    /** Marks the given column as missing a value. Its value reads as 0. */
+    void set_missing(size_t col) {
+        vals_[col].l = 0;
+        missing_[col] = true;
+    }
+
+    /** Is the value of the given column missing? Unset columns are missing. */
+    bool is_missing(size_t col) {
+        return missing_[col];
+    }
+
     /** Set/get the index of this row (ie. its position in the dataframe. This is
    *  only used for informational purposes, unused otherwise */
     void set_idx(size_t idx) {
@@ -95,38 +145,53 @@ public:
 
     /** Getters: get the value at the given column. If the column is not
     * of the requested type, the result is undefined. */
+    /** Values of 'Y' and 'H' columns are widened */
     int get_int(size_t col) {
-        if (schema_->col_type(col) == 'I') {
-            if (columns_[col]->get_type() == 'I') {
-                return columns_[col]->as_int()->get(0);
-            }
+        switch (col_type(col)) {
+        case 'I':
+            return vals_[col].i;
+        case 'Y':
+            return vals_[col].y;
+        case 'H':
+            return vals_[col].h;
+        }
+        assert("Wrong type. Program terminated." && false);
+    }
+
+    /** Values of any integer column, widened to 64 bits */
+    int64_t get_long(size_t col) {
+        if (col_type(col) == 'L') return vals_[col].l;
+        return get_int(col);
+    }
+
+    float get_float(size_t col) {
+        if (col_type(col) == 'F') {
+            return vals_[col].f;
         }
         assert("Wrong type. Program terminated." && false);
     }
 
     bool get_bool(size_t col) {
-        if (schema_->col_type(col) == 'B') {
-            if (columns_[col]->get_type() == 'B') {
-                return columns_[col]->as_bool()->get(0);
-            }
+        if (col_type(col) == 'B') {
+            return vals_[col].b;
         }
         assert("Wrong type. Program terminated." && false);
     }
 
+    /** Values of 'F' columns are widened */
     double get_double(size_t col) {
-        if (schema_->col_type(col) == 'D') {
-            if (columns_[col]->get_type() == 'D') {
-                return columns_[col]->as_double()->get(0);
-            }
+        if (col_type(col) == 'D') {
+            return vals_[col].d;
+        }
+        if (col_type(col) == 'F') {
+            return vals_[col].f;
         }
         assert("Wrong type. Program terminated." && false);
     }
 
     String *get_string(size_t col) {
-        if (schema_->col_type(col) == 'S') {
-            if (columns_[col]->get_type() == 'S') {
-                return columns_[col]->as_string()->get(0);
-            }
+        if (col_type(col) == 'S') {
+            return vals_[col].s;
         }
         assert("Wrong type. Program terminated." && false);
     }
@@ -142,7 +207,7 @@ public:
 
     /** Type of the field at the given position. An idx >= width is  undefined. */
     char col_type(size_t idx) {
-        return columns_[idx]->get_type();
+        return schema_->types[idx];
     }
 
     /** Given a Fielder, visit every field of this row. The first argument is
@@ -152,32 +217,31 @@ public:
         if (idx == idx_) {
             f.start(idx);
             for (size_t i = 0; i < width_; i++) {
-                char type = col_type(i);
-                switch (type) {
+                switch (col_type(i)) {
                 case 'I':
-                {
-                    IntColumn *intCol = columns_[i]->as_int();
-                    f.accept(intCol->get(0));
+                    f.accept(vals_[i].i);
                     break;
-                }
                 case 'B':
-                {
-                    BoolColumn *bCol = columns_[i]->as_bool();
-                    f.accept(bCol->get(0));
+                    f.accept(vals_[i].b);
                     break;
-                }
                 case 'D':
-                {
-                    DoubleColumn *fCol = columns_[i]->as_double();
-                    f.accept(fCol->get(0));
+                    f.accept(vals_[i].d);
                     break;
-                }
                 case 'S':
-                {
-                    StringColumn *sCol = columns_[i]->as_string();
-                    f.accept(sCol->get(0));
+                    f.accept(vals_[i].s);
+                    break;
+                case 'Y':
+                    f.accept(vals_[i].y);
+                    break;
+                case 'H':
+                    f.accept(vals_[i].h);
+                    break;
+                case 'L':
+                    f.accept(vals_[i].l);
+                    break;
+                case 'F':
+                    f.accept(vals_[i].f);
                     break;
-                }
                 default:
                     assert("Invalid type. Program terminated." && false);
                 }
@@ -194,12 +258,30 @@ public:
     void print() {
         std::cout << "------" << std::endl;
         for (size_t i = 0; i < width_; i++) {
-            columns_[i]->print();
+            if (missing_[i]) {
+                std::cout << "[NULL]" << std::endl;
+                continue;
+            }
+            switch (col_type(i)) {
+            case 'B':
+                std::cout << vals_[i].b << std::endl;
+                break;
+            case 'S':
+                std::cout << (vals_[i].s == nullptr ? "" : vals_[i].s->c_str()) << std::endl;
+                break;
+            case 'D':
+            case 'F':
+                std::cout << get_double(i) << std::endl;
+                break;
+            default:
+                std::cout << get_long(i) << std::endl;
+            }
         }
         std::cout << "------" << std::endl;
     }
 
     ~Row() {
-        delete[] columns_;
+        delete[] vals_;
+        delete[] missing_;
     }
 };
\ No newline at end of file
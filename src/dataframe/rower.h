@@ -1,6 +1,9 @@
 //lang: CwC
 #pragma once
 
+class Batch;
+class BatchRower;
+
 /*******************************************************************************
  *  Rower::
  *  An interface for iterating through each row of a data frame. The intent
@@ -20,4 +23,27 @@ public:
       original object will be the last to be called join on. The join method
       is reponsible for cleaning up memory. */
     virtual void join_delete(Rower *other) {}
+
+    /** This rower as a BatchRower, nullptr if it can only be shown rows */
+    virtual BatchRower *as_batch() { return nullptr; }
+};
+
+/*******************************************************************************
+ *  BatchRower::
+ *  A Rower that can also be shown many rows at once. Traversals that know
+ *  about batches call accept(Batch&) for each run of rows instead of
+ *  building a Row for every row, and read whole columns as typed spans.
+ *  accept(Row&) is still called by traversals that only have rows, so
+ *  subclasses implement both. A filter keeps a row of a batch when the
+ *  rower calls keep() on it.
+ */
+class BatchRower : public Rower {
+public:
+    using Rower::accept;
+
+    /** Called with consecutive runs of rows. The batch is on loan and its
+      spans are only valid during the call. */
+    virtual void accept(Batch &b) {}
+
+    BatchRower *as_batch() { return this; }
 };
\ No newline at end of file
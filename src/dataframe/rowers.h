@@ -34,6 +34,10 @@ class SumNumbersFielder : public Fielder {
             sum_ += i;
         }
 
+        void accept(int64_t l) {
+            sum_ += l;
+        }
+
         double get_sum() {
             return sum_;
         }
@@ -47,10 +51,11 @@ class SumNumbersFielder : public Fielder {
  * Authors:
  * Canon Sawrey sawrey.c@husky.neu.edu
  * Trevor Stenson stenson.t@husky.neu.edu */
-class SumNumbers : public Rower {
+class SumNumbers : public BatchRower {
     public:
         double sum_;
         SumNumbersFielder* sumFielder_;
+        vector<const double*> spans_; //reused from one batch to the next
 
         SumNumbers() {
             sum_ = 0;
@@ -63,6 +68,26 @@ class SumNumbers : public Rower {
             return true;
         }
 
+        /** Sums the numeric columns of the batch, a column at a time unless
+         *  only some rows are selected */
+        void accept(Batch& b) {
+            spans_.clear();
+            for (size_t c = 0; c < b.width(); c++) {
+                if (is_numeric_type(b.col_type(c))) spans_.push_back(b.doubles(c));
+            }
+            if (b.count() == b.size()) {
+                //every row is visited, so each column is summed as a whole
+                for (size_t c = 0; c < spans_.size(); c++) sum_ += span_sum(spans_[c], b.size());
+                return;
+            }
+            for (size_t k = 0; k < b.count(); k++) {
+                size_t i = b.row(k);
+                double row_sum = 0;
+                for (size_t c = 0; c < spans_.size(); c++) row_sum += spans_[c][i];
+                sum_ += row_sum;
+            }
+        }
+
         Object* clone() {
             return new SumNumbers();
         }
@@ -113,6 +138,10 @@ class FibSumFielder : public Fielder {
             total_fib_ += fib(i % mod_);
         }
 
+        void accept(int64_t l) {
+            total_fib_ += fib((int)(l % mod_));
+        }
+
         double get_total_fib() {
             return total_fib_;
         }
@@ -219,6 +248,14 @@ class HashingFielder : public Fielder {
             }
         }
 
+        void accept(int64_t l) {
+            for (int k = 0; k < l % 5; k++) {
+                for (int j = 0; j < strlen(hash_); j++) {
+                    hash_[j] = ((hash_[j] + (int)(l % 26)) % 26) + 97;
+                }
+            }
+        }
+
         char* get_hash() {
             return hash_;
         }
@@ -314,6 +351,11 @@ class InversionFielder : public Fielder {
             col_++;
         }
 
+        void accept(int64_t l) {
+            newRow->set(col_, -1 * l);
+            col_++;
+        }
+
         DataFrame* get_new_dataframe() {
             return new_df_;
         }
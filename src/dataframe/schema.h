@@ -9,7 +9,9 @@
  * A schema is a description of the contents of a data frame, the schema
  * knows the number of columns and number of rows, the type of each column,
  * optionally columns and rows can be named by strings.
- * The valid types are represented by the chars 'S', 'B', 'I' and 'F'.
+ * The valid types are represented by the chars 'S', 'B', 'I' and 'D', and
+ * the narrow and wide numeric types 'Y' (int8), 'H' (int16), 'L' (int64)
+ * and 'F' (float32).
  * Authors:
  * Canon Sawrey   sawrey.c@husky.neu.edu
  * Trevor Stenson stenson.t@husky.neu.edu
@@ -62,7 +64,7 @@ class Schema : public Object, public Serializable {
         strcpy(types, types_);
         n_row = 0;
       } else {
-        assert("Cannot instantiate types other than B, I, D, or S." && false);
+        assert("Cannot instantiate types other than B, Y, H, I, L, F, D, or S." && false);
       }
     }
 
@@ -75,8 +77,7 @@ class Schema : public Object, public Serializable {
       return types[idx];
     }
 
-    /** Ensures the char* contains only B, I, F, and S, representing
-     *  boolean, integer, double, and string types. **/
+    /** Ensures the char* contains only valid types **/
     bool containsValidTypes(const char* types) {
       for (int i = 0; i < strlen(types); i++) {
         if (!isValidType(types[i])) {
@@ -86,10 +87,11 @@ class Schema : public Object, public Serializable {
       return true;
     }
 
-     /** Ensures the char is one of B, I, F, and S, representing
-     *  boolean, integer, double, or string type. **/
+     /** Ensures the char is one of B, Y, H, I, L, F, D and S, representing
+     *  boolean, 8, 16, 32 and 64 bit integer, float, double, or string type. **/
     bool isValidType(const char type) {
-      return (type == 'B' || type == 'I' || type == 'D' || type == 'S');
+      return (type == 'B' || type == 'Y' || type == 'H' || type == 'I' || type == 'L' ||
+              type == 'F' || type == 'D' || type == 'S');
     }
   
     /** Add a column of the given type and name (can be nullptr), name
@@ -97,7 +99,7 @@ class Schema : public Object, public Serializable {
       * in undefined behavior. */
     void add_column(char typ, String* name) {
       if (!isValidType(typ)) {
-        assert("Cannot instantiate types other than B, I, D, or S." && false);
+        assert("Cannot instantiate types other than B, Y, H, I, L, F, D, or S." && false);
       }
       ensureColumnCapacity();
       types[n_col] = typ;
@@ -105,9 +107,9 @@ class Schema : public Object, public Serializable {
     }
 
     /** Ensures the current column capacity is enough to
-     * accomodate an addition */
+     * accomodate an addition and the terminating '\0' */
     void ensureColumnCapacity() {
-      if (n_col == col_cap) {
+      if (n_col + 1 >= col_cap) {
         growColumns();
       }
     }
@@ -189,28 +191,37 @@ class Schema : public Object, public Serializable {
       return (strcmp(types, x->types) == 0);
     }
 
-    /** Serializes the DoubleArray into an unsigned char array. Structure is as following
+    /** Serializes the Schema into an unsigned char array. Structure is as following
          * 
          * |--8 bytes--|--8 bytes-----|---Unknown----|
          * |--n_row----|--n_col-------|---types------|
     */
-    unsigned char* serialize() { 
-      unsigned char* buffer = new unsigned char[16 + width() + 1];
-      unsigned char* cast = reinterpret_cast<unsigned char*>(types);
-      insert_size_t(n_row, buffer, 0);
-      insert_size_t(n_col, buffer, 8);
-      insert_char_arr(types, buffer, 16, true);
-      return buffer;
+    size_t serial_size() {
+      return 16 + width() + 1;
     }
 
-    size_t deserialize(unsigned char* serialized) { 
-      n_row = extract_size_t(serialized, 0);
-      size_t width = extract_size_t(serialized, 8);
-      char* temp = reinterpret_cast<char*>(serialized + 16);
+    void write_to(BufferWriter& writer) {
+      writer.write_size_t(n_row);
+      writer.write_size_t(n_col);
+      writer.write_string(types, width());
+    }
+
+    void read_from(BufferReader& reader) {
+      n_row = reader.read_size_t();
+      size_t width = reader.read_size_t();
+      reader.need(width + 1);
+      char* temp = reinterpret_cast<char*>(reader.cursor());
       for (size_t i = 0; i < width; i++) {
         add_column(temp[i], nullptr);
       }
+      reader.skip(width + 1);
       assert(n_col == width);
-      return 16 + width + 1;
+    }
+
+    /** A schema does not start with its length, it ends with its types */
+    size_t deserialize(unsigned char* serialized) { 
+      BufferReader reader(serialized, 16 + extract_size_t(serialized, 8) + 1);
+      read_from(reader);
+      return reader.pos_;
     }
 };
\ No newline at end of file
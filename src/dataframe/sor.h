@@ -6,9 +6,13 @@
 #include <vector>
 #include "../type.h"
 #include "distributeddataframe.h"
+#include "arena.h"
 
 using namespace std;
 
+/** String columns whose values repeat at least this many times on average
+ *  are dictionary encoded */
+#define DICT_MIN_REPEATS 2
 
 /**
  * Helper class for parsing sor files
@@ -25,6 +29,7 @@ class Parser {
         bool infer_only;
         vector<char> type_vector;
         vector<string> staging_vector;
+        vector<bool> staging_missing; // is the field of staging_vector at the same index empty, <>
         unsigned int length;
         DataFrame* df;
 
@@ -72,26 +77,42 @@ class Parser {
          * Adds the staging vector to the columns
          */  
         void write_data() {
-            for (unsigned int i = 0; i < staging_vector.size(); i++) {
-                string current_field = staging_vector[i];
+            if (staging_vector.empty()) return;
+            for (unsigned int i = 0; i < type_vector.size(); i++) {
+                //fields that are empty or absent from the line are missing, <""> is an empty string
+                if (i >= staging_vector.size() || staging_missing[i]) {
+                    df->set_missing(i, line_count);
+                    continue;
+                }
+                string& current_field = staging_vector[i];
+                //a number too wide for the type inferred from the first lines widens the column
+                if (is_numeric_type(type_vector[i]) && is_numeric_type(df->schema->type(i))
+                        && type_vector[i] != df->schema->type(i)) {
+                    df->widen_column(i, type_vector[i]);
+                }
                 //add the data contained within the field to columns
-                if (current_field != "") {
-                    switch(type_vector[i]) {
-                        case 'B':
-                            df->set(i, line_count, parse_bool(current_field));
-                            break;
-                        case 'D':
-                            df->set(i, line_count, parse_double(current_field));
-                            break;
-                        case 'S':
-                            df->set(i, line_count, parse_string(current_field));
-                            break;
-                        case 'I':
-                            df->set(i, line_count, parse_int(current_field));
-                            break;
-                        default:
-                            assert("Unrecognized type" && false);
-                    }
+                switch(df->schema->type(i)) {
+                    case 'B':
+                        df->set(i, line_count, parse_bool(current_field));
+                        break;
+                    case 'D':
+                        df->set(i, line_count, parse_double(current_field));
+                        break;
+                    case 'S':
+                        //the bytes go straight into the column's storage
+                        df->set_chars(i, line_count, current_field.c_str(), current_field.size());
+                        break;
+                    case 'Y':
+                    case 'H':
+                    case 'I':
+                    case 'L':
+                        df->set(i, line_count, parse_long(current_field));
+                        break;
+                    case 'F':
+                        df->set(i, line_count, (float)parse_double(current_field));
+                        break;
+                    default:
+                        assert("Unrecognized type" && false);
                 }
             }
         }
@@ -115,10 +136,10 @@ class Parser {
                     handle_quote();
                     break;
                 case ' ':
-                    if (in_quotes) current_field = current_field + ch;
+                    if (in_quotes) current_field += ch;
                     break;
                 default:
-                    if (in_field) current_field = current_field + ch;
+                    if (in_field) current_field += ch;
                     break;
             }
         }
@@ -132,12 +153,13 @@ class Parser {
                     // add the staging vector to columns, lear the stagingVector for the next line
                     write_data();
                     staging_vector.clear();
+                    staging_missing.clear();
                 }
                 line_count++;
                 in_field = false;
                 current_width = 0;
             } else {
-                current_field = current_field + ch;
+                current_field += ch;
             }
         }
 
@@ -146,7 +168,7 @@ class Parser {
          */
         void handle_open_tag() {
             if (in_quotes || in_field) {
-                current_field = current_field + ch;
+                current_field += ch;
             } else if (!in_field) {
                 // set the inField flag to true to indicate we are at the beginning of a new field
                 in_field = true;
@@ -167,29 +189,27 @@ class Parser {
                     current_width++;
                     in_field = false;
                     if (!infer_only) {
-                        trim(current_field);
+                        //missing is decided before the quotes go, <> is missing and <""> is not
+                        trim_whitespace(current_field);
+                        staging_missing.push_back(current_field.empty());
+                        trim_quotes(current_field);
                         staging_vector.push_back(current_field);
                     }
-                    current_field = "";
+                    current_field.clear();
                 }
             } else {
-                current_field = current_field + ch;
+                current_field += ch;
             }
         }
 
         /**
-         * Updates the type of this Column if the incomingType is less restrictive than the currentType
-         * I.e. STRING replaces DOUBLE replaces INT replaces BOOL
+         * Updates the type of this Column to the narrowest type that holds
+         * both the values seen so far and the incoming one, see join_types
          * @param old_type The type that wa previosuly present
          * @param new_type The type that may replace this column's current Type
          */
         char update_type(Type old_type, Type new_type) {
-            // check if the old column Type should be updated
-            if (should_change_type(new_type, old_type)) {
-                return map_to_char(old_type);
-            } else {
-                return map_to_char(new_type);
-            }
+            return map_to_char(join_types(old_type, new_type));
         }
 
         /**
@@ -198,7 +218,7 @@ class Parser {
         void handle_quote() {
             if (in_field) {
                 in_quotes = !in_quotes;
-                current_field = current_field + '\"';
+                current_field += '\"';
             }
         }
 
@@ -239,7 +259,10 @@ class SorAdapter {
             string file = string(filename);
             Schema* schema = infer_schema(file, from, length);
             df_ = new DataFrame(*schema);
+            use_arena_strings();
             build_DataFrame(file, from, length);
+            dictionary_encode();
+            df_->seal();
         }
 
         SorAdapter(
@@ -291,6 +314,33 @@ class SorAdapter {
             delete p;
         }
 
+        /**
+         * Gives every string column arena storage so parsed strings are
+         * copied into slabs instead of allocated one by one
+         */
+        void use_arena_strings() {
+            for (size_t i = 0; i < df_->ncols(); i++) {
+                if (df_->columns[i]->as_string() == nullptr) continue;
+                delete df_->columns[i];
+                df_->columns[i] = new ArenaStringColumn();
+            }
+        }
+
+        /**
+         * Replaces every low cardinality string column with a dictionary
+         * encoded one, freeing the arena it was parsed into.
+         */
+        void dictionary_encode() {
+            for (size_t i = 0; i < df_->ncols(); i++) {
+                StringColumn* col = df_->columns[i]->as_string();
+                if (col == nullptr || col->size() == 0) continue;
+                DictStringColumn* dict = DictStringColumn::encode(col, col->size() / DICT_MIN_REPEATS);
+                if (dict == nullptr) continue;
+                delete col;
+                df_->columns[i] = dict;
+            }
+        }
+
         /**
          * Skips the fstream ahead from the start to "from" bytes in,
          * and then skips to the end of the line to eliminate partial start line.
@@ -0,0 +1,179 @@
+//lang: CwC
+#pragma once
+
+#include <algorithm>
+#include "column.h"
+#include "../threadpool.h"
+
+/** Rows of the permutation handled by one task of a parallel sort */
+#define SORT_MORSEL CHUNK_SIZE
+
+/*************************************************************************
+ * Sorting::
+ * Stable sorts of a permutation of rows by the values of one column. A
+ * permutation holds row numbers; sorting it by a column leaves the rows
+ * in the order of their values there, ties keeping their order, and rows
+ * whose value is missing last. Sorting by several columns sorts by the
+ * last one first, each pass keeping the order of the one before.
+ * Numeric and bool columns are sorted by an LSD radix sort over order
+ * preserving 64 bit keys, a byte per pass. Passes where every key has the
+ * same byte are skipped, so narrow values take few passes. Histograms and
+ * scatters run a morsel of the permutation per task on the shared pool.
+ * String columns are merge sorted: morsels are sorted in parallel, then
+ * merged pairwise, comparing an 8 byte prefix of each string before
+ * looking at the strings themselves.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+
+/** Runs f(m) for every morsel m below morsels, on the pool when there is
+ *  more than one */
+template <typename Fn>
+void for_each_morsel(size_t morsels, Fn f) {
+  if (morsels <= 1) {
+    for (size_t m = 0; m < morsels; m++) f(m);
+  } else {
+    ThreadPool::shared().parallel_for(morsels, f);
+  }
+}
+
+/** Unsigned key of x ordered like x */
+inline uint64_t order_key(int64_t x) {
+  return (uint64_t)x ^ ((uint64_t)1 << 63);
+}
+
+/** Unsigned key of d ordered like d, -0.0 and 0.0 alike */
+inline uint64_t order_key(double d) {
+  if (d == 0) d = 0;
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  return (bits >> 63) != 0 ? ~bits : bits | ((uint64_t)1 << 63);
+}
+
+/** Order preserving keys of every value of a numeric or bool column,
+ *  inverted when descending. Missing values get any key. */
+inline void sort_keys(Column* col, bool ascending, std::vector<uint64_t>& keys) {
+  size_t n = col->size();
+  keys.resize(n);
+  char type = col->get_type();
+  if (is_integer_type(type)) {
+    std::vector<int64_t> vals(n);
+    if (n > 0) read_integers(col, 0, n, vals.data());
+    for (size_t i = 0; i < n; i++) keys[i] = order_key(vals[i]);
+  } else if (type == 'B') {
+    for (size_t i = 0; i < n; i++) keys[i] = col->as_bool()->get(i);
+  } else if (type == 'F' || type == 'D') {
+    for (size_t c = 0; c < col->chunk_count(); c++) {
+      size_t start = c << CHUNK_SHIFT;
+      for (size_t i = 0; i < col->chunk_length(c); i++) {
+        double d = type == 'D' ? col->as_double()->chunk(c)[i] : col->as_float()->chunk(c)[i];
+        keys[start + i] = order_key(d);
+      }
+    }
+  } else {
+    assert("Column cannot be radix sorted." && false);
+  }
+  if (!ascending) {
+    for (size_t i = 0; i < n; i++) keys[i] = ~keys[i];
+  }
+}
+
+/** Stably sorts perm by keys[perm[i]], a byte per pass */
+inline void radix_sort(std::vector<size_t>& perm, std::vector<uint64_t>& keys) {
+  size_t n = perm.size();
+  size_t morsels = (n + SORT_MORSEL - 1) / SORT_MORSEL;
+  std::vector<size_t> out(n);
+  std::vector<size_t> counts(morsels * 256);
+  for (size_t shift = 0; shift < 64; shift += 8) {
+    std::fill(counts.begin(), counts.end(), 0);
+    for_each_morsel(morsels, [&](size_t m) {
+      size_t* count = &counts[m * 256];
+      size_t end = std::min((m + 1) * SORT_MORSEL, n);
+      for (size_t i = m * SORT_MORSEL; i < end; i++) count[(keys[perm[i]] >> shift) & 255]++;
+    });
+    //offsets by digit, then by morsel, so equal digits keep their order
+    size_t total = 0;
+    bool one_digit = false;
+    for (size_t d = 0; d < 256; d++) {
+      size_t digit_total = 0;
+      for (size_t m = 0; m < morsels; m++) {
+        size_t c = counts[m * 256 + d];
+        counts[m * 256 + d] = total;
+        total += c;
+        digit_total += c;
+      }
+      if (digit_total == n) one_digit = true;
+    }
+    if (one_digit) continue;
+    for_each_morsel(morsels, [&](size_t m) {
+      size_t* offset = &counts[m * 256];
+      size_t end = std::min((m + 1) * SORT_MORSEL, n);
+      for (size_t i = m * SORT_MORSEL; i < end; i++) out[offset[(keys[perm[i]] >> shift) & 255]++] = perm[i];
+    });
+    perm.swap(out);
+  }
+}
+
+/** First 8 bytes of s as a big endian number, so prefixes compare like
+ *  the strings do */
+inline uint64_t string_prefix(StringView s) {
+  uint64_t p = 0;
+  for (size_t i = 0; i < 8; i++) {
+    p <<= 8;
+    if (i < s.size()) p |= (unsigned char)s.c_str()[i];
+  }
+  return p;
+}
+
+/** Stably sorts perm by the strings of col, none of them missing */
+inline void string_sort(std::vector<size_t>& perm, StringColumn* col, bool ascending) {
+  std::vector<uint64_t> prefixes(col->size());
+  for (size_t i = 0; i < perm.size(); i++) prefixes[perm[i]] = string_prefix(col->get_view(perm[i]));
+  auto less = [&](size_t a, size_t b) {
+    if (!ascending) std::swap(a, b);
+    if (prefixes[a] != prefixes[b]) return prefixes[a] < prefixes[b];
+    StringView x = col->get_view(a);
+    StringView y = col->get_view(b);
+    int cmp = memcmp(x.c_str(), y.c_str(), std::min(x.size(), y.size()));
+    return cmp != 0 ? cmp < 0 : x.size() < y.size();
+  };
+  size_t n = perm.size();
+  size_t morsels = (n + SORT_MORSEL - 1) / SORT_MORSEL;
+  for_each_morsel(morsels, [&](size_t m) {
+    std::stable_sort(perm.begin() + m * SORT_MORSEL, perm.begin() + std::min((m + 1) * SORT_MORSEL, n), less);
+  });
+  //merge runs of width sorted rows pairwise until one is left
+  std::vector<size_t> out(n);
+  for (size_t width = SORT_MORSEL; width < n; width *= 2) {
+    size_t pairs = (n + 2 * width - 1) / (2 * width);
+    for_each_morsel(pairs, [&](size_t p) {
+      size_t lo = p * 2 * width;
+      size_t mid = std::min(lo + width, n);
+      size_t hi = std::min(lo + 2 * width, n);
+      std::merge(perm.begin() + lo, perm.begin() + mid, perm.begin() + mid, perm.begin() + hi, out.begin() + lo, less);
+    });
+    perm.swap(out);
+  }
+}
+
+/** Stably sorts perm by the values of col, missing values last */
+inline void sort_by_column(std::vector<size_t>& perm, Column* col, bool ascending) {
+  std::vector<size_t> missing;
+  if (col->null_count() > 0) {
+    std::vector<size_t> present;
+    for (size_t i = 0; i < perm.size(); i++) {
+      if (col->is_missing(perm[i])) missing.push_back(perm[i]);
+      else present.push_back(perm[i]);
+    }
+    perm.swap(present);
+  }
+  if (col->get_type() == 'S') {
+    string_sort(perm, col->as_string(), ascending);
+  } else {
+    std::vector<uint64_t> keys;
+    sort_keys(col, ascending, keys);
+    radix_sort(perm, keys);
+  }
+  perm.insert(perm.end(), missing.begin(), missing.end());
+}
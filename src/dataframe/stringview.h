@@ -0,0 +1,65 @@
+//lang: CwC
+#pragma once
+
+#include <cstring>
+#include "../string.h"
+
+/*************************************************************************
+ * StringView::
+ * A non-owning reference to len_ bytes of a string stored elsewhere, such
+ * as a column's arena or dictionary. The bytes are followed by a '\0' when
+ * they come from a String or a column. A view with no data is a nullptr
+ * value. Views are passed by value and stay valid while the storage they
+ * point into is unchanged.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+class StringView {
+  public:
+    const char* data_; // not owned
+    size_t len_;
+
+    StringView() {
+      data_ = nullptr;
+      len_ = 0;
+    }
+
+    StringView(const char* data, size_t len) {
+      data_ = data;
+      len_ = len;
+    }
+
+    /** View of s, a nullptr view if s is nullptr */
+    StringView(String* s) {
+      data_ = s == nullptr ? nullptr : s->c_str();
+      len_ = s == nullptr ? 0 : s->size();
+    }
+
+    /** Is this a view of a nullptr value? */
+    bool is_null() {
+      return data_ == nullptr;
+    }
+
+    size_t size() {
+      return len_;
+    }
+
+    const char* c_str() {
+      return data_;
+    }
+
+    bool equals(StringView other) {
+      if (data_ == nullptr || other.data_ == nullptr) return data_ == other.data_;
+      return len_ == other.len_ && memcmp(data_, other.data_, len_) == 0;
+    }
+
+    bool equals(String* other) {
+      return equals(StringView(other));
+    }
+
+    /** New String holding a copy of the bytes, nullptr for a nullptr view */
+    String* to_string() {
+      return data_ == nullptr ? nullptr : new String(data_, len_);
+    }
+};
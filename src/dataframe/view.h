@@ -0,0 +1,375 @@
+//lang: CwC
+#pragma once
+
+#include "dataframe.h"
+
+/*************************************************************************
+ * DataFrameView::
+ * The rows of a dataframe that a filter kept, held as a selection vector
+ * of their row numbers instead of copies of their values. A view reads
+ * through to its parent, so building one only tests the rows. Maps, pmaps,
+ * range scans and serialization run over the selected rows in place, and
+ * filtering a view gives another view of the same parent. materialize()
+ * copies the rows out into a dataframe of their own.
+ * A view is read only and must not outlive its parent. Rows seen by row
+ * rowers are numbered by their position in the view; batches address the
+ * parent's rows and select the ones in the view.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+class DataFrameView : public DataFrame {
+public:
+    DataFrame *parent_;        // external; never itself a view
+    std::vector<size_t> rows_; // rows of parent_ in the view, increasing
+
+    /** A view of the rows of df that r accepts. A view of a view selects
+    * from the rows of the first view and shares its parent. */
+    DataFrameView(DataFrame *df, Rower &r) {
+        DataFrameView *view = df->as_view();
+        if (view == nullptr) {
+            parent_ = df;
+            df->select_rows(r, 0, df->nrows(), rows_);
+        } else {
+            parent_ = view->parent_;
+            view->select_range(r, 0, view->nrows(), rows_);
+        }
+        init();
+    }
+
+    /** A view of the listed rows of parent, which the view takes */
+    DataFrameView(DataFrame *parent, std::vector<size_t> &rows) {
+        parent_ = parent;
+        rows_.swap(rows);
+        init();
+    }
+
+    /** Gives the view a schema of its own; it has no columns of its own */
+    void init() {
+        schema = new Schema(parent_->schema->types);
+        if (!rows_.empty()) schema->new_length(rows_.size() - 1);
+        col_cap = 0;
+        columns = nullptr;
+    }
+
+    ~DataFrameView() {
+        delete schema;
+    }
+
+    DataFrameView *as_view() {
+        return this;
+    }
+
+    /** Row of the parent at position row of the view */
+    size_t parent_row(size_t row) {
+        if (row >= rows_.size()) {
+            assert("Index out of bounds." && false);
+        }
+        return rows_[row];
+    }
+
+    int get_int(size_t col, size_t row) {
+        return parent_->get_int(col, parent_row(row));
+    }
+
+    int64_t get_long(size_t col, size_t row) {
+        return parent_->get_long(col, parent_row(row));
+    }
+
+    float get_float(size_t col, size_t row) {
+        return parent_->get_float(col, parent_row(row));
+    }
+
+    bool get_bool(size_t col, size_t row) {
+        return parent_->get_bool(col, parent_row(row));
+    }
+
+    double get_double(size_t col, size_t row) {
+        return parent_->get_double(col, parent_row(row));
+    }
+
+    String *get_string(size_t col, size_t row) {
+        return parent_->get_string(col, parent_row(row));
+    }
+
+    bool is_missing(size_t col, size_t row) {
+        return parent_->is_missing(col, parent_row(row));
+    }
+
+    void set(size_t col, size_t row, int val) { read_only(); }
+    void set(size_t col, size_t row, int64_t val) { read_only(); }
+    void set(size_t col, size_t row, float val) { read_only(); }
+    void set(size_t col, size_t row, bool val) { read_only(); }
+    void set(size_t col, size_t row, double val) { read_only(); }
+    void set(size_t col, size_t row, String *val) { read_only(); }
+    void set_chars(size_t col, size_t row, const char *s, size_t len) { read_only(); }
+    void set_missing(size_t col, size_t row) { read_only(); }
+
+    void read_only() {
+        assert("A DataFrameView cannot be modified." && false);
+    }
+
+    void fill_row(size_t idx, Row &row) {
+        parent_->fill_row(parent_row(idx), row);
+        row.set_idx(idx);
+    }
+
+    /** Visit the rows of the view in order */
+    void map(Rower &r) {
+        mapRange(0, rows_.size(), r);
+    }
+
+    /** Visit the rows of the view in parallel, a morsel of MORSEL_ROWS
+    * rows of the view per task */
+    void pmap(Rower &r) {
+        size_t morsels = (nrows() + MORSEL_ROWS - 1) / MORSEL_ROWS;
+        if (morsels <= 1) {
+            map(r);
+            return;
+        }
+        run_morsels(r, morsels, [&](Rower &mine, size_t m) {
+            size_t start = m * MORSEL_ROWS;
+            mapRange(start, std::min(start + MORSEL_ROWS, nrows()), mine);
+        });
+    }
+
+    /** Shows r the rows of the view at positions [from, to) */
+    void mapRange(size_t from, size_t to, Rower &r) {
+        if (from >= to) return;
+        BatchRower *b = r.as_batch();
+        if (b != nullptr) {
+            Batch batch(parent_->columns, ncols());
+            parent_->for_each_listed(rows_.data() + from, to - from, batch, [&]() { b->accept(batch); });
+            return;
+        }
+        Row row(get_schema());
+        for (size_t k = from; k < to; k++) {
+            fill_row(k, row);
+            r.accept(row);
+        }
+    }
+
+    /** Appends to sel, in order, the rows of the parent at positions
+    * [from, to) of the view that r accepts */
+    void select_range(Rower &r, size_t from, size_t to, std::vector<size_t> &sel) {
+        if (from >= to) return;
+        BatchRower *b = r.as_batch();
+        if (b != nullptr) {
+            Batch batch(parent_->columns, ncols());
+            parent_->for_each_listed(rows_.data() + from, to - from, batch, [&]() {
+                b->accept(batch);
+                for (size_t k = 0; k < batch.count(); k++) {
+                    if (batch.kept(batch.row(k))) sel.push_back(batch.start() + batch.row(k));
+                }
+            });
+            return;
+        }
+        Row row(get_schema());
+        for (size_t k = from; k < to; k++) {
+            fill_row(k, row);
+            if (r.accept(row)) sel.push_back(rows_[k]);
+        }
+    }
+
+    /** A view of the rows of this view that r accepts */
+    DataFrame *filter(Rower &r) {
+        return new DataFrameView(this, r);
+    }
+
+    /** Like filter, with the rows tested in parallel a morsel at a time */
+    DataFrame *pfilter(Rower &r) {
+        size_t morsels = (nrows() + MORSEL_ROWS - 1) / MORSEL_ROWS;
+        if (morsels <= 1) return filter(r);
+        std::vector<std::vector<size_t>> sels(morsels);
+        run_morsels(r, morsels, [&](Rower &mine, size_t m) {
+            size_t start = m * MORSEL_ROWS;
+            select_range(mine, start, std::min(start + MORSEL_ROWS, nrows()), sels[m]);
+        });
+        std::vector<size_t> sel;
+        for (size_t m = 0; m < morsels; m++) sel.insert(sel.end(), sels[m].begin(), sels[m].end());
+        return new DataFrameView(parent_, sel);
+    }
+
+    /** Visit, in order, the rows of the view whose value in the numeric
+    * column col lies in [lo, hi]. Rows in chunks of the parent whose zone
+    * map rules the range out are skipped without being read. */
+    void map_where(size_t col, double lo, double hi, Rower &r) {
+        std::vector<size_t> at;
+        positions_where(col, lo, hi, at);
+        BatchRower *b = r.as_batch();
+        if (b != nullptr) {
+            std::vector<size_t> rows;
+            for (size_t k = 0; k < at.size(); k++) rows.push_back(rows_[at[k]]);
+            Batch batch(parent_->columns, ncols());
+            parent_->for_each_listed(rows.data(), rows.size(), batch, [&]() { b->accept(batch); });
+            return;
+        }
+        Row row(get_schema());
+        for (size_t k = 0; k < at.size(); k++) {
+            fill_row(at[k], row);
+            r.accept(row);
+        }
+    }
+
+    /** A view of the rows of this view whose value in the numeric column
+    * col lies in [lo, hi] */
+    DataFrame *filter_where(size_t col, double lo, double hi) {
+        std::vector<size_t> at;
+        positions_where(col, lo, hi, at);
+        for (size_t k = 0; k < at.size(); k++) at[k] = rows_[at[k]];
+        return new DataFrameView(parent_, at);
+    }
+
+    /** Appends to at the positions of the rows whose value in column col
+    * lies in [lo, hi]. Missing values never match. */
+    void positions_where(size_t col, double lo, double hi, std::vector<size_t> &at) {
+        Column *column = parent_->columns[col];
+        size_t k = 0;
+        while (k < rows_.size()) {
+            size_t c = rows_[k] >> CHUNK_SHIFT;
+            if (!column->chunk_overlaps(c, lo, hi)) {
+                while (k < rows_.size() && rows_[k] >> CHUNK_SHIFT == c) k++;
+                continue;
+            }
+            if (!column->is_missing(rows_[k])) {
+                double val = column->get_numeric(rows_[k]);
+                if (val >= lo && val <= hi) at.push_back(k);
+            }
+            k++;
+        }
+    }
+
+    /** Sorting copies the rows out first */
+    std::vector<size_t> sort_order(const std::vector<size_t> &cols, const std::vector<bool> &ascending) {
+        DataFrame *df = materialize();
+        std::vector<size_t> perm = df->sort_order(cols, ascending);
+        delete df;
+        return perm;
+    }
+
+    DataFrame *sort_by(const std::vector<size_t> &cols, const std::vector<bool> &ascending) {
+        DataFrame *df = materialize();
+        DataFrame *sorted = df->sort_by(cols, ascending);
+        delete df;
+        return sorted;
+    }
+
+    /** Copies the rows of the view into a new dataframe */
+    DataFrame *materialize() {
+        DataFrame *df = new DataFrame(*parent_);
+        parent_->append_selected(df, rows_.data(), rows_.size());
+        return df;
+    }
+
+    /** An estimate, columns are gathered only while writing, the writer
+    * grows past it if needed */
+    size_t serial_size() {
+        return 8 + schema->serial_size() + schema->width() * (64 + 8 * rows_.size());
+    }
+
+    /** Encodes the view like the dataframe it would materialize into,
+    * copying out one column at a time */
+    void write_to(BufferWriter &writer) {
+        size_t start = writer.pos_;
+        writer.write_size_t(0);
+        schema->write_to(writer);
+        for (size_t i = 0; i < schema->width(); i++) {
+            Column *column = gather(i);
+            if (column->as_int() != nullptr) column->as_int()->seal();
+            serializeColumn(writer, start, column);
+            delete column;
+        }
+        writer.patch_size_t(writer.pos_ - start, start);
+    }
+
+    /** A new column holding the values of column col of the view */
+    Column *gather(size_t col) {
+        Column *column = make_column(schema->type(col));
+        if (schema->type(col) == 'S') {
+            //the copy shares the parent's strings, columns never delete them
+            StringColumn *from = parent_->columns[col]->as_string();
+            for (size_t k = 0; k < rows_.size(); k++) {
+                if (from->is_missing(rows_[k])) column->set_missing(k);
+                else column->as_string()->set(k, from->get(rows_[k]));
+            }
+        } else {
+            append_column(parent_->columns[col], column, rows_.data(), rows_.size(), 0);
+        }
+        return column;
+    }
+
+    size_t null_count(size_t col) {
+        size_t missing = 0;
+        for (size_t k = 0; k < rows_.size(); k++) {
+            if (parent_->columns[col]->is_missing(rows_[k])) missing++;
+        }
+        return missing;
+    }
+
+    size_t count(size_t col) {
+        return rows_.size() - null_count(col);
+    }
+
+    /** Aggregates gather the column of the view, then reduce it like a
+    * dataframe's */
+    double sum(size_t col) {
+        return moments(col, MOMENT_SUM).sum_;
+    }
+
+    double mean(size_t col) {
+        return moments(col, MOMENT_SUM).mean();
+    }
+
+    double minimum(size_t col) {
+        return moments(col, MOMENT_RANGE).lo_;
+    }
+
+    double maximum(size_t col) {
+        return moments(col, MOMENT_RANGE).hi_;
+    }
+
+    double variance(size_t col) {
+        Moments m = moments(col, MOMENT_SPREAD);
+        return m.n_ == 0 ? 0 : m.m2_ / m.n_;
+    }
+
+    double dot(size_t a, size_t b) {
+        Column *x = gather(a);
+        Column *y = gather(b);
+        double total = column_dot(x, y);
+        delete x;
+        delete y;
+        return total;
+    }
+
+    Moments moments(size_t col, MomentKind kind) {
+        Column *column = gather(col);
+        Moments m = column_moments(column, kind);
+        delete column;
+        return m;
+    }
+
+    void print() {
+        for (size_t i = 0; i < rows_.size(); i++) {
+            for (size_t j = 0; j < ncols(); j++) {
+                cout << "<";
+                parent_->columns[j]->print(rows_[i]);
+                cout << ">";
+            }
+            cout << endl;
+        }
+    }
+
+    bool equals(Object *other) {
+        if (other == this) return true;
+        DataFrame *x = dynamic_cast<DataFrame *>(other);
+        if (x == nullptr) return false;
+        DataFrame *mine = materialize();
+        DataFrameView *view = x->as_view();
+        DataFrame *theirs = view == nullptr ? x : view->materialize();
+        bool same = mine->equals(theirs);
+        if (theirs != x) delete theirs;
+        delete mine;
+        return same;
+    }
+};
@@ -0,0 +1,101 @@
+//lang: CwC
+#pragma once
+
+#include <vector>
+#include <limits>
+#include "chunkedarray.h"
+#include "../serial/serial.h"
+
+/*************************************************************************
+ * ZoneMap::
+ * The smallest and largest present value of each CHUNK_SIZE chunk of a
+ * numeric column. Bounds only ever widen: overwriting a value keeps the
+ * old one inside the bounds, which stay correct for pruning if not tight.
+ * A chunk with no present value has min > max and overlaps no range.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+template <typename T>
+class ZoneMap : public Serializable {
+  public:
+    std::vector<T> mins_;
+    std::vector<T> maxs_;
+
+    /** Number of chunks with bounds */
+    size_t size() {
+      return mins_.size();
+    }
+
+    /** Widens the bounds of the chunk holding idx to include val */
+    void record(size_t idx, T val) {
+      size_t c = idx >> CHUNK_SHIFT;
+      while (mins_.size() <= c) {
+        mins_.push_back(std::numeric_limits<T>::max());
+        maxs_.push_back(std::numeric_limits<T>::lowest());
+      }
+      if (val < mins_[c]) mins_[c] = val;
+      if (val > maxs_[c]) maxs_[c] = val;
+    }
+
+    T min(size_t c) {
+      return mins_[c];
+    }
+
+    T max(size_t c) {
+      return maxs_[c];
+    }
+
+    /** Can chunk c hold a value in [lo, hi]? */
+    bool overlaps(size_t c, double lo, double hi) {
+      if (c >= mins_.size() || mins_[c] > maxs_[c]) return false;
+      return !(maxs_[c] < lo || mins_[c] > hi);
+    }
+
+    /** Bounds over every chunk, false if no value is present */
+    bool range(double& lo, double& hi) {
+      bool any = false;
+      for (size_t c = 0; c < mins_.size(); c++) {
+        if (mins_[c] > maxs_[c]) continue;
+        if (!any || mins_[c] < lo) lo = mins_[c];
+        if (!any || maxs_[c] > hi) hi = maxs_[c];
+        any = true;
+      }
+      return any;
+    }
+
+    /** Serializes the bounds in their own type. Structure is as following
+     *
+     * |--8 bytes-------------|--8 bytes--|--2 * sizeof(T) bytes each--|
+     * |--length in bytes-----|--chunks---|--min 1, max 1, min 2...----|
+     */
+    size_t serial_size() {
+      return 16 + 2 * sizeof(T) * size();
+    }
+
+    void write_to(BufferWriter& writer) {
+      writer.write_size_t(serial_size());
+      writer.write_size_t(size());
+      for (size_t c = 0; c < size(); c++) {
+        T bounds[2] = { mins_[c], maxs_[c] };
+        writer.write_bytes(bounds, 2 * sizeof(T));
+      }
+    }
+
+    /** Reads the bounds at the reader's cursor, mutating this ZoneMap */
+    void read_from(BufferReader& reader) {
+      size_t length = reader.read_size_t();
+      size_t n = reader.read_size_t();
+      if (n > (reader.end_ - reader.pos_) / (2 * sizeof(T)) || length != 16 + 2 * sizeof(T) * n) {
+        assert("Malformed zone map." && false);
+      }
+      mins_.clear();
+      maxs_.clear();
+      for (size_t c = 0; c < n; c++) {
+        T bounds[2];
+        reader.read_bytes(bounds, 2 * sizeof(T));
+        mins_.push_back(bounds[0]);
+        maxs_.push_back(bounds[1]);
+      }
+    }
+};
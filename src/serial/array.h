@@ -30,53 +30,87 @@ class StringArray : public Object, public Serializable {
         StringArray(Column* c): StringArray(c->size()) {
             if (c->get_type() != 'S') assert("Type other than S found." && false);
             StringColumn* b = c->as_string();
-            for (size_t i = 0; i < b->size(); i++)
-                push(b->get(i));
+            for (size_t i = 0; i < b->size(); i++) {
+                //Missing strings go out empty, the column's validity bitmap restores them
+                StringView s = b->get_view(i);
+                push(s.is_null() ? new String("") : s.to_string());
+            }
         }
 
         /** Serializes the StringArray into an unsigned char array. Structure is as following
          * 
-         * |---------8 bytes-----------------|------Unknown length-----|-----Unknown Length------|...
-         * |--total serialized array length--|--String 1 c_str()-'\0'--|--String 2 c_str()-'\0'--|...
+         * |--8 bytes---------|--8 bytes--|--8 bytes each----------|--Unknown length---------------|
+         * |--length in bytes-|--count----|--offsets 0...count-----|--String 1-'\0'-String 2-'\0'...|
          * 
-         * The fact each string is of unknown length and that we must use '\0' character to delimit necessitates the total
-         * serialzied array length at the front
+         * String i is the bytes of the blob from offsets[i] up to offsets[i + 1], the last of them
+         * its '\0', so strings may hold '\0' and any one is found without walking the others.
          */ 
-        unsigned char* serialize() {
-            //Determine needed buffer size. Start at 8 to account for total serialized length size_t. 
-            size_t buffer_l = 8;
-            for (int i = 0; i < len_; i++) {
-                unsigned char* temp = serialize_string(vals_[i]);
-                buffer_l += strlen(reinterpret_cast<char*>(temp)) + 1;
-                delete temp;
+        size_t serial_size() {
+            size_t bytes = 0;
+            for (size_t i = 0; i < len_; i++) {
+                bytes += vals_[i]->size() + 1;
             }
+            return table_size(len_, bytes);
+        }
 
-            //Initialize array to needed size
-            unsigned char* ret = new unsigned char[buffer_l];
-            insert_size_t(buffer_l, ret, 0);
+        /** Bytes of a table of count strings holding bytes bytes, terminators included */
+        static size_t table_size(size_t count, size_t bytes) {
+            return 16 + 8 * (count + 1) + bytes;
+        }
 
-            //Serialize and add strings
-            size_t index = 8;
+        void write_to(BufferWriter& writer) {
+            size_t start = writer.pos_;
+            writer.write_size_t(0);
+            writer.write_size_t(len_);
+            size_t offset = 0;
+            writer.write_size_t(offset);
             for (size_t i = 0; i < len_; i++) {
-                index = insert_string(vals_[i], ret, index);
-                ret[index] = '\0';
-                index++;
+                offset += vals_[i]->size() + 1;
+                writer.write_size_t(offset);
+            }
+            for (size_t i = 0; i < len_; i++) {
+                writer.write_string(vals_[i]->c_str(), vals_[i]->size());
+            }
+            writer.patch_size_t(writer.pos_ - start, start);
+        }
+
+        /** Reads the strings at the reader's cursor onto the end of this StringArray */
+        void read_from(BufferReader& reader) {
+            size_t start = reader.pos_;
+            size_t end = start + reader.read_size_t();
+            size_t count = read_table(reader, end);
+            unsigned char* offsets = reader.cursor();
+            const char* blob = reinterpret_cast<const char*>(offsets + 8 * (count + 1));
+            for (size_t i = 0; i < count; i++) {
+                size_t from = extract_size_t(offsets, 8 * i);
+                push(new String(blob + from, extract_size_t(offsets, 8 * (i + 1)) - from - 1));
             }
-            return ret;
+            reader.skip(end - reader.pos_);
         }
 
-        /** Deserialize the buffer. Mutates this StringArray to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            //Determine bytes to read
-            size_t length = extract_size_t(buffer, 0);
-            size_t index = 8;
-            //Read in until we've passed the readable bytes
-            while (index < length) {
-                String* temp = extract_string(buffer, index);
-                push(temp);
-                index += strlen(temp->c_str()) + 1;
+        /** Reads the count of the table at the reader's cursor, just past
+         *  its length, and checks its offsets against end, the end of the
+         *  table. Leaves the cursor on the offsets, the blob follows them. */
+        static size_t read_table(BufferReader& reader, size_t end) {
+            if (end > reader.end_ || end < reader.pos_ + 8) assert("Malformed string table." && false);
+            size_t count = reader.read_size_t();
+            //count + 1 offsets must fit before end, checked before 8 * (count + 1) can wrap
+            if (count >= (end - reader.pos_) / 8) assert("Malformed string table." && false);
+            unsigned char* offsets = reader.cursor();
+            size_t blob = reader.pos_ + 8 * (count + 1);
+            size_t bytes = extract_size_t(offsets, 8 * count);
+            if (extract_size_t(offsets, 0) != 0 || bytes > end - blob) {
+                assert("Malformed string table." && false);
+            }
+            size_t previous = 0;
+            for (size_t i = 1; i <= count; i++) {
+                size_t offset = extract_size_t(offsets, 8 * i);
+                if (offset <= previous || offset > bytes || reader.buf_[blob + offset - 1] != '\0') {
+                    assert("Malformed string table." && false);
+                }
+                previous = offset;
             }
-            return length;
+            return count;
         }
 
         bool can_push() {
@@ -228,23 +262,22 @@ class DoubleArray : public Object, public Serializable  {
          * |--8 bytes-------------|--8 bytes each-----|
          * |--length in bytes-----|--vals1, vals2...--|
          */ 
-        unsigned char* serialize() {
-            size_t length = 8 + 8 * len_;
-            unsigned char* buffer = new unsigned char[length];
-            insert_size_t(length, buffer, 0);
-            for (size_t i = 0; i < len_; i++) 
-                insert_double(vals_[i], buffer, 8 + 8 * i);
-            return buffer;
+        size_t serial_size() {
+            return 8 + 8 * len_;
         }
 
-        /** Deserialize the buffer. Mutates this StringArray to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            len_ = (extract_size_t(buffer, 0) - 8) / 8;
+        void write_to(BufferWriter& writer) {
+            writer.write_size_t(serial_size());
+            writer.write_bytes(vals_, 8 * len_);
+        }
+
+        /** Reads the buffer. Mutates this DoubleArray to match the buffer */
+        void read_from(BufferReader& reader) {
+            len_ = (reader.read_size_t() - 8) / 8;
             cap_ = len_;
+            delete[] vals_;
             vals_ = new double[cap_];
-            for (int i = 0; i < len_; i++) 
-                vals_[i] = extract_double(buffer, 8 + 8 * i); 
-            return extract_size_t(buffer, 0);         
+            reader.read_bytes(vals_, 8 * len_);
         }
 
         void push(double dbl) {
@@ -0,0 +1,187 @@
+//lang: CwC
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+#include "assert.h"
+
+/** Shortest match worth a sequence, and the bytes a block always ends with
+ *  as literals, so decoding never reads ahead of its input */
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12   // no match starts in the last this many bytes
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+/** Misses in a row after which the compressor skips ahead faster, so
+ *  incompressible input costs little */
+#define LZ_SKIP_SHIFT 6
+
+/*************************************************************************
+ * Block compression in the LZ4 block format. A block is a series of
+ * sequences, each a token, literal bytes and a match:
+ *
+ * |--1 byte-------------------------|--0+ bytes----|--literals--|--2 bytes--|--0+ bytes----|
+ * |--literal length:4-match length:4-|--more length-|------------|--offset---|--more length-|
+ *
+ * A length of 15 in the token continues in the following bytes, each
+ * adding up to 255 until one is below 255. Matches are at least
+ * LZ_MIN_MATCH bytes copied from offset bytes back in the output. The last
+ * sequence has only literals. Blocks carry neither their length nor the
+ * length of their input, whoever stores a block keeps both.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+
+/** Bytes the block of n bytes of input may take at most */
+inline size_t lz_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+inline uint32_t lz_read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t lz_read64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+/** Bytes a and b have in common, comparing 8 at a time, up to limit */
+inline size_t lz_common(const unsigned char* a, const unsigned char* b, size_t limit) {
+    size_t len = 0;
+    while (len + 8 <= limit) {
+        uint64_t diff = lz_read64(a + len) ^ lz_read64(b + len);
+        if (diff != 0) return len + (__builtin_ctzll(diff) >> 3);
+        len += 8;
+    }
+    while (len < limit && a[len] == b[len]) len++;
+    return len;
+}
+
+inline size_t lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/** Writes the part of a length past the 15 held by a token */
+inline unsigned char* lz_write_length(unsigned char* out, size_t len) {
+    while (len >= 255) {
+        *out++ = 255;
+        len -= 255;
+    }
+    *out++ = (unsigned char)len;
+    return out;
+}
+
+/** Writes a sequence of len literals and, if match is not 0, a match of
+ *  match bytes offset bytes back */
+inline unsigned char* lz_write_sequence(unsigned char* out, const unsigned char* literals, size_t len,
+                                        size_t offset, size_t match) {
+    unsigned char* token = out++;
+    *token = (unsigned char)((len < 15 ? len : 15) << 4);
+    if (len >= 15) out = lz_write_length(out, len - 15);
+    memcpy(out, literals, len);
+    out += len;
+    if (match == 0) return out;
+    *out++ = (unsigned char)(offset & 0xff);
+    *out++ = (unsigned char)(offset >> 8);
+    size_t extra = match - LZ_MIN_MATCH;
+    *token |= (unsigned char)(extra < 15 ? extra : 15);
+    if (extra >= 15) out = lz_write_length(out, extra - 15);
+    return out;
+}
+
+/** Compresses the n bytes of src into dst, which must hold lz_bound(n)
+ *  bytes, and returns the length of the block */
+inline size_t lz_compress(const unsigned char* src, size_t n, unsigned char* dst) {
+    unsigned char* out = dst;
+    size_t anchor = 0; // first byte not yet written
+    if (n > LZ_MATCH_LIMIT) {
+        //positions plus one of the last 4 bytes hashed to each slot, 0 for none
+        uint32_t* table = new uint32_t[1 << LZ_HASH_BITS]();
+        size_t limit = n - LZ_MATCH_LIMIT;
+        size_t end = n - LZ_LAST_LITERALS;
+        size_t i = 0;
+        size_t misses = 0;
+        while (i < limit) {
+            uint32_t seq = lz_read32(src + i);
+            size_t h = lz_hash(seq);
+            size_t candidate = table[h];
+            table[h] = (uint32_t)(i + 1);
+            if (candidate == 0 || i + 1 - candidate > LZ_MAX_OFFSET || lz_read32(src + candidate - 1) != seq) {
+                i += 1 + (misses++ >> LZ_SKIP_SHIFT);
+                continue;
+            }
+            misses = 0;
+            size_t from = candidate - 1;
+            size_t len = LZ_MIN_MATCH + lz_common(src + from + LZ_MIN_MATCH, src + i + LZ_MIN_MATCH,
+                                                  end - i - LZ_MIN_MATCH);
+            while (i > anchor && from > 0 && src[i - 1] == src[from - 1]) {
+                i--;
+                from--;
+                len++;
+            }
+            out = lz_write_sequence(out, src + anchor, i - anchor, i - from, len);
+            i += len;
+            anchor = i;
+        }
+        delete[] table;
+    }
+    out = lz_write_sequence(out, src + anchor, n - anchor, 0, 0);
+    return out - dst;
+}
+
+/** Reads the rest of a length whose token part was 15 */
+inline size_t lz_read_length(const unsigned char* src, size_t n, size_t& in) {
+    size_t len = 0;
+    unsigned char b;
+    do {
+        if (in >= n) assert("Compressed block ends inside a length." && false);
+        b = src[in++];
+        len += b;
+    } while (b == 255);
+    return len;
+}
+
+/** Decompresses the block of n bytes at src into the length bytes at dst.
+ *  The block must decode to exactly length bytes. */
+inline void lz_decompress(const unsigned char* src, size_t n, unsigned char* dst, size_t length) {
+    size_t in = 0;
+    size_t out = 0;
+    while (true) {
+        if (in >= n) assert("Compressed block ends inside a sequence." && false);
+        unsigned char token = src[in++];
+        size_t len = token >> 4;
+        if (len == 15) len += lz_read_length(src, n, in);
+        if (len > n - in || len > length - out) assert("Compressed literals overrun." && false);
+        //short literals are copied 16 bytes at once when both sides have room
+        if (len <= 16 && n - in >= 16 && length - out >= 16) memcpy(dst + out, src + in, 16);
+        else memcpy(dst + out, src + in, len);
+        in += len;
+        out += len;
+        if (in == n) break;
+        if (n - in < 2) assert("Compressed block ends inside an offset." && false);
+        size_t offset = src[in] | ((size_t)src[in + 1] << 8);
+        in += 2;
+        if (offset == 0 || offset > out) assert("Compressed match before the start." && false);
+        size_t match = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15) match += lz_read_length(src, n, in);
+        if (match > length - out) assert("Compressed match overrun." && false);
+        unsigned char* to = dst + out;
+        const unsigned char* from = to - offset;
+        if (offset >= 8 && match + 8 <= length - out) {
+            //8 bytes at a time, the bytes written past the match are overwritten later
+            for (size_t k = 0; k < match; k += 8) memcpy(to + k, from + k, 8);
+        } else if (offset >= match) {
+            memcpy(to, from, match);
+        } else {
+            //the match overlaps what it writes, repeating the last offset bytes
+            for (size_t k = 0; k < match; k++) to[k] = from[k];
+        }
+        out += match;
+    }
+    if (out != length) assert("Compressed block decodes to the wrong length." && false);
+}
@@ -10,7 +10,7 @@ int main() {
     //Serialize the message
     unsigned char* register_send = registr->serialize();
     //"Send" the message, then deserialize
-    Register* received_register = new Register(register_send);
+    Register* received_register = new Register(register_send, message_length(register_send));
     //Ensure the messages are the same
     assert(registr->equals(received_register));
     //Respond with an Ack
@@ -18,7 +18,7 @@ int main() {
     //Serialize 
     unsigned char* ack_send = ack->serialize();
     //"Send" the message, then deserialize
-    Ack* received_ack = new Ack(ack_send);
+    Ack* received_ack = new Ack(ack_send, message_length(ack_send));
     //Ensure ack is the same
     assert(ack->equals(received_ack));
     cout << "New node succesfully registered and received ack.\n"; 
@@ -28,7 +28,7 @@ int main() {
     //Serialize
     unsigned char* directory_send = directory->serialize();
     //Send, receive, then deserialzie
-    Directory* directory_rec = new Directory(directory_send);
+    Directory* directory_rec = new Directory(directory_send, message_length(directory_send));
     //Ensrue same
     assert(directory->equals(directory_rec));
     //Pretend directory message corrupted, send Nack
@@ -36,7 +36,7 @@ int main() {
     //Serialize 
     unsigned char* nack_send = nack->serialize();
     //"Send" the message, then deserialize
-    Nack* received_nack = new Nack(nack_send);
+    Nack* received_nack = new Nack(nack_send, message_length(nack_send));
     //Ensure ack is the same
     assert(nack->equals(received_nack));
     cout << "Directory corrupted. Responded with Nack.\n"; 
@@ -1,5 +1,6 @@
 //CwC
 #pragma once 
+#include <unistd.h>
 #include "../string.h"
 #include "array.h"
 #include "serial.h"
@@ -26,33 +27,60 @@ class Message : public Object, public Serializable  {
         size_t sender_; // the index of the sender node
         size_t target_; // the index of the receiver node
         size_t id_;     // an id t unique within the node
+        bool compress_;   // may the body be sent compressed
+        bool compressed_; // is the body compressed, set by write_body and flagged in the header
 
         Message() {
             sender_ = 0;
             target_ = 0;
             id_ = 0;
+            compress_ = true;
+            compressed_ = false;
         }
 
+        /** Bytes of the fields a kind of message adds after the common ones */
+        virtual size_t body_size() { return 0; }
+
+        /** Writes the fields a kind of message adds */
+        virtual void write_body(BufferWriter& writer) { }
+
+        /** Reads the fields a kind of message adds */
+        virtual void read_body(BufferReader& reader) { }
+
         /** Serializes this Message, structure is as follows:
-         * |--1 byte-|--8 bytes----|--8 bytes each--|--8 bytes--|
-         * |--type---|--sender_----|--target_-------|--id_------|
+         * |--8 bytes------|--1 byte-|--8 bytes----|--8 bytes each--|--8 bytes--|--Unknown bytes--|
+         * |--Total bytes--|--type---|--sender_----|--target_-------|--id_------|--body-----------|
+         * The type has MSG_COMPRESSED set when the body is compressed. The
+         * size is that of the uncompressed body, compressing only shrinks it.
          */
-        unsigned char* serialize() {
-            unsigned char* buffer = new unsigned char[25];
-            buffer[0] = serialize_msg_kind(kind_);
-            insert_size_t(sender_, buffer, 1);
-            insert_size_t(target_, buffer, 9);
-            insert_size_t(id_, buffer, 17);
-            return buffer;
-        }
-
-        /** Deserialize, mutating this object to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            kind_ = extract_msg_kind(buffer, 0);
-            sender_ = extract_size_t(buffer, 1);
-            target_ = extract_size_t(buffer, 9);
-            id_ = extract_size_t(buffer, 17);
-            return 25;
+        size_t serial_size() {
+            return 33 + body_size();
+        }
+
+        void write_to(BufferWriter& writer) {
+            size_t start = writer.pos_;
+            writer.write_size_t(0);
+            writer.write_byte(serialize_msg_kind(kind_));
+            writer.write_size_t(sender_);
+            writer.write_size_t(target_);
+            writer.write_size_t(id_);
+            compressed_ = false;
+            write_body(writer);
+            if (compressed_) writer.buf_[start + 8] |= MSG_COMPRESSED;
+            writer.patch_size_t(writer.pos_ - start, start);
+        }
+
+        /** Reads the message at the reader's cursor, mutating this object */
+        void read_from(BufferReader& reader) {
+            size_t start = reader.pos_;
+            if (reader.read_size_t() > reader.end_ - start) assert("Message longer than its buffer." && false);
+            unsigned char kind = reader.read_byte();
+            compressed_ = (kind & MSG_COMPRESSED) != 0;
+            kind_ = deserialize_msg_kind(kind & ~MSG_COMPRESSED);
+            sender_ = reader.read_size_t();
+            target_ = reader.read_size_t();
+            id_ = reader.read_size_t();
+            read_body(reader);
         }
 
         bool equals(Object* other) {
@@ -83,29 +111,24 @@ class Ack : public Message {
             id_ = id;
         }
 
-        Ack(unsigned char* buffer) {
-            deserialize(buffer);
+        Ack(unsigned char* buffer, size_t length) {
+            deserialize(buffer, length);
         }
 
-        /** Serializes this Ack, structure is as follows:
-         * |--8 bytes------|--25 bytes----------|--1 byte---------|
-         * |--Total bytes--|--Message data------|--previous_type--|
+        /** Body of this Ack, structure is as follows:
+         * |--1 byte---------|
+         * |--previous_type--|
          */
-        unsigned char* serialize() {
-            unsigned char* buffer = new unsigned char[34];
-            insert_size_t(34, buffer, 0);
-            unsigned char* temp_buffer = Message::serialize();
-            copy_unsigned(buffer + 8, temp_buffer, 25);
-            delete temp_buffer;
-            buffer[33] = serialize_msg_kind(previous_kind);
-            return buffer;
+        size_t body_size() {
+            return 1;
         }
 
-        /** Deserialize, mutating this object to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            size_t msg_size = Message::deserialize(buffer + 8);
-            previous_kind = extract_msg_kind(buffer, 33);
-            return extract_size_t(buffer, 0);
+        void write_body(BufferWriter& writer) {
+            writer.write_byte(serialize_msg_kind(previous_kind));
+        }
+
+        void read_body(BufferReader& reader) {
+            previous_kind = deserialize_msg_kind(reader.read_byte());
         }
 
         bool equals(Object* other) {
@@ -135,29 +158,24 @@ class Nack : public Message {
             id_ = id;
         }
 
-        Nack(unsigned char* buffer) {
-            deserialize(buffer);
+        Nack(unsigned char* buffer, size_t length) {
+            deserialize(buffer, length);
         }
 
-        /** Serializes this Nack, structure is as follows:
-         * |--8 byte-------|--25 bytes----------|--1 byte---------|
-         * |--Total bytes--|--Message data------|--previous_type--|
+        /** Body of this Nack, structure is as follows:
+         * |--1 byte---------|
+         * |--previous_type--|
          */
-        unsigned char* serialize() {
-            unsigned char* buffer = new unsigned char[34];
-            insert_size_t(34, buffer, 0);
-            unsigned char* temp_buffer = Message::serialize();
-            copy_unsigned(buffer + 8, temp_buffer, 25);
-            delete temp_buffer;
-            buffer[33] = serialize_msg_kind(previous_kind);
-            return buffer;
+        size_t body_size() {
+            return 1;
         }
 
-        /** Deserialize, mutating this object to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            size_t msg_size = Message::deserialize(buffer + 8);
-            previous_kind = extract_msg_kind(buffer, 33);
-            return extract_size_t(buffer, 0);;
+        void write_body(BufferWriter& writer) {
+            writer.write_byte(serialize_msg_kind(previous_kind));
+        }
+
+        void read_body(BufferReader& reader) {
+            previous_kind = deserialize_msg_kind(reader.read_byte());
         }
 
         bool equals(Object* other) {
@@ -189,46 +207,33 @@ class Put : public Message {
             id_ = id;
         }
 
-        Put(unsigned char* buffer) {
-            deserialize(buffer);
+        Put(unsigned char* buffer, size_t length) {
+            deserialize(buffer, length);
         }
 
         ~Put() {
             delete key_;
-            delete value_;
+            if (value_ != nullptr) value_->release();
         }
 
-        /** Serializes this Put, structure is as follows:
-         * |--8 byte-------|--25 bytes----------|--Unknown bytes---------|--Unknown bytes----|
-         * |--Total bytes--|--Message data------|--Key-------------------|--Value------------|
+        /** Body of this Put, structure is as follows:
+         * |--Unknown bytes---------|--Unknown bytes----|
+         * |--Key-------------------|--Value------------|
          */
-        unsigned char* serialize() {
-            unsigned char* key_buffer = key_->serialize();
-            unsigned char* value_buffer = value_->serialize();
-            size_t key_length = extract_size_t(key_buffer, 0);
-            size_t value_length = extract_size_t(value_buffer, 0);
-            size_t total_length = key_length + value_length + 33;
-            unsigned char* buffer = new unsigned char[total_length];
-            insert_size_t(total_length, buffer, 0);
-            unsigned char* temp_buffer = Message::serialize();
-            copy_unsigned(buffer + 8, temp_buffer, 25);
-            delete temp_buffer;
-            copy_unsigned(buffer + 33, key_buffer, key_length);
-            delete key_buffer;
-            copy_unsigned(buffer + 33 + key_length, value_buffer, value_length);
-            delete value_buffer;
-            return buffer;
-        }
-
-        /** Deserialize, mutating this object to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            size_t index = 8 + Message::deserialize(buffer + 8);
+        size_t body_size() {
+            return key_->serial_size() + value_->serial_size();
+        }
+
+        void write_body(BufferWriter& writer) {
+            key_->write_to(writer);
+            compressed_ = value_->write_to(writer, compress_);
+        }
+
+        void read_body(BufferReader& reader) {
             key_ = new Key();
-            index += key_->deserialize(buffer + index);
+            key_->read_from(reader);
             value_ = new Value();
-            index += value_->deserialize(buffer + index);
-            assert(index == extract_size_t(buffer, 0));
-            return index;
+            value_->read_from(reader, compressed_);
         }
 
         bool equals(Object* other) {
@@ -259,39 +264,29 @@ class Result : public Message {
             id_ = id;
         }
 
-        Result(unsigned char* buffer) {
-            deserialize(buffer);
+        Result(unsigned char* buffer, size_t length) {
+            deserialize(buffer, length);
         }
 
         ~Result() {
-            delete value_;
+            if (value_ != nullptr) value_->release();
         }
 
-        /** Serializes this Result, structure is as follows:
-         * |--8 byte-------|--25 bytes----------|--Unknown bytes---------|
-         * |--Total bytes--|--Message data------|--Key-------------------|
+        /** Body of this Result, structure is as follows:
+         * |--Unknown bytes---------|
+         * |--Value-----------------|
          */
-        unsigned char* serialize() {
-            unsigned char* value_buffer = value_->serialize();
-            size_t value_length = extract_size_t(value_buffer, 0);
-            size_t total_length = value_length + 33;
-            unsigned char* buffer = new unsigned char[total_length];
-            insert_size_t(total_length, buffer, 0);
-            unsigned char* temp_buffer = Message::serialize();
-            copy_unsigned(buffer + 8, temp_buffer, 25);
-            delete temp_buffer;
-            copy_unsigned(buffer + 33, value_buffer, value_length);
-            delete value_buffer;
-            return buffer;
-        }
-
-        /** Deserialize, mutating this object to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            size_t index = 8 + Message::deserialize(buffer + 8);
+        size_t body_size() {
+            return value_->serial_size();
+        }
+
+        void write_body(BufferWriter& writer) {
+            compressed_ = value_->write_to(writer, compress_);
+        }
+
+        void read_body(BufferReader& reader) {
             value_ = new Value();
-            index += value_->deserialize(buffer + index);
-            assert(index == extract_size_t(buffer, 0));
-            return index;
+            value_->read_from(reader, compressed_);
         }
 
         bool equals(Object* other) {
@@ -321,39 +316,29 @@ class Get : public Message {
             id_ = id;
         }
 
-        Get(unsigned char* buffer) {
-            deserialize(buffer);
+        Get(unsigned char* buffer, size_t length) {
+            deserialize(buffer, length);
         }
 
         ~Get() {
             delete key_;
         }
 
-        /** Serializes this Get, structure is as follows:
-         * |--8 byte-------|--25 bytes----------|--Unknown bytes---------|
-         * |--Total bytes--|--Message data------|--Key-------------------|
+        /** Body of this Get, structure is as follows:
+         * |--Unknown bytes---------|
+         * |--Key-------------------|
          */
-        unsigned char* serialize() {
-            unsigned char* key_buffer = key_->serialize();
-            size_t key_length = extract_size_t(key_buffer, 0);
-            size_t total_length = key_length + 33;
-            unsigned char* buffer = new unsigned char[total_length];
-            insert_size_t(total_length, buffer, 0);
-            unsigned char* temp_buffer = Message::serialize();
-            copy_unsigned(buffer + 8, temp_buffer, 25);
-            delete temp_buffer;
-            copy_unsigned(buffer + 33, key_buffer, key_length);
-            delete key_buffer;
-            return buffer;
-        }
-
-        /** Deserialize, mutating this object to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            size_t index = 8 + Message::deserialize(buffer + 8);
+        size_t body_size() {
+            return key_->serial_size();
+        }
+
+        void write_body(BufferWriter& writer) {
+            key_->write_to(writer);
+        }
+
+        void read_body(BufferReader& reader) {
             key_ = new Key();
-            index += key_->deserialize(buffer + index);
-            assert(index == extract_size_t(buffer, 0));
-            return index;
+            key_->read_from(reader);
         }
 
         bool equals(Object* other) {
@@ -379,30 +364,13 @@ class Kill : public Message {
             id_ = id;
         }
 
-        Kill(unsigned char* buffer) {
-            deserialize(buffer);
+        Kill(unsigned char* buffer, size_t length) {
+            deserialize(buffer, length);
         }
 
         ~Kill() {}
 
-        /** Serializes this Ack, structure is as follows:
-         * |--8 bytes------|--25 bytes----------|
-         * |--Total bytes--|--Message data------|
-         */
-        unsigned char* serialize() {
-            unsigned char* buffer = new unsigned char[33];
-            insert_size_t(33, buffer, 0);
-            unsigned char* temp_buffer = Message::serialize();
-            copy_unsigned(buffer + 8, temp_buffer, 25);
-            delete temp_buffer;
-            return buffer;
-        }
-
-        /** Deserialize, mutating this object to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            size_t msg_size = Message::deserialize(buffer + 8);
-            return extract_size_t(buffer, 0);;
-        }
+        /** A Kill has no body, only the common fields */
 
         bool equals(Object* other) {
             if (other == this) return true;
@@ -430,35 +398,28 @@ class Status : public Message {
             id_ = id;
         }
 
-        Status(unsigned char* buffer) {
-            deserialize(buffer);
+        Status(unsigned char* buffer, size_t length) {
+            deserialize(buffer, length);
         }
 
         ~Status() {
             delete msg_;
         }
 
-        /** Serializes this Ack, structure is as follows:
-         * |--8 bytes------|--25 bytes----------|--unknown bytes--|
-         * |--Total bytes--|--Message data------|--msg_-----------|
+        /** Body of this Status, structure is as follows:
+         * |--unknown bytes--|
+         * |--msg_, '\0'-----|
          */
-        unsigned char* serialize() {
-            size_t length = 8 + 25 + strlen(msg_->c_str()) + 1;
-            unsigned char* buffer = new unsigned char[length];
-            insert_size_t(length, buffer, 0);
-            unsigned char* temp_buffer = Message::serialize();
-            copy_unsigned(buffer + 8, temp_buffer, 25);
-            delete temp_buffer;
-            insert_string(msg_, buffer, 33);
-            buffer[length - 1] = '\0';
-            return buffer;
+        size_t body_size() {
+            return strlen(msg_->c_str()) + 1;
+        }
+
+        void write_body(BufferWriter& writer) {
+            writer.write_string(msg_);
         }
 
-        /** Deserialize, mutating this object to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            size_t msg_size = Message::deserialize(buffer + 8);
-            msg_ = extract_string(buffer, 33);
-            return extract_size_t(buffer, 0);;
+        void read_body(BufferReader& reader) {
+            msg_ = reader.read_string();
         }
 
         bool equals(Object* other) {
@@ -490,37 +451,30 @@ class Register : public Message {
             id_ = id;
         }
 
-        Register(unsigned char* buffer) {
-            deserialize(buffer);
+        Register(unsigned char* buffer, size_t length) {
+            deserialize(buffer, length);
         }
 
         ~Register() {
             delete IP;
         }
 
-        /** Serializes this Ack, structure is as follows:
-         * |--8 bytes-----|--25 bytes----------|--8 bytes--|--unknown bytes--|
-         * |--Total size--|--Message data------|--port-----|--msg_-----------|
+        /** Body of this Register, structure is as follows:
+         * |--8 bytes--|--unknown bytes--|
+         * |--port-----|--IP, '\0'-------|
          */
-        unsigned char* serialize() {
-            size_t length = 8 + 25 + 8 + strlen(IP->c_str()) + 1;
-            unsigned char* buffer = new unsigned char[length];
-            insert_size_t(length, buffer, 0);
-            unsigned char* temp_buffer = Message::serialize();
-            copy_unsigned(buffer + 8, temp_buffer, 25);
-            delete temp_buffer;
-            insert_size_t(port, buffer, 33);
-            insert_string(IP, buffer, 41);
-            buffer[length - 1] = '\0';
-            return buffer;
-        }
-
-        /** Deserialize, mutating this object to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            size_t msg_size = Message::deserialize(buffer + 8);
-            port = extract_size_t(buffer, 33);
-            IP = extract_string(buffer, 41);
-            return extract_size_t(buffer, 0);;
+        size_t body_size() {
+            return 8 + strlen(IP->c_str()) + 1;
+        }
+
+        void write_body(BufferWriter& writer) {
+            writer.write_size_t(port);
+            writer.write_string(IP);
+        }
+
+        void read_body(BufferReader& reader) {
+            port = reader.read_size_t();
+            IP = reader.read_string();
         }
 
         bool equals(Object* other) {
@@ -558,8 +512,8 @@ class Directory : public Message {
             ports_cap_ = maxNodes;
         }
 
-        Directory(unsigned char * buffer) {
-            deserialize(buffer);
+        Directory(unsigned char* buffer, size_t length) {
+            deserialize(buffer, length);
         }
 
         ~Directory() {
@@ -621,42 +575,29 @@ class Directory : public Message {
             }
         }
 
-        /** Serializes this Directory, structure is as follows:
-         * |--8 bytes-----|--25 bytes--|--8 bytes-|--8 bytes----|-8 bytes each----|--variable, handled by StringArray()--|
-         * |--Toal bytes--|--Message---|--client--|--ports_len--|--ports 1, 2...--|--addresses---------------------------|
+        /** Body of this Directory, structure is as follows:
+         * |--8 bytes-|--8 bytes----|-8 bytes each----|--variable, handled by StringArray()--|
+         * |--client--|--ports_len--|--ports 1, 2...--|--addresses---------------------------|
          */
-        unsigned char* serialize() {
-            //Calculate length needed
-            unsigned char* address = addresses->serialize();
-            size_t length = 8 + 25 + 8 + 8 + 8 * ports_len_ + extract_size_t(address, 0);
-            //Init buffer, insert starting size_t's of the buffer
-            unsigned char* buffer = new unsigned char[length];
-            insert_size_t(length, buffer, 0);
-            unsigned char* temp_buffer = Message::serialize();
-            copy_unsigned(buffer + 8, temp_buffer, 25);
-            delete temp_buffer;
-            insert_size_t(client, buffer, 33);
-            insert_size_t(ports_len_, buffer, 41);
-            //Insert ports
-            for (size_t i = 0; i < ports_len_; i++)
-                insert_size_t(ports[i], buffer, 24 + 25 + 8 * i);
-            //Copy in StringArray
-            copy_unsigned(buffer + 24 + 25 + 8 * ports_len_, address, extract_size_t(address, 0));
-            return buffer;
+        size_t body_size() {
+            return 8 + 8 + 8 * ports_len_ + addresses->serial_size();
         }
 
-        /** Deserialize, mutating this object to match the buffer */
-        size_t deserialize(unsigned char* buffer) {
-            size_t msg_size = Message::deserialize(buffer + 8);
-            client = extract_size_t(buffer, 8 + 25);
-            ports_len_ = extract_size_t(buffer, 16 + 25);
+        void write_body(BufferWriter& writer) {
+            writer.write_size_t(client);
+            writer.write_size_t(ports_len_);
+            writer.write_bytes(ports, 8 * ports_len_);
+            addresses->write_to(writer);
+        }
+
+        void read_body(BufferReader& reader) {
+            client = reader.read_size_t();
+            ports_len_ = reader.read_size_t();
             ports_cap_ = ports_len_ * 2;
             ports = new size_t[ports_cap_];
-            for (size_t i = 0; i < ports_len_; i++)
-                ports[i] = extract_size_t(buffer, 24 + 25 + 8 * i);
+            reader.read_bytes(ports, 8 * ports_len_);
             addresses = new StringArray();
-            size_t arr_size = addresses->deserialize(buffer + 24 + 25 + 8 * ports_len_);
-            return extract_size_t(buffer, 0);
+            addresses->read_from(reader);
         }
 
         bool equals(Object* other) {
@@ -670,4 +611,32 @@ class Directory : public Message {
             }
             return Message::equals(other);
         }
-};
\ No newline at end of file
+};
+
+/** Messages longer than this are taken for garbage rather than allocated */
+#define MSG_MAX_LENGTH ((size_t)1 << 32)
+
+/** Reads n bytes from fd into buf, false if the connection closes first */
+inline bool read_fully(int fd, unsigned char* buf, size_t n) {
+    for (size_t got = 0; got < n;) {
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r < 0) assert("Error reading incoming data." && false);
+        if (r == 0) return false;
+        got += r;
+    }
+    return true;
+}
+
+/** Reads the next message on fd into a new buffer of exactly its bytes and
+ *  sets length to their count, or returns nullptr when the connection
+ *  closed between messages */
+inline unsigned char* read_message(int fd, size_t& length) {
+    unsigned char header[8];
+    if (!read_fully(fd, header, 8)) return nullptr;
+    length = extract_size_t(header, 0);
+    if (length < 33 || length > MSG_MAX_LENGTH) assert("Malformed message length." && false);
+    unsigned char* buffer = new unsigned char[length];
+    memcpy(buffer, header, 8);
+    if (!read_fully(fd, buffer + 8, length - 8)) assert("Connection closed inside a message." && false);
+    return buffer;
+}
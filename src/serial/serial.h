@@ -3,16 +3,6 @@
 #include "../string.h"
 #include "utils.h"
 
-class Serializable {
-    public: 
-        /** Serializes the object */
-        virtual unsigned char* serialize() { };
-        /** Deserializes the object. Note: returns number of bytes read */
-        virtual size_t deserialize(unsigned char* serialized) { }; 
-
-        virtual ~Serializable() { };
-};
-
 //Serialization utility functions to make serialization easier
 
 /** Serialize the size_t */
@@ -27,9 +17,7 @@ unsigned char* serialize_size_t(size_t s) {
 
 /** Insert the size_t into the buffer at a given offset */
 void insert_size_t(size_t s, unsigned char* buffer, size_t offset) {
-    unsigned char* char_to_insert = serialize_size_t(s);
-    copy_unsigned(buffer + offset, char_to_insert, 8);
-    delete char_to_insert;
+    memcpy(buffer + offset, &s, 8);
 }
 
 /** Extract a size_t from a buffer at the given offset */
@@ -56,9 +44,7 @@ unsigned char* serialize_double(double d) {
 
 /** Insert the size_t into the buffer at a given offset */
 void insert_double(double d, unsigned char* buffer, size_t offset) {
-    unsigned char* char_to_insert = serialize_double(d);
-    copy_unsigned(buffer + offset, char_to_insert, 8);
-    delete char_to_insert;
+    memcpy(buffer + offset, &d, 8);
 }
 
 double extract_double(unsigned char* buffer, size_t offset) {
@@ -77,9 +63,8 @@ unsigned char* serialize_string(String* s) {
 /** Insert the String into the buffer at a given offset, 
  * returns the index after the insert string in the buffer */
 size_t insert_string(String* s, unsigned char* buffer, size_t offset) {
-    unsigned char* temp = serialize_string(s);
-    size_t length = strlen(reinterpret_cast<char*>(temp));
-    copy_unsigned(buffer + offset, temp, length);
+    size_t length = strlen(s->c_str());
+    memcpy(buffer + offset, s->c_str(), length);
     return offset + length;
 }
 
@@ -93,15 +78,218 @@ String* deserialize_string(unsigned char* buffer) {
 }
 
 void insert_char_arr(char* arr, unsigned char* buffer, size_t offset, bool include_null_term) {
-    unsigned char* temp = reinterpret_cast<unsigned char*>(strdup(arr));
-    size_t length = strlen(reinterpret_cast<char*>(temp));
-    copy_unsigned(buffer + offset, temp, length);
+    size_t length = strlen(arr);
+    memcpy(buffer + offset, arr, length);
     if (include_null_term) buffer[offset + length] = '\0';
 }
 
+/*************************************************************************
+ * BufferWriter::
+ * A growable byte buffer filled at a cursor. Sized up front from
+ * serial_size it never grows, and cleared it is reused for the next
+ * object without allocating. steal hands the bytes to the caller.
+ */
+class BufferWriter {
+    public:
+        unsigned char* buf_; // owned until stolen
+        size_t cap_;
+        size_t pos_;         // bytes written
+
+        BufferWriter(size_t capacity) {
+            cap_ = capacity;
+            buf_ = new unsigned char[cap_];
+            pos_ = 0;
+        }
+
+        BufferWriter() : BufferWriter(64) {}
+
+        ~BufferWriter() {
+            delete[] buf_;
+        }
+
+        /** Makes room for n more bytes, doubling the buffer as needed */
+        void reserve(size_t n) {
+            if (pos_ + n <= cap_) return;
+            size_t cap = cap_ == 0 ? 64 : cap_;
+            while (cap < pos_ + n) cap *= 2;
+            unsigned char* grown = new unsigned char[cap];
+            memcpy(grown, buf_, pos_);
+            delete[] buf_;
+            buf_ = grown;
+            cap_ = cap;
+        }
+
+        void write_bytes(const void* src, size_t n) {
+            reserve(n);
+            memcpy(buf_ + pos_, src, n);
+            pos_ += n;
+        }
+
+        void write_size_t(size_t s) {
+            write_bytes(&s, 8);
+        }
+
+        void write_double(double d) {
+            write_bytes(&d, 8);
+        }
+
+        void write_byte(unsigned char c) {
+            reserve(1);
+            buf_[pos_++] = c;
+        }
+
+        /** Writes the len chars at s and a '\0' */
+        void write_string(const char* s, size_t len) {
+            write_bytes(s, len);
+            write_byte('\0');
+        }
+
+        void write_string(String* s) {
+            write_string(s->c_str(), strlen(s->c_str()));
+        }
+
+        /** Overwrites the size_t at offset, for lengths known after writing */
+        void patch_size_t(size_t s, size_t offset) {
+            memcpy(buf_ + offset, &s, 8);
+        }
+
+        /** Zero pads the cursor to a multiple of align bytes */
+        void align(size_t align) {
+            while (pos_ % align != 0) write_byte(0);
+        }
+
+        /** Hands the written bytes to the caller, leaving the writer empty */
+        unsigned char* steal() {
+            unsigned char* out = buf_;
+            buf_ = nullptr;
+            cap_ = 0;
+            pos_ = 0;
+            return out;
+        }
+
+        /** Starts over, keeping the buffer for the next object */
+        void clear() {
+            pos_ = 0;
+        }
+};
+
+/*************************************************************************
+ * BufferReader::
+ * Reads a serialized buffer at a cursor, asserting that no read goes past
+ * its end. The end is the count of bytes the caller holds, never a length
+ * read from the buffer itself.
+ */
+class BufferReader {
+    public:
+        unsigned char* buf_; // external
+        size_t end_;         // bytes that may be read
+        size_t pos_;         // bytes read
+
+        BufferReader(unsigned char* buffer, size_t length) {
+            buf_ = buffer;
+            end_ = length;
+            pos_ = 0;
+        }
+
+        /** Asserts that n more bytes can be read */
+        void need(size_t n) {
+            if (n > end_ - pos_) assert("Read past the end of the buffer." && false);
+        }
+
+        unsigned char* cursor() {
+            return buf_ + pos_;
+        }
+
+        void skip(size_t n) {
+            need(n);
+            pos_ += n;
+        }
+
+        void read_bytes(void* dst, size_t n) {
+            need(n);
+            memcpy(dst, buf_ + pos_, n);
+            pos_ += n;
+        }
+
+        size_t read_size_t() {
+            size_t s;
+            read_bytes(&s, 8);
+            return s;
+        }
+
+        double read_double() {
+            double d;
+            read_bytes(&d, 8);
+            return d;
+        }
+
+        unsigned char read_byte() {
+            need(1);
+            return buf_[pos_++];
+        }
+
+        /** Reads the chars up to a '\0' and moves past it */
+        String* read_string() {
+            size_t len = strnlen(reinterpret_cast<char*>(cursor()), end_ - pos_);
+            need(len + 1);
+            String* s = new String(reinterpret_cast<char*>(cursor()), len);
+            pos_ += len + 1;
+            return s;
+        }
+
+        /** Skips the padding up to a multiple of align bytes */
+        void align(size_t align) {
+            skip((align - pos_ % align) % align);
+        }
+};
+
+/** Objects that serialize through a BufferWriter implement serial_size,
+ *  write_to and read_from, and get serialize and deserialize from them:
+ *  serial_size sizes the single allocation of serialize, and a reused
+ *  writer takes none. Formats starting with their own length read with
+ *  the default deserialize. */
+class Serializable {
+    public: 
+        /** Serializes the object */
+        virtual unsigned char* serialize() {
+            BufferWriter writer(serial_size());
+            write_to(writer);
+            return writer.steal();
+        }
+
+        /** Deserializes the object from the length bytes at serialized.
+         *  Note: returns number of bytes read */
+        virtual size_t deserialize(unsigned char* serialized, size_t length) {
+            BufferReader reader(serialized, length);
+            read_from(reader);
+            return reader.pos_;
+        }
+
+        /** Deserializes a buffer this process wrote, which its own length
+         *  bounds. Bytes from elsewhere take the deserialize above. */
+        virtual size_t deserialize(unsigned char* serialized) {
+            return deserialize(serialized, extract_size_t(serialized, 0));
+        }
+
+        /** Bytes write_to writes, an upper bound where an exact count would
+         *  mean doing the work twice */
+        virtual size_t serial_size() { return 0; }
+
+        /** Writes the object at the writer's cursor */
+        virtual void write_to(BufferWriter& writer) { }
+
+        /** Reads the object at the reader's cursor, moving past it */
+        virtual void read_from(BufferReader& reader) { }
+
+        virtual ~Serializable() { };
+};
+
 //Stub out MsgKind to avoid circular dependencies
 enum class MsgKind;
 
+/** Bit of the kind byte of a message header set when its body is compressed */
+#define MSG_COMPRESSED 0x80
+
 char serialize_msg_kind(MsgKind m) {
     return (char)m;
 }
@@ -119,7 +307,7 @@ size_t message_length(unsigned char* buffer) {
 }
 
 MsgKind message_kind(unsigned char* buffer) {
-    return deserialize_msg_kind(buffer[8]);
+    return deserialize_msg_kind(buffer[8] & ~MSG_COMPRESSED);
 }
 
                 
\ No newline at end of file
@@ -56,22 +56,26 @@ class Key : public Object, public Serializable {
             return name_->hash() + node_ + 2;
         }
 
-        unsigned char *serialize() {
-            size_t length = 8 + 8 + strlen(name_->c_str()) + 1;
-            unsigned char* buffer = new unsigned char[length];
-            insert_size_t(length, buffer, 0);
-            insert_size_t(node_, buffer, 8);
-            insert_string(name_, buffer, 16);
-            buffer[length - 1] = '\0';
-            return buffer;
+        /**
+         * Serializes this key. Structure is as follows:
+         * |--8 bytes--------------|-8 bytes-|-X bytes------|
+         * |-Total length in bytes-|-node_---|-name_, '\0'--|
+         */
+        size_t serial_size() {
+            return 8 + 8 + strlen(name_->c_str()) + 1;
         }
 
-        size_t deserialize(unsigned char *serialized) {
-            size_t length = extract_size_t(serialized, 0);
-            node_ = extract_size_t(serialized, 8);
-            name_ = extract_string(serialized, 16);
+        void write_to(BufferWriter& writer) {
+            writer.write_size_t(serial_size());
+            writer.write_size_t(node_);
+            writer.write_string(name_);
+        }
+
+        void read_from(BufferReader& reader) {
+            size_t length = reader.read_size_t();
+            node_ = reader.read_size_t();
+            name_ = reader.read_string();
             assert(length == 17 + strlen(name_->c_str()));
-            return length;
         }
 };
 
@@ -38,6 +38,7 @@ class NetworkConfig : public Object {
         NetworkConfig() {
             ip_ = nullptr;
             serverIp_ = nullptr;
+            nodeDir = nullptr;
             serverBuffer = new unsigned char[BUFF_SIZE];
             neighborBuffer = new unsigned char[BUFF_SIZE];
             memset(serverBuffer, 0, BUFF_SIZE);
@@ -157,26 +157,24 @@ class Node : public Object {
                             }
                             FD_SET(new_socket, &neighborCurrentFds);
                         } else {
-                            handleNodeMsg(i, readIncomingNodeMsg(i));
+                            size_t length;
+                            unsigned char* msg = readIncomingNodeMsg(i, length);
+                            if (msg == nullptr) {
+                                handleDisconnect(i);
+                            } else {
+                                handleNodeMsg(i, msg, length);
+                                delete[] msg;
+                            }
                         }
                     }
                 }
             }
         }
 
-        //reads the incoming msg from the given file descriptor
-        unsigned char* readIncomingNodeMsg(int fd) {
-            //clear buffer
-            memset(neighborBuffer, 0, BUFF_SIZE);
-            int bytesRead = read(fd, neighborBuffer, BUFF_SIZE);
-            if (bytesRead < 0) {
-                assert("Error reading incoming data." && false);
-            }
-            unsigned char* newBuff = new unsigned char[BUFF_SIZE];
-            memcpy(newBuff, neighborBuffer, BUFF_SIZE);
-            //clear buffer
-            memset(neighborBuffer, 0, BUFF_SIZE);
-            return newBuff;
+        //reads the incoming msg from the given file descriptor, whole however
+        //long, setting length to its bytes; nullptr once the neighbor disconnected
+        unsigned char* readIncomingNodeMsg(int fd, size_t& length) {
+            return read_message(fd, length);
         }
 
         void handleDisconnect(int fd) {
@@ -185,20 +183,16 @@ class Node : public Object {
         }
 
         //handles messages from other Nodes
-        void handleNodeMsg(int fd, unsigned char* msg) {
-            if (*msg != 0) {
-                MsgKind kind = message_kind(msg);
-                switch (kind) {
-                    case MsgKind::Status: {
-                        handleStatus(fd, msg);
-                        break;
-                    }
-                    default: {
-                        assert("Unrecognized message" && false);
-                    }
+        void handleNodeMsg(int fd, unsigned char* msg, size_t length) {
+            MsgKind kind = message_kind(msg);
+            switch (kind) {
+                case MsgKind::Status: {
+                    handleStatus(fd, msg, length);
+                    break;
+                }
+                default: {
+                    assert("Unrecognized message" && false);
                 }
-            } else {
-                handleDisconnect(fd);
             }
         }
 
@@ -209,8 +203,8 @@ class Node : public Object {
         }
 
         //handler for status messages
-        void handleStatus(int fd, unsigned char* msg) {
-            Status* incomingStatus = new Status(msg);
+        void handleStatus(int fd, unsigned char* msg, size_t length) {
+            Status* incomingStatus = new Status(msg, length);
             p("Received on ").p(ip_->c_str()).p(":").p(port_).p(": ").pln(incomingStatus->msg_->c_str());
             delete incomingStatus;
         }
@@ -218,28 +212,30 @@ class Node : public Object {
         //listens to the server for directory updates
         void listenToServer() {
             while (running) {
-                memset(serverBuffer, 0, BUFF_SIZE);
-                read(serverSocket_, serverBuffer, BUFF_SIZE);
-                handleIncoming(serverBuffer);
+                size_t length;
+                unsigned char* data = read_message(serverSocket_, length);
+                if (data == nullptr) return;
+                handleIncoming(data, length);
+                delete[] data;
             }
         }
 
         //handles incoming messages from the server
-        void handleIncoming(unsigned char* data) {
+        void handleIncoming(unsigned char* data, size_t length) {
             MsgKind kind = message_kind(data);
             switch (kind) {
                 case MsgKind::Ack: {
-                    Ack* a = new Ack(data);
+                    Ack* a = new Ack(data, length);
                     handleAck(a);
                     break;
                 }    
                 case MsgKind::Nack: {
-                    Nack* n = new Nack(data);
+                    Nack* n = new Nack(data, length);
                     handleNack(n);
                     break;
                 }
                 case MsgKind::Directory: {
-                    updateConnections(data);
+                    updateConnections(data, length);
                     break;
                 }
                 case MsgKind::Kill: {
@@ -273,8 +269,8 @@ class Node : public Object {
         }
 
         //updated the node directory and opens connections with all other nodes
-        void updateConnections(unsigned char* data) {
-            nodeDir = new Directory(data);
+        void updateConnections(unsigned char* data, size_t length) {
+            nodeDir = new Directory(data, length);
             createNeighborConnections();
             greetAllNeighbors();
         }
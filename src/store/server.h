@@ -110,7 +110,12 @@ class Server : public Object {
                                 }
                             }
                         } else {
-                            handleMessage(i, readIncoming(i));
+                            size_t length;
+                            unsigned char* msg = readIncoming(i, length);
+                            if (msg != nullptr) {
+                                handleMessage(i, msg, length);
+                                delete[] msg;
+                            }
                         }
                     }
                 }
@@ -124,39 +129,29 @@ class Server : public Object {
             }
         }
 
-        //reads incoming data into the buffer from the given file descriptor
-        unsigned char* readIncoming(int fd) {
-            //clear buffer
-            memset(buffer, 0, BUFF_SIZE);
-            int bytesRead = read(fd, buffer, BUFF_SIZE);
-            if (bytesRead < 0) {
-                assert("Error reading incoming data." && false);
-            }
-            if (bytesRead == 0) {
+        //reads the next whole message from the given file descriptor, setting
+        //length to its bytes; nullptr when the node disconnected
+        unsigned char* readIncoming(int fd, size_t& length) {
+            unsigned char* msg = read_message(fd, length);
+            if (msg == nullptr) {
                 handleDisconnect(fd);
             }
-            unsigned char* newBuff = new unsigned char[BUFF_SIZE];
-            memcpy(newBuff, buffer, BUFF_SIZE);
-            //clear buffer
-            memset(buffer, 0, BUFF_SIZE);
-            return newBuff;
+            return msg;
         }
 
         //primary message handler for incoming node messages
-        void handleMessage(int fd, unsigned char* msg) {
-            if (*msg != 0) {
-                MsgKind kind = message_kind(msg);
-                switch (kind) {
-                    case MsgKind::Register: {
-                        handleRegistration(fd, msg);
-                        break;
-                    }
-                    default: {
-                        assert("Unrecognized message type" && false);
-                    }
+        void handleMessage(int fd, unsigned char* msg, size_t length) {
+            MsgKind kind = message_kind(msg);
+            switch (kind) {
+                case MsgKind::Register: {
+                    handleRegistration(fd, msg, length);
+                    break;
+                }
+                default: {
+                    assert("Unrecognized message type" && false);
                 }
-                //nodeDir->print();
             }
+            //nodeDir->print();
         }
 
         //handler for socket disconnections
@@ -166,9 +161,9 @@ class Server : public Object {
         }
 
         //message handler for registration Messages
-        void handleRegistration(int fd, unsigned char* msg) {
+        void handleRegistration(int fd, unsigned char* msg, size_t length) {
             Register* rMsg = new Register();
-            rMsg->deserialize(msg);
+            rMsg->deserialize(msg, length);
             if (nodeDir->addNode(rMsg->IP, rMsg->port)) {
                 //notify client of success
                 Ack* a = new Ack(MsgKind::Register);
@@ -4,25 +4,50 @@
 
 #include "../object.h"
 #include "../serial/serial.h"
+#include "../serial/compress.h"
+#include <atomic>
+#include <mutex>
 
-class Value : public Object {
+/** Values shorter than this are always sent as they are */
+#define COMPRESS_MIN_BYTES 4096
+
+/** A serialized blob held by the store. Values are reference counted: the
+ *  creator holds the first reference and whoever keeps the value around
+ *  retains it, such as the frames reading their columns in place from it.
+ *  Release instead of deleting a value that may be shared. */
+class Value : public Object, public Serializable {
     public:
         size_t blob_length_;
         unsigned char* blob_;
+        std::atomic<size_t> refs_; // holders, the last release deletes the value
+        Object* frame_;            // owned; frame over blob_ built by the first read, nullptr before
+        std::mutex frameLock_;     // guards building frame_
 
-        Value() { }
+        Value() : refs_(1), frame_(nullptr) { }
 
-        Value(unsigned char* serial) {
+        Value(unsigned char* serial) : Value() {
             deserialize(serial);
         }
 
-        Value(unsigned char* blob, size_t blob_length) {
+        Value(unsigned char* blob, size_t blob_length) : Value() {
             blob_length_ = blob_length;
             blob_ = blob;
         }
 
         ~Value() {
-            delete blob_;
+            delete frame_;
+            delete[] blob_;
+        }
+
+        /** Adds a holder, returns this value */
+        Value* retain() {
+            refs_++;
+            return this;
+        }
+
+        /** Drops a holder, deleting the value once none is left */
+        void release() {
+            if (--refs_ == 0) delete this;
         }
 
         /**
@@ -30,23 +55,63 @@ class Value : public Object {
          * |--8 bytes--------------|-8 bytes------|-X bytes-|
          * |-Total length in bytes-|-blob_length_-|-blob_---|
          */
-        unsigned char *serialize() {
-            //TODO this cast may need to be changed
-            size_t length = 16 + blob_length_;
-            unsigned char* buffer = new unsigned char[length];
-            insert_size_t(length, buffer, 0);
-            insert_size_t(blob_length_, buffer, 8);
-            copy_unsigned(buffer + 16, blob_, blob_length_);
-            return buffer;
-        }
-
-        size_t deserialize(unsigned char *serialized) {
-            size_t length = extract_size_t(serialized, 0);
-            blob_length_ = extract_size_t(serialized, 8);
+        size_t serial_size() {
+            return 16 + blob_length_;
+        }
+
+        void write_to(BufferWriter& writer) {
+            writer.write_size_t(serial_size());
+            writer.write_size_t(blob_length_);
+            writer.write_bytes(blob_, blob_length_);
+        }
+
+        void read_from(BufferReader& reader) {
+            read_from(reader, false);
+        }
+
+        /** Writes this value, its blob compressed when compress is true,
+         *  the blob is at least COMPRESS_MIN_BYTES and the block is
+         *  smaller. Returns whether it was compressed. A compressed value
+         *  has the same structure, its total length counting the block:
+         * |--8 bytes--------------|-8 bytes------|-X bytes---------|
+         * |-Total length in bytes-|-blob_length_-|-LZ block of blob-|
+         */
+        bool write_to(BufferWriter& writer, bool compress) {
+            if (!compress || blob_length_ < COMPRESS_MIN_BYTES) {
+                write_to(writer);
+                return false;
+            }
+            size_t start = writer.pos_;
+            writer.write_size_t(0);
+            writer.write_size_t(blob_length_);
+            writer.reserve(lz_bound(blob_length_));
+            size_t block = lz_compress(blob_, blob_length_, writer.buf_ + writer.pos_);
+            if (block >= blob_length_) {
+                writer.pos_ = start;
+                write_to(writer);
+                return false;
+            }
+            writer.pos_ += block;
+            writer.patch_size_t(writer.pos_ - start, start);
+            return true;
+        }
+
+        /** Reads a value written by write_to, decompressing its blob when
+         *  compressed is true */
+        void read_from(BufferReader& reader, bool compressed) {
+            size_t length = reader.read_size_t();
+            if (length < 16) assert("Malformed value." && false);
+            size_t block = length - 16;
+            blob_length_ = reader.read_size_t();
+            reader.need(block);
+            //checked before allocating: a block byte decodes to at most 255 bytes
+            if (compressed ? blob_length_ > block * 255 + 16 : blob_length_ != block) {
+                assert("Malformed value." && false);
+            }
             blob_ = new unsigned char[blob_length_];
-            copy_unsigned(blob_, serialized + 16, blob_length_);
-            assert(length == 16 + blob_length_);
-            return length;
+            if (compressed) lz_decompress(reader.cursor(), block, blob_, blob_length_);
+            else memcpy(blob_, reader.cursor(), block);
+            reader.skip(block);
         }
 
         bool equals(Object  * other) {
@@ -0,0 +1,172 @@
+//lang: CwC
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include "object.h"
+
+/*************************************************************************
+ * ThreadPool::
+ * A fixed set of worker threads running small tasks. Every worker owns a
+ * deque: it pushes and pops its own tasks at the back and, when it runs
+ * dry, steals from the front of the others'. Tasks submitted from outside
+ * the pool are spread over the deques round robin. shared() is the pool
+ * the whole process uses, sized from the hardware.
+ * Threads waiting on tasks they submitted help run queued tasks instead
+ * of blocking, so tasks may wait on tasks of their own.
+ * Authors:
+ * Canon Sawrey sawrey.c@husky.neu.edu
+ * Trevor Stenson stenson.t@husky.neu.edu
+ */
+class ThreadPool : public Object {
+  public:
+    typedef std::function<void()> Task;
+
+    /** The tasks of one worker, guarded by its own lock */
+    struct Queue {
+      std::mutex lock_;
+      std::deque<Task> tasks_;
+    };
+
+    size_t n_workers_;
+    Queue* queues_;                // owned; one per worker
+    std::vector<std::thread> threads_;
+    std::mutex idle_lock_;
+    std::condition_variable wake_; // signalled when a task is queued
+    std::atomic<size_t> queued_;   // tasks queued and not yet started
+    std::atomic<size_t> next_;     // deque the next outside task goes to
+    std::atomic<bool> stop_;
+
+    ThreadPool(size_t n_workers) {
+      n_workers_ = n_workers == 0 ? 1 : n_workers;
+      queues_ = new Queue[n_workers_];
+      queued_ = 0;
+      next_ = 0;
+      stop_ = false;
+      for (size_t i = 0; i < n_workers_; i++) {
+        threads_.push_back(std::thread(&ThreadPool::work, this, i));
+      }
+    }
+
+    ~ThreadPool() {
+      {
+        std::lock_guard<std::mutex> guard(idle_lock_);
+        stop_ = true;
+      }
+      wake_.notify_all();
+      for (size_t i = 0; i < n_workers_; i++) threads_[i].join();
+      delete[] queues_;
+    }
+
+    /** The pool shared by the process, one worker per hardware thread */
+    static ThreadPool& shared() {
+      static ThreadPool pool(std::thread::hardware_concurrency());
+      return pool;
+    }
+
+    /** Number of worker threads */
+    size_t size() {
+      return n_workers_;
+    }
+
+    /** The pool and worker index of the calling thread, nullptr and 0 for
+     *  threads that are not workers */
+    static ThreadPool*& current_pool() {
+      static thread_local ThreadPool* pool = nullptr;
+      return pool;
+    }
+    static size_t& current_worker() {
+      static thread_local size_t worker = 0;
+      return worker;
+    }
+
+    /** Index of the calling thread among size() + 1 slots: its worker
+     *  index in this pool, or size() for any other thread. Slots are not
+     *  exclusive, every outside thread has size() and a thread waiting in
+     *  parallel_for runs other tasks, so state that a task holds on to
+     *  belongs to the task, not to its slot. */
+    size_t slot() {
+      return current_pool() == this ? current_worker() : n_workers_;
+    }
+
+    /** Queues t to run on some worker */
+    void submit(Task t) {
+      size_t q = slot() < n_workers_ ? slot() : next_++ % n_workers_;
+      {
+        std::lock_guard<std::mutex> guard(queues_[q].lock_);
+        queues_[q].tasks_.push_back(t);
+      }
+      queued_++;
+      std::lock_guard<std::mutex> guard(idle_lock_);
+      wake_.notify_one();
+    }
+
+    /** Runs one queued task on the calling thread, preferring its own
+     *  deque. False if there was nothing to run. */
+    bool run_one() {
+      Task t;
+      size_t home = slot();
+      if (home < n_workers_ && pop_back(queues_[home], t)) {
+        t();
+        return true;
+      }
+      for (size_t i = 1; i <= n_workers_; i++) {
+        if (pop_front(queues_[(home + i) % n_workers_], t)) {
+          t();
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /** Calls f(i) for every i in [0, n) on the pool and returns once all
+     *  calls are done. The calling thread runs tasks while it waits. */
+    void parallel_for(size_t n, std::function<void(size_t)> f) {
+      std::atomic<size_t> left(n);
+      for (size_t i = 0; i < n; i++) {
+        submit([&f, &left, i]() {
+          f(i);
+          left--;
+        });
+      }
+      while (left > 0) {
+        if (!run_one()) std::this_thread::yield();
+      }
+    }
+
+    bool pop_back(Queue& q, Task& t) {
+      std::lock_guard<std::mutex> guard(q.lock_);
+      if (q.tasks_.empty()) return false;
+      t = q.tasks_.back();
+      q.tasks_.pop_back();
+      queued_--;
+      return true;
+    }
+
+    bool pop_front(Queue& q, Task& t) {
+      std::lock_guard<std::mutex> guard(q.lock_);
+      if (q.tasks_.empty()) return false;
+      t = q.tasks_.front();
+      q.tasks_.pop_front();
+      queued_--;
+      return true;
+    }
+
+    /** Body of worker idx: run tasks, stealing when out, sleep when the
+     *  whole pool is out */
+    void work(size_t idx) {
+      current_pool() = this;
+      current_worker() = idx;
+      while (true) {
+        if (run_one()) continue;
+        std::unique_lock<std::mutex> guard(idle_lock_);
+        wake_.wait(guard, [this]() { return stop_ || queued_ > 0; });
+        if (stop_) return;
+      }
+    }
+};
@@ -7,7 +7,11 @@
  */
 enum Type {
     BOOL,
+    BYTE,
+    SHORT,
     INT,
+    LONG,
+    FLOAT,
     DOUBLE,
     STRING
 }; 
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include <regex>
 #include "type.h"
 #include <string>
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
 
 using namespace std;
 
@@ -20,6 +23,19 @@ int parse_int(string value) {
     }
 }
 
+/**
+ * Convenience wrapper around stoll, returns a 64 bit integer from a string
+ * @param s The string to be parsed
+ * @return the parsed integer
+ */
+int64_t parse_long(string value) {
+    if (value == "") {
+        return 0;
+    } else {
+        return stoll(value);
+    }
+}
+
 /**
  * Convenience wrapper around stod, returns a double from a string
  * @param s The string to be parsed
@@ -149,6 +165,31 @@ void trim(string &s) {
     trim_quotes(s);
 }
 
+/** The narrowest integer type holding val */
+Type integer_type(int64_t val) {
+    if (val >= INT8_MIN && val <= INT8_MAX) return BYTE;
+    if (val >= INT16_MIN && val <= INT16_MAX) return SHORT;
+    if (val >= INT32_MIN && val <= INT32_MAX) return INT;
+    return LONG;
+}
+
+/**
+ * The narrowest integer type holding the integer in the string, DOUBLE if
+ * it does not fit in 64 bits
+ * @param value A string for which is_int holds
+ */
+Type integer_type(string value) {
+    errno = 0;
+    long long val = strtoll(value.c_str(), nullptr, 10);
+    if (errno == ERANGE) return DOUBLE;
+    return integer_type((int64_t)val);
+}
+
+/** FLOAT if val survives the round trip through a float, else DOUBLE */
+Type real_type(double val) {
+    return (double)(float)val == val ? FLOAT : DOUBLE;
+}
+
 /**
  * Determines the most restrictive type that can be applied to a string
  *  @param fieldValue The string to be evaluated
@@ -156,9 +197,11 @@ void trim(string &s) {
  */ 
 Type get_field_type(string fieldValue) {
     trim_whitespace(fieldValue);
+    //a missing value says nothing about the type, BOOL never widens a column
+    if (fieldValue == "") return BOOL;
     if (is_bool(fieldValue)) return BOOL;
-    if (is_int(fieldValue)) return INT;
-    if (is_double(fieldValue)) return DOUBLE;
+    if (is_int(fieldValue)) return integer_type(fieldValue);
+    if (is_double(fieldValue)) return real_type(stod(fieldValue));
     if (is_string(fieldValue)) return STRING;
     return BOOL;
 }
@@ -173,6 +216,28 @@ bool should_change_type(Type oldType, Type newType) {
     return newType > oldType;
 }
 
+/**
+ * The narrowest type holding values of both types. Integers widen among
+ * themselves, as do reals, BOOL fits in all of them and anything joined
+ * with a STRING is a STRING. Mixing integers and reals gives a FLOAT only
+ * when the integers are at most 16 bits wide, so they are exact in a float.
+ * @param a The type of a column so far
+ * @param b The type of a new value
+ * @return the type the column should have
+ */
+Type join_types(Type a, Type b) {
+    if (a == b) return a;
+    if (a == STRING || b == STRING) return STRING;
+    if (a == BOOL) return b;
+    if (b == BOOL) return a;
+    bool a_real = a == FLOAT || a == DOUBLE;
+    bool b_real = b == FLOAT || b == DOUBLE;
+    if (a_real == b_real) return a > b ? a : b;
+    Type integer = a_real ? b : a;
+    Type real = a_real ? a : b;
+    return real == FLOAT && integer <= SHORT ? FLOAT : DOUBLE;
+}
+
 /**
  * Maps character to Types
  * @param type The character representation on the type
@@ -192,6 +257,14 @@ Type map_to_type(char type) {
         case 'I':
             return INT;
             break;
+        case 'Y':
+            return BYTE;
+        case 'H':
+            return SHORT;
+        case 'L':
+            return LONG;
+        case 'F':
+            return FLOAT;
         default:
             assert("\nUnrecognized type" && false);
             break;
@@ -213,6 +286,14 @@ char map_to_char(Type type) {
             return 'D';
         case INT:
             return 'I';
+        case BYTE:
+            return 'Y';
+        case SHORT:
+            return 'H';
+        case LONG:
+            return 'L';
+        case FLOAT:
+            return 'F';
         default:
             assert("Unreciognized type" && false);
             break;
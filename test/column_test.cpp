@@ -0,0 +1,375 @@
+#include "test_util.h"
+
+#include "../src/dataframe/column.h"
+#include "../src/dataframe/dictionary.h"
+#include "../src/dataframe/arena.h"
+
+using namespace std;
+
+/** Makes sure values survive crossing chunk boundaries and gaps read as 0 */
+void chunked_int_test() {
+    IntColumn* col = new IntColumn();
+    size_t n = 3 * CHUNK_SIZE + 17;
+    for (size_t i = 0; i < n; i++) {
+        col->push_back((int)i * 3);
+    }
+    assert(col->size() == n);
+    assert(col->chunk_count() == 4);
+    assert(col->chunk_length(0) == CHUNK_SIZE);
+    assert(col->chunk_length(3) == 17);
+    assert(col->get(CHUNK_SIZE - 1) == (int)(CHUNK_SIZE - 1) * 3);
+    assert(col->get(CHUNK_SIZE) == (int)CHUNK_SIZE * 3);
+    size_t seen = 0;
+    for (size_t c = 0; c < col->chunk_count(); c++) {
+        int* vals = col->chunk(c);
+        for (size_t i = 0; i < col->chunk_length(c); i++) {
+            assert(vals[i] == (int)seen * 3);
+            seen++;
+        }
+    }
+    assert(seen == n);
+    col->set(n + 5, 42);
+    assert(col->size() == n + 6);
+    assert(col->get(n + 2) == 0);
+    assert(col->get(n + 5) == 42);
+    IntColumn* copy = col->clone();
+    assert(col->equals(copy));
+    copy->set(10, -1);
+    assert(!col->equals(copy));
+    delete col;
+    delete copy;
+}
+
+/** Checks the remaining column types on the chunked layout */
+void chunked_types_test() {
+    DoubleColumn* d = new DoubleColumn(3, 1.5, 2.5, 3.5);
+    assert(d->size() == 3);
+    assert(d->get(1) == 2.5);
+    BoolColumn* b = new BoolColumn();
+    StringColumn* s = new StringColumn();
+    String* hello = new String("hello");
+    for (size_t i = 0; i < CHUNK_SIZE + 1; i++) {
+        b->push_back(i % 3 == 0);
+        s->push_back(hello);
+    }
+    assert(b->get(CHUNK_SIZE) == (CHUNK_SIZE % 3 == 0));
+    assert(b->get(3));
+    assert(!b->get(4));
+    assert(s->get(CHUNK_SIZE)->equals(hello));
+    //borrowed chunks are copied on their first write
+    int span[3] = { 4, 5, 6 };
+    ChunkedArray<int> lent;
+    lent.set_length(3);
+    lent.borrow(0, span);
+    assert(lent.is_borrowed(0) && lent.get(2) == 6);
+    lent.set(1, 9);
+    assert(!lent.is_borrowed(0) && lent.get(1) == 9 && lent.get(2) == 6);
+    assert(span[1] == 5);
+    delete d;
+    delete b;
+    delete s;
+    delete hello;
+}
+
+/** Bit-packed bool column: popcount, word-wise logic and bitmap serialization */
+void packed_bool_test() {
+    BoolColumn* a = new BoolColumn();
+    BoolColumn* b = new BoolColumn();
+    size_t n = CHUNK_SIZE + 70;
+    for (size_t i = 0; i < n; i++) {
+        a->push_back(i % 2 == 0);
+        b->push_back(i % 3 == 0);
+    }
+    assert(a->count_true() == (n + 1) / 2);
+    BoolColumn* both = a->and_(b);
+    BoolColumn* either = a->or_(b);
+    BoolColumn* neither = either->not_();
+    for (size_t i = 0; i < n; i++) {
+        assert(both->get(i) == (i % 6 == 0));
+        assert(either->get(i) == (i % 2 == 0 || i % 3 == 0));
+        assert(neither->get(i) == !either->get(i));
+    }
+    assert(either->count_true() + neither->count_true() == n);
+    unsigned char* serial = a->vals_.serialize();
+    assert(extract_size_t(serial, 0) == 16 + 8 * ((n + 63) / 64));
+    BoolColumn* a2 = new BoolColumn();
+    a2->vals_.deserialize(serial);
+    assert(a->equals(a2));
+    delete[] serial;
+    delete a;
+    delete b;
+    delete both;
+    delete either;
+    delete neither;
+    delete a2;
+}
+
+/** Missing values are tracked apart from legitimate zeros */
+void validity_test() {
+    IntColumn* col = new IntColumn();
+    col->push_back(0);
+    col->push_back(5);
+    assert(col->validity_words() == nullptr);
+    assert(col->null_count() == 0);
+    col->set(200, 7);
+    assert(col->is_missing(100));
+    assert(!col->is_missing(0));
+    assert(col->get(0) == 0);
+    assert(col->null_count() == 198);
+    col->set_missing(1);
+    assert(col->is_missing(1));
+    assert(col->null_count() == 199);
+    col->set(150, 0);
+    assert(!col->is_missing(150));
+    size_t present = 0;
+    col->for_each_valid(0, col->size(), [&](size_t i) {
+        assert(!col->is_missing(i));
+        present++;
+    });
+    assert(present == col->size() - col->null_count());
+    IntColumn* copy = col->clone();
+    assert(copy->equals(col));
+    copy->set(150, 0);
+    copy->set_missing(0);
+    assert(!copy->equals(col));
+    delete col;
+    delete copy;
+}
+
+/** Dictionary encoded strings keep one copy per distinct value */
+void dict_string_test() {
+    String* words[3] = { new String("apple"), new String("pear"), new String("") };
+    StringColumn* plain = new StringColumn();
+    for (size_t i = 0; i < CHUNK_SIZE + 10; i++) plain->push_back(words[i % 3]);
+    plain->set_missing(4);
+    assert(DictStringColumn::encode(plain, 2) == nullptr);
+    DictStringColumn* dict = DictStringColumn::encode(plain, 3);
+    assert(dict != nullptr);
+    assert(dict->dict_size() == 3);
+    assert(dict->equals(plain));
+    assert(dict->is_missing(4));
+    assert(dict->get(CHUNK_SIZE + 2)->equals(words[(CHUNK_SIZE + 2) % 3]));
+    assert(dict->code(0) == dict->code(3));
+    BoolColumn* pears = dict->equal_to(words[1]);
+    assert(pears->get(1) && !pears->get(0) && !pears->get(4));
+    assert(pears->count_true() == (CHUNK_SIZE + 10 + 1) / 3 - 1);
+    size_t* counts = dict->group_counts();
+    assert(counts[dict->find(words[1])] == pears->count_true());
+    unsigned char* serial = dict->serialize();
+    DictStringColumn* back = new DictStringColumn();
+    assert(back->deserialize(serial) == extract_size_t(serial, 0));
+    back->copy_validity(dict);
+    assert(back->equals(dict));
+    DictStringColumn* copy = dict->clone();
+    assert(copy->as_dict() != nullptr);
+    copy->set(0, words[1]);
+    assert(copy->code(0) == copy->code(1));
+    assert(!copy->equals(dict));
+    delete[] serial;
+    delete[] counts;
+    delete pears;
+    delete back;
+    delete copy;
+    delete dict;
+    delete plain;
+    for (size_t i = 0; i < 3; i++) delete words[i];
+}
+
+/** Arena strings are read as views and only become Strings on request */
+void arena_string_test() {
+    ArenaStringColumn* col = new ArenaStringColumn();
+    StringColumn* plain = new StringColumn();
+    char buf[16];
+    for (size_t i = 0; i < 2 * CHUNK_SIZE; i++) {
+        snprintf(buf, sizeof(buf), "s%zu", i);
+        col->set_chars(i, buf, strlen(buf));
+        plain->push_back(new String(buf));
+    }
+    String big_str(std::string(ARENA_SLAB_SIZE + 5, 'x').c_str());
+    col->push_back(&big_str);
+    plain->push_back(&big_str);
+    col->push_back(nullptr);
+    plain->push_back(nullptr);
+    col->set_missing(7);
+    plain->set_missing(7);
+    assert(col->size() == 2 * CHUNK_SIZE + 2);
+    assert(col->arena_.n_slabs_ == 2);
+    assert(col->get_view(CHUNK_SIZE + 3).equals(plain->get(CHUNK_SIZE + 3)));
+    assert(col->get_view(2 * CHUNK_SIZE).size() == ARENA_SLAB_SIZE + 5);
+    assert(col->get_view(2 * CHUNK_SIZE + 1).is_null());
+    assert(col->get_view(7).is_null());
+    assert(col->get(7) == nullptr);
+    String* s = col->get(12);
+    assert(s->equals(plain->get(12)));
+    assert(col->get(12) == s);
+    col->set_chars(12, "changed", 7);
+    assert(strcmp(col->get_view(12).c_str(), "changed") == 0);
+    assert(!col->equals(plain));
+    col->set(12, plain->get(12));
+    assert(col->equals(plain));
+    assert(plain->equals(col));
+    ArenaStringColumn* copy = col->clone();
+    assert(copy->equals(col));
+    // a table of terminated strings is copied in as few pieces as fit the slabs
+    std::string blob;
+    std::vector<size_t> offsets(1, 0);
+    for (size_t i = 0; i < col->size(); i++) {
+        StringView v = col->get_view(i);
+        if (!v.is_null()) blob.append(v.c_str(), v.size());
+        blob.push_back('\0');
+        offsets.push_back(blob.size());
+    }
+    ArenaStringColumn* table = new ArenaStringColumn();
+    table->append_table(blob.data(), offsets.data(), col->size());
+    assert(table->size() == col->size());
+    assert(table->arena_.n_slabs_ == 3);
+    for (size_t i = 0; i < col->size(); i++) {
+        if (!col->get_view(i).is_null()) assert(table->get_view(i).equals(col->get_view(i)));
+    }
+    assert(table->get_view(2 * CHUNK_SIZE + 1).size() == 0);
+    delete table;
+    delete copy;
+    delete col;
+    delete plain;
+}
+
+/** Checks that vals encode with the expected encoding and decode back */
+void check_codec(int* vals, size_t n, size_t encoding) {
+    EncodedInts* enc = EncodedInts::encode(vals, n);
+    assert(enc->encoding_ == encoding);
+    int* out = new int[n];
+    enc->decode(out);
+    assert(memcmp(out, vals, 4 * n) == 0);
+    for (size_t i = 0; i < n; i += 7) assert(enc->get(i) == vals[i]);
+    assert(enc->get(n - 1) == vals[n - 1]);
+    unsigned char* serial = enc->serialize();
+    EncodedInts* back = new EncodedInts();
+    back->deserialize(serial);
+    back->decode(out);
+    assert(memcmp(out, vals, 4 * n) == 0);
+    delete[] serial;
+    delete[] out;
+    delete back;
+    delete enc;
+}
+
+/** Each int encoding is picked for the data it suits and round trips */
+void int_codec_test() {
+    size_t n = CHUNK_SIZE;
+    int* vals = new int[n];
+    for (size_t i = 0; i < n; i++) vals[i] = 1000000 + (i * 7919) % 100;
+    check_codec(vals, n, INT_FOR);
+    for (size_t i = 0; i < n; i++) vals[i] = -5 + (int)(i / 1000);
+    check_codec(vals, n, INT_RLE);
+    for (size_t i = 0; i < n; i++) vals[i] = (int)(i * 100000) + (int)(i % 3);
+    check_codec(vals, n, INT_DELTA);
+    for (size_t i = 0; i < n; i++) vals[i] = (int)(i * 2654435761u);
+    check_codec(vals, n, INT_RAW);
+    for (size_t i = 0; i < n; i++) vals[i] = i < n / 2 ? INT32_MIN : INT32_MAX;
+    check_codec(vals, n, INT_RLE);
+    for (size_t i = 0; i < n; i++) vals[i] = i % 2 == 0 ? INT32_MIN : INT32_MIN + 1;
+    check_codec(vals, n, INT_FOR);
+    delete[] vals;
+}
+
+/** Sealed int columns read, write and serialize like plain ones */
+void sealed_int_test() {
+    IntColumn* col = new IntColumn();
+    for (size_t i = 0; i < 2 * CHUNK_SIZE + 100; i++) col->push_back(i % 50);
+    col->set_missing(3);
+    IntColumn* plain = col->clone();
+    col->seal();
+    assert(col->is_sealed(0) && col->is_sealed(2));
+    assert(col->value_bytes() < plain->value_bytes() / 4);
+    assert(col->get(CHUNK_SIZE + 7) == (CHUNK_SIZE + 7) % 50);
+    assert(col->equals(plain));
+    unsigned char* serial = col->serialize();
+    IntColumn* back = new IntColumn();
+    back->deserialize(serial);
+    back->copy_validity(col);
+    assert(back->is_sealed(1));
+    assert(back->equals(plain));
+    IntColumn* lent = new IntColumn();
+    BufferReader lent_reader(serial, extract_size_t(serial, 0));
+    lent->borrow(lent_reader);
+    lent->copy_validity(col);
+    assert(lent->is_sealed(1) && lent->equals(plain));
+    lent->set(5, -1);
+    assert(!lent->is_sealed(0) && lent->get(5) == -1);
+    delete lent;
+    lent = new IntColumn();
+    BufferReader again(serial, extract_size_t(serial, 0));
+    lent->borrow(again);
+    lent->copy_validity(col);
+    assert(lent->equals(plain));
+    delete lent;
+    col->set(CHUNK_SIZE + 1, 12345);
+    assert(!col->is_sealed(1) && col->is_sealed(0));
+    assert(col->get(CHUNK_SIZE + 1) == 12345);
+    assert(col->get(CHUNK_SIZE + 2) == (CHUNK_SIZE + 2) % 50);
+    col->push_back(7);
+    assert(col->get(2 * CHUNK_SIZE + 100) == 7);
+    assert(col->get(2 * CHUNK_SIZE + 99) == (2 * CHUNK_SIZE + 99) % 50);
+    delete[] serial;
+    delete back;
+    delete plain;
+    delete col;
+}
+
+/** Narrow and wide numeric columns keep their width and widen on read */
+void numeric_types_test() {
+    ByteColumn* b = new ByteColumn();
+    LongColumn* l = new LongColumn();
+    FloatColumn* f = new FloatColumn();
+    for (size_t i = 0; i < CHUNK_SIZE + 3; i++) {
+        b->push_back((int8_t)(i % 200 - 100));
+        l->push_back((int64_t)i << 33);
+        f->push_back(i * 0.5f);
+    }
+    b->set_missing(2);
+    assert(b->get_type() == 'Y' && make_column('H')->get_type() == 'H');
+    assert(b->get(CHUNK_SIZE) == (int8_t)(CHUNK_SIZE % 200 - 100));
+    assert(b->get_integer(0) == -100);
+    assert(l->get_integer(CHUNK_SIZE + 2) == (int64_t)(CHUNK_SIZE + 2) << 33);
+    assert(f->get_numeric(3) == 1.5);
+    double lo, hi;
+    assert(b->value_range(lo, hi) && lo == -100 && hi == 99);
+    assert(!f->chunk_overlaps(0, -5, -1));
+    unsigned char* serial = b->serialize();
+    assert(extract_size_t(serial, 8) == CHUNK_SIZE + 3);
+    ByteColumn* back = new ByteColumn();
+    back->deserialize(serial);
+    back->copy_validity(b);
+    assert(back->equals(b));
+    assert(back->value_range(lo, hi) && hi == 99);
+    LongColumn* copy = l->clone();
+    assert(copy->equals(l) && !copy->equals(b));
+    delete[] serial;
+    delete back;
+    delete copy;
+    delete b;
+    delete l;
+    delete f;
+}
+
+int main() {
+    chunked_int_test();
+    success("Column chunked int");
+    chunked_types_test();
+    success("Column chunked types");
+    packed_bool_test();
+    success("Column packed bool");
+    validity_test();
+    success("Column validity");
+    dict_string_test();
+    success("Column dictionary strings");
+    arena_string_test();
+    success("Column arena strings");
+    int_codec_test();
+    success("Column int encodings");
+    sealed_int_test();
+    success("Column sealed ints");
+    numeric_types_test();
+    success("Column numeric types");
+    return 0;
+}
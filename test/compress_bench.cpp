@@ -0,0 +1,147 @@
+#include <chrono>
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "../src/dataframe/dataframe.h"
+
+/**
+ * Sends a serialized string heavy frame in Put messages over a loopback
+ * socket, once raw and once compressed, and reports the bytes on the wire
+ * against the time spent compressing and decompressing. Usage:
+ *   ./compress_bench [rows] [messages]
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::time_point from) {
+    return std::chrono::duration<double>(Clock::now() - from).count();
+}
+
+/** Rows of an id, a repository name and a user name, the strings drawn
+ *  from small vocabularies like the projects and users datasets */
+DataFrame* make_frame(size_t rows) {
+    const char* owners[8] = { "torvalds", "cocos2d", "matplotlib", "heroku",
+                              "kennethkalmer", "sgonyea", "chapuni", "NUBIC" };
+    const char* names[8] = { "linux", "cocos2d-x", "basemap", "heroku-buildpack-scala",
+                             "ruote-kit", "rake-compiler", "llvm", "ncs_navigator_core" };
+    //the frame keeps the schema, it lives as long as the program
+    DataFrame* df = new DataFrame(*new Schema("ISS"));
+    char buf[64];
+    size_t seed = 1;
+    for (size_t i = 0; i < rows; i++) {
+        seed = seed * 6364136223846793005u + 1442695040888963407u;
+        df->set(0, i, (int)i);
+        snprintf(buf, sizeof(buf), "%s/%s", owners[(seed >> 33) % 8], names[(seed >> 40) % 8]);
+        df->set(1, i, new String(buf));
+        snprintf(buf, sizeof(buf), "user%zu", (seed >> 45) % 5000);
+        df->set(2, i, new String(buf));
+    }
+    return df;
+}
+
+/** Reads messages and decodes them as Puts until count were received,
+ *  adding the time spent decoding to decode */
+void receive(int fd, size_t count, double* decode) {
+    unsigned char* buf = new unsigned char[16];
+    size_t cap = 16;
+    for (size_t m = 0; m < count; m++) {
+        size_t got = 0;
+        while (got < 8) got += read(fd, buf + got, 8 - got);
+        size_t length = message_length(buf);
+        if (length > cap) {
+            unsigned char* grown = new unsigned char[length];
+            memcpy(grown, buf, 8);
+            delete[] buf;
+            buf = grown;
+            cap = length;
+        }
+        while (got < length) {
+            ssize_t n = read(fd, buf + got, length - got);
+            assert(n > 0);
+            got += n;
+        }
+        Clock::time_point start = Clock::now();
+        Put* put = new Put(buf, length);
+        *decode += seconds(start);
+        delete put;
+    }
+    delete[] buf;
+}
+
+/** Sends messages Puts of blob, compressed or not, and prints a line of
+ *  results. Returns the seconds encoding and decoding took. */
+double run(const char* mode, unsigned char* blob, size_t length, size_t messages, bool compress) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+    if (listener < 0 || bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 1) < 0 ||
+        getsockname(listener, (sockaddr*)&addr, &addr_len) < 0) {
+        assert("Cannot listen on loopback." && false);
+    }
+    int sender = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(sender, (sockaddr*)&addr, sizeof(addr)) < 0) assert("Cannot connect on loopback." && false);
+    int receiver = accept(listener, nullptr, nullptr);
+
+    double decode = 0;
+    double encode = 0;
+    size_t wire = 0;
+    Clock::time_point start = Clock::now();
+    std::thread reader(receive, receiver, messages, &decode);
+    BufferWriter writer;
+    for (size_t m = 0; m < messages; m++) {
+        unsigned char* copy = new unsigned char[length];
+        memcpy(copy, blob, length);
+        Put* put = new Put(0, 1, m, new Key("bench", 1), new Value(copy, length));
+        put->compress_ = compress;
+        Clock::time_point encoding = Clock::now();
+        writer.clear();
+        put->write_to(writer);
+        encode += seconds(encoding);
+        for (size_t sent = 0; sent < writer.pos_;) {
+            ssize_t n = send(sender, writer.buf_ + sent, writer.pos_ - sent, 0);
+            assert(n > 0);
+            sent += n;
+        }
+        wire += writer.pos_;
+        delete put;
+    }
+    reader.join();
+    double total = seconds(start);
+    close(sender);
+    close(receiver);
+    close(listener);
+    double mb = 1024.0 * 1024.0;
+    printf("%-10s %10.2f %10.3f %10.2f %10.2f %10.2f %10.2f\n", mode, wire / mb / messages,
+           (double)wire / (length * messages), encode * 1000 / messages, decode * 1000 / messages,
+           length * messages / mb / total, wire / mb / total);
+    return encode + decode;
+}
+
+int main(int argc, char** argv) {
+    size_t rows = argc > 1 ? atol(argv[1]) : 200000;
+    size_t messages = argc > 2 ? atol(argv[2]) : 20;
+    DataFrame* df = make_frame(rows);
+    unsigned char* blob = df->serialize();
+    size_t length = message_length(blob);
+    printf("%zu rows, %.2f MB serialized, %zu messages over loopback\n", rows, length / 1024.0 / 1024.0, messages);
+    printf("%-10s %10s %10s %10s %10s %10s %10s\n", "mode", "wire MB", "ratio", "enc ms", "dec ms", "data MB/s",
+           "wire MB/s");
+    double raw = run("raw", blob, length, messages, false);
+    double lz = run("lz", blob, length, messages, true);
+    unsigned char* block = new unsigned char[lz_bound(length)];
+    size_t compressed = lz_compress(blob, length, block);
+    //compressing pays off on links slower than the bytes it saves per second of extra work
+    double saved = (double)(length - compressed) * messages;
+    if (lz > raw) printf("break even link: %.2f MB/s\n", saved / (lz - raw) / 1024.0 / 1024.0);
+    delete[] block;
+    delete[] blob;
+    delete df;
+    return 0;
+}
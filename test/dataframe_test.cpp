@@ -2,6 +2,11 @@
 
 #include "../src/dataframe/sor.h"
 #include "../src/dataframe/rowers.h"
+#include "../src/dataframe/view.h"
+#include "../src/dataframe/typed.h"
+#include "../src/dataframe/join.h"
+#include "../src/dataframe/groupby.h"
+#include "../src/dataframe/plan.h"
 
 using namespace std;
 
@@ -36,7 +41,7 @@ void integration_test() {
     SorAdapter* sor = new SorAdapter(0, UINT32_MAX, "test1000.sor");
     DataFrame* df = sor->df_;
     //Checking the schema is correct
-    assert(strcmp(df->get_schema().types, "BDSIBDSIBD") == 0);
+    assert(strcmp(df->get_schema().types, "BDSHBDSHBD") == 0);
     //Checking the data is correct
     assert(df->get_double(1, 0) == 0.01);
     assert(df->get_double(9, 999) == 99.99);
@@ -57,6 +62,934 @@ void integration_test() {
     delete df2;
 }
 
+/** Counts the rows it is shown */
+class CountRows : public Rower {
+public:
+    size_t count_ = 0;
+    bool accept(Row& r) { count_++; return true; }
+};
+
+/** Range scans only read chunks whose zone map can match */
+void zone_map_test() {
+    Schema* schema = new Schema("ID");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 4 * CHUNK_SIZE;
+    for (size_t i = 0; i < n; i++) {
+        df->set(0, i, (int)i);
+        df->set(1, i, (i / CHUNK_SIZE) * 1.5);
+    }
+    df->set_missing(0, 10);
+    IntColumn* ints = df->columns[0]->as_int();
+    assert(ints->zones_.min(1) == (int)CHUNK_SIZE);
+    assert(ints->zones_.max(1) == (int)(2 * CHUNK_SIZE - 1));
+    assert(!ints->chunk_overlaps(0, CHUNK_SIZE, 2 * CHUNK_SIZE));
+    assert(ints->chunk_overlaps(1, CHUNK_SIZE, 2 * CHUNK_SIZE));
+    assert(ints->chunk_null_count(0) == 1);
+    assert(ints->chunk_null_count(1) == 0);
+    CountRows counter;
+    df->map_where(0, 5, CHUNK_SIZE + 4, counter);
+    assert(counter.count_ == CHUNK_SIZE - 1);
+    DataFrame* found = df->filter_where(1, 2.0, 3.0);
+    assert(found->nrows() == CHUNK_SIZE);
+    assert(found->get_int(0, 0) == (int)(2 * CHUNK_SIZE));
+    unsigned char* serial = df->serialize();
+    DataFrame* df2 = new DataFrame(serial);
+    DoubleColumn* dbls = df2->columns[1]->as_double();
+    assert(dbls->zones_.size() == 4);
+    assert(dbls->zones_.min(3) == 4.5 && dbls->zones_.max(3) == 4.5);
+    assert(df2->columns[0]->equals(df->columns[0]));
+    double lo, hi;
+    assert(df2->columns[0]->value_range(lo, hi));
+    assert(lo == 0 && hi == n - 1);
+    delete[] serial;
+    delete df2;
+    delete found;
+    delete df;
+}
+
+/** Keeps the rows with an even value in column 0, counting what it sees */
+class EvenRows : public BatchRower {
+public:
+    size_t seen_ = 0;
+    long sum_ = 0;
+    bool accept(Row& r) {
+        seen_++;
+        sum_ += r.get_int(0);
+        return r.get_int(0) % 2 == 0;
+    }
+    void accept(Batch& b) {
+        const int* vals = b.ints(0);
+        for (size_t k = 0; k < b.count(); k++) {
+            size_t i = b.row(k);
+            seen_++;
+            sum_ += vals[i];
+            if (vals[i] % 2 == 0) b.keep(i);
+        }
+    }
+    Object* clone() { return new EvenRows(); }
+    void join_delete(Rower* other) {
+        EvenRows* o = dynamic_cast<EvenRows*>(other);
+        seen_ += o->seen_;
+        sum_ += o->sum_;
+        delete o;
+    }
+};
+
+/** Batch rowers see every row once, across chunks and threads */
+void batch_rower_test() {
+    Schema* schema = new Schema("HSD");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 3 * CHUNK_SIZE + 5;
+    String s("x");
+    for (size_t i = 0; i < n; i++) {
+        df->set(0, i, (int)(i % 1000));
+        df->set(1, i, &s);
+        df->set(2, i, 0.5);
+    }
+    df->set_missing(1, 4);
+    long expected = 0;
+    for (size_t i = 0; i < n; i++) expected += i % 1000;
+    EvenRows even;
+    df->map(even);
+    assert(even.seen_ == n && even.sum_ == expected);
+    EvenRows peven;
+    df->pmap(peven);
+    assert(peven.seen_ == n && peven.sum_ == expected);
+    DataFrame* kept = df->filter(even);
+    assert(kept->nrows() == (n + 1) / 2);
+    assert(kept->get_int(0, 3) == 6);
+    assert(kept->is_missing(1, 2));
+    assert(kept->get_string(1, 3)->equals(&s));
+    DataFrame* pkept = df->pfilter(even);
+    assert(pkept->equals(kept));
+    delete pkept;
+    EvenRows ranged;
+    df->map_where(0, 10, 19, ranged);
+    assert(ranged.seen_ == 10 * ((n + 999) / 1000) && ranged.sum_ == 145 * (long)((n + 999) / 1000));
+    SumNumbers sn;
+    df->map(sn);
+    assert(sn.get_sum() == expected + 0.5 * n);
+    delete kept;
+    delete df;
+}
+
+/** Sums every field it is shown */
+class TotalFielder : public Fielder {
+public:
+    double total_ = 0;
+    int64_t longs_ = 0;
+    void accept(int i) { total_ += i; }
+    void accept(double d) { total_ += d; }
+    void accept(int64_t l) { longs_ += l; }
+};
+
+/** Rows hold their values inline and can be refilled in place */
+void row_test() {
+    Schema* schema = new Schema("YLFSB");
+    DataFrame* df = new DataFrame(*schema);
+    String* s = new String("abc");
+    for (size_t i = 0; i < 10; i++) {
+        df->set(0, i, (int)i - 5);
+        df->set(1, i, (int64_t)i << 40);
+        df->set(2, i, (float)i / 4);
+        df->set(3, i, s);
+        df->set(4, i, i % 2 == 0);
+    }
+    df->set_missing(2, 3);
+    Row row(df->get_schema());
+    assert(row.is_missing(0));
+    df->fill_row(3, row);
+    assert(row.get_int(0) == -2 && row.get_long(0) == -2);
+    assert(row.get_long(1) == (int64_t)3 << 40);
+    assert(row.is_missing(2) && row.get_double(2) == 0);
+    assert(row.get_string(3)->equals(s));
+    df->fill_row(6, row);
+    assert(!row.is_missing(2) && row.get_float(2) == 1.5f);
+    assert(row.get_bool(4));
+    TotalFielder total;
+    row.visit(6, total);
+    assert(total.total_ == 1 + 1.5);
+    assert(total.longs_ == (int64_t)6 << 40);
+    //longs reach their own accept exactly, past what a double holds
+    Row wide_row(df->get_schema());
+    df->fill_row(6, wide_row);
+    wide_row.set(1, ((int64_t)1 << 53) + 1);
+    TotalFielder wide;
+    wide_row.visit(6, wide);
+    assert(wide.longs_ == ((int64_t)1 << 53) + 1);
+    df->add_row(row);
+    assert(df->nrows() == 11);
+    assert(df->get_string(3, 10)->equals(df->get_string(3, 6)));
+    assert(df->get_long(1, 10) == (int64_t)6 << 40);
+    assert(df->get_string(3, 10) != s);
+    delete df;
+    delete s;
+}
+
+/** Counts rows through the row interface, joining its clones */
+class CountClones : public Rower {
+public:
+    size_t count_ = 0;
+    bool accept(Row& r) { count_++; return true; }
+    Object* clone() { return new CountClones(); }
+    void join_delete(Rower* other) {
+        count_ += dynamic_cast<CountClones*>(other)->count_;
+        delete other;
+    }
+};
+
+/** Fails if two threads use the same clone at once. Every row waits on
+ *  nested tasks, so the waiting thread runs other tasks meanwhile. */
+class ExclusiveClones : public Rower {
+public:
+    size_t count_ = 0;
+    std::atomic<int> users_;
+    ExclusiveClones() : users_(0) { }
+    bool accept(Row& r) {
+        assert(++users_ == 1);
+        if (r.get_idx() % 512 == 0) ThreadPool::shared().parallel_for(4, [](size_t) { });
+        count_++;
+        users_--;
+        return true;
+    }
+    Object* clone() { return new ExclusiveClones(); }
+    void join_delete(Rower* other) {
+        count_ += dynamic_cast<ExclusiveClones*>(other)->count_;
+        delete other;
+    }
+};
+
+/** Lists the values of int column 0 it is shown; a join appends the
+ *  other's list. Pauses at the start of each morsel so other tasks get to
+ *  run. */
+class ListRows : public Rower {
+public:
+    std::vector<int> seen_;
+    bool accept(Row& r) {
+        if (r.get_int(0) % MORSEL_ROWS == 0) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        seen_.push_back(r.get_int(0));
+        return false;
+    }
+    Object* clone() { return new ListRows(); }
+    void join_delete(Rower* other) {
+        ListRows* mine = dynamic_cast<ListRows*>(other);
+        seen_.insert(seen_.end(), mine->seen_.begin(), mine->seen_.end());
+        delete other;
+    }
+};
+
+/** The shared pool runs every task once, also when tasks wait on tasks */
+void thread_pool_test() {
+    ThreadPool& pool = ThreadPool::shared();
+    assert(pool.size() >= 1);
+    assert(pool.slot() == pool.size());
+    std::atomic<size_t> total(0);
+    pool.parallel_for(100, [&](size_t i) {
+        assert(pool.slot() <= pool.size());
+        pool.parallel_for(10, [&](size_t j) { total += i * 10 + j; });
+    });
+    assert(total == 999 * 1000 / 2);
+    Schema* schema = new Schema("I");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 5 * MORSEL_ROWS + 3;
+    for (size_t i = 0; i < n; i++) df->set(0, i, (int)i);
+    CountClones counter;
+    df->pmap(counter);
+    assert(counter.count_ == n);
+    //threads outside the pool share a slot, clones must not follow it
+    ExclusiveClones first;
+    ExclusiveClones second;
+    std::thread other([&]() { df->pmap(second); });
+    df->pmap(first);
+    other.join();
+    assert(first.count_ == n && second.count_ == n);
+    //each clone sees a contiguous run of rows and is joined in row order
+    ListRows listed;
+    df->pmap(listed);
+    assert(listed.seen_.size() == n);
+    for (size_t i = 0; i < n; i++) assert(listed.seen_[i] == (int)i);
+    delete df;
+}
+
+/** Keeps rows whose int column 1 is a multiple of 3, through rows */
+class ThirdRows : public Rower {
+public:
+    bool accept(Row& r) { return r.get_int(1) % 3 == 0; }
+    Object* clone() { return new ThirdRows(); }
+    void join_delete(Rower* other) { delete other; }
+};
+
+/** Parallel filters keep the same rows, in order, as sequential ones */
+void parallel_filter_test() {
+    Schema* schema = new Schema("SIDB");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 4 * MORSEL_ROWS + 11;
+    String* names[2] = { new String("even"), new String("odd") };
+    for (size_t i = 0; i < n; i++) {
+        df->set(0, i, names[i % 2]);
+        df->set(1, i, (int)(i * 7 % 1000));
+        df->set(2, i, i * 0.25);
+        df->set(3, i, i % 4 == 0);
+    }
+    df->set_missing(2, 3);
+    df->set_missing(0, 6);
+    df->seal();
+    ThirdRows thirds;
+    DataFrame* seq = df->filter(thirds);
+    DataFrame* par = df->pfilter(thirds);
+    assert(seq->nrows() > 0 && seq->equals(par));
+    assert(par->get_int(1, 1) == 21);
+    assert(par->is_missing(2, 1) && par->is_missing(0, 2));
+    assert(par->get_string(0, 1)->equals(names[1]));
+    delete seq;
+    delete par;
+    delete df;
+    delete names[0];
+    delete names[1];
+}
+
+/** Filtered views read, traverse, filter and serialize in place */
+void view_test() {
+    Schema* schema = new Schema("IISD");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 3 * MORSEL_ROWS + 7;
+    String* names[2] = { new String("even"), new String("odd") };
+    for (size_t i = 0; i < n; i++) {
+        df->set(0, i, (int)(i % 1000));
+        df->set(1, i, (int)(i * 7 % 1000));
+        df->set(2, i, names[i % 2]);
+        df->set(3, i, i * 0.5);
+    }
+    df->set_missing(2, 8);
+    EvenRows even;
+    DataFrameView* view = new DataFrameView(df, even);
+    DataFrame* copy = df->filter(even);
+    assert(view->nrows() == copy->nrows() && view->ncols() == 4);
+    assert(view->get_int(0, 5) == 10 && view->get_double(3, 5) == 5.0);
+    assert(view->is_missing(2, 4) && view->get_string(2, 5)->equals(names[0]));
+    assert(view->equals(copy) && copy->equals(view));
+    EvenRows total;
+    view->map(total);
+    CountClones counter;
+    view->map(counter);
+    assert(total.seen_ == view->nrows() && counter.count_ == view->nrows());
+    EvenRows ptotal;
+    view->pmap(ptotal);
+    assert(ptotal.sum_ == total.sum_);
+    ThirdRows thirds;
+    DataFrame* sub = view->filter(thirds);
+    DataFrame* psub = view->pfilter(thirds);
+    DataFrame* expected = copy->filter(thirds);
+    assert(sub->as_view() != nullptr && sub->as_view()->parent_ == df);
+    assert(sub->equals(expected) && psub->equals(expected));
+    assert(sub->get_int(0, 1) == 6);
+    CountRows ranged;
+    view->map_where(3, 10.0, 20.0, ranged);
+    assert(ranged.count_ == 11);
+    DataFrame* found = view->filter_where(0, 100, 109);
+    assert(found->nrows() == 5 * ((n + 999) / 1000));
+    unsigned char* serial = view->serialize();
+    DataFrame* back = new DataFrame(serial);
+    DataFrame* real = view->materialize();
+    assert(back->equals(real) && real->equals(copy));
+    assert(back->get_string(2, 3)->equals(names[0]));
+    delete[] serial;
+    delete back;
+    delete real;
+    delete found;
+    delete expected;
+    delete psub;
+    delete sub;
+    delete view;
+    delete copy;
+    delete df;
+    delete names[0];
+    delete names[1];
+}
+
+/** Typed dataframes resolve columns statically and convert both ways */
+void typed_test() {
+    String* s = new String("abc");
+    TypedDataFrame<int, double, String*, bool, int64_t> typed;
+    assert(strcmp(typed.types(), "IDSBL") == 0);
+    size_t n = 2 * CHUNK_SIZE + 3;
+    for (size_t i = 0; i < n; i++) typed.add_row((int)i, i * 0.5, s, i % 2 == 0, (int64_t)i << 33);
+    typed.set_missing<2>(4);
+    assert(typed.nrows() == n && typed.get<0>(7) == 7 && typed.get<4>(2) == (int64_t)1 << 34);
+    assert(typed.is_missing<2>(4) && typed.get<2>(4) == nullptr);
+    assert(std::get<1>(typed.get_row(9)) == 4.5);
+    double total = 0;
+    size_t trues = 0;
+    typed.map([&](int i, double d, String* str, bool b, int64_t l) {
+        total += i + d;
+        if (b) trues++;
+    });
+    assert(total == 1.5 * (n * (n - 1) / 2) && trues == (n + 1) / 2);
+    DataFrame* df = typed.to_dataframe();
+    assert(strcmp(df->get_schema().types, "IDSBL") == 0 && df->nrows() == n);
+    assert(df->get_int(0, 11) == 11 && df->is_missing(2, 4) && df->get_string(2, 5)->equals(s));
+    df->seal();
+    TypedDataFrame<int, double, String*, bool, int64_t> back(*df);
+    assert(back.nrows() == n && back.get<0>(CHUNK_SIZE + 1) == (int)CHUNK_SIZE + 1);
+    long sum = 0;
+    back.map([&](int i, double d, String* str, bool b, int64_t l) { sum += i; });
+    assert(sum == (long)(n * (n - 1) / 2));
+    DataFrame* again = back.to_dataframe();
+    assert(again->equals(df));
+    delete again;
+    delete df;
+    delete s;
+}
+
+/** Column aggregates match plain loops, with missing values left out */
+void aggregate_test() {
+    Schema* schema = new Schema("IDBHF");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 40 * CHUNK_SIZE + 9;
+    double isum = 0, dsum = 0, dot = 0;
+    for (size_t i = 0; i < n; i++) {
+        int v = (int)(i % 2001) - 1000;
+        df->set(0, i, v);
+        df->set(1, i, (double)(i % 7));
+        df->set(2, i, i % 3 == 0);
+        df->set(3, i, (int)(i % 100));
+        df->set(4, i, 0.5f);
+        isum += v;
+        dsum += i % 7;
+        dot += (double)v * (i % 7);
+    }
+    df->set_missing(0, 5);
+    isum -= 5 - 1000;
+    dot -= (5 - 1000.0) * 5;
+    df->seal();
+    assert(df->sum(0) == isum && df->count(0) == n - 1);
+    assert(df->minimum(0) == -1000 && df->maximum(0) == 1000);
+    assert(df->sum(1) == dsum && df->mean(1) == dsum / n);
+    assert(df->dot(0, 1) == dot);
+    assert(df->sum(2) == (n + 2) / 3 && df->maximum(2) == 1 && df->minimum(2) == 0);
+    assert(df->sum(3) == df->mean(3) * n && df->maximum(3) == 99);
+    assert(df->sum(4) == 0.5 * n && df->variance(4) == 0);
+    double var = 0;
+    for (size_t i = 0; i < n; i++) var += (i % 7 - dsum / n) * (i % 7 - dsum / n);
+    assert(fabs(df->variance(1) - var / n) < 1e-9);
+    df->set_missing(1, 0);
+    df->set_missing(1, 7);
+    assert(df->minimum(1) == 0 && df->count(1) == n - 2);
+    EvenRows even;
+    DataFrameView* view = new DataFrameView(df, even);
+    DataFrame* copy = df->filter(even);
+    assert(view->sum(1) == copy->sum(1) && view->count(0) == copy->count(0));
+    assert(view->dot(0, 1) == copy->dot(0, 1));
+    delete view;
+    delete copy;
+    delete df;
+}
+
+/** Hash joins match keys like a nested loop would, in left row order */
+void join_test() {
+    Schema* cschema = new Schema("III");
+    DataFrame* commits = new DataFrame(*cschema);
+    size_t n = 3 * MORSEL_ROWS + 5;
+    for (size_t i = 0; i < n; i++) {
+        commits->set(0, i, (int)(i % 50));
+        commits->set(1, i, (int)(i % 13));
+        commits->set(2, i, (int)i);
+    }
+    commits->set_missing(1, 2);
+    commits->seal();
+    //uids 0 to 9, uid 4 twice
+    Schema* uschema = new Schema("IS");
+    DataFrame* users = new DataFrame(*uschema);
+    String* names[3] = { new String("ann"), new String("bob"), new String("cy") };
+    for (size_t u = 0; u < 11; u++) {
+        users->set(0, u, u == 10 ? 4 : (int)u);
+        users->set(1, u, names[u % 3]);
+    }
+    std::vector<size_t> ukey(1, 1);
+    std::vector<size_t> rkey(1, 0);
+    size_t matched = 0, expected = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (i == 2 || i % 13 > 9) continue;
+        matched++;
+        expected += i % 13 == 4 ? 2 : 1;
+    }
+    DataFrame* inner = hash_join(commits, users, ukey, rkey, JOIN_INNER);
+    assert(strcmp(inner->get_schema().types, "IIIIS") == 0);
+    assert(inner->nrows() == expected);
+    for (size_t k = 0; k < inner->nrows(); k++) assert(inner->get_int(1, k) == inner->get_int(3, k));
+    //row 4 has uid 4, joined with users 4 and 10 in that order
+    assert(inner->get_int(2, 3) == 4 && inner->get_int(2, 4) == 4);
+    assert(inner->get_string(4, 3)->equals(names[1]) && inner->get_string(4, 4)->equals(names[1]));
+    DataFrame* outer = hash_join(commits, users, ukey, rkey, JOIN_LEFT);
+    assert(outer->nrows() == expected + (n - matched));
+    assert(outer->get_int(2, 2) == 2 && outer->is_missing(3, 2) && outer->is_missing(4, 2));
+    assert(outer->get_int(2, 11) == 10 && outer->is_missing(4, 11));
+    DataFrame* semi = hash_join(commits, users, ukey, rkey, JOIN_SEMI);
+    assert(semi->as_view() != nullptr && semi->nrows() == matched);
+    assert(semi->get_int(2, 2) == 3);
+    //a view on the left, two keys of mixed types
+    EvenRows even;
+    DataFrameView* evens = new DataFrameView(commits, even);
+    Schema* pschema = new Schema("LI");
+    DataFrame* pairs = new DataFrame(*pschema);
+    pairs->set(0, 0, (int64_t)10);
+    pairs->set(1, 0, 10);
+    std::vector<size_t> lkeys;
+    lkeys.push_back(0);
+    lkeys.push_back(1);
+    std::vector<size_t> pkeys;
+    pkeys.push_back(0);
+    pkeys.push_back(1);
+    DataFrame* both = hash_join(evens, pairs, lkeys, pkeys, JOIN_SEMI);
+    for (size_t k = 0; k < both->nrows(); k++) {
+        assert(both->get_int(0, k) == 10 && both->get_int(1, k) == 10);
+    }
+    assert(both->nrows() > 0 && both->as_view()->parent_ == commits);
+    //two column keys past 2^53 compare as integers, with doubles as doubles
+    int64_t big = (int64_t)1 << 53;
+    DataFrame* wide = new DataFrame(*new Schema("LI"));
+    DataFrame* wanted = new DataFrame(*new Schema("LD"));
+    for (int i = 0; i < 3; i++) {
+        wide->set(0, i, big + i);
+        wide->set(1, i, 7);
+    }
+    wanted->set(0, 0, big + 1);
+    wanted->set(1, 0, 7.0);
+    DataFrame* exact = hash_join(wide, wanted, lkeys, pkeys, JOIN_INNER);
+    assert(exact->nrows() == 1);
+    assert(exact->get_long(0, 0) == big + 1);
+    //sealed int columns gathered in probe order, not row order
+    size_t m = 3 * CHUNK_SIZE;
+    DataFrame* probes = new DataFrame(*new Schema("I"));
+    DataFrame* sealed = new DataFrame(*new Schema("II"));
+    for (size_t i = 0; i < m; i++) {
+        probes->set(0, i, (int)((i * 7919) % m));
+        sealed->set(0, i, (int)i);
+        sealed->set(1, i, (int)(i % 13));
+    }
+    sealed->seal();
+    assert(sealed->columns[1]->as_int()->is_sealed(0));
+    std::vector<size_t> first(1, 0);
+    DataFrame* gathered = hash_join(probes, sealed, first, first, JOIN_INNER);
+    assert(gathered->nrows() == m);
+    for (size_t k = 0; k < m; k++) {
+        size_t row = (k * 7919) % m;
+        assert(gathered->get_int(1, k) == (int)row && gathered->get_int(2, k) == (int)(row % 13));
+    }
+    delete gathered;
+    delete sealed;
+    delete probes;
+    delete exact;
+    delete wanted;
+    delete wide;
+    delete both;
+    delete pairs;
+    delete evens;
+    delete semi;
+    delete outer;
+    delete inner;
+    delete users;
+    delete commits;
+    for (size_t i = 0; i < 3; i++) delete names[i];
+}
+
+/** Group-by aggregates match per-key loops, merged across threads */
+void group_by_test() {
+    Schema* schema = new Schema("SIDH");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 3 * MORSEL_ROWS + 17;
+    String* words[4] = { new String("a"), new String("bb"), new String("ccc"), new String("d") };
+    for (size_t i = 0; i < n; i++) {
+        df->set(0, i, words[i % 4]);
+        df->set(1, i, (int)(i % 10));
+        df->set(2, i, i * 0.5);
+        df->set(3, i, (int)(i % 7));
+    }
+    df->set_missing(0, 3);
+    df->set_missing(2, 4);
+    std::vector<GroupAgg> aggs;
+    aggs.push_back(GroupAgg(AGG_COUNT, 1));
+    aggs.push_back(GroupAgg(AGG_SUM, 1));
+    aggs.push_back(GroupAgg(AGG_MAX, 2));
+    aggs.push_back(GroupAgg(AGG_MIN, 3));
+    DataFrame* words_df = group_by(df, std::vector<size_t>(1, 0), aggs);
+    assert(strcmp(words_df->get_schema().types, "SLLDL") == 0);
+    assert(words_df->nrows() == 5);
+    for (size_t g = 0; g < words_df->nrows(); g++) {
+        //the word of each group, or the missing one at row 3
+        int64_t count = 0, sum = 0, lo = 100;
+        double hi = -1;
+        for (size_t i = 0; i < n; i++) {
+            bool missing = i == 3;
+            if (missing != words_df->is_missing(0, g)) continue;
+            if (!missing && !words_df->get_string(0, g)->equals(words[i % 4])) continue;
+            count++;
+            sum += i % 10;
+            if (i != 4 && i * 0.5 > hi) hi = i * 0.5;
+            if ((int64_t)(i % 7) < lo) lo = i % 7;
+        }
+        assert(words_df->get_long(1, g) == count && words_df->get_long(2, g) == sum);
+        assert(words_df->get_double(3, g) == hi && words_df->get_long(4, g) == lo);
+    }
+    std::vector<size_t> keys;
+    keys.push_back(1);
+    keys.push_back(3);
+    DataFrame* pairs = group_by(df, keys, std::vector<GroupAgg>(1, GroupAgg(AGG_COUNT, 2)));
+    assert(strcmp(pairs->get_schema().types, "IHL") == 0 && pairs->nrows() == 70);
+    assert(pairs->sum(2) == n - 1);
+    ThirdRows thirds;
+    DataFrameView* view = new DataFrameView(df, thirds);
+    DataFrame* small = group_by(view, std::vector<size_t>(1, 1), std::vector<GroupAgg>(1, GroupAgg(AGG_COUNT, 1)));
+    assert(small->nrows() == 4 && small->sum(1) == view->nrows());
+    delete small;
+    delete view;
+    delete pairs;
+    delete words_df;
+    delete df;
+    for (size_t i = 0; i < 4; i++) delete words[i];
+}
+
+void sort_test() {
+    Schema* schema = new Schema("IDSBL");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 3 * SORT_MORSEL + 17;
+    std::vector<String*> names;
+    char buf[16];
+    for (size_t i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "w%zu", i);
+        names.push_back(new String(buf));
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t k = (i * 7919) % n;
+        df->set(0, i, (int)(k % 100) - 50);
+        df->set(1, i, (double)k / 3 - 1000);
+        df->set(2, i, names[k % 1000]);
+        df->set(3, i, k % 3 == 0);
+        df->set(4, i, (int64_t)i);
+    }
+    df->set_missing(0, 5);
+    df->set_missing(2, 6);
+    //by int then descending double
+    std::vector<size_t> cols;
+    cols.push_back(0);
+    cols.push_back(1);
+    std::vector<bool> asc;
+    asc.push_back(true);
+    asc.push_back(false);
+    DataFrame* sorted = df->sort_by(cols, asc);
+    assert(sorted->nrows() == n && sorted->is_missing(0, n - 1) && sorted->get_long(4, n - 1) == 5);
+    for (size_t i = 1; i + 1 < n; i++) {
+        int a = sorted->get_int(0, i - 1), b = sorted->get_int(0, i);
+        assert(a < b || (a == b && sorted->get_double(1, i - 1) >= sorted->get_double(1, i)));
+    }
+    //strings, ties keeping the order of the rows
+    DataFrame* words = df->sort_by(std::vector<size_t>(1, 2), std::vector<bool>());
+    assert(words->is_missing(2, n - 1) && words->get_long(4, n - 1) == 6);
+    for (size_t i = 1; i + 1 < n; i++) {
+        String* a = words->get_string(2, i - 1);
+        String* b = words->get_string(2, i);
+        int cmp = strcmp(a->c_str(), b->c_str());
+        assert(cmp < 0 || (cmp == 0 && words->get_long(4, i - 1) < words->get_long(4, i)));
+    }
+    //descending bools, a view sorted like its rows
+    std::vector<size_t> order = df->sort_order(std::vector<size_t>(1, 3), std::vector<bool>(1, false));
+    assert(df->get_bool(3, order[0]) && !df->get_bool(3, order[n - 1]));
+    for (size_t i = 1; i < n; i++) {
+        assert(df->get_bool(3, order[i - 1]) != df->get_bool(3, order[i]) || order[i - 1] < order[i]);
+    }
+    std::vector<size_t> rows;
+    for (size_t i = 0; i < n; i += 3) rows.push_back(i);
+    DataFrameView* view = new DataFrameView(df, rows);
+    DataFrame* small = view->sort_by(std::vector<size_t>(1, 4), std::vector<bool>(1, false));
+    assert(small->nrows() == view->nrows());
+    assert(small->get_long(4, 0) == view->get_long(4, view->nrows() - 1));
+    delete small;
+    delete view;
+    delete words;
+    delete sorted;
+    delete df;
+    for (size_t i = 0; i < names.size(); i++) delete names[i];
+}
+
+void expr_test() {
+    Schema* schema = new Schema("ISDBL");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 2 * MORSEL_ROWS + 5;
+    String* words[4] = { new String("a"), new String("the"), new String("ccc"), new String("dddd") };
+    for (size_t i = 0; i < n; i++) {
+        df->set(0, i, (int)(i % 100));
+        df->set(1, i, words[i % 4]);
+        df->set(2, i, i * 0.25);
+        df->set(3, i, i % 3 == 0);
+        df->set(4, i, (int64_t)i * 1000);
+    }
+    df->set_missing(0, 45);
+    df->set_missing(1, 41);
+    //the same rows as a hand written test
+    DataFrameView* found = df->where(col<int>(0) > 30 && col<String>(1).len() == 3);
+    size_t expected = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (i != 45 && i != 41 && i % 100 > 30 && i % 4 >= 1 && i % 4 <= 2) {
+            assert(found->get_long(4, expected) == (int64_t)i * 1000);
+            expected++;
+        }
+    }
+    assert(found->nrows() == expected);
+    //strings, bools, negation and missing values
+    DataFrameView* the = df->where(col<String>(1) == "the" || !col<bool>(3));
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) count += i != 41 && i % 4 == 1 ? 1 : i % 3 != 0;
+    assert(the->nrows() == count);
+    DataFrameView* near = found->where(col<double>(2) * 4 - col<int64_t>(4) / 1000 == 0 && col<int>(0) <= 40);
+    assert(near->nrows() > 0);
+    for (size_t k = 0; k < near->nrows(); k++) assert(near->get_int(0, k) <= 40 && near->get_int(0, k) > 30);
+    //projections, on a frame and on a view
+    DataFrame* out = df->select(col<int>(0) * 2, col<double>(2) + col<int>(0), col<String>(1), col<String>(1).len(),
+                                col<int>(0) >= 50);
+    assert(strcmp(out->get_schema().types, "IDSIB") == 0 && out->nrows() == n);
+    assert(out->get_int(0, 7) == 14 && out->get_double(1, 8) == 10 && out->get_int(3, 5) == 3);
+    assert(out->get_string(2, 6)->equals(words[2]) && out->get_bool(4, 99) && !out->get_bool(4, 100));
+    assert(out->is_missing(0, 45) && out->is_missing(1, 45) && out->is_missing(3, 41) && !out->is_missing(0, 41));
+    DataFrame* picked = found->select(col<String>(1), col<int64_t>(4));
+    assert(picked->nrows() == found->nrows() && strcmp(picked->get_schema().types, "SL") == 0);
+    for (size_t k = 0; k < picked->nrows(); k++) {
+        assert(picked->get_long(1, k) == found->get_long(4, k));
+        assert(picked->get_string(0, k)->size() == 3);
+    }
+    //an integer divided by zero is missing, a double divided by zero is not
+    DataFrame* ratios = df->select(col<int64_t>(4) / col<int>(0), col<int>(0) / (col<int64_t>(4) / 1000),
+                                   col<double>(2) / col<double>(0));
+    assert(strcmp(ratios->get_schema().types, "LLD") == 0);
+    assert(ratios->is_missing(0, 0) && ratios->is_missing(0, 100) && ratios->is_missing(0, 45));
+    assert(ratios->get_long(0, 101) == 101000 && ratios->get_long(0, 3) == 1000);
+    assert(ratios->is_missing(1, 0) && !ratios->is_missing(1, 100) && ratios->get_long(1, 7) == 1);
+    assert(!ratios->is_missing(2, 100) && ratios->get_double(2, 100) == 25.0 / 0.0);
+    //the least int divided by -1 overflows an int but not a long
+    int least = std::numeric_limits<int>::min();
+    DataFrame* flips = df->select(least / (col<int>(0) - 1), least / (col<int64_t>(4) - 1),
+                                  std::numeric_limits<int64_t>::min() / (col<int64_t>(4) - 1));
+    assert(strcmp(flips->get_schema().types, "ILL") == 0);
+    assert(flips->is_missing(0, 0) && flips->is_missing(0, 1) && flips->get_int(0, 2) == least);
+    assert(!flips->is_missing(1, 0) && flips->get_long(1, 0) == -(int64_t)least);
+    assert(flips->is_missing(2, 0) && !flips->is_missing(2, 1) && flips->get_long(2, 1) == std::numeric_limits<int64_t>::min() / 999);
+    delete flips;
+    DataFrameView* whole = df->where(col<int>(0) / col<int>(0) == 1);
+    assert(whole->nrows() == n - (n + 99) / 100 - 1);
+    delete whole;
+    delete ratios;
+    delete picked;
+    delete out;
+    delete near;
+    delete the;
+    delete found;
+    delete df;
+    for (size_t i = 0; i < 4; i++) delete words[i];
+}
+
+/** Counts the rows it is shown and sums their first column */
+class SumRows : public BatchRower {
+public:
+    size_t rows_ = 0;
+    int64_t sum_ = 0;
+    bool accept(Row& r) {
+        rows_++;
+        sum_ += r.get_int(0);
+        return false;
+    }
+    void accept(Batch& b) {
+        const int* vals = b.ints(0);
+        for (size_t k = 0; k < b.count(); k++) sum_ += vals[b.row(k)];
+        rows_ += b.count();
+    }
+    Object* clone() { return new SumRows(); }
+    void join_delete(Rower* other) {
+        SumRows* o = dynamic_cast<SumRows*>(other);
+        rows_ += o->rows_;
+        sum_ += o->sum_;
+        delete o;
+    }
+};
+
+void plan_test() {
+    Schema* schema = new Schema("IISD");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 3 * MORSEL_ROWS + 7;
+    String* words[3] = { new String("x"), new String("yy"), new String("zzz") };
+    for (size_t i = 0; i < n; i++) {
+        df->set(0, i, (int)i);
+        df->set(1, i, (int)(i % 10));
+        df->set(2, i, words[i % 3]);
+        df->set(3, i, i * 0.5);
+    }
+    df->set_missing(1, 12);
+    //filters and projections fuse into the scan
+    std::vector<size_t> cols;
+    cols.push_back(3);
+    cols.push_back(1);
+    cols.push_back(0);
+    Plan plan(df);
+    plan.filter(col<int>(1) >= 5).project(cols).filter(col<int>(2) < 1000).where(0, 100, 300);
+    plan.optimize();
+    assert(plan.root_->kind_ == PLAN_PROJECT && plan.root_->input_->kind_ == PLAN_SCAN);
+    assert(plan.root_->input_->preds_.size() == 3);
+    DataFrame* out = plan.execute();
+    assert(strcmp(out->get_schema().types, "DII") == 0);
+    size_t k = 0;
+    for (size_t i = 200; i < 601; i++) {
+        if (i == 12 || i % 10 < 5) continue;
+        assert(out->get_int(2, k) == (int)i && out->get_double(0, k) == i * 0.5);
+        k++;
+    }
+    assert(out->nrows() == k);
+    //a plan that only filters is a view; limits keep the first rows
+    Plan first(df);
+    DataFrame* some = first.filter(col<String>(2) == "zzz").limit(4).execute();
+    assert(some->as_view() != nullptr && some->nrows() == 4 && some->get_int(0, 3) == 11);
+    //a filter above a limit stays there
+    Plan cut(df);
+    DataFrame* few = cut.limit(10).filter(col<int>(1) > 7).execute();
+    assert(cut.root_->kind_ == PLAN_FILTER && few->nrows() == 2 && few->get_int(0, 1) == 9);
+    //rowers see the projected columns, in order or in parallel
+    std::vector<size_t> second(1, 1);
+    SumRows counted;
+    Plan(df).where(1, 9, 9).project(second).map(counted);
+    SumRows pcounted;
+    Plan(df).where(1, 9, 9).project(second).pmap(pcounted);
+    assert(counted.rows_ == n / 10 && counted.sum_ == 9 * (int64_t)counted.rows_);
+    assert(pcounted.rows_ == counted.rows_ && pcounted.sum_ == counted.sum_);
+    //aggregates break the pipeline; filters on keys go below them
+    std::vector<GroupAgg> aggs(1, GroupAgg(AGG_SUM, 0));
+    Plan grouped(df);
+    DataFrame* groups = grouped.aggregate(std::vector<size_t>(1, 1), aggs).filter(col<int>(0) == 3).execute();
+    assert(grouped.root_->kind_ == PLAN_AGGREGATE && grouped.root_->input_->kind_ == PLAN_SCAN);
+    int64_t sum = 0;
+    for (size_t i = 3; i < n; i += 10) sum += i;
+    assert(groups->nrows() == 1 && groups->get_long(1, 0) == sum);
+    //joins get the filters of their sides
+    Schema* names_schema = new Schema("IS");
+    DataFrame* names = new DataFrame(*names_schema);
+    for (size_t i = 0; i < 10; i++) {
+        names->set(0, i, (int)i);
+        names->set(1, i, words[i % 3]);
+    }
+    Plan right(names);
+    Plan joined(df);
+    joined.join(right, std::vector<size_t>(1, 1), std::vector<size_t>(1, 0), JOIN_INNER)
+          .filter(col<int>(0) < 50)
+          .filter(col<String>(5) == "x");
+    DataFrame* pairs = joined.execute();
+    PlanNode* join = joined.root_;
+    assert(join->kind_ == PLAN_JOIN && join->input_->kind_ == PLAN_SCAN && join->right_->kind_ == PLAN_SCAN);
+    assert(join->input_->preds_.size() == 1 && join->right_->preds_.size() == 1);
+    k = 0;
+    for (size_t i = 0; i < 50; i++) {
+        if (i == 12 || (i % 10) % 3 != 0) continue;
+        assert(pairs->get_int(0, k) == (int)i && pairs->get_int(4, k) == (int)(i % 10));
+        k++;
+    }
+    assert(pairs->nrows() == k);
+    delete pairs;
+    delete names;
+    delete groups;
+    delete few;
+    delete some;
+    delete out;
+    delete df;
+    for (size_t i = 0; i < 3; i++) delete words[i];
+}
+
+/** Every column type round trips through its typed block, missing values,
+ *  encoded ints and dictionary strings included */
+void serialize_test() {
+    Schema* schema = new Schema("YLFDIBSS");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = 2 * CHUNK_SIZE + 3;
+    String* words[3] = { new String("a"), new String("bb"), new String("") };
+    for (size_t i = 0; i < n; i++) {
+        df->set(0, i, (int)i % 100);
+        df->set(1, i, (int64_t)i << 33);
+        df->set(2, i, (float)i / 8);
+        df->set(3, i, i * 0.25);
+        df->set(4, i, (int)i - 50);
+        df->set(5, i, i % 3 == 0);
+        df->set(6, i, words[i % 3]);
+        df->set(7, i, words[i % 2]);
+    }
+    df->set_missing(3, 7);
+    df->set_missing(6, CHUNK_SIZE + 1);
+    DictStringColumn* dict = DictStringColumn::encode(df->columns[7]->as_string(), 2);
+    assert(dict != nullptr);
+    delete df->columns[7];
+    df->columns[7] = dict;
+    unsigned char* serial = df->serialize();
+    DataFrame* back = new DataFrame(serial);
+    assert(back->equals(df));
+    assert(back->columns[7]->as_string()->as_dict() != nullptr);
+    assert(dynamic_cast<ArenaStringColumn*>(back->columns[6]) != nullptr);
+    assert(back->is_missing(3, 7) && back->is_missing(6, CHUNK_SIZE + 1));
+    assert(back->get_long(1, n - 1) == (int64_t)(n - 1) << 33);
+    assert(back->get_double(3, n - 1) == (n - 1) * 0.25);
+    size_t blocks[8];
+    size_t block = 8 + 16 + schema->width() + 1;
+    for (size_t i = 0; i < 8; i++) {
+        block = (block + 7) & ~(size_t)7;
+        blocks[i] = block;
+        assert(extract_size_t(serial, block + 8) == (size_t)schema->type(i));
+        assert(extract_size_t(serial, block + 24) == n);
+        block += extract_size_t(serial, block);
+    }
+    assert(block == extract_size_t(serial, 0));
+    assert(extract_size_t(serial, blocks[0] + 16) == ENCODING_RAW);
+    assert(extract_size_t(serial, blocks[4] + 16) == ENCODING_INTS);
+    assert(extract_size_t(serial, blocks[6] + 16) == ENCODING_STRINGS);
+    assert(extract_size_t(serial, blocks[7] + 16) == ENCODING_DICT);
+    delete[] serial;
+    delete back;
+    delete df;
+    for (size_t i = 0; i < 3; i++) delete words[i];
+}
+
+/** Frames read from the store share the columns decoded from the value,
+ *  read their numbers in place from its blob and keep it alive */
+void store_frame_test() {
+    Schema* schema = new Schema("IDSL");
+    DataFrame* df = new DataFrame(*schema);
+    size_t n = CHUNK_SIZE + 9;
+    String* word = new String("w");
+    for (size_t i = 0; i < n; i++) {
+        df->set(0, i, (int)i * 7);
+        df->set(1, i, i * 1.5);
+        df->set(2, i, word);
+        df->set(3, i, (int64_t)i << 35);
+    }
+    df->set_missing(1, 2);
+    Key k("frame", 0);
+    KVStore kv;
+    kv.setIndex(0);
+    unsigned char* serial = df->serialize();
+    Value* v = new Value(serial, extract_size_t(serial, 0));
+    kv.put(k, v);
+    DataFrame* a = kv.get(k);
+    DataFrame* b = kv.waitAndGet(k);
+    assert(a->equals(df) && b->equals(df));
+    assert(a->columns[1] == b->columns[1] && a->columns[0] == b->columns[0]);
+    assert(a->is_missing(1, 2) && a->get_long(3, n - 1) == (int64_t)(n - 1) << 35);
+    DoubleColumn* dbl = a->columns[1]->as_double();
+    unsigned char* span = (unsigned char*)dbl->vals_.chunk(1);
+    assert(dbl->vals_.is_borrowed(1));
+    assert(span > v->blob_ && span < v->blob_ + v->blob_length_);
+    assert((size_t)span % sizeof(double) == 0);
+    assert(a->columns[0]->as_int()->is_sealed(0));
+    assert(v->refs_ == 3);
+    delete a;
+    assert(v->refs_ == 2);
+    assert(b->get_int(0, n - 1) == (int)(n - 1) * 7);
+    delete b;
+    assert(v->refs_ == 1);
+    delete df;
+    delete word;
+}
+
 int main() {
     df_sum_test();
     success("DataFrame sum");
@@ -64,5 +997,35 @@ int main() {
     success("DataFrame equality");
     integration_test();
     success("DataFrame and Sor integration");
+    zone_map_test();
+    success("DataFrame zone maps");
+    batch_rower_test();
+    success("DataFrame batch rowers");
+    row_test();
+    success("DataFrame rows");
+    thread_pool_test();
+    success("DataFrame thread pool");
+    parallel_filter_test();
+    success("DataFrame parallel filter");
+    view_test();
+    success("DataFrame filtered views");
+    typed_test();
+    success("DataFrame typed dataframes");
+    aggregate_test();
+    success("DataFrame aggregates");
+    join_test();
+    success("DataFrame hash joins");
+    group_by_test();
+    success("DataFrame group by");
+    sort_test();
+    success("DataFrame sort");
+    expr_test();
+    success("DataFrame expressions");
+    plan_test();
+    success("DataFrame query plans");
+    serialize_test();
+    success("DataFrame typed serialization");
+    store_frame_test();
+    success("DataFrame store frames");
     return 0;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <sys/socket.h>
 #include "test_util.h"
 
 #include "../src/serial/array.h"
@@ -122,9 +123,37 @@ void string_array_test() {
     assert(!a->equals(a_deserial));
     a_deserial->deserialize(a_serial);
     assert(a->equals(a_deserial));
+    // offsets address every string, empty ones and ones holding '\0' too
+    assert(extract_size_t(a_serial, 8) == 50);
+    assert(extract_size_t(a_serial, 16 + 8 * 2) == strlen("hello") + strlen("excellent") + 2);
+    StringArray* b = new StringArray();
+    b->push(new String("nul\0inside", 10));
+    b->push(new String(""));
+    b->push(new String("last"));
+    unsigned char* b_serial = b->serialize();
+    assert(extract_size_t(b_serial, 0) == b->serial_size());
+    StringArray* b_deserial = new StringArray();
+    b_deserial->deserialize(b_serial);
+    assert(b_deserial->len_ == 3);
+    assert(b_deserial->vals_[0]->size() == 10);
+    assert(memcmp(b_deserial->vals_[0]->c_str(), "nul\0inside", 10) == 0);
+    assert(b_deserial->vals_[1]->size() == 0);
+    assert(b_deserial->vals_[2]->equals(b->vals_[2]));
+    // the smallest table is its length, its count and one offset
+    StringArray* empty = new StringArray();
+    unsigned char* empty_serial = empty->serialize();
+    assert(extract_size_t(empty_serial, 0) == 24);
+    StringArray* empty_deserial = new StringArray();
+    assert(empty_deserial->deserialize(empty_serial, 24) == 24 && empty_deserial->len_ == 0);
+    delete empty;
+    delete empty_deserial;
+    delete[] empty_serial;
     delete a;
     delete[] a_serial;
     delete a_deserial;
+    delete b;
+    delete[] b_serial;
+    delete b_deserial;
 }
 
 void directory_test() {
@@ -139,7 +168,7 @@ void directory_test() {
     d->addresses->push(new String("1.2.3.4"));
     d->addresses->push(new String("5.6.7.8"));
     unsigned char* d_serial = d->serialize();
-    Directory* d_deserial = new Directory(d_serial);
+    Directory* d_deserial = new Directory(d_serial, message_length(d_serial));
     assert(d->equals(d_deserial));
     d->push_port(12121213);
     assert(!d->equals(d_deserial));
@@ -164,7 +193,7 @@ void ack_test() {
     message->id_ = 1111;
     message->previous_kind = MsgKind::Directory;
     unsigned char* message_serialized = message->serialize();
-    Ack* message_deserialized = new Ack(message_serialized);
+    Ack* message_deserialized = new Ack(message_serialized, message_length(message_serialized));
     assert(message->equals(message_deserialized));
     message->sender_ = 123;
     assert(!message->equals(message_deserialized));
@@ -193,7 +222,7 @@ void nack_test() {
     message->id_ = 1111;
     message->previous_kind = MsgKind::Directory;
     unsigned char* message_serialized = message->serialize();
-    Nack* message_deserialized = new Nack(message_serialized);
+    Nack* message_deserialized = new Nack(message_serialized, message_length(message_serialized));
     assert(message->equals(message_deserialized));
     message->sender_ = 123;
     assert(!message->equals(message_deserialized));
@@ -222,7 +251,7 @@ void status_test() {
     message->id_ = 1111;
     message->msg_ = new String("test123");
     unsigned char* message_serialized = message->serialize();
-    Status* message_deserialized = new Status(message_serialized);
+    Status* message_deserialized = new Status(message_serialized, message_length(message_serialized));
     assert(message->equals(message_deserialized));
     message->sender_ = 123;
     assert(!message->equals(message_deserialized));
@@ -251,7 +280,7 @@ void register_test() {
     message->port = 12332;
     message->IP = new String("test123");
     unsigned char* message_serialized = message->serialize();
-    Register* message_deserialized = new Register(message_serialized);
+    Register* message_deserialized = new Register(message_serialized, message_length(message_serialized));
     assert(message->equals(message_deserialized));
     message->sender_ = 123;
     assert(!message->equals(message_deserialized));
@@ -308,7 +337,7 @@ void kill_test() {
     unsigned char* kill2 = kill->serialize();
     assert(MsgKind::Kill == message_kind(kill2));
     assert(33 == message_length(kill2));
-    Kill* kill_d = new Kill(kill2);
+    Kill* kill_d = new Kill(kill2, message_length(kill2));
     assert(kill->equals(kill_d));
     delete kill;
     delete[] kill2;
@@ -346,6 +375,9 @@ void df_test() {
     unsigned char* serial = df->serialize();
     DataFrame* df2 = new DataFrame(serial);
     //assert(df2->equals(df));
+    assert(df2->get_bool(0, 1) == true);
+    assert(df2->get_bool(0, 2) == false);
+    assert(df2->columns[0]->equals(df->columns[0]));
     delete schema;
     delete df;
     delete[] serial;
@@ -387,7 +419,7 @@ void put_test() {
     Value* value = new Value((unsigned char*)"4jdky032fjcl*!(X", 16);
     Put* put1 = new Put(2312312, 98094, 8694053, key, value);
     unsigned char* serial = put1->serialize();
-    Put* put2 = new Put(serial);
+    Put* put2 = new Put(serial, message_length(serial));
     assert(put1->equals(put2));
 }
 
@@ -395,13 +427,13 @@ void get_test() {
     Key* key = new Key("rh3i412r3-13d43424930d32sxd", 321133);
     Get* get1 = new Get(23123, 6324, 26745, key);
     unsigned char* serial = get1->serialize();
-    Get* get2 = new Get(serial);
+    Get* get2 = new Get(serial, message_length(serial));
     assert(get1->equals(get2));
 
     Key* key2 = new Key("rh3i413-m4qcn7&^SAD%c3h", 7893);
     Get* get3 = new Get(8904, 321, 58903, key2);
     unsigned char* serial2 = get3->serialize();
-    Get* get4 = new Get(serial2);
+    Get* get4 = new Get(serial2, message_length(serial2));
     assert(get3->equals(get4));
     assert(!get1->equals(get3));
 }
@@ -410,18 +442,168 @@ void result_test() {
     Value* value = new Value((unsigned char*)"4jdky032fjcl*!(X", 16);
     Result* res1 = new Result(2312312, 98094, 8694053, value);
     unsigned char* serial = res1->serialize();
-    Result* res2 = new Result(serial);
+    Result* res2 = new Result(serial, message_length(serial));
     assert(res1->equals(res2));
 
     Value* value2 = new Value((unsigned char*)"zxvchjkl2543asdf809-", 20);
     Result* res3 = new Result(389025, 5789, 784231, value2);
     unsigned char* serial2 = res3->serialize();
-    Result* res4 = new Result(serial2);
+    Result* res4 = new Result(serial2, message_length(serial2));
     assert(res3->equals(res4));
 
     assert(!res1->equals(res3));
 }
 
+void buffer_test() {
+    BufferWriter writer(8);
+    Key* key = new Key("buffered", 3);
+    Get* get = new Get(1, 3, 77, key);
+    get->write_to(writer);
+    assert(writer.pos_ == get->serial_size());
+    assert(writer.pos_ == message_length(writer.buf_));
+    Get* get2 = new Get(writer.buf_, writer.pos_);
+    assert(get->equals(get2));
+    // the buffer is reused, it only grows past its largest message
+    Status* status = new Status(2, 5, 9, new String("hello"));
+    writer.clear();
+    status->write_to(writer);
+    assert(writer.pos_ == 39);
+    BufferReader reader(writer.buf_, writer.pos_);
+    assert(reader.read_size_t() == 39);
+    assert(reader.read_byte() == (unsigned char)MsgKind::Status);
+    assert(reader.read_size_t() == 2);
+    assert(reader.read_size_t() == 5);
+    assert(reader.read_size_t() == 9);
+    String* hello = reader.read_string();
+    assert(strcmp(hello->c_str(), "hello") == 0);
+    delete hello;
+    assert(reader.pos_ == 39);
+
+    Schema schema("IDS");
+    DataFrame df(schema);
+    for (int i = 0; i < 100; i++) {
+        df.set(0, i, i);
+        df.set(1, i, i * 0.5);
+        df.set(2, i, new String("row"));
+    }
+    unsigned char* serial = df.serialize();
+    assert(extract_size_t(serial, 0) <= df.serial_size());
+    DataFrame df2(serial);
+    assert(df2.get_int(0, 99) == 99);
+    assert(df2.get_double(1, 10) == 5.0);
+    assert(df2.get_string(2, 50)->equals(new String("row")));
+    delete[] serial;
+    delete get;
+    delete get2;
+    delete status;
+}
+
+void compress_test() {
+    size_t n = 100000;
+    unsigned char* words = new unsigned char[n];
+    unsigned char* noise = new unsigned char[n];
+    const char* vocabulary[4] = { "project", "user", "commit", "linus" };
+    size_t w = 0;
+    for (size_t i = 0; i < n; i++) {
+        words[i] = vocabulary[w % 4][i % 5 < strlen(vocabulary[w % 4]) ? i % 5 : 0];
+        if (i % 7 == 0) w = w * 31 + 7;
+        noise[i] = (unsigned char)((i * 2654435761u) >> 13);
+    }
+    unsigned char* block = new unsigned char[lz_bound(n)];
+    unsigned char* back = new unsigned char[n];
+    size_t lengths[5] = { 0, 3, 13, 1000, n };
+    for (size_t k = 0; k < 5; k++) {
+        size_t len = lz_compress(words, lengths[k], block);
+        assert(len <= lz_bound(lengths[k]));
+        lz_decompress(block, len, back, lengths[k]);
+        assert(memcmp(back, words, lengths[k]) == 0);
+        len = lz_compress(noise, lengths[k], block);
+        assert(len <= lz_bound(lengths[k]));
+        lz_decompress(block, len, back, lengths[k]);
+        assert(memcmp(back, noise, lengths[k]) == 0);
+    }
+    assert(lz_compress(words, n, block) < n / 4);
+
+    // large values go out compressed and flagged, small ones as they were
+    unsigned char* blob = new unsigned char[n];
+    memcpy(blob, words, n);
+    Put* put = new Put(1, 2, 3, new Key("words", 2), new Value(blob, n));
+    unsigned char* serial = put->serialize();
+    assert(put->compressed_);
+    assert(message_kind(serial) == MsgKind::Put);
+    assert(message_length(serial) < n / 4);
+    Put* put2 = new Put(serial, message_length(serial));
+    assert(put2->compressed_);
+    assert(put->equals(put2));
+    put->compress_ = false;
+    unsigned char* raw = put->serialize();
+    assert(!put->compressed_ && message_length(raw) == put->serial_size());
+    Put* put3 = new Put(raw, message_length(raw));
+    assert(put->equals(put3));
+    // a run compresses as far as a value may claim to expand
+    size_t run = 1000000;
+    Put* zeros = new Put(1, 2, 4, new Key("zeros", 2), new Value(new unsigned char[run](), run));
+    unsigned char* zeros_serial = zeros->serialize();
+    assert(zeros->compressed_ && message_length(zeros_serial) < run / 200);
+    Put* zeros2 = new Put(zeros_serial, message_length(zeros_serial));
+    assert(zeros->equals(zeros2));
+    delete zeros;
+    delete zeros2;
+    delete[] zeros_serial;
+    Result* small = new Result(1, 2, 3, new Value((unsigned char*)"small", 5));
+    unsigned char* small_serial = small->serialize();
+    assert(!small->compressed_ && message_length(small_serial) == 33 + 16 + 5);
+    small->value_ = nullptr;
+    delete small;
+    delete[] small_serial;
+    delete put;
+    delete put2;
+    delete put3;
+    delete[] serial;
+    delete[] raw;
+    delete[] words;
+    delete[] noise;
+    delete[] block;
+    delete[] back;
+}
+
+void receive_test() {
+    // messages longer than one read arrive whole and back to back ones apart
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    size_t n = 5000;
+    unsigned char* blob = new unsigned char[n];
+    for (size_t i = 0; i < n; i++) blob[i] = (unsigned char)(i * 7);
+    Put* put = new Put(1, 2, 3, new Key("big", 2), new Value(blob, n));
+    put->compress_ = false;
+    Status* status = new Status(2, 1, 4, new String("after"));
+    BufferWriter writer;
+    put->write_to(writer);
+    status->write_to(writer);
+    std::thread sender([&]() {
+        assert(write(fds[0], writer.buf_, writer.pos_) == (ssize_t)writer.pos_);
+        close(fds[0]);
+    });
+    size_t length;
+    unsigned char* first = read_message(fds[1], length);
+    assert(length == put->serial_size() && length > n);
+    Put* put2 = new Put(first, length);
+    assert(put->equals(put2));
+    unsigned char* second = read_message(fds[1], length);
+    assert(length == 39);
+    Status* status2 = new Status(second, length);
+    assert(strcmp(status2->msg_->c_str(), "after") == 0);
+    assert(read_message(fds[1], length) == nullptr);
+    sender.join();
+    close(fds[1]);
+    delete put;
+    delete put2;
+    delete status;
+    delete status2;
+    delete[] first;
+    delete[] second;
+}
+
 int main() {
     size_t_test();
     success("Serial size_t");
@@ -461,4 +643,10 @@ int main() {
     success("Serial key");
     value_test();
     success("Serial value");
+    buffer_test();
+    success("Serial buffer");
+    compress_test();
+    success("Serial compression");
+    receive_test();
+    success("Serial receive");
 }
\ No newline at end of file
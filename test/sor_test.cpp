@@ -9,7 +9,7 @@ void sor_adapter() {
     SorAdapter* sor = new SorAdapter(0, UINT32_MAX, "test1000.sor");
     DataFrame* df = sor->df_;
     //Checking the schema is correct
-    assert(strcmp(df->get_schema().types, "BDSIBDSIBD") == 0);
+    assert(strcmp(df->get_schema().types, "BDSHBDSHBD") == 0);
     //Checking the data is correct
     assert(df->get_double(1, 0) == 0.01);
     assert(df->get_double(9, 999) == 99.99);
@@ -22,6 +22,7 @@ void sor_adapter() {
     String* s2 = new String("pklrcomvikpjzpx");
     assert(df->get_string(6, 747)->equals(s1));
     assert(df->get_string(2, 973)->equals(s2));
+    assert(df->columns[2]->as_string()->get_view(973).equals(s2));
     //Check the row counts are all correct
     assert(df->nrows() == 1000);
     assert(df->ncols() == 10);
@@ -30,9 +31,101 @@ void sor_adapter() {
     delete s2;
 }
 
+/** Empty and absent fields are read as missing, not as 0 */
+void sor_missing() {
+    ofstream out("missing.sor");
+    out << "<1><0><\"a\">\n<><1><\"b\">\n<3><>\n<0><1><\"\">";
+    out.close();
+    SorAdapter* sor = new SorAdapter(0, UINT32_MAX, "missing.sor");
+    DataFrame* df = sor->df_;
+    assert(strcmp(df->get_schema().types, "YBS") == 0);
+    assert(df->nrows() == 4);
+    assert(df->is_missing(0, 1));
+    assert(!df->is_missing(0, 3));
+    assert(df->get_int(0, 3) == 0);
+    assert(!df->is_missing(1, 0));
+    assert(df->get_bool(1, 0) == false);
+    assert(df->is_missing(1, 2));
+    assert(df->is_missing(2, 2));
+    //<""> is a present empty string, only <> is missing
+    assert(!df->is_missing(2, 3));
+    assert(df->get_string(2, 3)->size() == 0);
+    assert(df->null_count(0) == 1);
+    assert(df->null_count(2) == 1);
+    unsigned char* serial = df->serialize();
+    DataFrame* df2 = new DataFrame(serial);
+    assert(df2->is_missing(0, 1));
+    assert(df2->is_missing(2, 2));
+    assert(!df2->is_missing(2, 3));
+    assert(df2->get_string(2, 3)->size() == 0);
+    assert(df2->get_string(2, 1)->equals(df->get_string(2, 1)));
+    assert(df2->columns[0]->equals(df->columns[0]));
+    delete[] serial;
+    delete df2;
+    delete sor;
+}
+
+/** Repetitive string columns are dictionary encoded, unique ones are not */
+void sor_dictionary() {
+    ofstream out("dict.sor");
+    for (int i = 0; i < 100; i++) {
+        out << "<" << (i % 3 == 0 ? "red" : "blue") << "><" << i << "><\"w" << i << "\">\n";
+    }
+    out.close();
+    SorAdapter* sor = new SorAdapter(0, UINT32_MAX, "dict.sor");
+    DataFrame* df = sor->df_;
+    assert(strcmp(df->get_schema().types, "SYS") == 0);
+    DictStringColumn* colors = df->columns[0]->as_string()->as_dict();
+    assert(colors != nullptr);
+    assert(colors->dict_size() == 2);
+    assert(df->columns[2]->as_string()->as_dict() == nullptr);
+    String red("red");
+    assert(df->get_string(0, 99)->equals(&red));
+    unsigned char* serial = df->serialize();
+    DataFrame* df2 = new DataFrame(serial);
+    assert(df2->columns[0]->as_string()->as_dict() != nullptr);
+    assert(df2->equals(df));
+    delete[] serial;
+    delete df2;
+    delete sor;
+}
+
+/** Numbers get the narrowest type that fits, widening past the lines used
+ *  for inference when a later value does not fit */
+void sor_numeric_types() {
+    ofstream out("numeric.sor");
+    for (int i = 0; i < 600; i++) {
+        out << "<" << (i < 550 ? i % 100 : 70000) << "><" << (i == 580 ? "0.1" : "2.5")
+            << "><" << 5000000000LL + i << "><-200>\n";
+    }
+    out.close();
+    SorAdapter* sor = new SorAdapter(0, UINT32_MAX, "numeric.sor");
+    DataFrame* df = sor->df_;
+    assert(strcmp(df->get_schema().types, "IDLH") == 0);
+    assert(df->get_int(0, 99) == 99);
+    assert(df->get_int(0, 599) == 70000);
+    assert(df->get_double(1, 0) == 2.5);
+    assert(df->get_double(1, 580) == 0.1);
+    assert(df->get_long(2, 599) == 5000000599LL);
+    assert(df->get_int(3, 7) == -200);
+    assert(df->get_long(3, 7) == -200);
+    unsigned char* serial = df->serialize();
+    DataFrame* df2 = new DataFrame(serial);
+    assert(strcmp(df2->get_schema().types, "IDLH") == 0);
+    assert(df2->equals(df));
+    delete[] serial;
+    delete df2;
+    delete sor;
+}
 
 int main() {
     sor_adapter();
     success("SOR");
+    sor_missing();
+    success("SOR missing values");
+    sor_dictionary();
+    success("SOR dictionary strings");
+    sor_numeric_types();
+    success("SOR numeric types");
     return 0;
 }
\ No newline at end of file
@@ -26,7 +26,11 @@ void type_test() {
     string int_str = string("213123");
     string int_str_2 = string("10");
     assert(get_field_type(int_str) == INT);
-    assert(get_field_type(int_str_2) == INT);
+    assert(get_field_type(int_str_2) == BYTE);
+    assert(get_field_type(string("-300")) == SHORT);
+    assert(get_field_type(string("4000000000")) == LONG);
+    assert(get_field_type(string("99999999999999999999")) == DOUBLE);
+    assert(get_field_type(string("2.5")) == FLOAT);
     string float_str = string("123.321");
     string float_str_2 = string("34.967");
     assert(get_field_type(float_str) == DOUBLE);
@@ -42,6 +46,11 @@ void type_test() {
     assert(should_change_type(BOOL, INT));    
     assert(should_change_type(BOOL, STRING));
     assert(should_change_type(BOOL, DOUBLE));
+    assert(join_types(BYTE, INT) == INT);
+    assert(join_types(BOOL, SHORT) == SHORT);
+    assert(join_types(SHORT, FLOAT) == FLOAT);
+    assert(join_types(INT, FLOAT) == DOUBLE);
+    assert(join_types(LONG, STRING) == STRING);
     //Mappings
     assert(map_to_char(BOOL) == 'B');
     assert(map_to_char(INT) == 'I');
@@ -51,6 +60,10 @@ void type_test() {
     assert(map_to_type('I') == INT);
     assert(map_to_type('S') == STRING);
     assert(map_to_type('D') == DOUBLE);
+    assert(map_to_type(map_to_char(BYTE)) == BYTE);
+    assert(map_to_type(map_to_char(SHORT)) == SHORT);
+    assert(map_to_type(map_to_char(LONG)) == LONG);
+    assert(map_to_type(map_to_char(FLOAT)) == FLOAT);
 }
 /** Tests the util trim function */
 void trim_test() {